@@ -0,0 +1,278 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bus_line_handler.h"
+#include "bus_line_store.h"
+#include "field_parser.h"
+#include "file_handler.h"
+
+/*
+    Times the phases of the analysis separately - read_handler, calculate_profitability, sort_lines and
+    write_handler - over generated inputs of several sizes and prints the results as JSON:
+
+    {"benchmark": "bus_line_phases", "warmup": 1, "repetitions": 5, "scales": [
+        {"rows": 1000, "input_bytes": 26893, "phases": {
+            "read_handler": {"min_s": ..., "median_s": ..., "mean_s": ..., "rows_per_s": ..., "bytes_per_s": ...}, ...}}]}
+
+    rows_per_s and bytes_per_s are based on the median. The bytes are those of the input file for read_handler,
+    of the report for write_handler and of the rows in memory for the other two phases.
+    Each scale needs roughly 2 * rows * sizeof(BusLineProperties) of memory (the rows plus a copy to sort),
+    i.e. about 10 GB at 100M rows, and its input file is generated in the data directory and removed afterwards.
+*/
+
+#define BENCH_DEFAULT_SIZES "1000,10000,100000,1000000,10000000"
+#define BENCH_DEFAULT_WARMUP 1
+#define BENCH_DEFAULT_REPETITIONS 5
+#define BENCH_MAX_SCALES 16
+#define BENCH_MAX_REPETITIONS 1000
+
+enum {
+    PHASE_READ,
+    PHASE_CALCULATE,
+    PHASE_SORT,
+    PHASE_WRITE,
+    PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = { "read_handler", "calculate_profitability", "sort_lines", "write_handler" };
+
+typedef struct {
+    size_t sizes[BENCH_MAX_SCALES];
+    size_t size_count;
+    int warmup;
+    int repetitions;
+    const char *data_dir;
+    const char *output_file;
+} BenchOptions;
+
+typedef struct {
+    double seconds[BENCH_MAX_REPETITIONS];
+    uint64_t bytes;
+} PhaseTimes;
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static uint64_t file_bytes(const char *filename) {
+    struct stat file_stat;
+    return stat(filename, &file_stat) == 0 ? (uint64_t)file_stat.st_size : 0;
+}
+
+/*
+    Deterministic pseudo-random input in the same format as the data/ files - the same seed always gives the
+    same file, so results of different runs (and versions) are comparable
+*/
+static int generate_input(const char *filename, size_t rows) {
+    FILE *file = fopen(filename, "w");
+    if(file == NULL) return -1;
+
+    static char buffer[1 << 20];
+    setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    fprintf(file, "# Format: line_number,departure_time,subsidy_level,adults,students,seniors,route_length\n");
+
+    for(size_t i = 0; i < rows; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t random = (uint32_t)(state >> 32);
+
+        fprintf(file, "%zu,%02u:%02u,%u,%u,%u,%u,%u.%u\n",
+            i % 1000 + 1,
+            random % 24, (random >> 5) % 60,
+            (random >> 11) % 3 + 1,
+            (random >> 13) % 60, (random >> 19) % 30, (random >> 24) % 20,
+            (random >> 7) % 80 + 1, random % 10);
+    }
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_phase(FILE *out, const char *name, PhaseTimes *times, int repetitions, size_t rows, int last) {
+    double sum = 0.0;
+    for(int i = 0; i < repetitions; ++i) sum += times->seconds[i];
+
+    qsort(times->seconds, (size_t)repetitions, sizeof(double), compare_doubles);
+    double median = (repetitions % 2) ? times->seconds[repetitions / 2]
+                                      : (times->seconds[repetitions / 2 - 1] + times->seconds[repetitions / 2]) / 2.0;
+    double rate_base = median > 0.0 ? median : 1e-9;
+
+    fprintf(out, "        \"%s\": {\"min_s\": %.9f, \"median_s\": %.9f, \"mean_s\": %.9f, \"rows_per_s\": %.1f, \"bytes_per_s\": %.1f}%s\n",
+        name, times->seconds[0], median, sum / repetitions, (double)rows / rate_base, (double)times->bytes / rate_base,
+        last ? "" : ",");
+}
+
+/*
+    Runs every phase warmup + repetitions times on one scale - only the phase itself is inside the timed region
+    Returns 0 on success and -1 on error
+*/
+static int bench_scale(const BenchOptions *options, size_t rows, FILE *out, int first) {
+    char input_file[4096], report_file[4096];
+    snprintf(input_file, sizeof(input_file), "%s/bench_input_%zu.txt", options->data_dir, rows);
+    snprintf(report_file, sizeof(report_file), "%s/bench_report_%zu.txt", options->data_dir, rows);
+
+    fprintf(stderr, "[*] Generating %zu rows...\n", rows);
+    if(generate_input(input_file, rows) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not write the benchmark input '%s'.\n", input_file);
+        unlink(input_file);
+        return -1;
+    }
+
+    static PhaseTimes times[PHASE_COUNT];
+    memset(times, 0, sizeof(times));
+    times[PHASE_READ].bytes = file_bytes(input_file);
+    times[PHASE_CALCULATE].bytes = times[PHASE_SORT].bytes = (uint64_t)rows * sizeof(BusLineProperties);
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    BusLineProperties *scratch = malloc((rows + 1) * sizeof(BusLineProperties));
+    int status = (scratch == NULL) ? -1 : 0;
+
+    for(int run = 0; status == 0 && run < options->warmup + options->repetitions; ++run) {
+        int timed = run - options->warmup;
+
+        bus_line_store_free(&store);
+        bus_line_store_init(&store, 0);
+        double start = now_seconds();
+        int64_t read_count = read_handler(input_file, &store, READ_ALL_BUS_LINES);
+        double read_seconds = now_seconds() - start;
+        if(read_count != (int64_t)rows) {
+            fprintf(stderr, "[!!] FATAL Error: Expected %zu rows from '%s', got %lld.\n", rows, input_file, (long long)read_count);
+            status = -1;
+            break;
+        }
+
+        start = now_seconds();
+        calculate_profitability(store.lines, store.count);
+        double calculate_seconds = now_seconds() - start;
+
+        /* Every repetition sorts the same unsorted rows */
+        memcpy(scratch, store.lines, store.count * sizeof(BusLineProperties));
+        start = now_seconds();
+        sort_lines(scratch, store.count);
+        double sort_seconds = now_seconds() - start;
+
+        start = now_seconds();
+        status = write_handler(report_file, scratch, store.count, NULL);
+        double write_seconds = now_seconds() - start;
+
+        if(timed >= 0) {
+            times[PHASE_READ].seconds[timed] = read_seconds;
+            times[PHASE_CALCULATE].seconds[timed] = calculate_seconds;
+            times[PHASE_SORT].seconds[timed] = sort_seconds;
+            times[PHASE_WRITE].seconds[timed] = write_seconds;
+        }
+    }
+
+    if(status == 0) {
+        times[PHASE_WRITE].bytes = file_bytes(report_file);
+
+        fprintf(out, "%s    {\"rows\": %zu, \"input_bytes\": %llu, \"phases\": {\n", first ? "" : ",\n", rows, (unsigned long long)times[PHASE_READ].bytes);
+        for(int phase = 0; phase < PHASE_COUNT; ++phase) {
+            print_phase(out, phase_names[phase], &times[phase], options->repetitions, rows, phase + 1 == PHASE_COUNT);
+        }
+        fprintf(out, "    }}");
+    } else if(scratch == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Not enough memory for %zu rows.\n", rows);
+    }
+
+    free(scratch);
+    bus_line_store_free(&store);
+    unlink(input_file);
+    unlink(report_file);
+    return status;
+}
+
+static int parse_count(const char *text, int32_t min, int32_t max, int *value) {
+    int32_t parsed;
+    if(parse_int_field(text, text + strlen(text), min, max, &parsed) != FIELD_PARSE_OK) return -1;
+    *value = parsed;
+    return 0;
+}
+
+static int parse_sizes(const char *text, BenchOptions *options) {
+    options->size_count = 0;
+
+    while(*text != '\0') {
+        char *end;
+        unsigned long long rows = strtoull(text, &end, 10);
+        if(end == text || rows == 0 || (*end != ',' && *end != '\0') || options->size_count == BENCH_MAX_SCALES) return -1;
+
+        options->sizes[options->size_count++] = (size_t)rows;
+        text = (*end == ',') ? end + 1 : end;
+    }
+
+    return options->size_count > 0 ? 0 : -1;
+}
+
+static void print_usage(const char *executable_name) {
+    printf("Usage: %s [options]\n\n", executable_name);
+    printf("Options:\n");
+    printf("  --sizes N,N,...     Number of rows of every scale (default: %s)\n", BENCH_DEFAULT_SIZES);
+    printf("  --warmup N          Untimed runs before the measured ones (default: %d)\n", BENCH_DEFAULT_WARMUP);
+    printf("  --reps N            Measured runs per scale (default: %d)\n", BENCH_DEFAULT_REPETITIONS);
+    printf("  --dir DIR           Where the inputs and reports are generated (default: .)\n");
+    printf("  --output FILE       Write the JSON results to FILE instead of stdout\n");
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options = { .warmup = BENCH_DEFAULT_WARMUP, .repetitions = BENCH_DEFAULT_REPETITIONS,
+                             .data_dir = ".", .output_file = NULL };
+    parse_sizes(BENCH_DEFAULT_SIZES, &options);
+
+    for(int i = 1; i < argc; ++i) {
+        int valid = (i + 1 < argc);
+
+        if(valid && strcmp(argv[i], "--sizes") == 0) {
+            valid = parse_sizes(argv[++i], &options) == 0;
+        } else if(valid && strcmp(argv[i], "--warmup") == 0) {
+            valid = parse_count(argv[++i], 0, BENCH_MAX_REPETITIONS, &options.warmup) == 0;
+        } else if(valid && strcmp(argv[i], "--reps") == 0) {
+            valid = parse_count(argv[++i], 1, BENCH_MAX_REPETITIONS, &options.repetitions) == 0;
+        } else if(valid && strcmp(argv[i], "--dir") == 0) {
+            options.data_dir = argv[++i];
+        } else if(valid && strcmp(argv[i], "--output") == 0) {
+            options.output_file = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if(!valid) {
+            fprintf(stderr, "[!!] FATAL Error: Invalid value for %s\n", argv[i - 1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE *out = options.output_file ? fopen(options.output_file, "w") : stdout;
+    if(out == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Could not open the output file '%s'.\n", options.output_file);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\"benchmark\": \"bus_line_phases\", \"warmup\": %d, \"repetitions\": %d, \"row_bytes\": %zu, \"scales\": [\n",
+        options.warmup, options.repetitions, sizeof(BusLineProperties));
+
+    int status = 0;
+    for(size_t i = 0; status == 0 && i < options.size_count; ++i) {
+        status = bench_scale(&options, options.sizes[i], out, i == 0);
+    }
+
+    fprintf(out, "\n]}\n");
+    if(out != stdout) fclose(out);
+
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
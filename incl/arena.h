@@ -0,0 +1,83 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Region allocator that owns the memory of one analysis run - allocations are bumped out of large blocks that are
+    mapped straight from the OS, there is no per-allocation free and everything goes back with a single arena_release.
+    Allocations larger than half a block (e.g. the row store of a big input) get a block of their own, which lets
+    them grow without wasting the space of the old copy.
+    An arena is not thread-safe - use one per thread (or hand out memory before starting the threads).
+*/
+
+/*
+    Size of the regular blocks
+*/
+#define ARENA_DEFAULT_BLOCK_BYTES ((size_t)4 << 20)
+
+/*
+    Alignment of the rows and other bulk data of a run (one cache line, so a row array never starts mid-line)
+*/
+#define ARENA_SIMD_ALIGNMENT 64
+
+/*
+    Blocks of at least this size are backed by transparent huge pages if the arena asks for them
+*/
+#define ARENA_HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *blocks;         /* Every block of the arena, most recent first */
+    ArenaBlock *current;        /* Regular block that small allocations are bumped out of */
+    size_t block_bytes;
+    int huge_pages;
+    uint64_t reserved_bytes;    /* Bytes mapped from the OS right now */
+} Arena;
+
+/*
+    Position of an arena that it can be rewound to - for scratch memory that is only needed for a moment
+*/
+typedef struct {
+    ArenaBlock *blocks;
+    ArenaBlock *current;
+    size_t current_used;
+} ArenaMark;
+
+/*
+    Param 2 - block_bytes is the size of the regular blocks (0 = ARENA_DEFAULT_BLOCK_BYTES)
+    Param 3 - huge_pages = 1 asks for transparent huge pages for blocks of ARENA_HUGE_PAGE_BYTES and more
+              (only a hint - ignored where the system doesn't support it)
+    Nothing is allocated until the first arena_alloc
+*/
+void arena_init(Arena *arena, size_t block_bytes, int huge_pages);
+
+/*
+    Returns size bytes of uninitialized memory aligned to alignment (a power of two, 0 = alignof(max_align_t))
+    or NULL if the memory could not be mapped
+*/
+void *arena_alloc(Arena *arena, size_t size, size_t alignment);
+
+/*
+    Same as realloc for memory from arena_alloc (memory = NULL allocates). The allocation is extended in place if
+    it is the most recent one of its block and there is room, otherwise it is moved - a moved allocation that had
+    a block of its own gives that block back right away.
+    Returns the (possibly moved) memory or NULL on failure (the old memory is left untouched in that case)
+*/
+void *arena_grow(Arena *arena, void *memory, size_t old_size, size_t new_size, size_t alignment);
+
+/*
+    arena_rewind gives back everything allocated since arena_mark (blocks mapped since then are unmapped right away).
+    Memory allocated before the mark must not be grown with arena_grow in between.
+*/
+ArenaMark arena_mark(const Arena *arena);
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+/*
+    Gives all the memory of the arena back to the OS - the arena can be used again afterwards
+*/
+void arena_release(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,64 @@
+#ifndef BATCH_MODE_H
+#define BATCH_MODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bus_line_aggregator.h"
+#include "runtime_configuration_handler.h"
+
+/*
+    The report of every input file of a batch is written next to it as <input>.report.txt
+*/
+#define BATCH_REPORT_SUFFIX ".report.txt"
+
+typedef struct {
+    char *input_file;
+    char *report_file;
+    int status;                 /* 0 = analysed, -1 = failed */
+    const char *failure;        /* Why the file failed, shown in the merged report */
+    BusLineAggregator totals;
+} BatchFile;
+
+typedef struct {
+    BatchFile *files;
+    size_t count;
+    size_t capacity;
+} BatchFileList;
+
+void batch_file_list_init(BatchFileList *list);
+void batch_file_list_free(BatchFileList *list);
+
+/*
+    Collects the input files of a batch, sorted by name so that the merged report does not depend on the
+    order in which the files finish
+    Param 1 - path is either a directory (every regular file in it, hidden files excluded) or a glob pattern
+    Param 2 - exclude_file is left out of the batch (the merged report, NULL = none), just like caches
+              (.blcache), their temporary files and earlier per-file reports
+    Returns the number of files found or -1 on error
+*/
+int64_t batch_collect_files(const char *path, const char *exclude_file, BatchFileList *list);
+
+/*
+    Analyses every file of the list on up to settings->thread_count threads (0 = one per online CPU), one file
+    per thread at a time - so at most that many files are held in memory at once. Every file gets its own
+    report (if file output is enabled) and its totals in list->files[i].totals. A file that can't be read or
+    analysed is only marked as failed, the rest of the batch carries on.
+    Returns the number of failed files
+*/
+size_t batch_process_files(const FileSettings *settings, BatchFileList *list);
+
+/*
+    Writes the merged report - the result of every file followed by the combined totals of all analysed files
+    Param 1 - filename of the output file, "-" writes to stdout
+    Returns 0 on success and -1 on error
+*/
+int batch_write_report(const char *filename, const BatchFileList *list);
+
+/*
+    --batch: analyses all the files matching settings->batch_path and writes the merged report to
+    settings->output_file
+    Returns the exit status for main - EXIT_FAILURE if any of the files failed
+*/
+int batch_mode_run(const FileSettings *settings);
+
+#endif // BATCH_MODE_H
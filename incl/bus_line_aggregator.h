@@ -0,0 +1,51 @@
+#ifndef BUS_LINE_AGGREGATOR_H
+#define BUS_LINE_AGGREGATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bus_line_handler.h"
+#include "tariff.h"
+
+/*
+    Running totals over a stream of bus lines, kept per subsidy level - the memory used does not depend
+    on the number of bus lines, which makes it usable for inputs that do not fit into memory.
+    The profits are added up with compensated (Neumaier) summation, so the rounding error does not grow
+    with the number of bus lines the way it does with a plain running sum. In exact mode (tariff.h) the totals
+    come from the whole cents instead, which are added up as integers.
+*/
+typedef struct {
+    size_t line_count[SUBSIDY_LEVEL_COUNT + 1];         /* Indexed by tariff_level_index */
+    size_t profitable_lines[SUBSIDY_LEVEL_COUNT + 1];
+    double profit[SUBSIDY_LEVEL_COUNT + 1];
+    double profit_compensation[SUBSIDY_LEVEL_COUNT + 1];
+    int64_t profit_cents[SUBSIDY_LEVEL_COUNT + 1];      /* Only meaningful in exact mode */
+} BusLineAggregator;
+
+void bus_line_aggregator_init(BusLineAggregator *aggregator);
+
+/*
+    One step of the compensated summation - the running total is *sum + *compensation
+*/
+void bus_line_compensated_add(double *sum, double *compensation, double value);
+
+/*
+    Adds a single bus line - its profitability has to be calculated already
+*/
+void bus_line_aggregator_add(BusLineAggregator *aggregator, const BusLineProperties *bus_line);
+
+/*
+    Adds the totals of another aggregator (e.g. of another input file) to this one
+*/
+void bus_line_aggregator_merge(BusLineAggregator *aggregator, const BusLineAggregator *other);
+
+/*
+    Summary of the bus lines of one subsidy level (1 - SUBSIDY_LEVEL_COUNT)
+*/
+void bus_line_aggregator_level(const BusLineAggregator *aggregator, int subsidy_level, BusLineSummary *summary);
+
+/*
+    Summary of all the bus lines added so far
+*/
+void bus_line_aggregator_total(const BusLineAggregator *aggregator, BusLineSummary *summary);
+
+#endif // BUS_LINE_AGGREGATOR_H
@@ -0,0 +1,116 @@
+#ifndef BUS_LINE_CACHE_H
+#define BUS_LINE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bus_line_handler.h"
+#include "bus_line_store.h"
+
+/*
+    Binary columnar cache of a parsed input file, stored next to it as <input>.blcache
+
+    Layout: a fixed header (magic, format version, byte order, row count, the identity of the source file and
+    the offset of every column) followed by one block per column - line numbers, departure times (minutes since
+    midnight), subsidy levels, adults, students, seniors and route lengths. Every block starts on a 64-byte boundary.
+    The cache only holds the parsed fields (no profitability), so it stays valid when the tariffs change. Exact mode
+    rejects more route lengths (file_handler.h), so a cache written with or without --exact is only used by runs
+    of the same kind.
+    Warnings about rejected lines are only printed by the run that parses the text file.
+*/
+#define BUS_LINE_CACHE_SUFFIX ".blcache"
+#define BUS_LINE_CACHE_VERSION 5u
+
+/*
+    Identity of a source file, recorded in the cache (and the index) it was read into.
+    A cache is used right away while the file still has the same device, inode, size, modification time and status
+    change time - the last one can't be set back by touch -r, cp -p or rsync -t, so an edit that restores the
+    modification time is still noticed. Otherwise the whole file is hashed: if its size and hash still match, the
+    file was only touched or copied and the cache is used as well, with the recorded identity brought up to date so
+    that the next run takes the fast path again.
+*/
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+    uint64_t hash;
+    uint64_t hashed;            /* 1 = hash is filled in (bus_line_cache_hash) */
+} BusLineCacheSource;
+
+/*
+    Takes the identity of a source file from its attributes (no data is read) - meant to be called before parsing
+    it, so that a file that changes while being parsed doesn't end up with a cache that claims to match it
+    Returns 0 on success and -1 if the file is not a regular file (stdin, pipes etc. are never cached)
+*/
+int bus_line_cache_identify(const char *source_file, BusLineCacheSource *source);
+
+/*
+    Adds the hash of the whole file to an identity taken by bus_line_cache_identify. Hashing runs at about the speed
+    of reading the file, far below the cost of parsing it.
+    Returns 0 on success and -1 on error or if the file has changed since it was identified
+*/
+int bus_line_cache_hash(const char *source_file, BusLineCacheSource *source);
+
+/*
+    Checks the identity recorded in an open cache or index file against the source file, hashing the source (once,
+    the hash is kept in source) when the attributes don't settle it. The attributes aren't trusted while the recorded
+    status change time isn't older than the file holding it: the clock behind it is coarse, and the source could
+    have been changed again within the same tick after it was identified.
+    Param 1, 2 - recorded_fd is the cache or index file, recorded the identity stored in it at recorded_offset
+    (rewritten there with the current attributes when only the contents still match)
+    Returns 1 if the file was written for the source as it is now and 0 if not
+*/
+int bus_line_cache_source_check(int recorded_fd, size_t recorded_offset, const BusLineCacheSource *recorded,
+                                const char *source_file, BusLineCacheSource *source);
+
+/*
+    Builds the cache file name for a source file
+    Returns 0 on success and -1 if the name does not fit into path
+*/
+int bus_line_cache_path(const char *source_file, char *path, size_t path_size);
+
+/*
+    Loads the cached bus lines of a source file into the store (appending to it) with a single mmap
+    Param 2 - source is the identity taken by bus_line_cache_identify (its hash is added if the check needs it)
+    Returns the number of bus lines loaded, or -1 if there is no usable cache (missing, stale, corrupt or
+    from a different version) - the caller should parse the source file in that case
+*/
+int64_t bus_line_cache_load(const char *source_file, BusLineCacheSource *source, BusLineStore *store);
+
+/*
+    Same as bus_line_cache_load, but only the given rows (positions in the source file order) are loaded,
+    in the order they are listed in - used for index lookups (see bus_line_index.h)
+    Returns the number of bus lines loaded, or -1 if there is no usable cache or a row is out of range
+*/
+int64_t bus_line_cache_load_rows(const char *source_file, BusLineCacheSource *source, const uint64_t *rows, size_t count,
+                                 BusLineStore *store);
+
+/*
+    Writes the cache for a source file - written to a temporary file first and renamed into place,
+    so a concurrent reader never sees a half-written cache
+    Param 2 - source has to be hashed (bus_line_cache_hash) before the file is parsed
+    Returns 0 on success and -1 on error (nothing is left behind in that case)
+*/
+int bus_line_cache_save(const char *source_file, const BusLineCacheSource *source, const BusLineProperties *bus_lines, size_t count);
+
+/*
+    Reads an input file into the store - from its cache when there is an up-to-date one, otherwise the text file
+    gets parsed (read_handler_parallel) and the cache is written for the next run
+    Param 3 - thread_count is passed on to the parser (0 = one per online CPU)
+    Param 4 - cache_enabled = 0 always parses the text file and leaves the cache alone
+    Returns the number of bus lines appended to the store or -1 on error
+*/
+int64_t bus_line_cache_read(const char *source_file, BusLineStore *store, unsigned thread_count, int cache_enabled);
+
+/*
+    Same as bus_line_cache_read, for a caller that has already identified the source file (bus_line_cache_identify)
+    Param 2 - source is NULL to neither use nor write the cache, otherwise it gets hashed if the cache is missing or
+    doesn't match by its attributes
+*/
+int64_t bus_line_cache_read_identified(const char *source_file, BusLineCacheSource *source, BusLineStore *store,
+                                       unsigned thread_count);
+
+#endif // BUS_LINE_CACHE_H
@@ -1,7 +1,8 @@
 #ifndef BUS_LINE_HANDLER_H
 #define BUS_LINE_HANDLER_H
 
-#define MAX_BUS_LINES 100
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct {
     int student;
@@ -11,7 +12,7 @@ typedef struct {
 
 typedef struct {
     int line_number;
-    char departure_time[10];
+    uint16_t departure_minutes;     /* Minutes since midnight, parsed from HH:MM (formatted back only for output) */
     int subsidy_level;
     Passengers passengers;
     double route_length;
@@ -19,25 +20,70 @@ typedef struct {
 } BusLineProperties;
 
 /*
-    This function calculates the profitability for all buslines
+    Totals over all the analyzed bus lines - total_profit is reduced in a fixed order that does not depend on
+    the number of threads, so the same input always gives the exact same total (in exact mode it is added up in
+    whole cents and exact, see tariff.h)
+*/
+typedef struct {
+    size_t line_count;
+    size_t profitable_lines;
+    size_t unprofitable_lines;
+    double total_profit;
+    int exact_overflow;         /* 1 = the exact mode total is too large (tariff.h), total_profit must not be reported */
+} BusLineSummary;
+
+/*
+    This function calculates the profitability for all buslines using the active tariff table (see tariff.h)
     Param 1 - bus_lines is an array of bus lines that contains all the data about individual bus lines
     Param 2 - count defines the number of valid bus lines in the first parameter
 */
-void calculate_profitability(BusLineProperties *bus_lines, int count);
+void calculate_profitability(BusLineProperties *bus_lines, size_t count);
+
+/*
+    Same as calculate_profitability, but the bus lines are split into blocks that are processed on a thread pool
+    Param 3 - thread_count is the number of threads to use (0 = one per online CPU)
+*/
+void calculate_profitability_parallel(BusLineProperties *bus_lines, size_t count, unsigned thread_count);
+
+/*
+    Computes the total profit/loss and the number of profitable and unprofitable bus lines
+    The bus lines are summed pairwise in fixed-size blocks and the block sums are again combined pairwise,
+    which keeps the rounding error small and makes the result bit-identical for any thread_count
+    Param 3 - thread_count is the number of threads to use (0 = one per online CPU)
+    Param 4 - summary receives the results
+*/
+void summarize_profitability(const BusLineProperties *bus_lines, size_t count, unsigned thread_count, BusLineSummary *summary);
+
+/*
+    Same as summarize_profitability over only the rows listed in selection (e.g. the rows that passed --where),
+    in selection order - the blocks are laid out over the selection exactly as over a compacted copy of the rows,
+    so the totals are the same as summarizing such a copy, without making one
+    Param 2 - selection holds the row indices (NULL = every row)
+    Param 3 - count is the number of indices in selection
+*/
+void summarize_profitability_selection(const BusLineProperties *bus_lines, const size_t *selection, size_t count,
+                                       unsigned thread_count, BusLineSummary *summary);
 
 /*
     Sorts the bus lines by subsidy level followed by sorting by profitability
+    (a shortcut for sort_engine_sort with the default sort spec - see sort_engine.h for other orders)
     Param 1 - bus_lines is an array of bus lines that contains all the data about individual bus lines
     Param 2 - count defines the number of valid bus lines in the first parameter
 
     (same as the above)
 */
-void sort_lines(BusLineProperties *bus_lines, int count);
+void sort_lines(BusLineProperties *bus_lines, size_t count);
 
 /*
     This function displays the results in stdout (console)
     Parameters are same as the above
 */
-void display_result_handler(const BusLineProperties *bus_lines, int count);
+void display_result_handler(const BusLineProperties *bus_lines, size_t count);
+
+/*
+    Same as display_result_handler, but displays the rows that selection points to, in selection order
+    (selection = NULL displays the first count rows)
+*/
+void display_result_handler_selection(const BusLineProperties *bus_lines, const size_t *selection, size_t count);
 
 #endif // BUS_LINE_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef BUS_LINE_INDEX_H
+#define BUS_LINE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bus_line_cache.h"
+#include "bus_line_handler.h"
+#include "bus_line_store.h"
+
+/*
+    Persistent secondary index of an input file by line number, stored next to it as <input>.blidx
+
+    Layout: a fixed header (magic, format version, byte order, entry count and the identity of the source file,
+    the same as in the cache) followed by one entry per bus line, sorted by line number, then departure time, then
+    row. The rows point into the columnar cache (bus_line_cache.h), so a lookup binary searches the mapped entries
+    in O(log n) and then only reads the matching rows out of the cache - nothing gets parsed and the rest of the
+    data is never touched. The index is only used while both it and the cache still match the source file (and were
+    written by the same kind of run, with or without --exact).
+*/
+#define BUS_LINE_INDEX_SUFFIX ".blidx"
+#define BUS_LINE_INDEX_VERSION 3u
+
+typedef struct {
+    int32_t line_number;
+    uint16_t departure_minutes;
+    uint16_t reserved;
+    uint64_t row;               /* Position of the bus line in the source file (and the cache) */
+} BusLineIndexEntry;
+
+/*
+    Builds the index file name for a source file
+    Returns 0 on success and -1 if the name does not fit into path
+*/
+int bus_line_index_path(const char *source_file, char *path, size_t path_size);
+
+/*
+    Builds the sorted entries of the bus lines (row = position in bus_lines)
+    Param 3 - entries receives a malloc'ed array of count entries (free it)
+    Returns 0 on success and -1 on allocation failure
+*/
+int bus_line_index_build(const BusLineProperties *bus_lines, size_t count, BusLineIndexEntry **entries);
+
+/*
+    Range of the entries with first_line <= line_number <= last_line, found by binary search
+    Param 4, 5 - begin / end receive the range [begin, end) (begin == end if no bus line matches)
+*/
+void bus_line_index_range(const BusLineIndexEntry *entries, size_t count, int32_t first_line, int32_t last_line,
+                          size_t *begin, size_t *end);
+
+/*
+    Writes the index of a source file - entries are built by bus_line_index_build from all of its rows, in file order.
+    Written to a temporary file first and renamed into place like the cache
+    Param 2 - source has to be hashed (bus_line_cache_hash)
+    Returns 0 on success and -1 on error (nothing is left behind in that case)
+*/
+int bus_line_index_save(const char *source_file, const BusLineCacheSource *source, const BusLineIndexEntry *entries, size_t count);
+
+/*
+    Appends the bus lines with first_line <= line_number <= last_line to the store (ordered by line number and
+    departure time), using the index and the cache of the source file
+    Param 2 - source is the identity taken by bus_line_cache_identify (its hash is added if a check needs it)
+    Returns the number of bus lines appended, or -1 if the index or the cache is missing, stale or corrupt
+*/
+int64_t bus_line_index_lookup(const char *source_file, BusLineCacheSource *source, int32_t first_line, int32_t last_line,
+                              BusLineStore *store);
+
+/*
+    --line / --lines - looks the bus lines up through the index when there is an up-to-date one. Otherwise the
+    input is read once (bus_line_cache_read, which writes the cache) and the index is written for the next lookups.
+    Param 5 - thread_count is passed on to the parser (0 = one per online CPU)
+    Param 6 - cache_enabled = 0 always parses the text file and neither uses nor writes the cache and the index
+    Returns the number of bus lines appended to the store (0 = none with those line numbers) or -1 on error
+*/
+int64_t bus_line_index_read(const char *source_file, int32_t first_line, int32_t last_line, BusLineStore *store,
+                            unsigned thread_count, int cache_enabled);
+
+#endif // BUS_LINE_INDEX_H
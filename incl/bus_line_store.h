@@ -0,0 +1,53 @@
+#ifndef BUS_LINE_STORE_H
+#define BUS_LINE_STORE_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "bus_line_handler.h"
+
+/*
+    Heap-backed, geometrically growing storage for parsed bus lines.
+    Replaces the old fixed-size stack buffer (MAX_BUS_LINES) so that the input size is only bounded by memory.
+    The rows come either from malloc or from an arena (see bus_line_store_init_arena).
+*/
+typedef struct {
+    BusLineProperties *lines;
+    size_t count;
+    size_t capacity;
+    Arena *arena;               /* NULL = malloc'ed rows */
+} BusLineStore;
+
+/*
+    Initializes an empty store
+    Param 1 - store is the store to initialize
+    Param 2 - capacity_hint is the expected number of rows (0 = allocate lazily on first append)
+    Returns 0 on success, -1 if the initial allocation failed
+*/
+int bus_line_store_init(BusLineStore *store, size_t capacity_hint);
+
+/*
+    Same as bus_line_store_init, but the rows are allocated from the arena (aligned to ARENA_SIMD_ALIGNMENT)
+    and only given back when the arena is released - bus_line_store_free just empties the store
+*/
+int bus_line_store_init_arena(BusLineStore *store, Arena *arena, size_t capacity_hint);
+
+/*
+    Makes sure that the store can hold at least min_capacity rows without reallocating
+    Returns 0 on success, -1 on allocation failure (the store is left untouched in that case)
+*/
+int bus_line_store_reserve(BusLineStore *store, size_t min_capacity);
+
+/*
+    Returns a pointer to a new (uninitialized) row slot at the end of the store or NULL on allocation failure.
+    The slot only becomes part of the store after bus_line_store_commit is called, which lets the parser
+    write directly into the store and simply not commit rows that turned out to be invalid.
+*/
+BusLineProperties *bus_line_store_next_slot(BusLineStore *store);
+void bus_line_store_commit(BusLineStore *store);
+
+/*
+    Releases all the memory held by the store and resets it to an empty state
+*/
+void bus_line_store_free(BusLineStore *store);
+
+#endif // BUS_LINE_STORE_H
@@ -0,0 +1,85 @@
+#ifndef COMPRESSED_INPUT_H
+#define COMPRESSED_INPUT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+    Transparent decompression of gzip and zstd input files, recognized by their magic bytes.
+    The decompressor (gzip -dc / zstd -dc) runs as a child process that reads the compressed file and writes the
+    text into a pipe, which the parser reads like any other stream - decompression and parsing overlap on two
+    CPUs and the text never touches the disk.
+*/
+typedef enum {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} CompressionFormat;
+
+/*
+    Where the decompressors are expected - they are started by absolute path, never looked up in $PATH, so the
+    environment can't swap in a different program. Both can be overridden at build time (-DCOMPRESSED_INPUT_GZIP_PATH=...)
+    and at runtime with compressed_input_set_tool_path (the gzip_path / zstd_path configuration keys).
+*/
+#ifndef COMPRESSED_INPUT_GZIP_PATH
+#define COMPRESSED_INPUT_GZIP_PATH "/usr/bin/gzip"
+#endif
+#ifndef COMPRESSED_INPUT_ZSTD_PATH
+#define COMPRESSED_INPUT_ZSTD_PATH "/usr/bin/zstd"
+#endif
+
+#define COMPRESSED_INPUT_PATH_BYTES 256
+
+/*
+    Longest magic number - the detection needs at most this many bytes from the start of the file
+*/
+#define COMPRESSED_INPUT_MAGIC_BYTES 4
+
+typedef struct {
+    int fd;                     /* Read end of the pipe with the decompressed text */
+    pid_t pid;                  /* The decompressor */
+    CompressionFormat format;
+} CompressedInput;
+
+/*
+    Format of a file that starts with the given bytes
+*/
+CompressionFormat compressed_input_detect(const unsigned char *header, size_t length);
+
+/*
+    Same as above for an open file - the first bytes are read with pread, so the file offset doesn't move.
+    Anything that isn't a regular file (pipes, terminals) is reported as COMPRESSION_NONE.
+*/
+CompressionFormat compressed_input_detect_fd(int fd);
+
+/*
+    Name of the program that decompresses the format ("gzip" / "zstd")
+*/
+const char *compressed_input_tool(CompressionFormat format);
+
+/*
+    Absolute path of the program that decompresses the format
+*/
+const char *compressed_input_tool_path(CompressionFormat format);
+
+/*
+    Replaces the path of the decompressor of a format
+    Returns 0 on success and -1 if the path isn't absolute or too long (the previous path is kept)
+*/
+int compressed_input_set_tool_path(CompressionFormat format, const char *path);
+
+/*
+    Starts decompressing source_fd (read from its current offset, the caller keeps its own descriptor)
+    Returns 0 on success, -1 if the decompressor could not be started and -2 if it isn't installed (nothing
+    executable at compressed_input_tool_path)
+*/
+int compressed_input_open(int source_fd, CompressionFormat format, CompressedInput *input);
+
+/*
+    Closes the pipe and waits for the decompressor
+    Returns 0 if it finished cleanly (or was stopped because the caller closed the pipe before the end of the
+    data) and -1 if it failed, e.g. on a corrupt or truncated archive
+*/
+int compressed_input_close(CompressedInput *input);
+
+#endif // COMPRESSED_INPUT_H
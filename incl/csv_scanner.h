@@ -0,0 +1,92 @@
+#ifndef CSV_SCANNER_H
+#define CSV_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Number of input bytes classified by a single scan of the block scanner
+*/
+#define CSV_BLOCK_SIZE 64
+
+/*
+    Number of comma positions remembered per row - rows with more commas than this are still split correctly,
+    the remaining separators are just located with a plain byte search instead
+*/
+#define CSV_MAX_ROW_COMMAS 16
+
+/*
+    Bitmasks of the interesting characters in one 64-byte block, bit i corresponds to byte i of the block
+*/
+typedef struct {
+    uint64_t comma;
+    uint64_t newline;
+    uint64_t carriage_return;
+    uint64_t comment;
+} CsvBlockMasks;
+
+/*
+    One row (line) of the input as located by the scanner
+    begin/end span the row without its '\n', but including a trailing '\r' if there was one
+*/
+typedef struct {
+    const char *begin;
+    const char *end;
+    int has_carriage_return;
+    int is_comment;
+    size_t comma_count;
+    size_t commas[CSV_MAX_ROW_COMMAS];
+} CsvRow;
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t pos;
+    size_t block_base;
+    int block_loaded;
+    CsvBlockMasks masks;
+    uint64_t previous_carriage_return;
+} CsvScanner;
+
+/*
+    Picks the fastest block scanning kernel for the current CPU (AVX2, SSE2 or the portable scalar one).
+    This is done lazily on first use, but calling it up front keeps the choice out of any worker threads.
+*/
+void csv_scanner_init(void);
+
+/*
+    Forces a specific kernel ("scalar", "sse2" or "avx2") - mostly useful for tests and benchmarks
+    Returns 0 on success, -1 if the kernel is unknown or not supported by the CPU
+*/
+int csv_scanner_select_kernel(const char *kernel_name);
+
+/*
+    Returns the name of the currently selected kernel
+*/
+const char *csv_scanner_kernel_name(void);
+
+/*
+    Classifies CSV_BLOCK_SIZE bytes starting at block (all of them must be readable)
+*/
+void csv_scan_block(const char *block, CsvBlockMasks *masks);
+
+/*
+    Portable byte-at-a-time reference implementation of csv_scan_block
+*/
+void csv_scan_block_scalar(const char *block, CsvBlockMasks *masks);
+
+/*
+    Row iteration over an in-memory buffer
+    Param 1 - scanner is the iterator state
+    Param 2 - data is the input buffer (it does not have to be null-terminated)
+    Param 3 - size is the size of the input buffer in bytes
+*/
+void csv_scanner_start(CsvScanner *scanner, const char *data, size_t size);
+
+/*
+    Locates the next row and all of its field separators
+    Returns 1 if a row was found and 0 once the whole input has been consumed
+*/
+int csv_scanner_next_row(CsvScanner *scanner, CsvRow *row);
+
+#endif // CSV_SCANNER_H
@@ -0,0 +1,49 @@
+#ifndef FIELD_PARSER_H
+#define FIELD_PARSER_H
+
+#include <stdint.h>
+
+/*
+    Dedicated parsers for the numeric CSV fields - they work directly on [begin, end) ranges of the input
+    (no null terminator needed), check the syntax of the whole field and never go through the locale machinery
+    of sscanf/strtod for the common inputs
+*/
+
+typedef enum {
+    FIELD_PARSE_OK = 0,
+    FIELD_PARSE_EMPTY,      /* The field contains no characters at all */
+    FIELD_PARSE_SYNTAX,     /* The field is not a number or has trailing garbage */
+    FIELD_PARSE_RANGE       /* The field is a number but outside of the allowed range (or overflows) */
+} FieldParseStatus;
+
+/*
+    Parses a base-10 integer with an optional sign
+    Param 1 - begin is the first character of the field
+    Param 2 - end is one past the last character of the field
+    Param 3 - min_value is the smallest accepted value
+    Param 4 - max_value is the largest accepted value
+    Param 5 - value receives the parsed value (only written on FIELD_PARSE_OK)
+*/
+FieldParseStatus parse_int_field(const char *begin, const char *end, int32_t min_value, int32_t max_value, int32_t *value);
+
+/*
+    Parses a decimal number such as 15.5, -0.25 or 1e3 into the closest double
+    Plain fixed-precision decimals (up to 19 significant digits) are handled by a fast exact path,
+    anything else falls back to strtod.
+    Params are the same as above, only the result is a double and there is no range check
+*/
+FieldParseStatus parse_decimal_field(const char *begin, const char *end, double *value);
+
+/*
+    Minutes in a day - departure times are stored as minutes since midnight, 0 to MINUTES_PER_DAY - 1
+*/
+#define MINUTES_PER_DAY 1440
+
+/*
+    Parses a departure time of exactly the form HH:MM (00:00 to 23:59) into minutes since midnight
+    Params are the same as above, FIELD_PARSE_SYNTAX is returned for anything that isn't two digits, a colon
+    and two digits and FIELD_PARSE_RANGE for hours above 23 or minutes above 59
+*/
+FieldParseStatus parse_time_field(const char *begin, const char *end, uint16_t *minutes);
+
+#endif // FIELD_PARSER_H
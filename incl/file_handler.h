@@ -1,21 +1,98 @@
 #ifndef FILE_HANDLER_H
 #define FILE_HANDLER_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bus_line_aggregator.h"
 #include "bus_line_handler.h"
+#include "bus_line_store.h"
+
+/*
+    Pass this as max_bus_lines to read every valid line from the input file
+*/
+#define READ_ALL_BUS_LINES SIZE_MAX
+
+/*
+    Longest route length accepted from the input, in km - longer routes are rejected like any other invalid
+    length. The bound keeps the whole metres of exact mode (tariff.h) far away from the limits of an int64.
+    In exact mode a route length must also be a whole number of metres (at most 3 decimals), anything finer
+    would be silently rounded away.
+*/
+#define MAX_ROUTE_LENGTH_KM 100000.0
 
 /*
     Param 1 - filename, pretty self explanatory i.e. the input file's name
-    Param 2 - bus_lines is an array of bus lines that contains all the data about individual bus lines
-    Param 3 - max_bus_lines is the maximum number of lines to read from the input file
+    Param 2 - store is the (growable) row store that the parsed bus lines get appended to
+    Param 3 - max_bus_lines is the maximum number of lines to read from the input file (READ_ALL_BUS_LINES for no limit)
+    gzip and zstd compressed files are recognized by their magic bytes and decompressed on the fly
+    (see compressed_input.h) - this applies to read_handler_parallel and read_handler_stream as well
+    Returns the number of bus lines appended to the store or -1 on error
+*/
+int64_t read_handler(const char* filename, BusLineStore *store, size_t max_bus_lines);
+
+/*
+    Parallel version of read_handler - the input file is split into newline-aligned byte ranges that are parsed
+    concurrently and then appended to the store in their original order (warnings keep their correct line numbers).
+    Falls back to read_handler for pipes, small files and thread_count == 1
+    Param 3 - thread_count is the number of parser threads (0 = one per online CPU)
+*/
+int64_t read_handler_parallel(const char* filename, BusLineStore *store, unsigned thread_count);
+
+/*
+    Called once for every valid bus line of a streamed input - the bus line is only valid during the call
+*/
+typedef void (*BusLineVisitor)(BusLineProperties *bus_line, void *context);
+
+/*
+    Streaming version of read_handler that never holds more than a small read buffer in memory - every valid
+    bus line is handed to the visitor as soon as it has been parsed and is then forgotten
+    Param 1 - filename of the input file, "-" reads from stdin (read_handler accepts "-" as well)
+    Param 2 - visitor is called for every valid bus line, in input order
+    Param 3 - visitor_context is passed on to the visitor
+    Returns the number of valid bus lines or -1 on error
 */
-int read_handler(const char* filename, BusLineProperties *bus_lines, int max_bus_lines);
+int64_t read_handler_stream(const char* filename, BusLineVisitor visitor, void *visitor_context);
+
+/*
+    Parses the complete lines of an in-memory buffer and hands every valid bus line to the visitor - for callers
+    that do their own reading (e.g. following a growing file). The buffer should end at the end of a line.
+    Param 3 - line_num is the number of lines before this buffer (for the warnings) and receives the new total
+    Returns the number of valid bus lines
+*/
+int64_t read_handler_buffer(const char *data, size_t size, size_t *line_num, BusLineVisitor visitor, void *visitor_context);
 
 /*
     Handler for writing all the results out to a output file
     Param 1 - same as parameter 1 above, but for the output file
     Param 2 - bus_lines is an array of bus lines that contains all the data about individual bus lines
     Param 3 - count defines the number of valid bus lines in the first parameter
+    Param 4 - summary holds the precomputed totals for the report (NULL = compute them here). The summary may
+              cover more rows than are listed, e.g. when only the top/bottom bus lines are written out
+    Returns 0 on success and -1 if the file could not be written or the exact mode total is too large (see tariff.h)
+*/
+int write_handler(const char* filename, BusLineProperties *bus_lines, size_t count, const BusLineSummary *summary);
+
+/*
+    Same as write_handler, but writes the rows that selection points to, in selection order
+    (selection = NULL writes the first count rows) - the rows stay where they are
+*/
+int write_handler_selection(const char* filename, const BusLineProperties *bus_lines, const size_t *selection, size_t count,
+                            const BusLineSummary *summary);
+
+/*
+    Writes only the summary part of the report (totals per subsidy level and overall) - used by the streaming
+    mode, which does not keep the individual bus lines around
+    Param 1 - filename of the output file, "-" writes to stdout
+    Param 2 - aggregator holds the totals
+*/
+int write_summary_handler(const char* filename, const BusLineAggregator *aggregator);
+
+/*
+    Prints the totals per subsidy level and overall to an already open file - the body of write_summary_handler,
+    also used by the merged report of the batch mode
+    Returns 0 on success and -1 (without printing anything) if an exact mode total is too large (see tariff.h)
 */
-int write_handler(const char* filename, BusLineProperties *bus_lines, int count);
+int print_summary_handler(FILE *file, const BusLineAggregator *aggregator);
 
 #endif // FILE_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef FOLLOW_MODE_H
+#define FOLLOW_MODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "bus_line_aggregator.h"
+#include "bus_line_handler.h"
+#include "bus_line_store.h"
+#include "rank_tree.h"
+#include "runtime_configuration_handler.h"
+#include "tariff.h"
+
+/*
+    Rows reported per subsidy level and direction when following without --top/--bottom
+*/
+#define FOLLOW_DEFAULT_K 10
+
+/*
+    Everything known about a followed (append-only) input file. Only the bytes appended since the last update
+    get parsed - a trailing line without a newline is kept back until the rest of it has been written.
+*/
+typedef struct {
+    const char *filename;
+    int fd;
+    dev_t device;
+    ino_t inode;
+    uint64_t offset;                    /* Bytes of the file read so far, including the pending partial line */
+    char *pending;                      /* Partial last line plus room for the next read */
+    size_t pending_size;
+    size_t pending_capacity;
+    size_t line_num;
+    size_t new_rows;                    /* Valid rows added since the last report */
+    int error;                          /* Set when a row could not be stored (out of memory) */
+    BusLineStore rows;
+    RankTree ranking[SUBSIDY_LEVEL_COUNT + 1];   /* Indexed by tariff_level_index */
+    BusLineAggregator totals;
+} FollowState;
+
+void follow_state_init(FollowState *state, const char *filename);
+void follow_state_free(FollowState *state);
+
+/*
+    Parses whatever has been appended to the file since the last update. A file that got truncated or replaced
+    (e.g. rotated) is read again from the start.
+    Returns the number of new valid bus lines or -1 on error
+*/
+int64_t follow_state_update(FollowState *state);
+
+/*
+    Collects the top/bottom rows of every subsidy level in report order (level, then most profitable first)
+    Param 4 - report_rows receives a malloc'ed array of the rows (free it), report_count their number
+    Returns 0 on success and -1 on allocation failure
+*/
+int follow_state_report_rows(const FollowState *state, size_t top_k, size_t bottom_k, BusLineProperties **report_rows, size_t *report_count);
+
+/*
+    --follow: reads the input, then keeps watching it (inotify, or polling where that is not available) and
+    re-emits the ranked report every settings->follow_interval seconds if new rows have arrived, until SIGINT/SIGTERM
+    Returns the exit status for main
+*/
+int follow_mode_run(const FileSettings *settings);
+
+#endif // FOLLOW_MODE_H
@@ -0,0 +1,125 @@
+#ifndef GROUP_BY_H
+#define GROUP_BY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bus_line_handler.h"
+
+/*
+    Per-group totals of the bus lines (--group-by) - e.g. per line number, per departure hour or per line and hour.
+    The bus lines are aggregated in a single pass into an open-addressing hash table (linear probing) whose keys
+    are kept in an array of their own, so a lookup only touches the key array until it finds its slot.
+    The order of the rows does not matter, the groups are reported in ascending key order.
+*/
+
+#define GROUP_BY_MAX_KEYS 3
+
+/*
+    Columns that the bus lines can be grouped by
+*/
+typedef enum {
+    GROUP_FIELD_LINE_NUMBER,
+    GROUP_FIELD_HOUR,           /* Hour of the departure time, 0-23 */
+    GROUP_FIELD_SUBSIDY_LEVEL
+} GroupField;
+
+/*
+    Ordered list of group keys - the first key is the most significant one in the report order.
+    key_count = 0 means no grouping.
+*/
+typedef struct {
+    size_t key_count;
+    GroupField keys[GROUP_BY_MAX_KEYS];
+} GroupSpec;
+
+typedef struct {
+    uint64_t line_count;
+    uint64_t profitable_lines;
+    uint64_t adults;
+    uint64_t students;
+    uint64_t seniors;
+    double profit;                  /* Compensated sum - the total is profit + profit_compensation */
+    double profit_compensation;
+    int64_t profit_cents;           /* The total in whole cents - used instead in exact mode (tariff.h) */
+    double min_profit;
+    double max_profit;
+} GroupTotals;
+
+typedef struct {
+    GroupSpec spec;
+    uint64_t *keys;             /* GROUP_KEY_EMPTY = free slot */
+    GroupTotals *totals;        /* totals[i] belongs to keys[i] */
+    size_t capacity;            /* Power of two */
+    size_t count;               /* Occupied slots i.e. number of groups */
+} GroupTable;
+
+#define GROUP_KEY_EMPTY UINT64_MAX
+
+/*
+    Parses a comma separated list of group keys, e.g. "line,hour"
+    Known keys: line, hour, subsidy (each at most once)
+    Returns 0 on success, -1 if the specification is invalid (spec is left untouched in that case)
+*/
+int group_spec_parse(const char *text, GroupSpec *spec);
+
+/*
+    Packs the key columns of a bus line into one integer - comparing packed keys gives the same order as comparing
+    the columns one after the other
+*/
+uint64_t group_spec_key(const GroupSpec *spec, const BusLineProperties *bus_line);
+
+/*
+    Value of the index-th key column (0 = the first key of the spec) of a packed key
+*/
+int64_t group_spec_key_value(const GroupSpec *spec, uint64_t key, size_t index);
+
+/*
+    Param 3 - capacity_hint is the expected number of groups (0 = a small default)
+    Returns 0 on success and -1 on allocation failure
+*/
+int group_table_init(GroupTable *table, const GroupSpec *spec, size_t capacity_hint);
+void group_table_free(GroupTable *table);
+
+/*
+    Adds a single bus line to its group - the profitability has to be calculated already
+    Returns 0 on success and -1 if the table could not grow
+*/
+int group_table_add(GroupTable *table, const BusLineProperties *bus_line);
+
+/*
+    Adds every group of other (built with the same spec) to the table
+    Returns 0 on success and -1 if the table could not grow
+*/
+int group_table_merge(GroupTable *table, const GroupTable *other);
+
+/*
+    Totals of the group with the given packed key, NULL if there is no such group
+*/
+const GroupTotals *group_table_find(const GroupTable *table, uint64_t key);
+
+/*
+    Groups the bus lines into table (initialized by this function).
+    Large inputs are split into up to GROUP_BY_MAX_PARTIALS contiguous ranges that are aggregated into partial tables
+    on the thread pool and then merged in range order - the number of ranges depends only on the number of bus lines,
+    so the results are exactly the same for any thread_count.
+    Param 4 - thread_count is the number of threads to use (0 = one per online CPU)
+    Returns 0 on success and -1 on allocation failure
+*/
+#define GROUP_BY_MAX_PARTIALS 16
+int group_by_lines(const BusLineProperties *bus_lines, size_t count, const GroupSpec *spec, unsigned thread_count, GroupTable *table);
+
+/*
+    Same as group_by_lines over only the rows listed in selection (NULL = every row)
+    Param 3 - count is the number of indices in selection
+*/
+int group_by_selection(const BusLineProperties *bus_lines, const size_t *selection, size_t count, const GroupSpec *spec,
+                       unsigned thread_count, GroupTable *table);
+
+/*
+    Writes the groups in ascending key order with their totals
+    Param 1 - filename of the report, "-" writes to stdout
+    Returns 0 on success and -1 on error
+*/
+int group_by_write_report(const char *filename, const GroupTable *table);
+
+#endif // GROUP_BY_H
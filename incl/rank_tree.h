@@ -0,0 +1,50 @@
+#ifndef RANK_TREE_H
+#define RANK_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Order-maintaining structure for ranking bus lines by profitability as they arrive - a treap (a binary search
+    tree balanced by random node priorities) over (profitability descending, row index ascending), which is the
+    same order the stable full sort produces. Inserting is O(log n) expected, reading the k best or worst rows
+    is O(k + log n), so keeping the ranking up to date costs time proportional to the new rows only.
+*/
+typedef struct {
+    size_t row;
+    double profitability;
+    uint32_t priority;
+    size_t left;
+    size_t right;
+} RankNode;
+
+typedef struct {
+    RankNode *nodes;
+    size_t count;
+    size_t capacity;
+    size_t root;
+    uint64_t random_state;
+} RankTree;
+
+void rank_tree_init(RankTree *tree);
+void rank_tree_free(RankTree *tree);
+
+/*
+    Adds a row - rows are expected to be inserted with increasing row indices
+    Returns 0 on success and -1 on allocation failure
+*/
+int rank_tree_insert(RankTree *tree, size_t row, double profitability);
+
+/*
+    Copies the indices of the (up to) k best ranked rows into rows, best first
+    Returns the number of rows copied
+*/
+size_t rank_tree_first(const RankTree *tree, size_t k, size_t *rows);
+
+/*
+    Copies the indices of the (up to) k worst ranked rows into rows, in ranking order (the worst one last)
+    Returns the number of rows copied
+*/
+size_t rank_tree_last(const RankTree *tree, size_t k, size_t *rows);
+
+#endif // RANK_TREE_H
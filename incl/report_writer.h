@@ -0,0 +1,90 @@
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Size of the output buffer - the report is written out with write() calls of (at most) this size
+*/
+#define REPORT_WRITER_BUFFER_BYTES (1u << 20)
+
+/*
+    Buffered output for the reports - rows are rendered straight into one large reusable buffer with dedicated
+    integer and fixed-point formatters instead of going through printf once per row.
+    The bytes written are exactly the same as printf would write with the corresponding conversions.
+*/
+typedef struct {
+    int fd;
+    int owns_fd;
+    int error;                  /* Set once a write() has failed, everything after that is dropped */
+    char *buffer;
+    size_t size;
+    size_t capacity;
+    uint64_t bytes_written;     /* Bytes that have made it out of the buffer so far */
+    char fallback[4096];        /* Used when the large buffer can't be allocated */
+} ReportWriter;
+
+/*
+    Starts writing to an already open file descriptor (e.g. STDOUT_FILENO) - stdout's stdio buffer is flushed
+    first so that earlier printf output stays in front of the report
+*/
+void report_writer_init(ReportWriter *writer, int fd);
+
+/*
+    Creates (or truncates) filename and starts writing to it
+    Returns 0 on success and -1 if the file could not be opened
+*/
+int report_writer_open(ReportWriter *writer, const char *filename);
+
+void report_writer_append(ReportWriter *writer, const char *text, size_t length);
+void report_writer_puts(ReportWriter *writer, const char *text);
+
+/*
+    printf-style output for the odd header line - rows should use the dedicated formatters below
+*/
+void report_writer_printf(ReportWriter *writer, const char *format, ...);
+
+/*
+    Width works the same as in printf: 0 = no padding, positive = right aligned (%5d), negative = left aligned (%-5d)
+*/
+void report_writer_int(ReportWriter *writer, int value, int width);
+void report_writer_string(ReportWriter *writer, const char *text, int width);
+
+/*
+    Same as %.Nf (with N = decimals, at most 6) - plus_sign prefixes non-negative values with '+'
+    (the same as "+%.Nf" for value >= 0)
+*/
+void report_writer_fixed(ReportWriter *writer, double value, int decimals, int width, int plus_sign);
+
+/*
+    Fast path of report_writer_fixed - formats a value like %.Nf into out (at least 32 bytes) and returns the length.
+    Returns 0 without writing anything if the value is too large, not finite or too close to a rounding tie to
+    be formatted exactly without printf.
+*/
+size_t report_format_fixed(char *out, double value, int decimals);
+
+/*
+    Departure time (minutes since midnight) as HH:MM - width is the same as for the strings above
+*/
+void report_writer_time(ReportWriter *writer, uint16_t minutes, int width);
+
+/*
+    Formats minutes since midnight as HH:MM into out (at least REPORT_TIME_BYTES bytes, null terminated)
+*/
+#define REPORT_TIME_BYTES 6
+void report_format_time(char *out, uint16_t minutes);
+
+/*
+    Writes out everything buffered so far
+    Returns 0 on success and -1 if any write failed
+*/
+int report_writer_flush(ReportWriter *writer);
+
+/*
+    Flushes, releases the buffer and closes the file if report_writer_open opened it
+    Returns 0 on success and -1 if any write failed
+*/
+int report_writer_close(ReportWriter *writer);
+
+#endif // REPORT_WRITER_H
@@ -0,0 +1,83 @@
+#ifndef ROW_FILTER_H
+#define ROW_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "bus_line_handler.h"
+#include "sort_engine.h"
+
+/*
+    Row filter for --where - a small boolean expression over the bus line columns, e.g.
+        subsidy = 2 and (profit < 0 or passengers >= 40) and not time < 06:30
+    Columns use the same names as the sort keys (line, time, subsidy, adult, student, senior, passengers,
+    length, profit), the comparisons are = (or ==), !=, <, <=, >, >= against a number (or an HH:MM time for
+    the time column), combined with and/or/not (or &&, ||, !) and parentheses. "and" binds tighter than "or".
+
+    The expression is compiled once into a postfix program. The filter pass then runs it column-at-a-time over
+    blocks of rows - every comparison fills one bitmap word per 64 rows and the boolean operators combine whole
+    words - and finally turns the bitmap into a selection vector of row indices that the later phases work on,
+    so the rows themselves are never copied.
+*/
+
+#define ROW_FILTER_MAX_OPS 64
+#define ROW_FILTER_MAX_DEPTH 16     /* Operand stack depth of the postfix program */
+
+typedef enum {
+    ROW_FILTER_OP_COMPARE,
+    ROW_FILTER_OP_AND,
+    ROW_FILTER_OP_OR,
+    ROW_FILTER_OP_NOT
+} RowFilterOpcode;
+
+typedef enum {
+    ROW_FILTER_EQUAL,
+    ROW_FILTER_NOT_EQUAL,
+    ROW_FILTER_LESS,
+    ROW_FILTER_LESS_EQUAL,
+    ROW_FILTER_GREATER,
+    ROW_FILTER_GREATER_EQUAL
+} RowFilterComparison;
+
+typedef struct {
+    RowFilterOpcode opcode;
+    SortField field;                /* Only used by ROW_FILTER_OP_COMPARE */
+    RowFilterComparison comparison;
+    double value;                   /* Departure times are compared in minutes since midnight */
+} RowFilterOp;
+
+/*
+    Compiled expression - op_count = 0 is the empty filter that every row matches
+*/
+typedef struct {
+    size_t op_count;
+    RowFilterOp ops[ROW_FILTER_MAX_OPS];    /* Postfix order */
+} RowFilter;
+
+/*
+    Compiles an expression (see above)
+    Returns 0 on success, -1 if the expression is invalid or too long (filter is left untouched in that case)
+*/
+int row_filter_compile(const char *text, RowFilter *filter);
+
+/*
+    Returns 1 if the bus line matches the filter and 0 if it doesn't - the profitability has to be calculated
+    already if the filter uses it
+*/
+int row_filter_matches(const RowFilter *filter, const BusLineProperties *bus_line);
+
+/*
+    Runs the filter over all the rows and collects the indices of the matching ones
+    The rows are split into blocks that are evaluated on the thread pool into one bitmap, which is then
+    compacted into the selection vector - the indices are in ascending order for any thread_count
+    Param 4 - thread_count is the number of threads to use (0 = one per online CPU)
+    Param 5 - arena that the selection is allocated from (NULL = malloc, the caller frees it)
+    Param 6 - selection receives the array of the matching row indices
+    Param 7 - selected_count receives the number of matching rows
+    Returns 0 on success, -1 on allocation failure
+*/
+#define ROW_FILTER_BLOCK_ROWS 1024
+int row_filter_select(const RowFilter *filter, const BusLineProperties *bus_lines, size_t count, unsigned thread_count,
+                      Arena *arena, size_t **selection, size_t *selected_count);
+
+#endif // ROW_FILTER_H
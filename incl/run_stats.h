@@ -0,0 +1,73 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdint.h>
+
+/*
+    Runtime statistics of one run (--stats) - wall clock time per phase, a few counters and the peak RSS,
+    written out as JSON at the end of the run.
+    Everything is off by default: until run_stats_enable is called, every function returns right away after
+    checking one flag, and the callers only count once per buffer, file or rejected line - never per row.
+    Counters may be updated from several threads (e.g. in batch mode), the phase timers only from the main thread.
+*/
+
+typedef enum {
+    STATS_PHASE_LOAD,           /* Reading the input (or the cache) */
+    STATS_PHASE_PROFITABILITY,
+    STATS_PHASE_FILTER,         /* --where */
+    STATS_PHASE_SUMMARY,
+    STATS_PHASE_SELECTION,      /* --top / --bottom */
+    STATS_PHASE_GROUP_BY,
+    STATS_PHASE_SORT,
+    STATS_PHASE_DISPLAY,
+    STATS_PHASE_WRITE,
+    STATS_PHASE_BATCH,          /* The whole of --batch, the files are processed concurrently */
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+typedef enum {
+    STATS_BYTES_READ,           /* Input bytes handed to the parser, plus the bytes of loaded caches */
+    STATS_ROWS_PARSED,          /* Valid bus lines */
+    STATS_ROWS_REJECTED,        /* Invalid lines - every line counts once, however many problems it has */
+    STATS_REJECTED_LINE_NUMBER, /* Invalid lines by problem */
+    STATS_REJECTED_DEPARTURE_TIME,
+    STATS_REJECTED_SUBSIDY_LEVEL,
+    STATS_REJECTED_ADULTS,
+    STATS_REJECTED_STUDENTS,
+    STATS_REJECTED_SENIORS,
+    STATS_REJECTED_ROUTE_LENGTH,
+    STATS_REJECTED_MISSING_FIELDS,
+    STATS_CACHE_HITS,
+    STATS_ROWS_FROM_CACHE,      /* Bus lines loaded from caches instead of being parsed */
+    STATS_ROWS_WRITTEN,         /* Bus lines listed in the report file(s) */
+    STATS_BYTES_WRITTEN,        /* Report bytes written, including the report shown on screen */
+    STATS_ALLOCATIONS,          /* Allocations of row-sized buffers (row store growth, sort keys, selections) */
+    STATS_ALLOCATED_BYTES,
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+void run_stats_enable(void);
+int run_stats_enabled(void);
+
+/*
+    Phases can be entered more than once, their times add up
+*/
+void run_stats_phase_begin(StatsPhase phase);
+void run_stats_phase_end(StatsPhase phase);
+
+void run_stats_add(StatsCounter counter, uint64_t amount);
+uint64_t run_stats_counter(StatsCounter counter);
+
+/*
+    Counts one row-sized allocation of the given size
+*/
+void run_stats_allocation(uint64_t bytes);
+
+/*
+    Writes the statistics as a single JSON object
+    Param 1 - filename of the output file, NULL or "" writes to stderr
+    Returns 0 on success and -1 on error
+*/
+int run_stats_write(const char *filename);
+
+#endif // RUN_STATS_H
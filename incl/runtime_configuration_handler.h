@@ -1,11 +1,40 @@
 #ifndef RUNTIME_CONFIGURATION_HANDLER_H
 #define RUNTIME_CONFIGURATION_HANDLER_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "group_by.h"
+#include "row_filter.h"
+#include "sort_engine.h"
+#include "tariff.h"
+
 typedef struct {
     char input_file[256];
     char output_file[256];
     int stdout_output_enabled;
     int file_output_enabled;
+    unsigned thread_count;      /* 0 = one thread per online CPU */
+    Tariff tariff;
+    int exact;                  /* 1 = integer cents arithmetic for the profitability and the totals (see tariff.h) */
+    SortSpec sort_spec;
+    GroupSpec group_spec;       /* key_count = 0 = the regular per bus line report, otherwise totals per group */
+    RowFilter where_filter;     /* Compiled --where expression, op_count = 0 = every bus line */
+    int line_lookup;            /* 1 = only the bus lines with line numbers first_line..last_line, through <input>.blidx */
+    int32_t first_line;
+    int32_t last_line;
+    size_t top_k;               /* 0 = no limit, otherwise only the top/bottom rows of each subsidy level are reported */
+    size_t bottom_k;
+    int cache_enabled;          /* 1 = load/save the parsed input from/to <input_file>.blcache */
+    int follow;                 /* 1 = keep watching the input file for appended rows */
+    unsigned follow_interval;   /* Seconds between two reports while following */
+    int huge_pages;             /* 1 = back the memory of large inputs with transparent huge pages (see arena.h) */
+    int summary_only;           /* 1 = stream the input and only report the totals (constant memory) */
+    int stats_enabled;          /* 1 = write the runtime statistics (run_stats.h) as JSON at the end of the run */
+    char stats_file[256];       /* Where the statistics go, "" = stderr */
+    char batch_path[256];       /* Directory or glob pattern of the files to analyse as one batch, "" = single input file */
+    char serve_socket[256];     /* Unix socket to answer queries on (serve_mode.h), "" = analyse once and exit */
+    char gzip_path[256];        /* Absolute paths of the decompressors of compressed inputs (compressed_input.h) */
+    char zstd_path[256];
 } FileSettings;
 
 void runtime_config_load_handler(FileSettings *settings, const char* configuration_file);
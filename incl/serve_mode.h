@@ -0,0 +1,84 @@
+#ifndef SERVE_MODE_H
+#define SERVE_MODE_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "arena.h"
+#include "bus_line_handler.h"
+#include "bus_line_index.h"
+#include "bus_line_store.h"
+#include "report_writer.h"
+#include "runtime_configuration_handler.h"
+
+/*
+    --serve SOCKET - resident analysis server. The input is loaded once into an immutable snapshot (rows with their
+    profitability, the totals, the rows in report order and the line number index) and queries are answered from it
+    over a Unix domain socket, one thread per client.
+
+    Protocol: one request per line, the response is zero or more data lines followed by a status line that starts
+    with "OK" or "ERR". Rows are written as line,time,subsidy,adults,students,seniors,length,profit.
+        summary             lines=N profitable=N unprofitable=N total=P/L
+        top K / bottom K    the K most / least profitable rows of every subsidy level, in report order
+        line N / lines A-B  the rows of the line numbers, by line number and departure time
+        where EXPR          the rows matching a --where expression (row_filter.h) followed by their summary
+        reload              loads the input again and swaps the new snapshot in
+        quit                closes the connection
+
+    A reload builds the new snapshot on the side and swaps it in under a short lock - queries that are already
+    running keep using the snapshot they started with, which is freed once the last of them has finished.
+    SIGHUP reloads as well, SIGINT/SIGTERM stop the server.
+*/
+
+#define SERVE_MAX_CLIENTS 64
+#define SERVE_MAX_REQUEST_BYTES 1024
+
+typedef struct {
+    Arena arena;                    /* Holds the rows, report_order and level_starts */
+    BusLineStore store;
+    BusLineSummary summary;
+    size_t *report_order;           /* Rows by subsidy level, most profitable first (ties in file order) */
+    size_t *level_starts;           /* Start of every subsidy level in report_order, level_starts[level_count] = count */
+    size_t level_count;
+    BusLineIndexEntry *index;       /* Line number index, see bus_line_index.h */
+    size_t references;              /* Queries using the snapshot, plus one while it is the current snapshot */
+} ServeSnapshot;
+
+typedef struct {
+    const FileSettings *settings;
+    pthread_mutex_t lock;           /* Guards current and the reference counts */
+    pthread_mutex_t reload_lock;    /* Only one reload at a time */
+    ServeSnapshot *current;
+} ServeState;
+
+/*
+    Loads the first snapshot of settings->input_file
+    Returns 0 on success and -1 if the input could not be loaded
+*/
+int serve_state_init(ServeState *state, const FileSettings *settings);
+void serve_state_free(ServeState *state);
+
+/*
+    Loads the input again and makes it the current snapshot
+    Returns the number of bus lines of the new snapshot or -1 on error (the old snapshot stays current)
+*/
+int64_t serve_state_reload(ServeState *state);
+
+/*
+    The current snapshot, kept alive until it is released - a reload in between doesn't affect it
+*/
+ServeSnapshot *serve_snapshot_acquire(ServeState *state);
+void serve_snapshot_release(ServeState *state, ServeSnapshot *snapshot);
+
+/*
+    Answers one request (a single line without the newline) into the writer - the response is flushed
+    Returns 1 if the client asked to close the connection and 0 otherwise
+*/
+int serve_execute(ServeState *state, const char *request, ReportWriter *response);
+
+/*
+    Listens on settings->serve_socket until SIGINT/SIGTERM
+    Returns the exit status for main
+*/
+int serve_mode_run(const FileSettings *settings);
+
+#endif // SERVE_MODE_H
@@ -0,0 +1,92 @@
+#ifndef SORT_ENGINE_H
+#define SORT_ENGINE_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "bus_line_handler.h"
+
+#define SORT_MAX_KEYS 8
+
+/*
+    Columns that the bus lines can be sorted by
+*/
+typedef enum {
+    SORT_FIELD_LINE_NUMBER,
+    SORT_FIELD_DEPARTURE_TIME,
+    SORT_FIELD_SUBSIDY_LEVEL,
+    SORT_FIELD_ADULTS,
+    SORT_FIELD_STUDENTS,
+    SORT_FIELD_SENIORS,
+    SORT_FIELD_PASSENGERS,      /* adults + students + seniors */
+    SORT_FIELD_ROUTE_LENGTH,
+    SORT_FIELD_PROFITABILITY
+} SortField;
+
+typedef struct {
+    SortField field;
+    int descending;
+} SortKey;
+
+/*
+    Ordered list of sort keys - the first key is the most significant one, rows that compare equal
+    on every key keep their original relative order (the sort is stable)
+*/
+typedef struct {
+    size_t key_count;
+    SortKey keys[SORT_MAX_KEYS];
+} SortSpec;
+
+/*
+    Sets the default order of the report: by subsidy level and then by profitability, most profitable first
+*/
+void sort_spec_set_default(SortSpec *spec);
+
+/*
+    Parses a comma separated list of sort keys, e.g. "subsidy,-profit"
+    A leading '-' sorts the key in descending order, a leading '+' (or nothing) in ascending order
+    Known keys: line, time, subsidy, adult, student, senior, passengers, length, profit
+    Returns 0 on success, -1 if the specification is invalid (spec is left untouched in that case)
+*/
+int sort_spec_parse(const char *text, SortSpec *spec);
+
+/*
+    Looks up a single key name (see above) of the given length
+    Returns 0 on success and -1 if there is no such key
+*/
+int sort_field_lookup(const char *name, size_t length, SortField *field);
+
+/*
+    Compares two bus lines according to the spec, the same way as strcmp (<0, 0, >0)
+*/
+int sort_engine_compare(const BusLineProperties *bus_line_a, const BusLineProperties *bus_line_b, const SortSpec *spec);
+
+/*
+    Sorts an array of row indices instead of the rows themselves
+    Every key is turned into an order-preserving unsigned 64-bit integer and the key/index pairs are
+    radix sorted (LSD, 8 bits per pass) - passes over bytes that are the same for every row are skipped
+    Param 1 - bus_lines are the rows that the indices point into
+    Param 2 - order holds the indices of the rows to sort and receives them in sorted order
+    Param 3 - count is the number of indices in order
+    Returns 0 on success, -1 on allocation failure (order is left untouched in that case)
+*/
+int sort_engine_order(const BusLineProperties *bus_lines, size_t *order, size_t count, const SortSpec *spec);
+
+/*
+    Same as sort_engine_order with the radix keys allocated from the arena and given back to it before returning
+    (scratch = NULL uses malloc)
+*/
+int sort_engine_order_arena(const BusLineProperties *bus_lines, size_t *order, size_t count, const SortSpec *spec, Arena *scratch);
+
+/*
+    Sorts the bus lines in place - the rows are sorted by index first and then moved into place only once
+    Returns 0 on success, -1 on allocation failure (the rows are left untouched in that case)
+*/
+int sort_engine_sort(BusLineProperties *bus_lines, size_t count, const SortSpec *spec);
+
+/*
+    Same as sort_engine_sort, but the scratch memory (the order and the radix keys) comes from the arena and is
+    given back to it before returning - scratch = NULL uses malloc
+*/
+int sort_engine_sort_arena(BusLineProperties *bus_lines, size_t count, const SortSpec *spec, Arena *scratch);
+
+#endif // SORT_ENGINE_H
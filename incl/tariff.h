@@ -0,0 +1,168 @@
+#ifndef TARIFF_H
+#define TARIFF_H
+
+#include <stdint.h>
+
+/*
+    Default tariffs used for the profitability calculation - they can be overridden at runtime
+    from the [tariff] section of the configuration file
+*/
+#define COST_PER_KM 2.50
+#define ADULT_TICKET 12.0
+#define STUDENT_TICKET 8.0
+#define SENIOR_TICKET 5.0
+#define LEVEL1_SUBSIDY 0.50
+#define LEVEL2_SUBSIDY 1.00
+#define LEVEL3_SUBSIDY 1.50
+
+#define SUBSIDY_LEVEL_COUNT 3
+
+/*
+    Tariffs as they are written in the configuration file
+*/
+typedef struct {
+    double cost_per_km;
+    double adult_ticket;
+    double student_ticket;
+    double senior_ticket;
+    double level_subsidy[SUBSIDY_LEVEL_COUNT + 1];          /* Subsidy per km, indexed by subsidy level */
+    int senior_ticket_levels[SUBSIDY_LEVEL_COUNT + 1];      /* 1 if seniors pay for the ticket on that subsidy level */
+} Tariff;
+
+/*
+    Precomputed per-level coefficients - the profitability of a bus line is simply
+        route_length * per_km + adults * adult_ticket + students * student_ticket + seniors * senior_ticket
+    with all the coefficients taken from the bus line's subsidy level.
+    Every coefficient is kept in its own small array indexed by level, index 0 holds the coefficients for
+    subsidy levels outside of 1-3 (no subsidy, seniors ride for free).
+*/
+typedef struct {
+    double per_km[SUBSIDY_LEVEL_COUNT + 1];                 /* Subsidy per km minus the cost per km */
+    double adult_ticket[SUBSIDY_LEVEL_COUNT + 1];
+    double student_ticket[SUBSIDY_LEVEL_COUNT + 1];
+    double senior_ticket[SUBSIDY_LEVEL_COUNT + 1];
+
+    /*
+        Exact (--exact) mode - the same coefficients as integers, see tariff_table_enable_exact
+    */
+    int exact;                                              /* 1 = calculate with the integer coefficients below */
+    int32_t exact_per_km[SUBSIDY_LEVEL_COUNT + 1];          /* Cents per km = milli-cents per metre */
+    int32_t exact_adult_ticket[SUBSIDY_LEVEL_COUNT + 1];    /* Milli-cents */
+    int32_t exact_student_ticket[SUBSIDY_LEVEL_COUNT + 1];
+    int32_t exact_senior_ticket[SUBSIDY_LEVEL_COUNT + 1];
+} TariffTable;
+
+/*
+    Exact mode works in milli-cents: tickets are converted to milli-cents and route lengths to whole metres,
+    so that every product and sum is an exact int64. The profitability of a bus line is then rounded to whole
+    cents (half away from zero) and stored as cents / 100.0 - the closest double to the amount in euros, which
+    is what the reports print. Totals are added up from those cents as integers, so they are exact, equal to
+    the sum of the printed rows and the same in any order.
+
+    A single bus line can't overflow: passenger counts are below 2^31 and every ticket is capped at
+    TARIFF_EXACT_MAX_TICKET_UNITS (2^27 milli-cents, 1342.17€), so each ticket product stays below 2^58. Route lengths
+    are at most MAX_ROUTE_LENGTH_KM (file_handler.h, 10^8 metres) and the per-km amounts at TARIFF_EXACT_MAX_PER_KM_UNITS
+    (2^27 milli-cents per metre), so the distance product stays below 2^54. A bus line is therefore below
+    3 * 2^58 + 2^54 milli-cents, i.e. below 2^50 cents.
+
+    Totals have no such bound - the number of bus lines isn't limited. They are added up with tariff_exact_add_cents,
+    which keeps them below TARIFF_EXACT_MAX_CENTS (2^50) and otherwise replaces them with TARIFF_EXACT_OVERFLOW. Below
+    2^50 cents an amount in euros is below 2^44, where doubles are at most 2^-9 apart - cents / 100.0 is within 1/1024€
+    of the exact amount, so it prints as the right cents and tariff_cents gets them back. The marker sticks through
+    every later addition, and whatever reports such a total fails with tariff_exact_overflow_error instead of
+    printing a wrong one.
+*/
+#define TARIFF_EXACT_UNITS_PER_CENT 1000
+#define TARIFF_EXACT_METRES_PER_KM 1000
+#define TARIFF_EXACT_MAX_TICKET_UNITS (1 << 27)
+#define TARIFF_EXACT_MAX_PER_KM_UNITS (1 << 27)
+#define TARIFF_EXACT_MAX_CENTS ((int64_t)1 << 50)
+#define TARIFF_EXACT_OVERFLOW INT64_MIN
+
+/*
+    Fills in the built-in default tariffs (the #defines above)
+*/
+void tariff_set_defaults(Tariff *tariff);
+
+/*
+    Turns the configured tariffs into the per-level coefficient table
+*/
+void tariff_table_build(const Tariff *tariff, TariffTable *table);
+
+/*
+    Switches a table built by tariff_table_build to exact mode
+    Returns 0 on success and -1 if a tariff is not a whole number of cents or too large for the integer
+    coefficients - a ticket above TARIFF_EXACT_MAX_TICKET_UNITS or a cost / subsidy per km that doesn't fit an
+    int32 in cents (the table is left unchanged in that case)
+*/
+int tariff_table_enable_exact(TariffTable *table);
+
+/*
+    The coefficient table used by calculate_profitability
+    Until tariff_table_set_active is called this is the table built from the default tariffs.
+*/
+void tariff_table_set_active(const TariffTable *table);
+const TariffTable *tariff_table_active(void);
+
+/*
+    Maps a subsidy level to its row in the coefficient table (out-of-range levels map to row 0) without branching
+*/
+static inline int tariff_level_index(int subsidy_level) {
+    return ((unsigned)(subsidy_level - 1) < SUBSIDY_LEVEL_COUNT) ? subsidy_level : 0;
+}
+
+/*
+    Exact mode helpers
+    Route length in km (at most MAX_ROUTE_LENGTH_KM) -> whole metres, half away from zero
+*/
+static inline int64_t tariff_exact_metres(double route_length) {
+    double metres = route_length * TARIFF_EXACT_METRES_PER_KM;
+    return (int64_t)(metres + (metres < 0 ? -0.5 : 0.5));
+}
+
+/*
+    1 if a route length is a whole number of metres (up to the rounding of the parsed decimal) - exact mode
+    rejects route lengths with more than 3 decimals instead of rounding them
+*/
+static inline int tariff_exact_whole_metres(double route_length) {
+    double error = route_length * TARIFF_EXACT_METRES_PER_KM - (double)tariff_exact_metres(route_length);
+    return error < 1e-6 && error > -1e-6;
+}
+
+/*
+    Milli-cents -> euros rounded to whole cents, half away from zero (the rounding is done on the integer)
+*/
+static inline double tariff_exact_euros(int64_t units) {
+    int64_t half = TARIFF_EXACT_UNITS_PER_CENT / 2;
+    int64_t cents = (units + (units < 0 ? -half : half)) / TARIFF_EXACT_UNITS_PER_CENT;
+    return (double)cents / 100.0;
+}
+
+/*
+    Whole cents of an amount that is a multiple of a cent - the inverse of the above, only meant for exact mode
+    results and totals (exact below TARIFF_EXACT_MAX_CENTS, any other amount could even be too large for an int64)
+*/
+static inline int64_t tariff_cents(double euros) {
+    double cents = euros * 100.0;
+    return (int64_t)(cents + (cents < 0 ? -0.5 : 0.5));
+}
+
+/*
+    Adds whole cents to an exact total - see above for the overflow marker
+*/
+static inline void tariff_exact_add_cents(int64_t *total, int64_t cents) {
+    if(*total == TARIFF_EXACT_OVERFLOW || cents == TARIFF_EXACT_OVERFLOW) {
+        *total = TARIFF_EXACT_OVERFLOW;
+        return;
+    }
+
+    int64_t sum = *total + cents;     /* Both are below 2^50 in magnitude, so this can't overflow */
+    *total = (sum < TARIFF_EXACT_MAX_CENTS && sum > -TARIFF_EXACT_MAX_CENTS) ? sum : TARIFF_EXACT_OVERFLOW;
+}
+
+/*
+    Prints the error for a total that is too large for exact mode
+*/
+void tariff_exact_overflow_error(void);
+
+#endif // TARIFF_H
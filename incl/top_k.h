@@ -0,0 +1,44 @@
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "bus_line_handler.h"
+
+/*
+    Picks the top_k most profitable and the bottom_k least profitable bus lines of every subsidy level
+    in a single pass over the rows, using one bounded heap per level and direction - O(n log k) instead
+    of sorting everything. Equal profitabilities are ranked by row position, the same way as the stable
+    full sort would order them, so the selection is deterministic.
+    Rows that are both in the top and in the bottom of a small level are only selected once.
+
+    Param 1 - bus_lines are the rows with their profitability already calculated
+    Param 2 - count is the number of rows
+    Param 3, 4 - top_k / bottom_k are the number of rows to pick from each end of every level (0 = none)
+    Param 5 - selection receives a malloc'ed array of the selected row indices in ascending order (free it)
+    Param 6 - selected_count receives the number of selected rows
+    Returns 0 on success, -1 on allocation failure
+*/
+int top_k_select(const BusLineProperties *bus_lines, size_t count, size_t top_k, size_t bottom_k,
+                 size_t **selection, size_t *selected_count);
+
+/*
+    Same as top_k_select, but only the rows listed in candidates (e.g. the rows that passed --where) compete
+    Param 2 - candidates holds row indices in ascending order (NULL = every row)
+    Param 3 - count is the number of indices in candidates
+    Param 6 - arena that the selection is allocated from (NULL = malloc, the caller frees it)
+    The selection receives row indices (not positions in candidates)
+*/
+int top_k_select_from(const BusLineProperties *bus_lines, const size_t *candidates, size_t count,
+                      size_t top_k, size_t bottom_k, Arena *arena, size_t **selection, size_t *selected_count);
+
+/*
+    Same selection as top_k_select, but copies the selected rows out (in their original order)
+    Param 5 - arena that the copies are allocated from (NULL = malloc, the caller frees them)
+    Param 6 - selected_lines receives the array of the selected rows
+    Returns 0 on success, -1 on allocation failure
+*/
+int top_k_select_rows(const BusLineProperties *bus_lines, size_t count, size_t top_k, size_t bottom_k, Arena *arena,
+                      BusLineProperties **selected_lines, size_t *selected_count);
+
+#endif // TOP_K_H
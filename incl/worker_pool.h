@@ -0,0 +1,23 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+
+/*
+    A task is identified by its index - the context pointer is shared by all tasks of one run
+*/
+typedef void (*WorkerTask)(size_t task_index, void *context);
+
+/*
+    Returns the number of online CPUs (at least 1) - used whenever the thread count is configured as 0 (auto)
+*/
+unsigned worker_pool_default_threads(void);
+
+/*
+    Runs task_count tasks on up to thread_count threads (the calling thread is one of them) and returns once
+    all of them have finished. Tasks are handed out in index order, but may finish in any order.
+    If threads cannot be created, the remaining tasks simply run on fewer threads.
+*/
+void worker_pool_run(unsigned thread_count, size_t task_count, WorkerTask task, void *context);
+
+#endif // WORKER_POOL_H
@@ -1,33 +1,213 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+#include "batch_mode.h"
+#include "bus_line_aggregator.h"
+#include "bus_line_cache.h"
 #include "bus_line_handler.h"
+#include "bus_line_index.h"
+#include "bus_line_store.h"
+#include "compressed_input.h"
 #include "file_handler.h"
+#include "follow_mode.h"
+#include "group_by.h"
+#include "row_filter.h"
+#include "run_stats.h"
 #include "runtime_configuration_handler.h"
+#include "serve_mode.h"
+#include "sort_engine.h"
+#include "tariff.h"
+#include "top_k.h"
 
-int main(int argc, char** argv) {
-    FileSettings settings;
-    cli_argument_handler(argc, argv, &settings);
-    runtime_config_load_handler(&settings, "config.txt");
+typedef struct {
+    BusLineAggregator aggregator;
+    const RowFilter *filter;
+} SummaryOnlyContext;
+
+/*
+    Streaming mode visitor - every bus line is calculated, added to the totals (if it passes --where) and forgotten
+*/
+static void aggregate_bus_line(BusLineProperties *bus_line, void *context) {
+    SummaryOnlyContext *summary_context = (SummaryOnlyContext *)context;
+
+    calculate_profitability(bus_line, 1);
+    if(row_filter_matches(summary_context->filter, bus_line)) bus_line_aggregator_add(&summary_context->aggregator, bus_line);
+}
+
+static int run_summary_only(const FileSettings *settings) {
+    SummaryOnlyContext context = { .filter = &settings->where_filter };
+    BusLineAggregator *aggregator = &context.aggregator;
+    bus_line_aggregator_init(aggregator);
+
+    run_stats_phase_begin(STATS_PHASE_LOAD);
+    int64_t read_count = read_handler_stream(settings->input_file, aggregate_bus_line, &context);
+    run_stats_phase_end(STATS_PHASE_LOAD);
+    if (read_count <= 0) {
+        fprintf(stderr, "[!!] FATAL Error: No valid data found in input file '%s'.\n", settings->input_file);
+        return EXIT_FAILURE;
+    }
+
+    BusLineSummary totals;
+    bus_line_aggregator_total(aggregator, &totals);
+    if(totals.exact_overflow) {
+        tariff_exact_overflow_error();
+        return EXIT_FAILURE;
+    }
+
+    if(settings->stdout_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_DISPLAY);
+        printf("[*] Processing file: %s\n", settings->input_file);
+        printf("[+] Found %lld valid bus lines\n\n", (long long)read_count);
+        write_summary_handler("-", aggregator);
+        run_stats_phase_end(STATS_PHASE_DISPLAY);
+    }
+
+    if(settings->file_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_WRITE);
+        int status = write_summary_handler(settings->output_file, aggregator);
+        run_stats_phase_end(STATS_PHASE_WRITE);
+
+        if(status != 0) return EXIT_FAILURE;
+        printf("\n[+] Results saved to : %s\n", settings->output_file);
+    }
+
+    printf("[+] All done. Exiting...\n");
+    return EXIT_SUCCESS;
+}
+
+/*
+    --group-by - the report lists the totals per group instead of the bus lines
+*/
+static int report_groups(const FileSettings *settings, const BusLineProperties *bus_lines, const size_t *selection, size_t count) {
+    GroupTable groups;
+
+    run_stats_phase_begin(STATS_PHASE_GROUP_BY);
+    int status = group_by_selection(bus_lines, selection, count, &settings->group_spec, settings->thread_count, &groups);
+    run_stats_phase_end(STATS_PHASE_GROUP_BY);
+    if(status != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Not enough memory to group %zu bus lines.\n", count);
+        return EXIT_FAILURE;
+    }
+
+    if(settings->stdout_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_DISPLAY);
+        printf("[*] Processing file: %s\n", settings->input_file);
+        printf("[+] Found %zu %sbus lines in %zu groups\n\n", count, selection ? "matching " : "valid ", groups.count);
+        status = group_by_write_report("-", &groups);
+        run_stats_phase_end(STATS_PHASE_DISPLAY);
+    }
+
+    if(status == 0 && settings->file_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_WRITE);
+        status = group_by_write_report(settings->output_file, &groups);
+        run_stats_phase_end(STATS_PHASE_WRITE);
+        if(status == 0) printf("\n[+] Results saved to : %s\n", settings->output_file);
+    }
+
+    printf("[+] All done. Exiting...\n");
+    group_table_free(&groups);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+    The regular run - the whole input is loaded, analysed, sorted and reported
+*/
+static int run_analysis(const FileSettings *settings) {
+    /* All the memory of the run - rows, selection and sort scratch - comes from one arena and goes back at once */
+    Arena run_arena;
+    arena_init(&run_arena, 0, settings->huge_pages);
+
+    BusLineStore bus_lines_store;
+    bus_line_store_init_arena(&bus_lines_store, &run_arena, 0);
 
-    BusLineProperties bus_lines_input_data_buffer[MAX_BUS_LINES];
-    int line_count = read_handler(settings.input_file, bus_lines_input_data_buffer, MAX_BUS_LINES);
-    if (line_count <= 0) {
-        fprintf(stderr, "[!!] FATAL Error: No valid data found in input file '%s'.\n", settings.input_file);
+    /* --line / --lines only load the requested bus lines, finding none of them is a valid answer */
+    run_stats_phase_begin(STATS_PHASE_LOAD);
+    int64_t read_count = settings->line_lookup
+        ? bus_line_index_read(settings->input_file, settings->first_line, settings->last_line, &bus_lines_store, settings->thread_count, settings->cache_enabled)
+        : bus_line_cache_read(settings->input_file, &bus_lines_store, settings->thread_count, settings->cache_enabled);
+    run_stats_phase_end(STATS_PHASE_LOAD);
+    if (read_count < 0 || (read_count == 0 && !settings->line_lookup)) {
+        fprintf(stderr, "[!!] FATAL Error: No valid data found in input file '%s'.\n", settings->input_file);
         exit(EXIT_FAILURE);
     }
-    
 
-    calculate_profitability(bus_lines_input_data_buffer, line_count);
-    sort_lines(bus_lines_input_data_buffer, line_count);
+    BusLineProperties *bus_lines_input_data_buffer = bus_lines_store.lines;
+    size_t line_count = bus_lines_store.count;
 
-    if(settings.stdout_output_enabled) {
-        printf("[*] Processing file: %s\n", settings.input_file);
-        printf("[+] Found %d valid bus lines\n\n", line_count);
-        display_result_handler(bus_lines_input_data_buffer, line_count);
+    run_stats_phase_begin(STATS_PHASE_PROFITABILITY);
+    calculate_profitability_parallel(bus_lines_input_data_buffer, line_count, settings->thread_count);
+    run_stats_phase_end(STATS_PHASE_PROFITABILITY);
 
-        double total_pl = 0.0;
-        for(int i = 0; i < line_count; ++i) total_pl += bus_lines_input_data_buffer[i].profitability;
+    /*
+        --where - the later phases only get the indices of the matching rows (selection = NULL = every row),
+        the rows themselves stay where they are
+    */
+    size_t *selection = NULL;
+    size_t selected_count = line_count;
+
+    if(settings->where_filter.op_count > 0) {
+        run_stats_phase_begin(STATS_PHASE_FILTER);
+        if(row_filter_select(&settings->where_filter, bus_lines_input_data_buffer, line_count, settings->thread_count, &run_arena, &selection, &selected_count) != 0) {
+            fprintf(stderr, "[!!] FATAL Error: Not enough memory to filter %zu bus lines.\n", line_count);
+            exit(EXIT_FAILURE);
+        }
+        run_stats_phase_end(STATS_PHASE_FILTER);
+    }
+
+    if(settings->group_spec.key_count > 0) {
+        int status = report_groups(settings, bus_lines_input_data_buffer, selection, selected_count);
+        arena_release(&run_arena);
+        return status;
+    }
+
+    /* The totals always cover every bus line that passed the filter, even if only some of them end up in the report */
+    BusLineSummary summary;
+    run_stats_phase_begin(STATS_PHASE_SUMMARY);
+    summarize_profitability_selection(bus_lines_input_data_buffer, selection, selected_count, settings->thread_count, &summary);
+    run_stats_phase_end(STATS_PHASE_SUMMARY);
+    if(summary.exact_overflow) {
+        tariff_exact_overflow_error();
+        exit(EXIT_FAILURE);
+    }
+
+    size_t *report_rows = selection;
+    size_t report_count = selected_count;
+    size_t *top_k_rows = NULL;
+
+    if(settings->top_k > 0 || settings->bottom_k > 0) {
+        run_stats_phase_begin(STATS_PHASE_SELECTION);
+        if(top_k_select_from(bus_lines_input_data_buffer, selection, selected_count, settings->top_k, settings->bottom_k, &run_arena, &top_k_rows, &report_count) != 0) {
+            fprintf(stderr, "[!!] FATAL Error: Not enough memory to select the top/bottom bus lines.\n");
+            exit(EXIT_FAILURE);
+        }
+        run_stats_phase_end(STATS_PHASE_SELECTION);
+
+        report_rows = top_k_rows;
+    }
+
+    /* Without a selection the rows are sorted in place, otherwise only the selected indices are */
+    run_stats_phase_begin(STATS_PHASE_SORT);
+    int sort_status = report_rows == NULL
+        ? sort_engine_sort_arena(bus_lines_input_data_buffer, report_count, &settings->sort_spec, &run_arena)
+        : sort_engine_order_arena(bus_lines_input_data_buffer, report_rows, report_count, &settings->sort_spec, &run_arena);
+    if(sort_status != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Not enough memory to sort %zu bus lines.\n", report_count);
+        exit(EXIT_FAILURE);
+    }
+    run_stats_phase_end(STATS_PHASE_SORT);
+
+    if(settings->stdout_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_DISPLAY);
+        printf("[*] Processing file: %s\n", settings->input_file);
+        if(!settings->line_lookup) printf("[+] Found %zu valid bus lines\n\n", line_count);
+        else if(settings->first_line == settings->last_line) printf("[+] Found %zu bus lines with line number %d\n\n", line_count, (int)settings->first_line);
+        else printf("[+] Found %zu bus lines with line numbers %d-%d\n\n", line_count, (int)settings->first_line, (int)settings->last_line);
+        if(selection != NULL) printf("[+] %zu of them match the filter\n\n", selected_count);
+        if(top_k_rows != NULL) printf("[+] Showing %zu of them (top %zu / bottom %zu of each subsidy level)\n\n", report_count, settings->top_k, settings->bottom_k);
+        display_result_handler_selection(bus_lines_input_data_buffer, report_rows, report_count);
+
+        double total_pl = summary.total_profit;
 
         printf("\n------------------------------------------------------------------\n");
         printf("TOTAL P/L: %s %.2f€\n", 
@@ -35,11 +215,52 @@ int main(int argc, char** argv) {
                total_pl);
         printf("------------------------------------------------------------------\n");
 
-        if (settings.file_output_enabled) printf("\n[+] Bus Line Profitability Analysis Complete.\n[*] Savings Results to : %s\n\n", settings.output_file);
+        if (settings->file_output_enabled) printf("\n[+] Bus Line Profitability Analysis Complete.\n[*] Savings Results to : %s\n\n", settings->output_file);
+        run_stats_phase_end(STATS_PHASE_DISPLAY);
     }
 
-    if(settings.file_output_enabled) write_handler(settings.output_file, bus_lines_input_data_buffer, line_count);
-    printf("\n[+] Results saved to : %s\n[+] All done. Exiting...\n", settings.output_file);
+    if(settings->file_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_WRITE);
+        write_handler_selection(settings->output_file, bus_lines_input_data_buffer, report_rows, report_count, &summary);
+        run_stats_phase_end(STATS_PHASE_WRITE);
+    }
+    printf("\n[+] Results saved to : %s\n[+] All done. Exiting...\n", settings->output_file);
 
+    arena_release(&run_arena);
     return 0;
 }
+
+int main(int argc, char** argv) {
+    FileSettings settings;
+    runtime_config_load_handler(&settings, "config.txt");
+    cli_argument_handler(argc, argv, &settings);
+
+    if(settings.stats_enabled) run_stats_enable();
+
+    TariffTable tariff_table;
+    tariff_table_build(&settings.tariff, &tariff_table);
+    if(settings.exact && tariff_table_enable_exact(&tariff_table) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: --exact needs every tariff to be a whole number of cents (tickets up to 1342.17€, per km amounts up to 1342177.27€).\n");
+        return EXIT_FAILURE;
+    }
+    tariff_table_set_active(&tariff_table);
+
+    compressed_input_set_tool_path(COMPRESSION_GZIP, settings.gzip_path);
+    compressed_input_set_tool_path(COMPRESSION_ZSTD, settings.zstd_path);
+
+    int status;
+    if(settings.batch_path[0] != '\0') {
+        status = batch_mode_run(&settings);
+    } else if(settings.serve_socket[0] != '\0') {
+        status = serve_mode_run(&settings);
+    } else if(settings.follow) {
+        status = follow_mode_run(&settings);
+    } else if(settings.summary_only) {
+        status = run_summary_only(&settings);
+    } else {
+        status = run_analysis(&settings);
+    }
+
+    if(settings.stats_enabled && run_stats_write(settings.stats_file) != 0 && status == EXIT_SUCCESS) status = EXIT_FAILURE;
+    return status;
+}
@@ -0,0 +1,167 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "run_stats.h"
+
+/*
+    Alignment used when the caller doesn't ask for one - enough for any of the basic types
+*/
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;                /* Mapped bytes, this header included */
+    size_t used;                /* Bytes in use, counted from the start of the block */
+    int dedicated;              /* 1 = the block holds a single large allocation */
+};
+
+static uintptr_t align_up(uintptr_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+void arena_init(Arena *arena, size_t block_bytes, int huge_pages) {
+    arena->blocks = NULL;
+    arena->current = NULL;
+    arena->block_bytes = block_bytes ? block_bytes : ARENA_DEFAULT_BLOCK_BYTES;
+    arena->huge_pages = huge_pages;
+    arena->reserved_bytes = 0;
+}
+
+static ArenaBlock *map_block(Arena *arena, size_t bytes, int dedicated) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    int huge = arena->huge_pages && bytes >= ARENA_HUGE_PAGE_BYTES;
+    size_t granularity = huge ? ARENA_HUGE_PAGE_BYTES : page;
+
+    if(bytes > SIZE_MAX - granularity) return NULL;
+    bytes = (size_t)align_up(bytes, granularity);
+
+    void *mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED) return NULL;
+
+#ifdef MADV_HUGEPAGE
+    if(huge) madvise(mapping, bytes, MADV_HUGEPAGE);
+#endif
+
+    ArenaBlock *block = mapping;
+    block->size = bytes;
+    block->used = sizeof(ArenaBlock);
+    block->dedicated = dedicated;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->reserved_bytes += bytes;
+
+    run_stats_allocation(bytes);
+    return block;
+}
+
+/*
+    Bumps size bytes out of the block - returns NULL if they don't fit
+*/
+static void *bump(ArenaBlock *block, size_t size, size_t alignment) {
+    uintptr_t base = (uintptr_t)block;
+    uintptr_t start = align_up(base + block->used, alignment);
+
+    if(start - base > block->size || size > block->size - (start - base)) return NULL;
+
+    block->used = (size_t)(start - base) + size;
+    return (void *)start;
+}
+
+void *arena_alloc(Arena *arena, size_t size, size_t alignment) {
+    if(alignment == 0) alignment = ARENA_DEFAULT_ALIGNMENT;
+    if(size == 0) size = 1;
+
+    if(arena->current != NULL) {
+        void *memory = bump(arena->current, size, alignment);
+        if(memory != NULL) return memory;
+    }
+
+    /* Header, worst case padding and the allocation itself */
+    size_t overhead = sizeof(ArenaBlock) + alignment;
+    if(size > SIZE_MAX - overhead) return NULL;
+
+    if(size > arena->block_bytes / 2) {
+        ArenaBlock *block = map_block(arena, size + overhead, 1);
+        return block ? bump(block, size, alignment) : NULL;
+    }
+
+    ArenaBlock *block = map_block(arena, arena->block_bytes > size + overhead ? arena->block_bytes : size + overhead, 0);
+    if(block == NULL) return NULL;
+
+    arena->current = block;
+    return bump(block, size, alignment);
+}
+
+static ArenaBlock *find_dedicated_block(const Arena *arena, const void *memory) {
+    for(ArenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+        if(block->dedicated && (uintptr_t)memory > (uintptr_t)block && (uintptr_t)memory < (uintptr_t)block + block->size) return block;
+    }
+    return NULL;
+}
+
+static void unmap_block(Arena *arena, ArenaBlock *block) {
+    ArenaBlock **link = &arena->blocks;
+    while(*link != block) link = &(*link)->next;
+    *link = block->next;
+
+    arena->reserved_bytes -= block->size;
+    munmap(block, block->size);
+}
+
+void *arena_grow(Arena *arena, void *memory, size_t old_size, size_t new_size, size_t alignment) {
+    if(memory == NULL) return arena_alloc(arena, new_size, alignment);
+    if(new_size <= old_size) return memory;
+
+    uintptr_t end = (uintptr_t)memory + old_size;
+    ArenaBlock *dedicated = find_dedicated_block(arena, memory);
+    ArenaBlock *owner = dedicated ? dedicated : arena->current;
+
+    /* Most recent allocation of its block - it can simply take more of the block if there is room */
+    if(owner != NULL && end == (uintptr_t)owner + owner->used && new_size - old_size <= owner->size - owner->used) {
+        owner->used += new_size - old_size;
+        return memory;
+    }
+
+    void *moved = arena_alloc(arena, new_size, alignment);
+    if(moved == NULL) return NULL;
+
+    memcpy(moved, memory, old_size);
+    if(dedicated != NULL) unmap_block(arena, dedicated);
+    return moved;
+}
+
+ArenaMark arena_mark(const Arena *arena) {
+    ArenaMark mark = { .blocks = arena->blocks, .current = arena->current,
+                       .current_used = arena->current ? arena->current->used : 0 };
+    return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    while(arena->blocks != NULL && arena->blocks != mark.blocks) {
+        ArenaBlock *block = arena->blocks;
+        arena->blocks = block->next;
+        arena->reserved_bytes -= block->size;
+        munmap(block, block->size);
+    }
+
+    arena->current = mark.current;
+    if(mark.current != NULL) mark.current->used = mark.current_used;
+}
+
+void arena_release(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while(block != NULL) {
+        ArenaBlock *next = block->next;
+        munmap(block, block->size);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->current = NULL;
+    arena->reserved_bytes = 0;
+}
@@ -0,0 +1,327 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include "batch_mode.h"
+#include "bus_line_cache.h"
+#include "bus_line_handler.h"
+#include "bus_line_store.h"
+#include "csv_scanner.h"
+#include "file_handler.h"
+#include "run_stats.h"
+#include "sort_engine.h"
+#include "top_k.h"
+#include "worker_pool.h"
+
+typedef struct {
+    const FileSettings *settings;
+    BatchFileList *list;
+} BatchJob;
+
+void batch_file_list_init(BatchFileList *list) {
+    list->files = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void batch_file_list_free(BatchFileList *list) {
+    for(size_t i = 0; i < list->count; ++i) {
+        free(list->files[i].input_file);
+        free(list->files[i].report_file);
+    }
+
+    free(list->files);
+    batch_file_list_init(list);
+}
+
+static int ends_with(const char *text, const char *suffix) {
+    size_t text_length = strlen(text), suffix_length = strlen(suffix);
+    return text_length >= suffix_length && strcmp(text + text_length - suffix_length, suffix) == 0;
+}
+
+/*
+    Files that the program writes itself - a second run over the same directory must not pick them up as input
+*/
+static int is_generated_file(const char *path) {
+    return ends_with(path, BUS_LINE_CACHE_SUFFIX) || ends_with(path, ".tmp") || ends_with(path, BATCH_REPORT_SUFFIX);
+}
+
+static int batch_file_list_add(BatchFileList *list, const char *path) {
+    if(list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        BatchFile *files = realloc(list->files, capacity * sizeof(BatchFile));
+        if(files == NULL) return -1;
+        list->files = files;
+        list->capacity = capacity;
+    }
+
+    BatchFile *file = &list->files[list->count];
+    memset(file, 0, sizeof(*file));
+    file->input_file = malloc(strlen(path) + 1);
+    file->report_file = malloc(strlen(path) + sizeof(BATCH_REPORT_SUFFIX));
+    if(file->input_file == NULL || file->report_file == NULL) {
+        free(file->input_file);
+        free(file->report_file);
+        return -1;
+    }
+
+    strcpy(file->input_file, path);
+    sprintf(file->report_file, "%s%s", path, BATCH_REPORT_SUFFIX);
+    bus_line_aggregator_init(&file->totals);
+    list->count++;
+    return 0;
+}
+
+/*
+    Adds the path if it is a regular file that isn't excluded - returns -1 only on allocation failure
+*/
+static int add_candidate(BatchFileList *list, const char *path, const struct stat *excluded) {
+    struct stat file_stat;
+    if(stat(path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || is_generated_file(path)) return 0;
+    if(excluded != NULL && file_stat.st_dev == excluded->st_dev && file_stat.st_ino == excluded->st_ino) return 0;
+
+    if(batch_file_list_add(list, path) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Out of memory while collecting the input files.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_batch_files(const void *a, const void *b) {
+    return strcmp(((const BatchFile *)a)->input_file, ((const BatchFile *)b)->input_file);
+}
+
+static int collect_directory(const char *directory, BatchFileList *list, const struct stat *excluded) {
+    DIR *dir = opendir(directory);
+    if(dir == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Could not open the directory '%s'.\n", directory);
+        return -1;
+    }
+
+    size_t first = list->count;
+    int status = 0;
+    struct dirent *entry;
+
+    while(status == 0 && (entry = readdir(dir)) != NULL) {
+        if(entry->d_name[0] == '.') continue;
+
+        char *path = malloc(strlen(directory) + strlen(entry->d_name) + 2);
+        if(path == NULL) {
+            fprintf(stderr, "[!!] FATAL Error: Out of memory while collecting the input files.\n");
+            status = -1;
+            break;
+        }
+
+        sprintf(path, "%s%s%s", directory, ends_with(directory, "/") ? "" : "/", entry->d_name);
+        status = add_candidate(list, path, excluded);
+        free(path);
+    }
+
+    closedir(dir);
+
+    /* readdir returns the entries in no particular order, glob already sorts its matches */
+    qsort(list->files + first, list->count - first, sizeof(BatchFile), compare_batch_files);
+    return status;
+}
+
+static int collect_glob(const char *pattern, BatchFileList *list, const struct stat *excluded) {
+    glob_t matches;
+    int result = glob(pattern, 0, NULL, &matches);
+
+    if(result == GLOB_NOMATCH) return 0;
+    if(result != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not expand the pattern '%s'.\n", pattern);
+        return -1;
+    }
+
+    int status = 0;
+    for(size_t i = 0; status == 0 && i < matches.gl_pathc; ++i) {
+        status = add_candidate(list, matches.gl_pathv[i], excluded);
+    }
+
+    globfree(&matches);
+    return status;
+}
+
+int64_t batch_collect_files(const char *path, const char *exclude_file, BatchFileList *list) {
+    struct stat path_stat, excluded_stat;
+    const struct stat *excluded = (exclude_file != NULL && stat(exclude_file, &excluded_stat) == 0) ? &excluded_stat : NULL;
+    size_t first = list->count;
+
+    int status = (stat(path, &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) ? collect_directory(path, list, excluded)
+                                                                              : collect_glob(path, list, excluded);
+    if(status != 0) return -1;
+
+    return (int64_t)(list->count - first);
+}
+
+/*
+    The whole single-file pipeline for one file of the batch - parsing, profitability, totals, selection, sorting
+    and the report. Runs single-threaded, the batch is parallel across the files instead.
+*/
+static void batch_file_task(size_t task_index, void *context) {
+    BatchJob *job = (BatchJob *)context;
+    const FileSettings *settings = job->settings;
+    BatchFile *file = &job->list->files[task_index];
+
+    /* One arena per file - everything of the file goes back in one go once its report is written */
+    Arena file_arena;
+    arena_init(&file_arena, 0, settings->huge_pages);
+
+    BusLineStore store;
+    bus_line_store_init_arena(&store, &file_arena, 0);
+
+    int64_t read_count = bus_line_cache_read(file->input_file, &store, 1, settings->cache_enabled);
+    if(read_count <= 0) {
+        file->status = -1;
+        file->failure = (read_count < 0) ? "could not be read" : "no valid bus lines";
+        arena_release(&file_arena);
+        return;
+    }
+
+    calculate_profitability_parallel(store.lines, store.count, 1);
+
+    BusLineSummary summary;
+    summarize_profitability(store.lines, store.count, 1, &summary);
+    if(summary.exact_overflow) {
+        file->status = -1;
+        file->failure = "the total is too large for --exact";
+        arena_release(&file_arena);
+        return;
+    }
+    for(size_t i = 0; i < store.count; ++i) bus_line_aggregator_add(&file->totals, &store.lines[i]);
+
+    BusLineProperties *report_lines = store.lines;
+    size_t report_count = store.count;
+
+    if((settings->top_k > 0 || settings->bottom_k > 0) &&
+       top_k_select_rows(store.lines, store.count, settings->top_k, settings->bottom_k, &file_arena, &report_lines, &report_count) != 0) {
+        file->status = -1;
+        file->failure = "out of memory";
+    } else if(sort_engine_sort_arena(report_lines, report_count, &settings->sort_spec, &file_arena) != 0) {
+        file->status = -1;
+        file->failure = "out of memory";
+    } else if(settings->file_output_enabled && write_handler(file->report_file, report_lines, report_count, &summary) != 0) {
+        file->status = -1;
+        file->failure = "the report could not be written";
+    }
+
+    arena_release(&file_arena);
+}
+
+size_t batch_process_files(const FileSettings *settings, BatchFileList *list) {
+    BatchJob job = { .settings = settings, .list = list };
+
+    /* The scanner kernel is picked once up front rather than by whichever file gets there first */
+    csv_scanner_init();
+
+    worker_pool_run(settings->thread_count, list->count, batch_file_task, &job);
+
+    size_t failed = 0;
+    for(size_t i = 0; i < list->count; ++i) failed += (list->files[i].status != 0);
+    return failed;
+}
+
+int batch_write_report(const char *filename, const BatchFileList *list) {
+    int to_stdout = (strcmp(filename, "-") == 0);
+    FILE *file = to_stdout ? stdout : fopen(filename, "w");
+    if(file == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Could not open the output file '%s'.\n", filename);
+        return -1;
+    }
+
+    BusLineAggregator combined;
+    bus_line_aggregator_init(&combined);
+    size_t failed = 0;
+
+    fprintf(file, "--------------------------------------------------------------------\n");
+    fprintf(file, "                BUS LINES' BATCH PROFITABILITY REPORT                \n");
+    fprintf(file, "--------------------------------------------------------------------\n\n");
+
+    for(size_t i = 0; i < list->count; ++i) {
+        const BatchFile *batch_file = &list->files[i];
+
+        if(batch_file->status != 0) {
+            fprintf(file, "%s: FAILED (%s)\n", batch_file->input_file, batch_file->failure);
+            failed++;
+            continue;
+        }
+
+        BusLineSummary summary;
+        bus_line_aggregator_total(&batch_file->totals, &summary);
+        fprintf(file, "%s: %zu lines (%zu profitable, %zu unprofitable), P/L %s%.2f€\n",
+            batch_file->input_file,
+            summary.line_count,
+            summary.profitable_lines,
+            summary.unprofitable_lines,
+            (summary.total_profit >= 0) ? "+" : "",
+            summary.total_profit);
+
+        /* Merged in file order, so the combined totals are the same however the files were scheduled */
+        bus_line_aggregator_merge(&combined, &batch_file->totals);
+    }
+
+    fprintf(file, "\nFiles analysed: %zu, failed: %zu\n\n", list->count - failed, failed);
+    int status = print_summary_handler(file, &combined);
+
+    if(to_stdout) {
+        fflush(file);
+        return status;
+    }
+
+    if(fclose(file) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not write the output file '%s'.\n", filename);
+        return -1;
+    }
+    return status;
+}
+
+int batch_mode_run(const FileSettings *settings) {
+    BatchFileList list;
+    batch_file_list_init(&list);
+
+    int64_t file_count = batch_collect_files(settings->batch_path, settings->file_output_enabled ? settings->output_file : NULL, &list);
+    if(file_count <= 0) {
+        if(file_count == 0) fprintf(stderr, "[!!] FATAL Error: No input files found in '%s'.\n", settings->batch_path);
+        batch_file_list_free(&list);
+        return EXIT_FAILURE;
+    }
+
+    if(settings->stdout_output_enabled) printf("[*] Processing %lld files from: %s\n", (long long)file_count, settings->batch_path);
+
+    run_stats_phase_begin(STATS_PHASE_BATCH);
+    size_t failed = batch_process_files(settings, &list);
+    run_stats_phase_end(STATS_PHASE_BATCH);
+
+    int display_status = 0;
+    if(settings->stdout_output_enabled) {
+        printf("\n");
+        display_status = batch_write_report("-", &list);
+    }
+
+    int status = (failed == 0 && display_status == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if(settings->file_output_enabled) {
+        run_stats_phase_begin(STATS_PHASE_WRITE);
+        int write_status = batch_write_report(settings->output_file, &list);
+        run_stats_phase_end(STATS_PHASE_WRITE);
+
+        if(write_status != 0) {
+            status = EXIT_FAILURE;
+        } else {
+            printf("\n[+] Per-file reports saved next to the input files (*%s)\n", BATCH_REPORT_SUFFIX);
+            printf("[+] Merged report saved to : %s\n", settings->output_file);
+        }
+    }
+
+    if(failed > 0) fprintf(stderr, "[!] Warning : %zu of %lld files could not be analysed.\n", failed, (long long)file_count);
+    printf("[+] All done. Exiting...\n");
+
+    batch_file_list_free(&list);
+    return status;
+}
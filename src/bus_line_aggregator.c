@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include "bus_line_aggregator.h"
+
+void bus_line_aggregator_init(BusLineAggregator *aggregator) {
+    memset(aggregator, 0, sizeof(*aggregator));
+}
+
+/*
+    Neumaier's variant of Kahan summation - the low-order bits lost by each addition are collected separately
+*/
+static double magnitude(double value) {
+    return value < 0 ? -value : value;
+}
+
+void bus_line_compensated_add(double *sum, double *compensation, double value) {
+    double total = *sum + value;
+
+    if(magnitude(*sum) >= magnitude(value)) {
+        *compensation += (*sum - total) + value;
+    } else {
+        *compensation += (value - total) + *sum;
+    }
+
+    *sum = total;
+}
+
+void bus_line_aggregator_add(BusLineAggregator *aggregator, const BusLineProperties *bus_line) {
+    int level = tariff_level_index(bus_line->subsidy_level);
+
+    aggregator->line_count[level]++;
+    aggregator->profitable_lines[level] += (bus_line->profitability >= 0);
+    bus_line_compensated_add(&aggregator->profit[level], &aggregator->profit_compensation[level], bus_line->profitability);
+    if(tariff_table_active()->exact) tariff_exact_add_cents(&aggregator->profit_cents[level], tariff_cents(bus_line->profitability));
+}
+
+void bus_line_aggregator_merge(BusLineAggregator *aggregator, const BusLineAggregator *other) {
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        aggregator->line_count[level] += other->line_count[level];
+        aggregator->profitable_lines[level] += other->profitable_lines[level];
+        bus_line_compensated_add(&aggregator->profit[level], &aggregator->profit_compensation[level], other->profit[level]);
+        bus_line_compensated_add(&aggregator->profit[level], &aggregator->profit_compensation[level], other->profit_compensation[level]);
+        tariff_exact_add_cents(&aggregator->profit_cents[level], other->profit_cents[level]);
+    }
+}
+
+/*
+    Exact mode total of a summary - flagged instead of converted if it got too large
+*/
+static void exact_total(int64_t cents, BusLineSummary *summary) {
+    summary->exact_overflow = (cents == TARIFF_EXACT_OVERFLOW);
+    summary->total_profit = summary->exact_overflow ? 0.0 : (double)cents / 100.0;
+}
+
+void bus_line_aggregator_level(const BusLineAggregator *aggregator, int subsidy_level, BusLineSummary *summary) {
+    int level = tariff_level_index(subsidy_level);
+
+    memset(summary, 0, sizeof(*summary));
+    summary->line_count = aggregator->line_count[level];
+    summary->profitable_lines = aggregator->profitable_lines[level];
+    summary->unprofitable_lines = aggregator->line_count[level] - aggregator->profitable_lines[level];
+    summary->total_profit = aggregator->profit[level] + aggregator->profit_compensation[level];
+    if(tariff_table_active()->exact) exact_total(aggregator->profit_cents[level], summary);
+}
+
+void bus_line_aggregator_total(const BusLineAggregator *aggregator, BusLineSummary *summary) {
+    double sum = 0.0, compensation = 0.0;
+    int64_t cents = 0;
+
+    memset(summary, 0, sizeof(*summary));
+
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        summary->line_count += aggregator->line_count[level];
+        summary->profitable_lines += aggregator->profitable_lines[level];
+        bus_line_compensated_add(&sum, &compensation, aggregator->profit[level]);
+        bus_line_compensated_add(&sum, &compensation, aggregator->profit_compensation[level]);
+        tariff_exact_add_cents(&cents, aggregator->profit_cents[level]);
+    }
+
+    summary->unprofitable_lines = summary->line_count - summary->profitable_lines;
+    summary->total_profit = sum + compensation;
+    if(tariff_table_active()->exact) exact_total(cents, summary);
+}
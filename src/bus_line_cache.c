@@ -0,0 +1,411 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bus_line_cache.h"
+#include "file_handler.h"
+#include "run_stats.h"
+#include "tariff.h"
+
+#define CACHE_MAGIC "BLCACHE"
+#define CACHE_BYTE_ORDER_MARK 0x01020304u
+#define CACHE_ALIGNMENT 64
+
+/*
+    Rows per write when the columns are written out
+*/
+#define CACHE_WRITE_BATCH_ROWS 4096
+
+enum {
+    CACHE_COLUMN_LINE_NUMBER,
+    CACHE_COLUMN_DEPARTURE_TIME,
+    CACHE_COLUMN_SUBSIDY_LEVEL,
+    CACHE_COLUMN_ADULTS,
+    CACHE_COLUMN_STUDENTS,
+    CACHE_COLUMN_SENIORS,
+    CACHE_COLUMN_ROUTE_LENGTH,
+    CACHE_COLUMN_COUNT
+};
+
+static const uint64_t column_element_bytes[CACHE_COLUMN_COUNT] = {
+    sizeof(int32_t), sizeof(uint16_t), sizeof(int32_t), sizeof(int32_t), sizeof(int32_t), sizeof(int32_t), sizeof(double)
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t header_bytes;
+    uint64_t row_count;
+    BusLineCacheSource source;
+    uint64_t exact_rows;            /* 1 = the rows were validated with the stricter route lengths of exact mode */
+    uint64_t column_offset[CACHE_COLUMN_COUNT];
+    uint64_t column_element_bytes[CACHE_COLUMN_COUNT];
+} CacheHeader;
+
+static uint64_t align_up(uint64_t value) {
+    return (value + CACHE_ALIGNMENT - 1) & ~(uint64_t)(CACHE_ALIGNMENT - 1);
+}
+
+/*
+    Hash of the whole source file - a 64-bit multiply-xorshift over 8-byte words, fast enough to run at close to the
+    speed of reading the file (much faster than parsing it). The last partial word is zero padded, the size is
+    part of the identity anyway.
+*/
+static uint64_t hash_words(uint64_t hash, const unsigned char *data, size_t size) {
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * UINT64_C(0x9e3779b97f4a7c15);
+        hash ^= hash >> 32;
+    }
+
+    if(i < size) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        hash = (hash ^ word) * UINT64_C(0x9e3779b97f4a7c15);
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+static int hash_file(int fd, uint64_t size, uint64_t *hash) {
+    *hash = UINT64_C(0xcbf29ce484222325);
+    if(size == 0) return 0;
+    if(size > SIZE_MAX) return -1;
+
+    void *mapping = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) return -1;
+
+    posix_madvise(mapping, (size_t)size, POSIX_MADV_SEQUENTIAL);
+    *hash = hash_words(*hash, mapping, (size_t)size);
+
+    munmap(mapping, (size_t)size);
+    return 0;
+}
+
+static void identity_from_stat(const struct stat *file_stat, BusLineCacheSource *source) {
+    source->device = (uint64_t)file_stat->st_dev;
+    source->inode = (uint64_t)file_stat->st_ino;
+    source->size = (uint64_t)file_stat->st_size;
+    source->mtime_sec = (int64_t)file_stat->st_mtim.tv_sec;
+    source->mtime_nsec = (int64_t)file_stat->st_mtim.tv_nsec;
+    source->ctime_sec = (int64_t)file_stat->st_ctim.tv_sec;
+    source->ctime_nsec = (int64_t)file_stat->st_ctim.tv_nsec;
+}
+
+static int same_attributes(const BusLineCacheSource *x, const BusLineCacheSource *y) {
+    return x->device == y->device && x->inode == y->inode && x->size == y->size &&
+           x->mtime_sec == y->mtime_sec && x->mtime_nsec == y->mtime_nsec &&
+           x->ctime_sec == y->ctime_sec && x->ctime_nsec == y->ctime_nsec;
+}
+
+int bus_line_cache_identify(const char *source_file, BusLineCacheSource *source) {
+    struct stat file_stat;
+    if(stat(source_file, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return -1;
+
+    memset(source, 0, sizeof(*source));
+    identity_from_stat(&file_stat, source);
+    return 0;
+}
+
+int bus_line_cache_hash(const char *source_file, BusLineCacheSource *source) {
+    int fd = open(source_file, O_RDONLY);
+    if(fd < 0) return -1;
+
+    struct stat file_stat;
+    BusLineCacheSource current = *source;
+    int status = (fstat(fd, &file_stat) == 0) ? 0 : -1;
+    if(status == 0) identity_from_stat(&file_stat, &current);
+
+    if(status == 0 && same_attributes(&current, source) && hash_file(fd, source->size, &source->hash) == 0) source->hashed = 1;
+    else status = -1;
+
+    close(fd);
+    return status;
+}
+
+int bus_line_cache_source_check(int recorded_fd, size_t recorded_offset, const BusLineCacheSource *recorded,
+                                const char *source_file, BusLineCacheSource *source) {
+    struct stat file_stat;
+    if(fstat(recorded_fd, &file_stat) != 0) return 0;
+
+    int racy = recorded->ctime_sec > (int64_t)file_stat.st_mtim.tv_sec ||
+               (recorded->ctime_sec == (int64_t)file_stat.st_mtim.tv_sec && recorded->ctime_nsec >= (int64_t)file_stat.st_mtim.tv_nsec);
+    if(!racy && same_attributes(recorded, source)) return 1;
+
+    if(!source->hashed && bus_line_cache_hash(source_file, source) != 0) return 0;
+    if(recorded->size != source->size || recorded->hash != source->hash) return 0;
+
+    /* Best effort - a cache that can't be written (opened read-only) just keeps taking this path */
+    ssize_t written = pwrite(recorded_fd, source, sizeof(*source), (off_t)recorded_offset);
+    (void)written;
+    return 1;
+}
+
+int bus_line_cache_path(const char *source_file, char *path, size_t path_size) {
+    int length = snprintf(path, path_size, "%s%s", source_file, BUS_LINE_CACHE_SUFFIX);
+    return (length < 0 || (size_t)length >= path_size) ? -1 : 0;
+}
+
+/*
+    Everything the loader relies on - a cache that fails any of these checks is simply ignored
+*/
+static int header_is_usable(const CacheHeader *header, size_t file_size) {
+    if(memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0) return 0;
+    if(header->version != BUS_LINE_CACHE_VERSION || header->byte_order != CACHE_BYTE_ORDER_MARK) return 0;
+    if(header->header_bytes != sizeof(CacheHeader)) return 0;
+
+    if(header->exact_rows != (uint64_t)tariff_table_active()->exact) return 0;
+
+    for(int column = 0; column < CACHE_COLUMN_COUNT; ++column) {
+        uint64_t offset = header->column_offset[column];
+        uint64_t element_bytes = header->column_element_bytes[column];
+
+        if(element_bytes != column_element_bytes[column] || offset % CACHE_ALIGNMENT != 0 || offset < sizeof(CacheHeader)) return 0;
+        if(offset > file_size || header->row_count > (file_size - offset) / element_bytes) return 0;
+    }
+
+    return 1;
+}
+
+/*
+    Maps the cache of a source file - returns NULL if there is no usable one (see header_is_usable) or it doesn't
+    match the source file any more (see bus_line_cache_source_check)
+*/
+static const CacheHeader *map_cache(const char *source_file, BusLineCacheSource *source, size_t *file_size) {
+    char path[4096];
+    if(bus_line_cache_path(source_file, path, sizeof(path)) != 0) return NULL;
+
+    /* Writable if possible, so that the recorded identity can be brought up to date */
+    int fd = open(path, O_RDWR);
+    if(fd < 0) fd = open(path, O_RDONLY);
+    if(fd < 0) return NULL;
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    *file_size = (size_t)file_stat.st_size;
+    void *mapping = mmap(NULL, *file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    const CacheHeader *header = mapping;
+    int usable = header_is_usable(header, *file_size) && header->row_count <= SIZE_MAX &&
+                 bus_line_cache_source_check(fd, offsetof(CacheHeader, source), &header->source, source_file, source);
+    close(fd);
+
+    if(!usable) {
+        munmap(mapping, *file_size);
+        return NULL;
+    }
+    return mapping;
+}
+
+int64_t bus_line_cache_load(const char *source_file, BusLineCacheSource *source, BusLineStore *store) {
+    size_t file_size = 0;
+    const CacheHeader *header = map_cache(source_file, source, &file_size);
+    if(header == NULL) return -1;
+
+    const char *data = (const char *)header;
+    int64_t loaded = -1;
+
+    if(bus_line_store_reserve(store, store->count + (size_t)header->row_count) == 0) {
+        posix_madvise((void *)header, file_size, POSIX_MADV_SEQUENTIAL);
+
+        size_t count = (size_t)header->row_count;
+        const int32_t *line_number = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_LINE_NUMBER]);
+        const uint16_t *departure_minutes = (const uint16_t *)(data + header->column_offset[CACHE_COLUMN_DEPARTURE_TIME]);
+        const int32_t *subsidy_level = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_SUBSIDY_LEVEL]);
+        const int32_t *adult = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_ADULTS]);
+        const int32_t *student = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_STUDENTS]);
+        const int32_t *senior = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_SENIORS]);
+        const double *route_length = (const double *)(data + header->column_offset[CACHE_COLUMN_ROUTE_LENGTH]);
+
+        BusLineProperties *lines = store->lines + store->count;
+        for(size_t i = 0; i < count; ++i) {
+            lines[i].line_number = line_number[i];
+            lines[i].departure_minutes = departure_minutes[i];
+            lines[i].subsidy_level = subsidy_level[i];
+            lines[i].passengers.adult = adult[i];
+            lines[i].passengers.student = student[i];
+            lines[i].passengers.senior = senior[i];
+            lines[i].route_length = route_length[i];
+            lines[i].profitability = 0.0;
+        }
+
+        store->count += count;
+        loaded = (int64_t)count;
+
+        run_stats_add(STATS_CACHE_HITS, 1);
+        run_stats_add(STATS_ROWS_FROM_CACHE, count);
+        run_stats_add(STATS_BYTES_READ, file_size);
+    }
+
+    munmap((void *)header, file_size);
+    return loaded;
+}
+
+int64_t bus_line_cache_load_rows(const char *source_file, BusLineCacheSource *source, const uint64_t *rows, size_t count,
+                                 BusLineStore *store) {
+    size_t file_size = 0;
+    const CacheHeader *header = map_cache(source_file, source, &file_size);
+    if(header == NULL) return -1;
+
+    const char *data = (const char *)header;
+    int64_t loaded = -1;
+
+    int rows_valid = 1;
+    for(size_t i = 0; i < count; ++i) rows_valid &= rows[i] < header->row_count;
+
+    /* Only the pages of the requested rows are touched, so read-ahead would mostly fetch pages nobody needs */
+    if(rows_valid && bus_line_store_reserve(store, store->count + count) == 0) {
+        posix_madvise((void *)header, file_size, POSIX_MADV_RANDOM);
+
+        const int32_t *line_number = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_LINE_NUMBER]);
+        const uint16_t *departure_minutes = (const uint16_t *)(data + header->column_offset[CACHE_COLUMN_DEPARTURE_TIME]);
+        const int32_t *subsidy_level = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_SUBSIDY_LEVEL]);
+        const int32_t *adult = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_ADULTS]);
+        const int32_t *student = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_STUDENTS]);
+        const int32_t *senior = (const int32_t *)(data + header->column_offset[CACHE_COLUMN_SENIORS]);
+        const double *route_length = (const double *)(data + header->column_offset[CACHE_COLUMN_ROUTE_LENGTH]);
+
+        BusLineProperties *lines = store->lines + store->count;
+        for(size_t i = 0; i < count; ++i) {
+            size_t row = (size_t)rows[i];
+            lines[i].line_number = line_number[row];
+            lines[i].departure_minutes = departure_minutes[row];
+            lines[i].subsidy_level = subsidy_level[row];
+            lines[i].passengers.adult = adult[row];
+            lines[i].passengers.student = student[row];
+            lines[i].passengers.senior = senior[row];
+            lines[i].route_length = route_length[row];
+            lines[i].profitability = 0.0;
+        }
+
+        store->count += count;
+        loaded = (int64_t)count;
+
+        run_stats_add(STATS_CACHE_HITS, 1);
+        run_stats_add(STATS_ROWS_FROM_CACHE, count);
+    }
+
+    munmap((void *)header, file_size);
+    return loaded;
+}
+
+/*
+    Writes one column, gathering the field out of the rows a batch at a time
+*/
+static int write_column(FILE *file, int column, const BusLineProperties *bus_lines, size_t count) {
+    union {
+        unsigned char bytes[CACHE_WRITE_BATCH_ROWS * sizeof(double)];
+        uint16_t minutes[CACHE_WRITE_BATCH_ROWS];
+        int32_t integers[CACHE_WRITE_BATCH_ROWS];
+        double decimals[CACHE_WRITE_BATCH_ROWS];
+    } batch;
+
+    for(size_t begin = 0; begin < count; begin += CACHE_WRITE_BATCH_ROWS) {
+        size_t rows = (count - begin < CACHE_WRITE_BATCH_ROWS) ? count - begin : CACHE_WRITE_BATCH_ROWS;
+        for(size_t i = 0; i < rows; ++i) {
+            const BusLineProperties *line = &bus_lines[begin + i];
+            switch(column) {
+                case CACHE_COLUMN_LINE_NUMBER:    batch.integers[i] = line->line_number; break;
+                case CACHE_COLUMN_DEPARTURE_TIME: batch.minutes[i] = line->departure_minutes; break;
+                case CACHE_COLUMN_SUBSIDY_LEVEL:  batch.integers[i] = line->subsidy_level; break;
+                case CACHE_COLUMN_ADULTS:         batch.integers[i] = line->passengers.adult; break;
+                case CACHE_COLUMN_STUDENTS:       batch.integers[i] = line->passengers.student; break;
+                case CACHE_COLUMN_SENIORS:        batch.integers[i] = line->passengers.senior; break;
+                case CACHE_COLUMN_ROUTE_LENGTH:   batch.decimals[i] = line->route_length; break;
+            }
+        }
+
+        if(fwrite(batch.bytes, (size_t)column_element_bytes[column], rows, file) != rows) return -1;
+    }
+
+    return 0;
+}
+
+int bus_line_cache_save(const char *source_file, const BusLineCacheSource *source, const BusLineProperties *bus_lines, size_t count) {
+    char path[4096], temporary_path[4096 + 32];
+    if(!source->hashed || bus_line_cache_path(source_file, path, sizeof(path)) != 0) return -1;
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%ld.tmp", path, (long)getpid());
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = BUS_LINE_CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER_MARK;
+    header.header_bytes = sizeof(CacheHeader);
+    header.row_count = count;
+    header.source = *source;
+    header.exact_rows = (uint64_t)tariff_table_active()->exact;
+
+    uint64_t offset = align_up(sizeof(CacheHeader));
+    for(int column = 0; column < CACHE_COLUMN_COUNT; ++column) {
+        header.column_offset[column] = offset;
+        header.column_element_bytes[column] = column_element_bytes[column];
+        offset = align_up(offset + count * column_element_bytes[column]);
+    }
+
+    FILE *file = fopen(temporary_path, "wb");
+    if(file == NULL) return -1;
+
+    static const unsigned char padding[CACHE_ALIGNMENT] = {0};
+    int status = (fwrite(&header, sizeof(header), 1, file) == 1) ? 0 : -1;
+    uint64_t written = sizeof(header);
+
+    for(int column = 0; status == 0 && column < CACHE_COLUMN_COUNT; ++column) {
+        size_t padding_bytes = (size_t)(header.column_offset[column] - written);
+        if(fwrite(padding, 1, padding_bytes, file) != padding_bytes) status = -1;
+        if(status == 0) status = write_column(file, column, bus_lines, count);
+        written = header.column_offset[column] + count * column_element_bytes[column];
+    }
+
+    if(fclose(file) != 0) status = -1;
+
+    if(status == 0 && rename(temporary_path, path) != 0) status = -1;
+    if(status != 0) unlink(temporary_path);
+
+    return status;
+}
+
+int64_t bus_line_cache_read_identified(const char *source_file, BusLineCacheSource *source, BusLineStore *store,
+                                       unsigned thread_count) {
+    if(source != NULL) {
+        int64_t cached_count = bus_line_cache_load(source_file, source, store);
+        if(cached_count > 0) return cached_count;
+
+        /* The cache written below has to record the contents as they were before parsing */
+        if(!source->hashed && bus_line_cache_hash(source_file, source) != 0) source = NULL;
+    }
+
+    size_t first_row = store->count;
+    int64_t read_count = read_handler_parallel(source_file, store, thread_count);
+
+    if(source != NULL && read_count > 0 && bus_line_cache_save(source_file, source, store->lines + first_row, (size_t)read_count) != 0) {
+        fprintf(stderr, "[!] Warning : Could not write the cache for '%s' - the next run parses it again.\n", source_file);
+    }
+
+    return read_count;
+}
+
+int64_t bus_line_cache_read(const char *source_file, BusLineStore *store, unsigned thread_count, int cache_enabled) {
+    BusLineCacheSource source;
+    int cacheable = cache_enabled && bus_line_cache_identify(source_file, &source) == 0;
+
+    return bus_line_cache_read_identified(source_file, cacheable ? &source : NULL, store, thread_count);
+}
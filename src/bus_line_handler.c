@@ -1,44 +1,237 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "bus_line_handler.h"
+#include "report_writer.h"
+#include "sort_engine.h"
+#include "tariff.h"
+#include "worker_pool.h"
 
-#define COST_PER_KM 2.50
-#define ADULT_TICKET 12.0
-#define STUDENT_TICKET 8.0
-#define SENIOR_TICKET 5.0
-#define LEVEL1_SUBSIDY 0.50
-#define LEVEL2_SUBSIDY 1.00
-#define LEVEL3_SUBSIDY 1.50
-
-void calculate_profitability(BusLineProperties *bus_lines, int count) {
-    for(int i = 0; i < count; ++i) {
-    
+/*
+    Exact mode - the same calculation with the integer coefficients (see tariff.h)
+*/
+static void calculate_profitability_exact(BusLineProperties *bus_lines, size_t count, const TariffTable *tariff) {
+    for(size_t i = 0; i < count; ++i) {
         BusLineProperties* line = &bus_lines[i];
-        double cost_per_km = line->route_length * COST_PER_KM;
-        double revenue_from_tickets = 0.0, subsidy_from_gov = 0.0;
-
-        revenue_from_tickets += line->passengers.adult * ADULT_TICKET;
-        revenue_from_tickets += line->passengers.student * STUDENT_TICKET;
-        revenue_from_tickets += (line->subsidy_level == 1) ? line->passengers.senior * SENIOR_TICKET : 0;
-
-        switch(line->subsidy_level) {
-            case 1:
-                subsidy_from_gov = line->route_length * LEVEL1_SUBSIDY;
-                break;
-            case 2:
-                subsidy_from_gov = line->route_length * LEVEL2_SUBSIDY;
-                break;
-            case 3:
-                subsidy_from_gov = line->route_length * LEVEL3_SUBSIDY;
-                break;
+        int level = tariff_level_index(line->subsidy_level);
+
+        int64_t units = (int64_t)line->passengers.adult * tariff->exact_adult_ticket[level];
+        units += (int64_t)line->passengers.student * tariff->exact_student_ticket[level];
+        units += (int64_t)line->passengers.senior * tariff->exact_senior_ticket[level];
+        units += tariff_exact_metres(line->route_length) * tariff->exact_per_km[level];
+
+        line->profitability = tariff_exact_euros(units);
+    }
+}
+
+void calculate_profitability(BusLineProperties *bus_lines, size_t count) {
+    const TariffTable *tariff = tariff_table_active();
+
+    if(tariff->exact) {
+        calculate_profitability_exact(bus_lines, count, tariff);
+        return;
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+
+        /*
+            All the tariff logic (which subsidy applies, whether seniors pay) is baked into the coefficient
+            table, so this is just a lookup followed by a chain of multiply-adds without any branches
+        */
+        BusLineProperties* line = &bus_lines[i];
+        int level = tariff_level_index(line->subsidy_level);
+
+        double profitability = line->passengers.adult * tariff->adult_ticket[level];
+        profitability += line->passengers.student * tariff->student_ticket[level];
+        profitability += line->passengers.senior * tariff->senior_ticket[level];
+        profitability += line->route_length * tariff->per_km[level];
+
+        line->profitability = profitability;
+    }
+}
+
+/*
+    Rows per task of the parallel profitability calculation
+*/
+#define PROFITABILITY_BLOCK_ROWS 65536
+
+/*
+    Rows per block of the profitability summary - the block layout only depends on the number of rows,
+    never on the number of threads, which is what makes the total reproducible
+*/
+#define SUMMARY_BLOCK_ROWS 4096
+#define SUMMARY_BLOCKS_PER_TASK 16
+#define PAIRWISE_BASE_CASE 8
+
+typedef struct {
+    BusLineProperties *bus_lines;
+    size_t count;
+} ProfitabilityJob;
+
+static void profitability_task(size_t task_index, void *context) {
+    ProfitabilityJob *job = context;
+    size_t begin = task_index * PROFITABILITY_BLOCK_ROWS;
+    size_t end = begin + PROFITABILITY_BLOCK_ROWS;
+    if(end > job->count) end = job->count;
+
+    calculate_profitability(job->bus_lines + begin, end - begin);
+}
+
+void calculate_profitability_parallel(BusLineProperties *bus_lines, size_t count, unsigned thread_count) {
+    ProfitabilityJob job = { .bus_lines = bus_lines, .count = count };
+    size_t task_count = (count + PROFITABILITY_BLOCK_ROWS - 1) / PROFITABILITY_BLOCK_ROWS;
+
+    worker_pool_run(thread_count, task_count, profitability_task, &job);
+}
+
+/*
+    Pairwise (cascade) summation - the error grows with log(n) instead of n as with a plain running sum
+*/
+static double pairwise_profit_sum(const BusLineProperties *bus_lines, size_t count) {
+    if(count <= PAIRWISE_BASE_CASE) {
+        double sum = 0.0;
+        for(size_t i = 0; i < count; ++i) sum += bus_lines[i].profitability;
+        return sum;
+    }
+
+    size_t half = count / 2;
+    return pairwise_profit_sum(bus_lines, half) + pairwise_profit_sum(bus_lines + half, count - half);
+}
+
+/*
+    Same as above over the rows that selection points to
+*/
+static double pairwise_selected_profit_sum(const BusLineProperties *bus_lines, const size_t *selection, size_t count) {
+    if(count <= PAIRWISE_BASE_CASE) {
+        double sum = 0.0;
+        for(size_t i = 0; i < count; ++i) sum += bus_lines[selection[i]].profitability;
+        return sum;
+    }
+
+    size_t half = count / 2;
+    return pairwise_selected_profit_sum(bus_lines, selection, half) +
+           pairwise_selected_profit_sum(bus_lines, selection + half, count - half);
+}
+
+static double pairwise_sum(const double *values, size_t count) {
+    if(count <= PAIRWISE_BASE_CASE) {
+        double sum = 0.0;
+        for(size_t i = 0; i < count; ++i) sum += values[i];
+        return sum;
+    }
+
+    size_t half = count / 2;
+    return pairwise_sum(values, half) + pairwise_sum(values + half, count - half);
+}
+
+/*
+    Exact mode - the profit in whole cents, added up as integers (the order doesn't matter, TARIFF_EXACT_OVERFLOW
+    if the total gets too large)
+*/
+static int64_t profit_cents(const BusLineProperties *bus_lines, const size_t *selection, size_t begin, size_t end) {
+    int64_t cents = 0;
+    for(size_t i = begin; i < end; ++i) tariff_exact_add_cents(&cents, tariff_cents(bus_lines[selection ? selection[i] : i].profitability));
+    return cents;
+}
+
+typedef struct {
+    const BusLineProperties *bus_lines;
+    const size_t *selection;    /* NULL = every row */
+    size_t count;
+    size_t block_count;
+    int exact;                  /* 1 = the blocks are added up in block_cents instead of block_sums */
+    double *block_sums;
+    int64_t *block_cents;
+    size_t *block_profitable;
+} SummaryJob;
+
+static void summary_task(size_t task_index, void *context) {
+    SummaryJob *job = context;
+    size_t first_block = task_index * SUMMARY_BLOCKS_PER_TASK;
+    size_t last_block = first_block + SUMMARY_BLOCKS_PER_TASK;
+    if(last_block > job->block_count) last_block = job->block_count;
+
+    for(size_t block = first_block; block < last_block; ++block) {
+        size_t begin = block * SUMMARY_BLOCK_ROWS;
+        size_t end = begin + SUMMARY_BLOCK_ROWS;
+        if(end > job->count) end = job->count;
+
+        size_t profitable = 0;
+        if(job->exact) {
+            for(size_t i = begin; i < end; ++i) profitable += (job->bus_lines[job->selection ? job->selection[i] : i].profitability >= 0);
+            job->block_cents[block] = profit_cents(job->bus_lines, job->selection, begin, end);
+        } else if(job->selection == NULL) {
+            for(size_t i = begin; i < end; ++i) profitable += (job->bus_lines[i].profitability >= 0);
+            job->block_sums[block] = pairwise_profit_sum(job->bus_lines + begin, end - begin);
+        } else {
+            for(size_t i = begin; i < end; ++i) profitable += (job->bus_lines[job->selection[i]].profitability >= 0);
+            job->block_sums[block] = pairwise_selected_profit_sum(job->bus_lines, job->selection + begin, end - begin);
         }
+        job->block_profitable[block] = profitable;
+    }
+}
 
-        line->profitability = revenue_from_tickets + subsidy_from_gov - cost_per_km;
+void summarize_profitability(const BusLineProperties *bus_lines, size_t count, unsigned thread_count, BusLineSummary *summary) {
+    summarize_profitability_selection(bus_lines, NULL, count, thread_count, summary);
+}
+
+void summarize_profitability_selection(const BusLineProperties *bus_lines, const size_t *selection, size_t count,
+                                       unsigned thread_count, BusLineSummary *summary) {
+    memset(summary, 0, sizeof(*summary));      /* Padding included, summaries can be compared with memcmp */
+    summary->line_count = count;
+
+    if(count == 0) return;
+
+    SummaryJob job = { .bus_lines = bus_lines, .selection = selection, .count = count, .exact = tariff_table_active()->exact };
+    job.block_count = (count + SUMMARY_BLOCK_ROWS - 1) / SUMMARY_BLOCK_ROWS;
+    if(job.exact) job.block_cents = malloc(job.block_count * sizeof(int64_t));
+    else job.block_sums = malloc(job.block_count * sizeof(double));
+    job.block_profitable = malloc(job.block_count * sizeof(size_t));
+
+    int64_t cents = 0;
+    if((job.exact ? job.block_cents == NULL : job.block_sums == NULL) || job.block_profitable == NULL) {
+        /*
+            Out of memory for the block sums - one block per task would need them too, so fall back to a
+            single-threaded pairwise sum over everything (the results are the same up to rounding)
+        */
+        if(job.exact) {
+            for(size_t i = 0; i < count; ++i) summary->profitable_lines += (bus_lines[selection ? selection[i] : i].profitability >= 0);
+            cents = profit_cents(bus_lines, selection, 0, count);
+        } else if(selection == NULL) {
+            for(size_t i = 0; i < count; ++i) summary->profitable_lines += (bus_lines[i].profitability >= 0);
+            summary->total_profit = pairwise_profit_sum(bus_lines, count);
+        } else {
+            for(size_t i = 0; i < count; ++i) summary->profitable_lines += (bus_lines[selection[i]].profitability >= 0);
+            summary->total_profit = pairwise_selected_profit_sum(bus_lines, selection, count);
+        }
+    } else {
+        size_t task_count = (job.block_count + SUMMARY_BLOCKS_PER_TASK - 1) / SUMMARY_BLOCKS_PER_TASK;
+        worker_pool_run(thread_count, task_count, summary_task, &job);
+
+        for(size_t block = 0; block < job.block_count; ++block) summary->profitable_lines += job.block_profitable[block];
+
+        if(job.exact) {
+            for(size_t block = 0; block < job.block_count; ++block) tariff_exact_add_cents(&cents, job.block_cents[block]);
+        } else {
+            summary->total_profit = pairwise_sum(job.block_sums, job.block_count);
+        }
+    }
+
+    if(job.exact) {
+        summary->exact_overflow = (cents == TARIFF_EXACT_OVERFLOW);
+        summary->total_profit = summary->exact_overflow ? 0.0 : (double)cents / 100.0;
     }
+    summary->unprofitable_lines = count - summary->profitable_lines;
+
+    free(job.block_sums);
+    free(job.block_cents);
+    free(job.block_profitable);
 }
 
 /*
-    Quicksort implementation for comparing bus lines first by subsidy level and then by profitability
+    Comparator for the qsort fallback, which is only used when the sort engine runs out of memory - compares
+    bus lines first by subsidy level and then by profitability
     (in descending order i.e. most profitable bus lines first)
 */
 static int compare_bus_lines_handler(const void *comparator_a, const void* comparator_b) {
@@ -52,11 +245,20 @@ static int compare_bus_lines_handler(const void *comparator_a, const void* compa
     return 0;
 }
 
-void sort_lines(BusLineProperties *bus_lines, int count) {
-    qsort(bus_lines, count, sizeof(BusLineProperties), compare_bus_lines_handler);
+void sort_lines(BusLineProperties *bus_lines, size_t count) {
+    SortSpec spec;
+    sort_spec_set_default(&spec);
+
+    if(sort_engine_sort(bus_lines, count, &spec) != 0) {
+        qsort(bus_lines, count, sizeof(BusLineProperties), compare_bus_lines_handler);
+    }
 }
 
-void display_result_handler(const BusLineProperties *bus_lines, int count) {
+void display_result_handler(const BusLineProperties *bus_lines, size_t count) {
+    display_result_handler_selection(bus_lines, NULL, count);
+}
+
+void display_result_handler_selection(const BusLineProperties *bus_lines, const size_t *selection, size_t count) {
     printf("Bus Lines' Profitability Report\n");
     printf("--------------------------------\n\n");
 
@@ -65,27 +267,41 @@ void display_result_handler(const BusLineProperties *bus_lines, int count) {
         return;
     }
 
+    /*
+        The rows go through the report writer - one printf per row is way too slow for large inputs
+    */
+    ReportWriter report;
+    report_writer_init(&report, STDOUT_FILENO);
+
     int current_subsidy_level = -1;
 
-    for(int i = 0; i < count; ++i) {
-        const BusLineProperties *line = &bus_lines[i];
+    for(size_t i = 0; i < count; ++i) {
+        const BusLineProperties *line = &bus_lines[selection ? selection[i] : i];
 
         if(line->subsidy_level != current_subsidy_level) {
             current_subsidy_level = line->subsidy_level;
-            printf("\n[*] Subsidy Level %d:\n", current_subsidy_level);
-            printf("------------------------------------------------------------------\n");
-            printf("Line\tTime\tPassengers (A+S+Sr)\tLength(km)\tProfit(€)\n");
-            printf("------------------------------------------------------------------\n");
+            report_writer_printf(&report, "\n[*] Subsidy Level %d:\n", current_subsidy_level);
+            report_writer_puts(&report, "------------------------------------------------------------------\n");
+            report_writer_puts(&report, "Line\tTime\tPassengers (A+S+Sr)\tLength(km)\tProfit(€)\n");
+            report_writer_puts(&report, "------------------------------------------------------------------\n");
         }
-        
-        printf("%d\t%s\t%d+%d+%d\t\t%.1f\t\t%.2f\n", 
-            line->line_number,
-            line->departure_time,
-            line->passengers.adult,
-            line->passengers.student,
-            line->passengers.senior,
-            line->route_length,
-            line->profitability);
 
+        /* "%d\t%s\t%d+%d+%d\t\t%.1f\t\t%.2f\n" */
+        report_writer_int(&report, line->line_number, 0);
+        report_writer_append(&report, "\t", 1);
+        report_writer_time(&report, line->departure_minutes, 0);
+        report_writer_append(&report, "\t", 1);
+        report_writer_int(&report, line->passengers.adult, 0);
+        report_writer_append(&report, "+", 1);
+        report_writer_int(&report, line->passengers.student, 0);
+        report_writer_append(&report, "+", 1);
+        report_writer_int(&report, line->passengers.senior, 0);
+        report_writer_append(&report, "\t\t", 2);
+        report_writer_fixed(&report, line->route_length, 1, 0, 0);
+        report_writer_append(&report, "\t\t", 2);
+        report_writer_fixed(&report, line->profitability, 2, 0, 0);
+        report_writer_append(&report, "\n", 1);
     }
-}
\ No newline at end of file
+
+    report_writer_close(&report);
+}
@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bus_line_index.h"
+#include "run_stats.h"
+#include "sort_engine.h"
+#include "tariff.h"
+
+#define INDEX_MAGIC "BLINDEX"
+#define INDEX_BYTE_ORDER_MARK 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t header_bytes;
+    uint64_t entry_count;
+    BusLineCacheSource source;
+    uint64_t exact_rows;            /* The rows point into a cache of this kind (see bus_line_cache.h) */
+} IndexHeader;
+
+int bus_line_index_path(const char *source_file, char *path, size_t path_size) {
+    int length = snprintf(path, path_size, "%s%s", source_file, BUS_LINE_INDEX_SUFFIX);
+    return (length < 0 || (size_t)length >= path_size) ? -1 : 0;
+}
+
+int bus_line_index_build(const BusLineProperties *bus_lines, size_t count, BusLineIndexEntry **entries) {
+    *entries = NULL;
+    if(count > SIZE_MAX / sizeof(BusLineIndexEntry)) return -1;
+
+    /* The sort is stable, so the rows of equal keys stay in file order */
+    SortSpec spec = { .key_count = 2, .keys = { { SORT_FIELD_LINE_NUMBER, 0 }, { SORT_FIELD_DEPARTURE_TIME, 0 } } };
+
+    size_t *order = malloc((count + 1) * sizeof(size_t));
+    BusLineIndexEntry *sorted = malloc((count + 1) * sizeof(BusLineIndexEntry));
+    if(order == NULL || sorted == NULL) {
+        free(order);
+        free(sorted);
+        return -1;
+    }
+    run_stats_allocation((count + 1) * (sizeof(size_t) + sizeof(BusLineIndexEntry)));
+
+    for(size_t i = 0; i < count; ++i) order[i] = i;
+    if(sort_engine_order(bus_lines, order, count, &spec) != 0) {
+        free(order);
+        free(sorted);
+        return -1;
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        const BusLineProperties *line = &bus_lines[order[i]];
+        sorted[i] = (BusLineIndexEntry){ .line_number = line->line_number, .departure_minutes = line->departure_minutes,
+                                         .reserved = 0, .row = order[i] };
+    }
+
+    free(order);
+    *entries = sorted;
+    return 0;
+}
+
+/*
+    First entry whose line number is not below line_number
+*/
+static size_t lower_bound(const BusLineIndexEntry *entries, size_t count, int64_t line_number) {
+    size_t low = 0, high = count;
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        if(entries[middle].line_number < line_number) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+void bus_line_index_range(const BusLineIndexEntry *entries, size_t count, int32_t first_line, int32_t last_line,
+                          size_t *begin, size_t *end) {
+    *begin = *end = 0;
+    if(first_line > last_line) return;
+
+    *begin = lower_bound(entries, count, first_line);
+    *end = lower_bound(entries, count, (int64_t)last_line + 1);
+}
+
+int bus_line_index_save(const char *source_file, const BusLineCacheSource *source, const BusLineIndexEntry *entries, size_t count) {
+    char path[4096], temporary_path[4096 + 32];
+    if(!source->hashed || bus_line_index_path(source_file, path, sizeof(path)) != 0) return -1;
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%ld.tmp", path, (long)getpid());
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = BUS_LINE_INDEX_VERSION;
+    header.byte_order = INDEX_BYTE_ORDER_MARK;
+    header.header_bytes = sizeof(IndexHeader);
+    header.entry_count = count;
+    header.source = *source;
+    header.exact_rows = (uint64_t)tariff_table_active()->exact;
+
+    FILE *file = fopen(temporary_path, "wb");
+    if(file == NULL) return -1;
+
+    int status = (fwrite(&header, sizeof(header), 1, file) == 1) ? 0 : -1;
+    if(status == 0 && fwrite(entries, sizeof(BusLineIndexEntry), count, file) != count) status = -1;
+    if(fclose(file) != 0) status = -1;
+
+    if(status == 0 && rename(temporary_path, path) != 0) status = -1;
+    if(status != 0) unlink(temporary_path);
+
+    return status;
+}
+
+static int header_is_usable(const IndexHeader *header, size_t file_size) {
+    if(memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0) return 0;
+    if(header->version != BUS_LINE_INDEX_VERSION || header->byte_order != INDEX_BYTE_ORDER_MARK) return 0;
+    if(header->header_bytes != sizeof(IndexHeader)) return 0;
+
+    if(header->exact_rows != (uint64_t)tariff_table_active()->exact) return 0;
+
+    return header->entry_count == (file_size - sizeof(IndexHeader)) / sizeof(BusLineIndexEntry) &&
+           (file_size - sizeof(IndexHeader)) % sizeof(BusLineIndexEntry) == 0;
+}
+
+int64_t bus_line_index_lookup(const char *source_file, BusLineCacheSource *source, int32_t first_line, int32_t last_line,
+                              BusLineStore *store) {
+    char path[4096];
+    if(bus_line_index_path(source_file, path, sizeof(path)) != 0) return -1;
+
+    /* Writable if possible, so that the recorded identity can be brought up to date (see bus_line_cache_source_check) */
+    int fd = open(path, O_RDWR);
+    if(fd < 0) fd = open(path, O_RDONLY);
+    if(fd < 0) return -1;
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t file_size = (size_t)file_stat.st_size;
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    const IndexHeader *header = mapping;
+    int usable = header_is_usable(header, file_size) &&
+                 bus_line_cache_source_check(fd, offsetof(IndexHeader, source), &header->source, source_file, source);
+    close(fd);
+
+    int64_t found = -1;
+    if(usable) {
+        /* Only the pages on the binary search path and the ones of the matching entries are read */
+        posix_madvise(mapping, file_size, POSIX_MADV_RANDOM);
+
+        const BusLineIndexEntry *entries = (const BusLineIndexEntry *)((const char *)mapping + sizeof(IndexHeader));
+        size_t begin = 0, end = 0;
+        bus_line_index_range(entries, (size_t)header->entry_count, first_line, last_line, &begin, &end);
+
+        uint64_t *rows = malloc((end - begin + 1) * sizeof(uint64_t));
+        if(rows != NULL) {
+            for(size_t i = begin; i < end; ++i) rows[i - begin] = entries[i].row;
+            found = bus_line_cache_load_rows(source_file, source, rows, end - begin, store);
+            free(rows);
+        }
+    }
+
+    munmap(mapping, file_size);
+    return found;
+}
+
+int64_t bus_line_index_read(const char *source_file, int32_t first_line, int32_t last_line, BusLineStore *store,
+                            unsigned thread_count, int cache_enabled) {
+    BusLineCacheSource source;
+    int indexable = cache_enabled && bus_line_cache_identify(source_file, &source) == 0;
+
+    if(indexable) {
+        int64_t found = bus_line_index_lookup(source_file, &source, first_line, last_line, store);
+        if(found >= 0) return found;
+    }
+
+    /*
+        No usable index - all the bus lines are read once (that writes the cache too), indexed, and only the
+        requested ones are kept. The source identity is handed on, so the file isn't identified (or hashed) twice.
+    */
+    BusLineStore all_lines;
+    bus_line_store_init(&all_lines, 0);
+
+    int64_t read_count = bus_line_cache_read_identified(source_file, indexable ? &source : NULL, &all_lines, thread_count);
+    if(read_count <= 0) {
+        bus_line_store_free(&all_lines);
+        return read_count;
+    }
+
+    BusLineIndexEntry *entries = NULL;
+    if(bus_line_index_build(all_lines.lines, all_lines.count, &entries) != 0) {
+        fprintf(stderr, "[!!] FATAL Error : Out of memory while indexing '%s'.\n", source_file);
+        bus_line_store_free(&all_lines);
+        return -1;
+    }
+
+    /* After a cache hit the source may not be hashed yet - the index records the hash just like the cache */
+    if(indexable && !source.hashed) indexable = bus_line_cache_hash(source_file, &source) == 0;
+    if(indexable && bus_line_index_save(source_file, &source, entries, all_lines.count) != 0) {
+        fprintf(stderr, "[!] Warning : Could not write the index for '%s' - the next lookup reads the whole file again.\n", source_file);
+    }
+
+    size_t begin = 0, end = 0;
+    bus_line_index_range(entries, all_lines.count, first_line, last_line, &begin, &end);
+
+    int64_t found = -1;
+    if(bus_line_store_reserve(store, store->count + (end - begin)) == 0) {
+        for(size_t i = begin; i < end; ++i) store->lines[store->count++] = all_lines.lines[entries[i].row];
+        found = (int64_t)(end - begin);
+    }
+
+    free(entries);
+    bus_line_store_free(&all_lines);
+    return found;
+}
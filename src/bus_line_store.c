@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "bus_line_store.h"
+#include "run_stats.h"
+
+#define BUS_LINE_STORE_MIN_CAPACITY 64
+
+int bus_line_store_init(BusLineStore *store, size_t capacity_hint) {
+    return bus_line_store_init_arena(store, NULL, capacity_hint);
+}
+
+int bus_line_store_init_arena(BusLineStore *store, Arena *arena, size_t capacity_hint) {
+    store->lines = NULL;
+    store->count = 0;
+    store->capacity = 0;
+    store->arena = arena;
+
+    if(capacity_hint == 0) return 0;
+    return bus_line_store_reserve(store, capacity_hint);
+}
+
+int bus_line_store_reserve(BusLineStore *store, size_t min_capacity) {
+    if(min_capacity <= store->capacity) return 0;
+    if(min_capacity > SIZE_MAX / sizeof(BusLineProperties)) return -1;
+
+    BusLineProperties *grown;
+    if(store->arena != NULL) {
+        grown = arena_grow(store->arena, store->lines, store->capacity * sizeof(BusLineProperties),
+                           min_capacity * sizeof(BusLineProperties), ARENA_SIMD_ALIGNMENT);
+    } else {
+        grown = realloc(store->lines, min_capacity * sizeof(BusLineProperties));
+        if(grown != NULL) run_stats_allocation(min_capacity * sizeof(BusLineProperties));
+    }
+    if(grown == NULL) return -1;
+
+    store->lines = grown;
+    store->capacity = min_capacity;
+    return 0;
+}
+
+BusLineProperties *bus_line_store_next_slot(BusLineStore *store) {
+    if(store->count == store->capacity) {
+        /*
+            Grow geometrically (x1.5) so that appending n rows costs O(n) amortized
+            instead of reallocating (and copying everything) on every append
+        */
+        size_t grown_capacity = store->capacity + store->capacity / 2;
+        if(grown_capacity < BUS_LINE_STORE_MIN_CAPACITY) grown_capacity = BUS_LINE_STORE_MIN_CAPACITY;
+        if(grown_capacity < store->capacity) grown_capacity = SIZE_MAX / sizeof(BusLineProperties);
+
+        if(bus_line_store_reserve(store, grown_capacity) != 0) return NULL;
+    }
+
+    return &store->lines[store->count];
+}
+
+void bus_line_store_commit(BusLineStore *store) {
+    ++store->count;
+}
+
+void bus_line_store_free(BusLineStore *store) {
+    if(store->arena == NULL) free(store->lines);
+    store->lines = NULL;
+    store->count = 0;
+    store->capacity = 0;
+}
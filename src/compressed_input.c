@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "compressed_input.h"
+
+extern char **environ;
+
+#define COMPRESSED_INPUT_PIPE_BYTES (1 << 20)
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+CompressionFormat compressed_input_detect(const unsigned char *header, size_t length) {
+    if(length >= sizeof(gzip_magic) && memcmp(header, gzip_magic, sizeof(gzip_magic)) == 0) return COMPRESSION_GZIP;
+    if(length >= sizeof(zstd_magic) && memcmp(header, zstd_magic, sizeof(zstd_magic)) == 0) return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+CompressionFormat compressed_input_detect_fd(int fd) {
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return COMPRESSION_NONE;
+
+    unsigned char header[COMPRESSED_INPUT_MAGIC_BYTES];
+    ssize_t length = pread(fd, header, sizeof(header), 0);
+    return length > 0 ? compressed_input_detect(header, (size_t)length) : COMPRESSION_NONE;
+}
+
+static char gzip_path[COMPRESSED_INPUT_PATH_BYTES] = COMPRESSED_INPUT_GZIP_PATH;
+static char zstd_path[COMPRESSED_INPUT_PATH_BYTES] = COMPRESSED_INPUT_ZSTD_PATH;
+
+const char *compressed_input_tool(CompressionFormat format) {
+    switch(format) {
+        case COMPRESSION_GZIP: return "gzip";
+        case COMPRESSION_ZSTD: return "zstd";
+        default: return "cat";
+    }
+}
+
+const char *compressed_input_tool_path(CompressionFormat format) {
+    switch(format) {
+        case COMPRESSION_GZIP: return gzip_path;
+        case COMPRESSION_ZSTD: return zstd_path;
+        default: return "/bin/cat";
+    }
+}
+
+int compressed_input_set_tool_path(CompressionFormat format, const char *path) {
+    char *target = (format == COMPRESSION_GZIP) ? gzip_path : (format == COMPRESSION_ZSTD) ? zstd_path : NULL;
+    if(target == NULL || path[0] != '/' || strlen(path) >= COMPRESSED_INPUT_PATH_BYTES) return -1;
+
+    strcpy(target, path);
+    return 0;
+}
+
+int compressed_input_open(int source_fd, CompressionFormat format, CompressedInput *input) {
+    const char *path = compressed_input_tool_path(format);
+    if(access(path, X_OK) != 0) return -2;
+
+    int pipe_fds[2];
+    if(pipe(pipe_fds) != 0) return -1;
+
+    /* Neither end leaks into the decompressor (or any other child) - it only gets the dup2'ed copies */
+    fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+
+#ifdef F_SETPIPE_SZ
+    /*
+        The default 64 KB pipe means a switch between the decompressor and the parser for every 64 KB of text -
+        a bigger one lets both run longer stretches (only a hint, the system limit may be lower)
+    */
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, COMPRESSED_INPUT_PIPE_BYTES);
+#endif
+
+    char *tool = (char *)compressed_input_tool(format);
+    char *argv[] = { tool, "-dc", NULL };
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, source_fd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+
+    /*
+        SIGPIPE back to the default even if this process ignores it (serve mode does) - if the parser stops
+        early, the decompressor simply ends instead of complaining about a broken pipe
+    */
+    posix_spawnattr_t attributes;
+    sigset_t default_signals;
+    posix_spawnattr_init(&attributes);
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &default_signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int status = posix_spawn(&pid, path, &actions, &attributes, argv, environ);
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+
+    if(status != 0) {
+        close(pipe_fds[0]);
+        return -1;
+    }
+
+    input->fd = pipe_fds[0];
+    input->pid = pid;
+    input->format = format;
+    return 0;
+}
+
+int compressed_input_close(CompressedInput *input) {
+    close(input->fd);
+
+    int status;
+    while(waitpid(input->pid, &status, 0) < 0) {
+        if(errno != EINTR) return -1;
+    }
+
+    if(WIFEXITED(status)) return WEXITSTATUS(status) == 0 ? 0 : -1;
+    return (WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE) ? 0 : -1;
+}
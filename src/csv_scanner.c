@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csv_scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CSV_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*CsvScanKernel)(const char *block, CsvBlockMasks *masks);
+
+static CsvScanKernel scan_kernel = NULL;
+static const char *scan_kernel_name = "none";
+
+void csv_scan_block_scalar(const char *block, CsvBlockMasks *masks) {
+    uint64_t comma = 0, newline = 0, carriage_return = 0, comment = 0;
+
+    for(unsigned i = 0; i < CSV_BLOCK_SIZE; ++i) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch(block[i]) {
+            case ',':  comma |= bit; break;
+            case '\n': newline |= bit; break;
+            case '\r': carriage_return |= bit; break;
+            case '#':  comment |= bit; break;
+        }
+    }
+
+    masks->comma = comma;
+    masks->newline = newline;
+    masks->carriage_return = carriage_return;
+    masks->comment = comment;
+}
+
+#ifdef CSV_SCANNER_X86
+
+/*
+    SSE2 is part of the x86-64 baseline, so this kernel is always available there - 4 x 16 bytes per block
+*/
+__attribute__((target("sse2")))
+static void csv_scan_block_sse2(const char *block, CsvBlockMasks *masks) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    const __m128i comment = _mm_set1_epi8('#');
+
+    uint64_t comma_bits = 0, newline_bits = 0, carriage_return_bits = 0, comment_bits = 0;
+
+    for(unsigned i = 0; i < CSV_BLOCK_SIZE; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + i));
+        comma_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)) << i;
+        newline_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << i;
+        carriage_return_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, carriage_return)) << i;
+        comment_bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comment)) << i;
+    }
+
+    masks->comma = comma_bits;
+    masks->newline = newline_bits;
+    masks->carriage_return = carriage_return_bits;
+    masks->comment = comment_bits;
+}
+
+/*
+    AVX2 kernel - 2 x 32 bytes per block, only selected if the CPU reports AVX2 support at runtime
+*/
+__attribute__((target("avx2")))
+static void csv_scan_block_avx2(const char *block, CsvBlockMasks *masks) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage_return = _mm256_set1_epi8('\r');
+    const __m256i comment = _mm256_set1_epi8('#');
+
+    __m256i low = _mm256_loadu_si256((const __m256i *)block);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(block + 32));
+
+    masks->comma = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, comma)) |
+                   (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, comma)) << 32;
+    masks->newline = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)) |
+                     (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)) << 32;
+    masks->carriage_return = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, carriage_return)) |
+                             (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, carriage_return)) << 32;
+    masks->comment = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, comment)) |
+                     (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, comment)) << 32;
+}
+
+#endif // CSV_SCANNER_X86
+
+int csv_scanner_select_kernel(const char *kernel_name) {
+    if(strcmp(kernel_name, "scalar") == 0) {
+        scan_kernel = csv_scan_block_scalar;
+        scan_kernel_name = "scalar";
+        return 0;
+    }
+
+#ifdef CSV_SCANNER_X86
+    __builtin_cpu_init();
+
+    if(strcmp(kernel_name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        scan_kernel = csv_scan_block_sse2;
+        scan_kernel_name = "sse2";
+        return 0;
+    }
+
+    if(strcmp(kernel_name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        scan_kernel = csv_scan_block_avx2;
+        scan_kernel_name = "avx2";
+        return 0;
+    }
+#endif
+
+    return -1;
+}
+
+void csv_scanner_init(void) {
+    if(scan_kernel != NULL) return;
+
+    if(csv_scanner_select_kernel("avx2") == 0) return;
+    if(csv_scanner_select_kernel("sse2") == 0) return;
+    csv_scanner_select_kernel("scalar");
+}
+
+const char *csv_scanner_kernel_name(void) {
+    csv_scanner_init();
+    return scan_kernel_name;
+}
+
+void csv_scan_block(const char *block, CsvBlockMasks *masks) {
+    if(scan_kernel == NULL) csv_scanner_init();
+    scan_kernel(block, masks);
+}
+
+/*
+    Classifies the block that starts at scanner->block_base - the last (partial) block of the input is
+    copied into a zero padded scratch block so that the kernels never read past the end of the buffer
+*/
+static void load_block(CsvScanner *scanner) {
+    size_t remaining = scanner->size - scanner->block_base;
+
+    if(remaining >= CSV_BLOCK_SIZE) {
+        csv_scan_block(scanner->data + scanner->block_base, &scanner->masks);
+    } else {
+        char tail[CSV_BLOCK_SIZE] = {0};
+        memcpy(tail, scanner->data + scanner->block_base, remaining);
+        csv_scan_block(tail, &scanner->masks);
+    }
+
+    scanner->block_loaded = 1;
+}
+
+void csv_scanner_start(CsvScanner *scanner, const char *data, size_t size) {
+    if(scan_kernel == NULL) csv_scanner_init();
+
+    scanner->data = data;
+    scanner->size = size;
+    scanner->pos = 0;
+    scanner->block_base = 0;
+    scanner->block_loaded = 0;
+    scanner->previous_carriage_return = 0;
+}
+
+static void record_commas(CsvRow *row, uint64_t comma_bits, size_t bit_offset) {
+    while(comma_bits != 0) {
+        if(row->comma_count < CSV_MAX_ROW_COMMAS) {
+            row->commas[row->comma_count] = bit_offset + (size_t)__builtin_ctzll(comma_bits);
+        }
+        ++row->comma_count;
+        comma_bits &= comma_bits - 1;
+    }
+}
+
+int csv_scanner_next_row(CsvScanner *scanner, CsvRow *row) {
+    size_t start = scanner->pos;
+    if(start >= scanner->size) return 0;
+
+    /*
+        Rows never skip a whole block, so the row start is either in the current block or in the one right after it
+    */
+    if(!scanner->block_loaded || start >= scanner->block_base + CSV_BLOCK_SIZE) {
+        if(scanner->block_loaded) scanner->previous_carriage_return = scanner->masks.carriage_return >> 63;
+        scanner->block_base = start - (start % CSV_BLOCK_SIZE);
+        load_block(scanner);
+    }
+
+    unsigned shift = (unsigned)(start - scanner->block_base);
+
+    row->begin = scanner->data + start;
+    row->is_comment = (int)((scanner->masks.comment >> shift) & 1);
+    row->comma_count = 0;
+
+    for(;;) {
+        uint64_t from_start = ~(uint64_t)0 << shift;
+        uint64_t newline_bits = scanner->masks.newline & from_start;
+        uint64_t comma_bits = scanner->masks.comma & from_start;
+        size_t bit_offset = scanner->block_base - start;
+
+        if(newline_bits != 0) {
+            unsigned newline_bit = (unsigned)__builtin_ctzll(newline_bits);
+            size_t end = scanner->block_base + newline_bit;
+
+            record_commas(row, comma_bits & ((((uint64_t)1) << newline_bit) - 1), bit_offset);
+
+            uint64_t carriage_return_before = (newline_bit > 0) ?
+                (scanner->masks.carriage_return >> (newline_bit - 1)) & 1 : scanner->previous_carriage_return;
+
+            row->end = scanner->data + end;
+            row->has_carriage_return = (end > start) && carriage_return_before;
+            scanner->pos = end + 1;
+            return 1;
+        }
+
+        record_commas(row, comma_bits, bit_offset);
+
+        if(scanner->block_base + CSV_BLOCK_SIZE >= scanner->size) {
+            /*
+                Last row of the input without a trailing newline
+            */
+            size_t end = scanner->size;
+            unsigned last_bit = (unsigned)(end - 1 - scanner->block_base);
+
+            row->end = scanner->data + end;
+            row->has_carriage_return = (int)((scanner->masks.carriage_return >> last_bit) & 1);
+            scanner->pos = end;
+            return 1;
+        }
+
+        scanner->previous_carriage_return = scanner->masks.carriage_return >> 63;
+        scanner->block_base += CSV_BLOCK_SIZE;
+        load_block(scanner);
+        shift = 0;
+    }
+}
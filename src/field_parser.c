@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "field_parser.h"
+
+/*
+    Integers up to 2^53 are exactly representable in a double, so a mantissa below this limit divided by an
+    exact power of ten yields the correctly rounded result (the same as strtod would produce)
+*/
+#define EXACT_MANTISSA_LIMIT (UINT64_C(1) << 53)
+#define MAX_FAST_DIGITS 19
+#define DECIMAL_SCRATCH_SIZE 64
+
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+FieldParseStatus parse_int_field(const char *begin, const char *end, int32_t min_value, int32_t max_value, int32_t *value) {
+    if(begin == end) return FIELD_PARSE_EMPTY;
+
+    int negative = 0;
+    if(*begin == '+' || *begin == '-') {
+        negative = (*begin == '-');
+        ++begin;
+    }
+    if(begin == end) return FIELD_PARSE_SYNTAX;
+
+    /*
+        Accumulate in 64 bits and bail out as soon as the magnitude leaves the 32-bit range,
+        which keeps overflow detection down to a single compare per digit
+    */
+    int64_t magnitude = 0;
+    int overflow = 0;
+    for(const char *cursor = begin; cursor < end; ++cursor) {
+        if(!is_digit(*cursor)) return FIELD_PARSE_SYNTAX;
+        magnitude = magnitude * 10 + (*cursor - '0');
+        if(magnitude > (int64_t)INT32_MAX + 1) {
+            overflow = 1;
+            magnitude = (int64_t)INT32_MAX + 1;
+        }
+    }
+
+    int64_t parsed = negative ? -magnitude : magnitude;
+    if(overflow || parsed < min_value || parsed > max_value) return FIELD_PARSE_RANGE;
+
+    *value = (int32_t)parsed;
+    return FIELD_PARSE_OK;
+}
+
+FieldParseStatus parse_decimal_field(const char *begin, const char *end, double *value) {
+    if(begin == end) return FIELD_PARSE_EMPTY;
+
+    const char *cursor = begin;
+    int negative = 0;
+    if(*cursor == '+' || *cursor == '-') {
+        negative = (*cursor == '-');
+        ++cursor;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0, significant_digits = 0, fraction_digits = 0;
+
+    for(; cursor < end && is_digit(*cursor); ++cursor, ++digits) {
+        if(mantissa != 0 || *cursor != '0') ++significant_digits;
+        if(significant_digits <= MAX_FAST_DIGITS) mantissa = mantissa * 10 + (uint64_t)(*cursor - '0');
+    }
+
+    if(cursor < end && *cursor == '.') {
+        for(++cursor; cursor < end && is_digit(*cursor); ++cursor, ++digits) {
+            if(mantissa != 0 || *cursor != '0') ++significant_digits;
+            if(significant_digits <= MAX_FAST_DIGITS) mantissa = mantissa * 10 + (uint64_t)(*cursor - '0');
+            ++fraction_digits;
+        }
+    }
+
+    if(digits == 0) return FIELD_PARSE_SYNTAX;
+
+    int has_exponent = 0;
+    if(cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+        const char *exponent = cursor + 1;
+        if(exponent < end && (*exponent == '+' || *exponent == '-')) ++exponent;
+        if(exponent == end) return FIELD_PARSE_SYNTAX;
+        for(; exponent < end; ++exponent) {
+            if(!is_digit(*exponent)) return FIELD_PARSE_SYNTAX;
+        }
+        has_exponent = 1;
+        cursor = end;
+    }
+
+    if(cursor != end) return FIELD_PARSE_SYNTAX;
+
+    /*
+        Fast path - this is what practically every route length in the input looks like (e.g. 15.5)
+    */
+    if(!has_exponent && significant_digits <= MAX_FAST_DIGITS && mantissa <= EXACT_MANTISSA_LIMIT &&
+        fraction_digits < (int)(sizeof(exact_powers_of_ten) / sizeof(exact_powers_of_ten[0]))) {
+        double parsed = (double)mantissa / exact_powers_of_ten[fraction_digits];
+        *value = negative ? -parsed : parsed;
+        return FIELD_PARSE_OK;
+    }
+
+    /*
+        Slow path for very long mantissas and exponents - the syntax has already been validated above,
+        so strtod only has to do the (correctly rounded) conversion
+    */
+    size_t length = (size_t)(end - begin);
+    if(length >= DECIMAL_SCRATCH_SIZE) return FIELD_PARSE_RANGE;
+
+    char scratch[DECIMAL_SCRATCH_SIZE];
+    memcpy(scratch, begin, length);
+    scratch[length] = '\0';
+
+    double parsed = strtod(scratch, NULL);
+    if(!isfinite(parsed)) return FIELD_PARSE_RANGE;
+
+    *value = parsed;
+    return FIELD_PARSE_OK;
+}
+
+FieldParseStatus parse_time_field(const char *begin, const char *end, uint16_t *minutes) {
+    if(begin == end) return FIELD_PARSE_EMPTY;
+    if(end - begin != 5 || !is_digit(begin[0]) || !is_digit(begin[1]) || begin[2] != ':' ||
+        !is_digit(begin[3]) || !is_digit(begin[4])) return FIELD_PARSE_SYNTAX;
+
+    int hours = (begin[0] - '0') * 10 + (begin[1] - '0');
+    int minute = (begin[3] - '0') * 10 + (begin[4] - '0');
+    if(hours > 23 || minute > 59) return FIELD_PARSE_RANGE;
+
+    *minutes = (uint16_t)(hours * 60 + minute);
+    return FIELD_PARSE_OK;
+}
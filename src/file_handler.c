@@ -1,13 +1,383 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "compressed_input.h"
+#include "csv_scanner.h"
+#include "field_parser.h"
 #include "file_handler.h"
+#include "report_writer.h"
+#include "run_stats.h"
+#include "tariff.h"
+#include "worker_pool.h"
 
 #define UNUSED(x) (void)(x) // debug
 
-int read_handler(const char* filename, BusLineProperties *bus_lines, int max_bus_lines) {
-    FILE* file = fopen(filename, "r");
+/*
+    Rough average size of one CSV row in bytes - used for turning the input file's size into a capacity hint
+    for the row store so that it does not have to grow (realloc) over and over again on large inputs
+*/
+#define AVERAGE_ROW_BYTES 24
+
+/*
+    Typical compression ratio of the CSV input with gzip or zstd - only used for the capacity hint of compressed files
+*/
+#define COMPRESSED_TEXT_RATIO 3
+
+/*
+    Number of comma separated fields in a single bus line record:
+    line_number,departure_time,subsidy_level,adults,students,seniors,route_length
+*/
+#define BUS_LINE_FIELD_COUNT 7
+
+/*
+    Problems that get a line rejected - a single line can have several of them
+    (in the same order as the STATS_REJECTED_* counters of run_stats.h)
+*/
+enum {
+    REJECT_LINE_NUMBER    = 1u << 0,
+    REJECT_DEPARTURE_TIME = 1u << 1,
+    REJECT_SUBSIDY_LEVEL  = 1u << 2,
+    REJECT_ADULTS         = 1u << 3,
+    REJECT_STUDENTS       = 1u << 4,
+    REJECT_SENIORS        = 1u << 5,
+    REJECT_ROUTE_LENGTH   = 1u << 6,
+    REJECT_MISSING_FIELDS = 1u << 7
+};
+
+/*
+    Parallel parsing splits the input into chunks of at least this many bytes - below that, starting
+    threads costs more than it saves
+*/
+#define MIN_PARALLEL_CHUNK_BYTES (1u << 20)
+
+/*
+    Shortest line that can hold a valid bus line - seven fields of at least one character (the departure time has
+    exactly five) and six commas, so a chunk of n bytes holds at most n / MIN_ROW_BYTES + 1 bus lines
+*/
+#define MIN_ROW_BYTES 17
+
+/*
+    Size of the read buffer of the streaming input path - it only grows if a single line is longer than this
+*/
+#define STREAM_BUFFER_BYTES (1u << 20)
+
+typedef struct {
+    size_t line_num;
+    unsigned reasons;
+} RejectedLine;
+
+typedef struct {
+    RejectedLine *lines;
+    size_t count;
+    size_t capacity;
+} RejectionLog;
+
+typedef struct {
+    BusLineStore *store;
+    size_t max_bus_lines;
+    size_t count;
+    size_t line_num;
+    RejectionLog *deferred_rejections;      /* NULL = print the warnings right away */
+    BusLineVisitor visitor;                 /* Non-NULL = valid lines are handed to the visitor instead of the store */
+    void *visitor_context;
+} ReadContext;
+
+static int is_blank(char c) {
+    return isspace((unsigned char)c);
+}
+
+/*
+    Parses a single record (one row located by the CSV scanner) in place into a BusLineProperties struct.
+    Returns 0 if the record was valid and a combination of the REJECT_* flags otherwise.
+
+    Fields are split the same way strtok(line, ",") used to split them i.e. runs of commas count as a single separator
+    and surrounding whitespace is trimmed from every field. The separators themselves come from the scanner's
+    bitmasks, so there is no byte-by-byte search for commas here.
+*/
+static unsigned parse_bus_line_record(const CsvRow *row, const char *line_end, BusLineProperties *current) {
+    const char *segment = row->begin;
+    size_t next_comma = 0;
+    unsigned reasons = 0;
+    int field = 0;
+
+    while(field < BUS_LINE_FIELD_COUNT) {
+        const char *segment_end = line_end;
+        if(next_comma < row->comma_count) {
+            segment_end = (next_comma < CSV_MAX_ROW_COMMAS) ?
+                row->begin + row->commas[next_comma] : memchr(segment, ',', (size_t)(line_end - segment));
+            ++next_comma;
+        }
+
+        if(segment_end != segment) {
+            const char *token = segment;
+            const char *token_end = segment_end;
+
+            while(token < token_end && is_blank(*token)) ++token;
+            while(token_end > token && is_blank(token_end[-1])) --token_end;
+
+            int32_t parsed = 0;
+
+            switch(field) {
+                case 0:
+                    if(parse_int_field(token, token_end, 1, INT32_MAX, &parsed) != FIELD_PARSE_OK) {
+                        reasons |= REJECT_LINE_NUMBER;
+                    }
+                    current->line_number = parsed;
+                    break;
+
+                case 1:
+                    if(parse_time_field(token, token_end, &current->departure_minutes) != FIELD_PARSE_OK) {
+                        reasons |= REJECT_DEPARTURE_TIME;
+                    }
+                    break;
+
+                case 2:
+                    if(parse_int_field(token, token_end, 1, 3, &parsed) != FIELD_PARSE_OK) {
+                        reasons |= REJECT_SUBSIDY_LEVEL;
+                    }
+                    current->subsidy_level = parsed;
+                    break;
+
+                case 3:
+                    if(parse_int_field(token, token_end, 0, INT32_MAX, &parsed) != FIELD_PARSE_OK) {
+                        reasons |= REJECT_ADULTS;
+                    }
+                    current->passengers.adult = parsed;
+                    break;
+
+                case 4:
+                    if(parse_int_field(token, token_end, 0, INT32_MAX, &parsed) != FIELD_PARSE_OK) {
+                        reasons |= REJECT_STUDENTS;
+                    }
+                    current->passengers.student = parsed;
+                    break;
+
+                case 5:
+                    if(parse_int_field(token, token_end, 0, INT32_MAX, &parsed) != FIELD_PARSE_OK) {
+                        reasons |= REJECT_SENIORS;
+                    }
+                    current->passengers.senior = parsed;
+                    break;
+
+                case 6:
+                    if(parse_decimal_field(token, token_end, &current->route_length) != FIELD_PARSE_OK ||
+                        !(current->route_length > 0 && current->route_length <= MAX_ROUTE_LENGTH_KM) ||
+                        (tariff_table_active()->exact && !tariff_exact_whole_metres(current->route_length))) {
+                            reasons |= REJECT_ROUTE_LENGTH;
+                        }
+                    break;
+            }
+
+            ++field;
+        }
+
+        if(segment_end == line_end) break;
+        segment = segment_end + 1;
+    }
+
+    if(field < BUS_LINE_FIELD_COUNT) reasons |= REJECT_MISSING_FIELDS;
+
+    return reasons;
+}
+
+/*
+    Prints one warning per problem found in a rejected line, in the same order as the fields of the line
+*/
+static void report_rejected_line(unsigned reasons, size_t line_num) {
+    if(run_stats_enabled()) {
+        run_stats_add(STATS_ROWS_REJECTED, 1);
+        for(unsigned reason = 0; reason <= STATS_REJECTED_MISSING_FIELDS - STATS_REJECTED_LINE_NUMBER; ++reason) {
+            if(reasons & (1u << reason)) run_stats_add((StatsCounter)(STATS_REJECTED_LINE_NUMBER + reason), 1);
+        }
+    }
+
+    if(reasons & REJECT_LINE_NUMBER) fprintf(stderr, "[!] Warning : Invalid line number (line %zu\n).", line_num);
+    if(reasons & REJECT_DEPARTURE_TIME) fprintf(stderr, "[!] Warning : Invalid departure time, expected HH:MM (line %zu).\n", line_num);
+    if(reasons & REJECT_SUBSIDY_LEVEL) fprintf(stderr, "[!] Warning : Invalid subsidy level (line %zu).\n", line_num);
+    if(reasons & REJECT_ADULTS) fprintf(stderr, "[!] Warning : Invalid number of adult passengers (line %zu).\n", line_num);
+    if(reasons & REJECT_STUDENTS) fprintf(stderr, "[!] Warning : Invalid number of student passengers (line %zu).\n", line_num);
+    if(reasons & REJECT_SENIORS) fprintf(stderr, "[!] Warning : Invalid number of senior passengers (line %zu).\n", line_num);
+    if(reasons & REJECT_ROUTE_LENGTH) {
+        if(tariff_table_active()->exact) {
+            fprintf(stderr, "[!] Warning : Invalid route length, --exact needs whole metres up to %.0f km (line %zu).\n", MAX_ROUTE_LENGTH_KM, line_num);
+        } else {
+            fprintf(stderr, "[!] Warning : Invalid route length (line %zu).\n", line_num);
+        }
+    }
+    if(reasons & REJECT_MISSING_FIELDS) fprintf(stderr, "[!] Warning : Missing data fields (line %zu).\n", line_num);
+}
+
+/*
+    Worker threads do not print their warnings right away - they are collected here and printed by the main thread
+    once the line numbers of the chunks are known, which also keeps them in the order of the input file
+*/
+static int log_rejected_line(RejectionLog *log, unsigned reasons, size_t line_num) {
+    if(log->count == log->capacity) {
+        size_t grown_capacity = log->capacity ? log->capacity * 2 : 64;
+        RejectedLine *grown = realloc(log->lines, grown_capacity * sizeof(RejectedLine));
+        if(grown == NULL) return -1;
+        log->lines = grown;
+        log->capacity = grown_capacity;
+    }
+
+    log->lines[log->count].reasons = reasons;
+    log->lines[log->count].line_num = line_num;
+    ++log->count;
+    return 0;
+}
+
+/*
+    Handles one row of input - shared by the memory mapped and the buffered input paths
+    so that both of them treat comments, blank lines and CRLF line endings exactly the same way.
+    Returns 0 on success and -1 if the row store could not grow.
+*/
+static int consume_row(ReadContext *ctx, const CsvRow *row) {
+    ++ctx->line_num;
+
+    /*
+        Drop the carriage return of CRLF line endings
+    */
+    const char *line_end = row->has_carriage_return ? row->end - 1 : row->end;
+
+    /*
+        Skip empty lines and commented lines
+    */
+    if(row->begin == line_end || row->is_comment) return 0;
+
+    /*
+        Streaming - the line only lives for as long as the visitor looks at it
+    */
+    if(ctx->visitor != NULL) {
+        BusLineProperties line;
+        unsigned reasons = parse_bus_line_record(row, line_end, &line);
+        if(reasons == 0) {
+            ctx->visitor(&line, ctx->visitor_context);
+            ++ctx->count;
+        } else {
+            report_rejected_line(reasons, ctx->line_num);
+        }
+        return 0;
+    }
+
+    /*
+        Parse the current line directly into the next free slot of the row store - the slot is only
+        committed if the line turned out to be valid
+    */
+    BusLineProperties* current = bus_line_store_next_slot(ctx->store);
+    if(current == NULL) return -1;
+
+    unsigned reasons = parse_bus_line_record(row, line_end, current);
+    if(reasons == 0) {
+        bus_line_store_commit(ctx->store);
+        ++ctx->count;
+    } else if(ctx->deferred_rejections != NULL) {
+        return log_rejected_line(ctx->deferred_rejections, reasons, ctx->line_num);
+    } else {
+        report_rejected_line(reasons, ctx->line_num);
+    }
+
+    return 0;
+}
+
+/*
+    Parses every row of an in-memory buffer (up to the context's row limit)
+    Returns 0 on success and -1 on allocation failure, consumed receives the number of bytes that were looked at
+*/
+static int parse_buffer(ReadContext *ctx, const char *data, size_t size, size_t *consumed) {
+    CsvScanner scanner;
+    CsvRow row;
+    int status = 0;
+    size_t count_before = ctx->count;
+
+    csv_scanner_start(&scanner, data, size);
+
+    while(ctx->count < ctx->max_bus_lines && csv_scanner_next_row(&scanner, &row)) {
+        if(consume_row(ctx, &row) != 0) {
+            status = -1;
+            break;
+        }
+    }
+
+    if(consumed != NULL) *consumed = scanner.pos;
+    if(run_stats_enabled()) {
+        run_stats_add(STATS_BYTES_READ, scanner.pos);
+        run_stats_add(STATS_ROWS_PARSED, ctx->count - count_before);
+    }
+    return status;
+}
+
+/*
+    Zero-copy input path for regular files - the whole file is mapped into memory and every line is parsed
+    straight from the mapping without going through stdio buffers.
+    Returns 0 on success, -1 on error and 1 if the file could not be mapped (the caller falls back to buffered reads).
+*/
+static int read_mapped(int fd, size_t file_size, ReadContext *ctx, int *truncated) {
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) return 1;
+
+    /*
+        The file is consumed strictly front to back exactly once, so let the kernel read ahead aggressively
+    */
+    posix_madvise(mapping, file_size, POSIX_MADV_SEQUENTIAL);
+
+    size_t consumed = 0;
+    int status = parse_buffer(ctx, (const char *)mapping, file_size, &consumed);
+
+    *truncated = (status == 0 && consumed < file_size);
+
+    munmap(mapping, file_size);
+    return status;
+}
+
+static int read_streamed(int fd, ReadContext *ctx, int *truncated);
+
+/*
+    Compressed input path - the decompressor's output is parsed as a stream (see compressed_input.h)
+    Returns 0 on success, -1 on allocation failure, -2 on a read error, -3 if the decompressor failed and -4 if
+    it isn't installed
+*/
+static int read_compressed(int fd, CompressionFormat format, ReadContext *ctx, int *truncated) {
+    CompressedInput input;
+    int opened = compressed_input_open(fd, format, &input);
+    if(opened != 0) return (opened == -2) ? -4 : -3;
+
+    int status = read_streamed(input.fd, ctx, truncated);
+    if(compressed_input_close(&input) != 0 && status == 0) status = -3;
+    return status;
+}
+
+/*
+    Buffered input path for everything that cannot be memory mapped (pipes, character devices etc.)
+*/
+static int read_buffered(FILE *file, ReadContext *ctx, int *truncated) {
+    char *line_buffer = NULL;
+    size_t line_buffer_size = 0;
+    ssize_t line_len;
+    int status = 0;
+
+    while(status == 0 && ctx->count < ctx->max_bus_lines && (line_len = getline(&line_buffer, &line_buffer_size, file)) != -1) {
+        status = parse_buffer(ctx, line_buffer, (size_t)line_len, NULL);
+    }
+
+    *truncated = (status == 0 && ctx->count == ctx->max_bus_lines && getline(&line_buffer, &line_buffer_size, file) != -1);
+
+    free(line_buffer);
+    return status;
+}
+
+int64_t read_handler(const char* filename, BusLineStore *store, size_t max_bus_lines) {
+    int from_stdin = (strcmp(filename, "-") == 0);
+    FILE* file = from_stdin ? stdin : fopen(filename, "r");
 
     /*
         Note to self: 
@@ -29,108 +399,349 @@ int read_handler(const char* filename, BusLineProperties *bus_lines, int max_bus
         return -1;
     }
 
-    char line_buffer[256];
-    int count = 0, line_num = 0;
+    csv_scanner_init();
 
-    while(count < max_bus_lines && fgets(line_buffer, sizeof(line_buffer), file) != NULL) {
-        ++line_num;
-        /*
-            Skip empty lines and commented lines
-        */
-        if(line_buffer[0] == '\n' || line_buffer[0] == '#') continue;
+    ReadContext ctx = { .store = store, .max_bus_lines = max_bus_lines, .count = 0, .line_num = 0, .deferred_rejections = NULL,
+                        .visitor = NULL, .visitor_context = NULL };
+    int status = 1, truncated = 0;
+
+    struct stat file_stat;
+    CompressionFormat format = compressed_input_detect_fd(fileno(file));
+    if(fstat(fileno(file), &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+        size_t file_size = (size_t)file_stat.st_size;
+        size_t text_size = (format != COMPRESSION_NONE) ? file_size * COMPRESSED_TEXT_RATIO : file_size;
+        size_t capacity_hint = text_size / AVERAGE_ROW_BYTES + 1;
+        if(capacity_hint > max_bus_lines) capacity_hint = max_bus_lines;
 
         /*
-            Remove the trailing newline
+            The hint is only an optimization - if it cannot be satisfied, the store still grows on demand
+            (and rows that are reserved but never filled are never touched, so they cost no memory)
         */
-        size_t trailing_len = strlen(line_buffer);
-        if(trailing_len > 0 && (line_buffer[trailing_len-1] == '\n' || line_buffer[trailing_len-1] == '\r')) line_buffer[trailing_len-1] = '\0';
+        bus_line_store_reserve(store, store->count + capacity_hint);
+
+        if(format != COMPRESSION_NONE) status = read_compressed(fileno(file), format, &ctx, &truncated);
+        else status = (file_size > 0) ? read_mapped(fileno(file), file_size, &ctx, &truncated) : 0;
+    }
+
+    if(status == 1) status = read_buffered(file, &ctx, &truncated);
+
+    if(!from_stdin) fclose(file);
 
+    if(status == -4) {
+        fprintf(stderr, "[!!] FATAL Error : '%s' is %s compressed, but %s is not installed (expected at %s).\n", filename,
+                compressed_input_tool(format), compressed_input_tool(format), compressed_input_tool_path(format));
+        return -1;
+    }
+    if(status == -3) {
+        fprintf(stderr, "[!!] FATAL Error : Could not decompress '%s' with %s after %zu bus lines.\n", filename,
+                compressed_input_tool(format), ctx.count);
+        return -1;
+    }
+    if(status == -2) {
+        fprintf(stderr, "[!!] FATAL Error : Could not read the input file '%s' after %zu bus lines.\n", filename, ctx.count);
+        return -1;
+    }
+    if(status != 0) {
+        fprintf(stderr, "[!!] FATAL Error : Out of memory after reading %zu bus lines from '%s'.\n", ctx.count, filename);
+        return -1;
+    }
+
+    /*
+        Never drop data silently - let the user know if the row limit cut the input short
+    */
+    if(truncated) fprintf(stderr, "[!] Warning : Stopped reading '%s' after %zu bus lines (limit reached).\n", filename, ctx.count);
+
+    if (ctx.count == 0) fprintf(stderr, "[!] Warning : No valid data found in file '%s'.\n", filename);
+
+    return (int64_t)ctx.count;
+}
+
+/*
+    Streaming input path - reads fixed-size blocks with read() and only ever parses complete lines, the partial
+    line at the end of a block is moved to the front of the buffer and completed by the next read.
+    Stops at the context's row limit - truncated (may be NULL) is set if there was more input after it.
+    Returns 0 on success, -1 on allocation failure and -2 on a read error.
+*/
+static int read_streamed(int fd, ReadContext *ctx, int *truncated) {
+    size_t capacity = STREAM_BUFFER_BYTES;
+    size_t filled = 0;
+    char *buffer = malloc(capacity);
+    if(buffer == NULL) return -1;
+
+    int status = 0;
+    if(truncated != NULL) *truncated = 0;
+
+    while(status == 0) {
+        if(ctx->count == ctx->max_bus_lines) {
+            /* Anything but the end of the input after the last bus line that fits is cut off */
+            ssize_t more = filled > 0 ? 1 : read(fd, buffer, capacity);
+            if(truncated != NULL) *truncated = more > 0;
+            break;
+        }
+
+        if(filled == capacity) {
+            /* A single line that does not fit into the buffer */
+            char *grown = realloc(buffer, capacity * 2);
+            if(grown == NULL) {
+                status = -1;
+                break;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+
+        ssize_t bytes_read = read(fd, buffer + filled, capacity - filled);
+        if(bytes_read < 0) {
+            if(errno == EINTR) continue;
+            status = -2;
+            break;
+        }
+
+        if(bytes_read == 0) {
+            /* End of input - whatever is left is the last line without a newline */
+            if(filled > 0) status = parse_buffer(ctx, buffer, filled, NULL);
+            break;
+        }
+
+        filled += (size_t)bytes_read;
+
+        size_t complete = filled;
+        while(complete > 0 && buffer[complete - 1] != '\n') --complete;
+        if(complete == 0) continue;
+
+        size_t consumed = 0;
+        status = parse_buffer(ctx, buffer, complete, &consumed);
+        memmove(buffer, buffer + consumed, filled - consumed);
+        filled -= consumed;
+    }
+
+    free(buffer);
+    return status;
+}
+
+int64_t read_handler_buffer(const char *data, size_t size, size_t *line_num, BusLineVisitor visitor, void *visitor_context) {
+    csv_scanner_init();
+
+    ReadContext ctx = { .store = NULL, .max_bus_lines = READ_ALL_BUS_LINES, .count = 0, .line_num = *line_num, .deferred_rejections = NULL,
+                        .visitor = visitor, .visitor_context = visitor_context };
+    parse_buffer(&ctx, data, size, NULL);
+
+    *line_num = ctx.line_num;
+    return (int64_t)ctx.count;
+}
+
+int64_t read_handler_stream(const char* filename, BusLineVisitor visitor, void *visitor_context) {
+    int from_stdin = (strcmp(filename, "-") == 0);
+    int fd = from_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+
+    if(fd < 0) {
+        fprintf(stderr, "[!!] FATAL Error : Could not open the input file '%s'.\n", filename);
+        return -1;
+    }
+
+    /*
+        Every byte is read exactly once front to back, so let the kernel read ahead aggressively (no-op for pipes)
+    */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    csv_scanner_init();
+
+    ReadContext ctx = { .store = NULL, .max_bus_lines = READ_ALL_BUS_LINES, .count = 0, .line_num = 0, .deferred_rejections = NULL,
+                        .visitor = visitor, .visitor_context = visitor_context };
+    CompressionFormat format = compressed_input_detect_fd(fd);
+    int status = (format != COMPRESSION_NONE) ? read_compressed(fd, format, &ctx, NULL) : read_streamed(fd, &ctx, NULL);
+
+    if(!from_stdin) close(fd);
+
+    if(status == -4) {
+        fprintf(stderr, "[!!] FATAL Error : '%s' is %s compressed, but %s is not installed (expected at %s).\n", filename,
+                compressed_input_tool(format), compressed_input_tool(format), compressed_input_tool_path(format));
+        return -1;
+    }
+    if(status == -3) {
+        fprintf(stderr, "[!!] FATAL Error : Could not decompress '%s' with %s after %zu bus lines.\n", filename,
+                compressed_input_tool(format), ctx.count);
+        return -1;
+    }
+
+    if(status == -2) {
+        fprintf(stderr, "[!!] FATAL Error : Could not read the input file '%s' after %zu bus lines.\n", filename, ctx.count);
+        return -1;
+    }
+    if(status != 0) {
+        fprintf(stderr, "[!!] FATAL Error : Out of memory after reading %zu bus lines from '%s'.\n", ctx.count, filename);
+        return -1;
+    }
+
+    if (ctx.count == 0) fprintf(stderr, "[!] Warning : No valid data found in file '%s'.\n", filename);
+
+    return (int64_t)ctx.count;
+}
+
+typedef struct {
+    const char *data;
+    size_t size;
+    BusLineStore store;         /* The chunk's own part of the destination store, sized for the chunk's worst case */
+    RejectionLog rejections;
+    size_t line_count;
+    int status;
+} ParseChunk;
+
+static void parse_chunk_task(size_t task_index, void *context) {
+    ParseChunk *chunk = &((ParseChunk *)context)[task_index];
+
+    /*
+        The limit keeps the store from ever growing - its rows belong to the destination store. The chunk can't
+        hold more valid lines than that, so stopping short of its end would mean the row bound is wrong.
+    */
+    ReadContext ctx = { .store = &chunk->store, .max_bus_lines = chunk->store.capacity, .count = 0, .line_num = 0,
+                        .deferred_rejections = &chunk->rejections, .visitor = NULL, .visitor_context = NULL };
+
+    size_t consumed = 0;
+    chunk->status = parse_buffer(&ctx, chunk->data, chunk->size, &consumed);
+    if(chunk->status == 0 && consumed < chunk->size) chunk->status = -1;
+    chunk->line_count = ctx.line_num;
+}
+
+/*
+    Gives the whole pages inside [begin, end) back to the OS - for memory whose contents are no longer needed
+*/
+static void discard_pages(void *begin, void *end) {
+#ifdef MADV_DONTNEED
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)begin + page - 1) & ~(page - 1);
+    uintptr_t last = (uintptr_t)end & ~(page - 1);
+    if(first < last) madvise((void *)first, last - first, MADV_DONTNEED);
+#else
+    UNUSED(begin);
+    UNUSED(end);
+#endif
+}
+
+/*
+    Moves a chunk boundary forward to the start of the next line so that no line is split between two chunks
+*/
+static size_t align_to_next_line(const char *data, size_t size, size_t offset) {
+    if(offset == 0) return 0;
+    if(offset >= size) return size;
+    if(data[offset - 1] == '\n') return offset;
+
+    const char *newline = memchr(data + offset, '\n', size - offset);
+    return newline ? (size_t)(newline - data) + 1 : size;
+}
+
+int64_t read_handler_parallel(const char* filename, BusLineStore *store, unsigned thread_count) {
+    if(thread_count == 0) thread_count = worker_pool_default_threads();
+
+    int fd = open(filename, O_RDONLY);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        (size_t)file_stat.st_size < 2 * MIN_PARALLEL_CHUNK_BYTES || thread_count == 1 || compressed_input_detect_fd(fd) != COMPRESSION_NONE) {
         /*
-            Parse the current line being read into a BusLineProperties struct as defined in bus_line_handler.h
+            Not worth it (or not possible) to split - pipes, small files, compressed files (a single stream that has
+            to be decompressed front to back) and single-threaded runs go the sequential way
         */
-        BusLineProperties* current = &bus_lines[count];
+        if(fd >= 0) close(fd);
+        return read_handler(filename, store, READ_ALL_BUS_LINES);
+    }
 
-        char *token = strtok(line_buffer, ",");
-        int field = 0, valid = 1;
+    size_t file_size = (size_t)file_stat.st_size;
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) return read_handler(filename, store, READ_ALL_BUS_LINES);
 
-        while (token != NULL && field < 7) {
-            while(isspace((unsigned char)*token)) ++token;
+    posix_madvise(mapping, file_size, POSIX_MADV_WILLNEED);
+    csv_scanner_init();
 
-            char *end = token + strlen(token) - 1;
-            while(end > token && isspace((unsigned char)*end)) *--end = '\0';
+    /*
+        A few more chunks than threads evens out the load if some parts of the file are denser than others
+    */
+    size_t chunk_count = (size_t)thread_count * 4;
+    if(chunk_count > file_size / MIN_PARALLEL_CHUNK_BYTES) chunk_count = file_size / MIN_PARALLEL_CHUNK_BYTES;
 
-            switch(field) {
-                case 0:
-                    if(sscanf(token, "%d", &current->line_number) != 1 ||
-                        current->line_number <= 0) {
-                            fprintf(stderr, "[!] Warning : Invalid line number (line %d\n).", line_num);
-                            valid = 0;
-                        }
-                    break;
+    ParseChunk *chunks = calloc(chunk_count, sizeof(ParseChunk));
+    if(chunks == NULL) {
+        munmap(mapping, file_size);
+        return read_handler(filename, store, READ_ALL_BUS_LINES);
+    }
 
-                case 1:
-                    strncpy(current->departure_time, token, sizeof(current->departure_time) - 1);
-                    current->departure_time[sizeof(current->departure_time) - 1] = '\0';
-                    break;
+    const char *data = (const char *)mapping;
+    size_t chunk_start = 0, row_bound = 0;
+    for(size_t i = 0; i < chunk_count; ++i) {
+        size_t chunk_end = (i + 1 == chunk_count) ? file_size : align_to_next_line(data, file_size, file_size / chunk_count * (i + 1));
+        if(chunk_end < chunk_start) chunk_end = chunk_start;
+
+        chunks[i].data = data + chunk_start;
+        chunks[i].size = chunk_end - chunk_start;
+        chunks[i].store.capacity = chunks[i].size / MIN_ROW_BYTES + 1;
+        row_bound += chunks[i].store.capacity;
+        chunk_start = chunk_end;
+    }
 
-                case 2:
-                    if(sscanf(token, "%d", &current->subsidy_level) != 1 ||
-                    current->subsidy_level < 1 || current->subsidy_level > 3) {
-                        fprintf(stderr, "[!] Warning : Invalid subsidy level (line %d).\n", line_num);
-                        valid = 0;
-                    }
-                    break;
+    /*
+        Every chunk parses straight into its own range of the destination store, sized for the chunk's worst case -
+        nothing is reallocated while parsing and the rows are never held twice. Only the pages of the rows that
+        get written are ever touched, the rest of the reservation costs address space and no memory.
+    */
+    size_t first_row = store->count;
+    if(bus_line_store_reserve(store, first_row + row_bound) != 0) {
+        free(chunks);
+        munmap(mapping, file_size);
+        return read_handler(filename, store, READ_ALL_BUS_LINES);
+    }
 
-                case 3:
-                    if(sscanf(token, "%d", &current->passengers.adult) != 1 ||
-                    current->passengers.adult < 0) {
-                        fprintf(stderr, "[!] Warning : Invalid number of adult passengers (line %d).\n", line_num);
-                        valid = 0;
-                    }
-                    break;
+    size_t slot = first_row;
+    for(size_t i = 0; i < chunk_count; ++i) {
+        chunks[i].store.lines = store->lines + slot;
+        chunks[i].store.count = 0;
+        chunks[i].store.arena = NULL;
+        slot += chunks[i].store.capacity;
+    }
 
-                case 4: 
-                    if(sscanf(token, "%d", &current->passengers.student) != 1 || 
-                    current->passengers.student < 0) {
-                        fprintf(stderr, "[!] Warning : Invalid number of student passengers (line %d).\n", line_num);
-                        valid = 0;
-                    }
-                    break;
-                    
-                case 5: 
-                    if(sscanf(token, "%d", &current->passengers.senior) != 1 || 
-                    current->passengers.senior < 0) {
-                        fprintf(stderr, "[!] Warning : Invalid number of senior passengers (line %d).\n", line_num);
-                        valid = 0;
-                    }
-                    break;
-                        
-                case 6: 
-                    if(sscanf(token, "%lf", &current->route_length) != 1 ||
-                        current->route_length <= 0) {
-                            fprintf(stderr, "[!] Warning : Invalid route length (line %d).\n", line_num);
-                            valid = 0;
-                        }
-                    break;
-            }
+    worker_pool_run(thread_count, chunk_count, parse_chunk_task, chunks);
 
-            token = strtok(NULL, ",");
-            ++field;
+    /*
+        Close the gaps between the chunks in file order - warnings get their absolute line numbers here
+    */
+    int status = 0;
+    size_t total_count = 0, line_base = 0;
+    for(size_t i = 0; i < chunk_count; ++i) {
+        ParseChunk *chunk = &chunks[i];
+        if(chunk->status != 0) status = -1;
+
+        for(size_t r = 0; r < chunk->rejections.count; ++r) {
+            report_rejected_line(chunk->rejections.lines[r].reasons, line_base + chunk->rejections.lines[r].line_num);
         }
+        line_base += chunk->line_count;
 
-        if(field < 7) {
-            fprintf(stderr, "[!] Warning : Missing data fields (line %d).\n", line_num);
-            valid = 0;
+        /*
+            Once a chunk has moved down, the pages of its old rows past the new end are dropped right away, so the
+            rows take no more memory while they are compacted than they do afterwards
+        */
+        BusLineProperties *destination = store->lines + first_row + total_count;
+        BusLineProperties *source = chunk->store.lines;
+        if(destination != source) {
+            memmove(destination, source, chunk->store.count * sizeof(BusLineProperties));
+            BusLineProperties *moved_end = destination + chunk->store.count;
+            discard_pages(moved_end > source ? moved_end : source, source + chunk->store.count);
         }
+        total_count += chunk->store.count;
 
-        if(valid) ++count;
+        free(chunk->rejections.lines);
     }
 
-    fclose(file);
+    free(chunks);
+    munmap(mapping, file_size);
+
+    if(status != 0) {
+        fprintf(stderr, "[!!] FATAL Error : Out of memory while reading '%s'.\n", filename);
+        return -1;
+    }
 
-    if (count == 0) fprintf(stderr, "[!] Warning : No valid data found in file '%s'.\n", filename);
+    store->count += total_count;
+    if(total_count == 0) fprintf(stderr, "[!] Warning : No valid data found in file '%s'.\n", filename);
 
-    return count;
+    return (int64_t)total_count;
 }
 
 /*
@@ -141,85 +752,164 @@ int read_handler(const char* filename, BusLineProperties *bus_lines, int max_bus
     I might or might not rename this later on, on second thought the parameters' data types indicate that it's a specific kind
     of write handler so on the other hand, it can stay the way it is
 */
-int write_handler(const char* filename, BusLineProperties *bus_lines, int count) {
-    FILE *file;
-    file = fopen(filename, "w");
-    if(file == NULL) {
+int write_handler(const char* filename, BusLineProperties *bus_lines, size_t count, const BusLineSummary *summary) {
+    return write_handler_selection(filename, bus_lines, NULL, count, summary);
+}
+
+int write_handler_selection(const char* filename, const BusLineProperties *bus_lines, const size_t *selection, size_t count,
+                            const BusLineSummary *summary) {
+    /* Totals come from the caller when it already has them, otherwise they're computed here */
+    BusLineSummary local_summary;
+    if(summary == NULL && count > 0) {
+        summarize_profitability_selection(bus_lines, selection, count, 1, &local_summary);
+        summary = &local_summary;
+    }
+    if(summary != NULL && summary->exact_overflow) {
+        tariff_exact_overflow_error();
+        return -1;
+    }
+
+    ReportWriter report;
+    if(report_writer_open(&report, filename) != 0) {
         fprintf(stderr, "[!!] FATAL Error: Could not open the output file '%s'.\n", filename);
         return -1;
     }
 
+    run_stats_add(STATS_ROWS_WRITTEN, count);
+
     /* Write report header */
-    fprintf(file, "--------------------------------------------------------------------\n");
-    fprintf(file, "                   BUS LINES' PROFITABILITY REPORT                   \n");
-    fprintf(file, "--------------------------------------------------------------------\n\n");
+    report_writer_puts(&report, "--------------------------------------------------------------------\n");
+    report_writer_puts(&report, "                   BUS LINES' PROFITABILITY REPORT                   \n");
+    report_writer_puts(&report, "--------------------------------------------------------------------\n\n");
 
     if(count == 0) {
-        fprintf(file, "No bus lines to display - closing the file and exiting.\n");
-        fclose(file); 
-        return 0;
+        report_writer_puts(&report, "No bus lines to display - closing the file and exiting.\n");
+        return report_writer_close(&report);
     }
 
     int current_subsidy_level = -1;
-    double total_profit = 0.0;
-    int profitable_lines = 0;
-    int unprofitable_lines = 0;
 
     /* Process each bus line */
-    for(int i = 0; i < count; ++i) {
-        const BusLineProperties *line = &bus_lines[i];
-        total_profit += line->profitability;
-        
-        /* Track profitable vs unprofitable lines */
-        if(line->profitability >= 0) {
-            profitable_lines++;
-        } else {
-            unprofitable_lines++;
-        }
+    for(size_t i = 0; i < count; ++i) {
+        const BusLineProperties *line = &bus_lines[selection ? selection[i] : i];
 
         /* Print subsidy level headers when changing levels */
         if(line->subsidy_level != current_subsidy_level) {
             current_subsidy_level = line->subsidy_level;
-            fprintf(file, "\n------------------------------------------------------------------\n");
-            fprintf(file, "                      SUBSIDY LEVEL %d                              \n", current_subsidy_level);
-            fprintf(file, "------------------------------------------------------------------\n");
-            fprintf(file, "| Line | Time   | Passengers (Adults+Students+Seniors/Elderly) | Route length(km) | Result (P/L) (€)   |\n");
-            fprintf(file, "------------------------------------------------------------------\n");
+            report_writer_puts(&report, "\n------------------------------------------------------------------\n");
+            report_writer_printf(&report, "                      SUBSIDY LEVEL %d                              \n", current_subsidy_level);
+            report_writer_puts(&report, "------------------------------------------------------------------\n");
+            report_writer_puts(&report, "| Line | Time   | Passengers (Adults+Students+Seniors/Elderly) | Route length(km) | Result (P/L) (€)   |\n");
+            report_writer_puts(&report, "------------------------------------------------------------------\n");
         }
 
-        /* Format profit/loss indicators */
-        char profit_indicator[20];
-        if(line->profitability >= 0) {
-            snprintf(profit_indicator, sizeof(profit_indicator), "+%.2f", line->profitability);
-        } else {
-            snprintf(profit_indicator, sizeof(profit_indicator), "%.2f", line->profitability);
-        }
+        /*
+            Same layout as "| %-4d | %-6s | %3d+%-3d+%-3d      | %-9.1f | %-12s |\n" with a "+%.2f" / "%.2f" profit/loss indicator
+        */
+        report_writer_append(&report, "| ", 2);
+        report_writer_int(&report, line->line_number, -4);
+        report_writer_append(&report, " | ", 3);
+        report_writer_time(&report, line->departure_minutes, -6);
+        report_writer_append(&report, " | ", 3);
+        report_writer_int(&report, line->passengers.adult, 3);
+        report_writer_append(&report, "+", 1);
+        report_writer_int(&report, line->passengers.student, -3);
+        report_writer_append(&report, "+", 1);
+        report_writer_int(&report, line->passengers.senior, -3);
+        report_writer_append(&report, "      | ", 8);
+        report_writer_fixed(&report, line->route_length, 1, -9, 0);
+        report_writer_append(&report, " | ", 3);
+        report_writer_fixed(&report, line->profitability, 2, -12, 1);
+        report_writer_append(&report, " |\n", 3);
+    }
+
+    report_writer_puts(&report, "\n--------------------------------------------------------------------\n");
+    report_writer_puts(&report, "                          PROFITABILITY ANALYSIS REPORT                          \n");
+    report_writer_puts(&report, "-----------------------------------------------------------------------\n");
+    report_writer_printf(&report, "Total bus lines analyzed: %zu\n", summary->line_count);
+    if(count != summary->line_count) report_writer_printf(&report, "Bus lines listed: %zu\n", count);
+    report_writer_printf(&report, "Profitable lines: %zu\n", summary->profitable_lines);
+    report_writer_printf(&report, "Unprofitable lines: %zu\n", summary->unprofitable_lines);
+    
+    /* Display final profit/loss with appropriate formatting */
+    if(summary->total_profit >= 0) {
+        report_writer_printf(&report, "RESULT: PROFIT of %.2f€\n", summary->total_profit);
+    } else {
+        report_writer_printf(&report, "RESULT: LOSS of %.2f€\n", -summary->total_profit);
+    }
+    report_writer_puts(&report, "--------------------------------------------------------------------\n");
 
-        fprintf(file, "| %-4d | %-6s | %3d+%-3d+%-3d      | %-9.1f | %-12s |\n", 
-            line->line_number,
-            line->departure_time,
-            line->passengers.adult,
-            line->passengers.student,
-            line->passengers.senior,
-            line->route_length,
-            profit_indicator);
+    if(report_writer_close(&report) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not write the output file '%s'.\n", filename);
+        return -1;
     }
+    return 0;
+}
+
+int print_summary_handler(FILE *file, const BusLineAggregator *aggregator) {
+    BusLineSummary summary;
+
+    /* Every level total is part of the grand total, so checking that one covers them all */
+    bus_line_aggregator_total(aggregator, &summary);
+    if(summary.exact_overflow) {
+        tariff_exact_overflow_error();
+        return -1;
+    }
+
+    for(int level = 1; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        bus_line_aggregator_level(aggregator, level, &summary);
+        fprintf(file, "SUBSIDY LEVEL %d: %zu lines (%zu profitable, %zu unprofitable), P/L %s%.2f€\n",
+            level,
+            summary.line_count,
+            summary.profitable_lines,
+            summary.unprofitable_lines,
+            (summary.total_profit >= 0) ? "+" : "",
+            summary.total_profit);
+    }
+
+    bus_line_aggregator_total(aggregator, &summary);
 
     fprintf(file, "\n--------------------------------------------------------------------\n");
     fprintf(file, "                          PROFITABILITY ANALYSIS REPORT                          \n");
     fprintf(file, "-----------------------------------------------------------------------\n");
-    fprintf(file, "Total bus lines analyzed: %d\n", count);
-    fprintf(file, "Profitable lines: %d\n", profitable_lines);
-    fprintf(file, "Unprofitable lines: %d\n", unprofitable_lines);
-    
-    /* Display final profit/loss with appropriate formatting */
-    if(total_profit >= 0) {
-        fprintf(file, "RESULT: PROFIT of %.2f€\n", total_profit);
+    fprintf(file, "Total bus lines analyzed: %zu\n", summary.line_count);
+    fprintf(file, "Profitable lines: %zu\n", summary.profitable_lines);
+    fprintf(file, "Unprofitable lines: %zu\n", summary.unprofitable_lines);
+
+    if(summary.total_profit >= 0) {
+        fprintf(file, "RESULT: PROFIT of %.2f€\n", summary.total_profit);
     } else {
-        fprintf(file, "RESULT: LOSS of %.2f€\n", -total_profit);
+        fprintf(file, "RESULT: LOSS of %.2f€\n", -summary.total_profit);
     }
     fprintf(file, "--------------------------------------------------------------------\n");
+    return 0;
+}
 
-    fclose(file);
+int write_summary_handler(const char* filename, const BusLineAggregator *aggregator) {
+    BusLineSummary summary;
+    bus_line_aggregator_total(aggregator, &summary);
+    if(summary.exact_overflow) {
+        tariff_exact_overflow_error();
+        return -1;
+    }
+
+    int to_stdout = (strcmp(filename, "-") == 0);
+    FILE *file = to_stdout ? stdout : fopen(filename, "w");
+    if(file == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Could not open the output file '%s'.\n", filename);
+        return -1;
+    }
+
+    fprintf(file, "--------------------------------------------------------------------\n");
+    fprintf(file, "                   BUS LINES' PROFITABILITY SUMMARY                   \n");
+    fprintf(file, "--------------------------------------------------------------------\n\n");
+
+    print_summary_handler(file, aggregator);
+
+    if(to_stdout) {
+        fflush(file);
+    } else {
+        fclose(file);
+    }
     return 0;
 }
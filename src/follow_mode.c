@@ -0,0 +1,335 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "compressed_input.h"
+#include "file_handler.h"
+#include "follow_mode.h"
+#include "tariff.h"
+
+/*
+    Appended data is read in blocks of this size
+*/
+#define FOLLOW_READ_BYTES (1u << 20)
+
+/*
+    How often the file is checked when there are no inotify events to wait for
+*/
+#define FOLLOW_POLL_MILLISECONDS 500
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+void follow_state_init(FollowState *state, const char *filename) {
+    memset(state, 0, sizeof(*state));
+    state->filename = filename;
+    state->fd = -1;
+
+    bus_line_store_init(&state->rows, 0);
+    bus_line_aggregator_init(&state->totals);
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) rank_tree_init(&state->ranking[level]);
+}
+
+void follow_state_free(FollowState *state) {
+    if(state->fd >= 0) close(state->fd);
+    free(state->pending);
+    bus_line_store_free(&state->rows);
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) rank_tree_free(&state->ranking[level]);
+
+    state->fd = -1;
+    state->pending = NULL;
+}
+
+/*
+    Forgets everything read so far - used when the file got truncated or replaced
+*/
+static void follow_state_reset(FollowState *state) {
+    const char *filename = state->filename;
+    follow_state_free(state);
+    follow_state_init(state, filename);
+}
+
+static void follow_add_row(BusLineProperties *bus_line, void *context) {
+    FollowState *state = context;
+
+    calculate_profitability(bus_line, 1);
+
+    BusLineProperties *slot = bus_line_store_next_slot(&state->rows);
+    if(slot == NULL || rank_tree_insert(&state->ranking[tariff_level_index(bus_line->subsidy_level)], state->rows.count, bus_line->profitability) != 0) {
+        state->error = 1;
+        return;
+    }
+
+    *slot = *bus_line;
+    bus_line_store_commit(&state->rows);
+    bus_line_aggregator_add(&state->totals, bus_line);
+    ++state->new_rows;
+}
+
+int64_t follow_state_update(FollowState *state) {
+    struct stat file_stat;
+    if(stat(state->filename, &file_stat) != 0) return 0;    /* Gone for now (e.g. in the middle of a rotation) */
+
+    if(state->fd >= 0 && (file_stat.st_dev != state->device || file_stat.st_ino != state->inode ||
+                          (uint64_t)file_stat.st_size < state->offset)) {
+        fprintf(stderr, "[!] Warning : '%s' was truncated or replaced - reading it again from the start.\n", state->filename);
+        follow_state_reset(state);
+    }
+
+    if(state->fd < 0) {
+        state->fd = open(state->filename, O_RDONLY);
+        if(state->fd < 0) return 0;
+        if(fstat(state->fd, &file_stat) != 0) return -1;
+        state->device = file_stat.st_dev;
+        state->inode = file_stat.st_ino;
+    }
+
+    int64_t added = 0;
+
+    while(state->offset < (uint64_t)file_stat.st_size && !state->error) {
+        if(state->pending_capacity - state->pending_size < FOLLOW_READ_BYTES) {
+            size_t grown_capacity = state->pending_size + FOLLOW_READ_BYTES;
+            char *grown = realloc(state->pending, grown_capacity);
+            if(grown == NULL) return -1;
+            state->pending = grown;
+            state->pending_capacity = grown_capacity;
+        }
+
+        ssize_t bytes_read = pread(state->fd, state->pending + state->pending_size, FOLLOW_READ_BYTES, (off_t)state->offset);
+        if(bytes_read < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        if(bytes_read == 0) break;
+
+        state->offset += (uint64_t)bytes_read;
+        state->pending_size += (size_t)bytes_read;
+
+        size_t complete = state->pending_size;
+        while(complete > 0 && state->pending[complete - 1] != '\n') --complete;
+        if(complete == 0) continue;
+
+        added += read_handler_buffer(state->pending, complete, &state->line_num, follow_add_row, state);
+
+        memmove(state->pending, state->pending + complete, state->pending_size - complete);
+        state->pending_size -= complete;
+    }
+
+    return state->error ? -1 : added;
+}
+
+int follow_state_report_rows(const FollowState *state, size_t top_k, size_t bottom_k, BusLineProperties **report_rows, size_t *report_count) {
+    size_t capacity = 0;
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        size_t level_rows = state->ranking[level].count;
+        capacity += (level_rows < top_k + bottom_k) ? level_rows : top_k + bottom_k;
+    }
+
+    *report_rows = NULL;
+    *report_count = 0;
+    if(capacity == 0) return 0;
+
+    BusLineProperties *rows = malloc(capacity * sizeof(BusLineProperties));
+    size_t *indices = malloc(capacity * sizeof(size_t));
+    if(rows == NULL || indices == NULL) {
+        free(rows);
+        free(indices);
+        return -1;
+    }
+
+    /*
+        Same order as the batch report - level by level (out-of-range levels can't get here, the parser rejects them),
+        a level that's smaller than top + bottom is listed completely
+    */
+    size_t count = 0;
+    for(int level = 1; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        const RankTree *ranking = &state->ranking[level];
+        size_t found;
+
+        if(ranking->count <= top_k + bottom_k) {
+            found = rank_tree_first(ranking, ranking->count, indices);
+        } else {
+            found = rank_tree_first(ranking, top_k, indices);
+            found += rank_tree_last(ranking, bottom_k, indices + found);
+        }
+
+        for(size_t i = 0; i < found; ++i) rows[count++] = state->rows.lines[indices[i]];
+    }
+
+    free(indices);
+    *report_rows = rows;
+    *report_count = count;
+    return 0;
+}
+
+/*
+    Returns 0 when the report was written (or skipped for lack of memory) and -1 if the exact mode total got too
+    large - following can't go on in that case, the total only gets worse
+*/
+static int emit_report(FollowState *state, const FileSettings *settings, size_t top_k, size_t bottom_k) {
+    BusLineSummary summary;
+    bus_line_aggregator_total(&state->totals, &summary);
+    if(summary.exact_overflow) {
+        tariff_exact_overflow_error();
+        return -1;
+    }
+
+    BusLineProperties *report_rows = NULL;
+    size_t report_count = 0;
+
+    if(follow_state_report_rows(state, top_k, bottom_k, &report_rows, &report_count) != 0) {
+        fprintf(stderr, "[!] Warning : Not enough memory for the report - skipping this refresh.\n");
+        return 0;
+    }
+
+    if(settings->stdout_output_enabled) {
+        printf("\n[*] Following file: %s\n", state->filename);
+        printf("[+] %zu valid bus lines (+%zu since the last report), showing the top %zu / bottom %zu of each subsidy level\n\n",
+               summary.line_count, state->new_rows, top_k, bottom_k);
+        display_result_handler(report_rows, report_count);
+
+        printf("\n------------------------------------------------------------------\n");
+        printf("TOTAL P/L: %s %.2f€\n", (summary.total_profit < 0) ? "Loss of" : "Profit of", summary.total_profit);
+        printf("------------------------------------------------------------------\n");
+        fflush(stdout);
+    }
+
+    if(settings->file_output_enabled) write_handler(settings->output_file, report_rows, report_count, &summary);
+
+    state->new_rows = 0;
+    free(report_rows);
+    return 0;
+}
+
+static int64_t monotonic_milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+    Returns the inotify descriptor watching the file or -1 if changes have to be found by polling
+*/
+static int watch_file(const char *filename, int *watch) {
+#ifdef __linux__
+    int notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(notify_fd < 0) return -1;
+
+    *watch = inotify_add_watch(notify_fd, filename, IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    if(*watch < 0) {
+        close(notify_fd);
+        return -1;
+    }
+    return notify_fd;
+#else
+    (void)filename;
+    *watch = -1;
+    return -1;
+#endif
+}
+
+int follow_mode_run(const FileSettings *settings) {
+    if(strcmp(settings->input_file, "-") == 0) {
+        fprintf(stderr, "[!!] FATAL Error: --follow needs an input file, it can't follow stdin.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Appended rows are read as they are, which doesn't work for the middle of a compressed stream */
+    int probe = open(settings->input_file, O_RDONLY);
+    if(probe >= 0) {
+        CompressionFormat format = compressed_input_detect_fd(probe);
+        close(probe);
+        if(format != COMPRESSION_NONE) {
+            fprintf(stderr, "[!!] FATAL Error: --follow can't follow the %s compressed file '%s'.\n", compressed_input_tool(format), settings->input_file);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    size_t top_k = settings->top_k, bottom_k = settings->bottom_k;
+    if(top_k == 0 && bottom_k == 0) top_k = bottom_k = FOLLOW_DEFAULT_K;
+
+    FollowState state;
+    follow_state_init(&state, settings->input_file);
+
+    if(follow_state_update(&state) < 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not read '%s'.\n", settings->input_file);
+        follow_state_free(&state);
+        return EXIT_FAILURE;
+    }
+    if(emit_report(&state, settings, top_k, bottom_k) != 0) {
+        follow_state_free(&state);
+        return EXIT_FAILURE;
+    }
+
+    int watch = -1;
+    int notify_fd = watch_file(settings->input_file, &watch);
+    int64_t interval = (int64_t)settings->follow_interval * 1000;
+    int64_t next_report = monotonic_milliseconds() + interval;
+    ino_t watched_inode = state.inode;
+    int status = EXIT_SUCCESS;
+
+    while(!stop_requested) {
+        int64_t wait = next_report - monotonic_milliseconds();
+        if(wait < 0) wait = 0;
+        if(notify_fd < 0 && wait > FOLLOW_POLL_MILLISECONDS) wait = FOLLOW_POLL_MILLISECONDS;
+
+        struct pollfd poll_fd = { .fd = notify_fd, .events = POLLIN };
+        int ready = poll(&poll_fd, notify_fd >= 0 ? 1 : 0, (int)wait);
+        if(ready < 0 && errno != EINTR) break;
+
+        if(ready > 0) {
+            /* Only the fact that something happened matters, the events themselves are drained and dropped */
+            char events[4096];
+            while(read(notify_fd, events, sizeof(events)) > 0) {}
+        }
+
+        if(follow_state_update(&state) < 0) {
+            fprintf(stderr, "[!!] FATAL Error: Could not keep up with '%s'.\n", settings->input_file);
+            break;
+        }
+
+        /* A replaced file needs a new watch, the old one still points to the old inode */
+        if(notify_fd >= 0 && state.fd >= 0 && state.inode != watched_inode) {
+            close(notify_fd);
+            notify_fd = watch_file(settings->input_file, &watch);
+            watched_inode = state.inode;
+        }
+
+        if(monotonic_milliseconds() >= next_report) {
+            if(state.new_rows > 0 && emit_report(&state, settings, top_k, bottom_k) != 0) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            next_report = monotonic_milliseconds() + interval;
+        }
+    }
+
+    if(status == EXIT_SUCCESS && state.new_rows > 0 && emit_report(&state, settings, top_k, bottom_k) != 0) status = EXIT_FAILURE;
+    printf("\n[+] Stopped following '%s'. Exiting...\n", settings->input_file);
+
+    if(notify_fd >= 0) close(notify_fd);
+    follow_state_free(&state);
+    return status;
+}
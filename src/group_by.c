@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bus_line_aggregator.h"
+#include "group_by.h"
+#include "report_writer.h"
+#include "run_stats.h"
+#include "tariff.h"
+#include "worker_pool.h"
+
+#define GROUP_TABLE_MIN_CAPACITY 64
+
+/*
+    Inputs are split into partial tables only above this many rows per range - below that one pass is faster
+    than starting threads and merging
+*/
+#define GROUP_BY_PARTIAL_ROWS (1u << 18)
+
+/*
+    Fibonacci hashing - the multiplication spreads the packed keys (which mostly differ in their low bits)
+    over the top bits, which pick the slot
+*/
+#define GROUP_HASH_MULTIPLIER UINT64_C(0x9E3779B97F4A7C15)
+
+typedef struct {
+    const char *name;
+    GroupField field;
+    unsigned bits;              /* Width of the field in a packed key */
+} GroupFieldName;
+
+static const GroupFieldName group_field_names[] = {
+    {"line", GROUP_FIELD_LINE_NUMBER, 32},
+    {"hour", GROUP_FIELD_HOUR, 5},
+    {"subsidy", GROUP_FIELD_SUBSIDY_LEVEL, 8}
+};
+
+static const char *group_column_titles[] = { " Line   ", " Hour ", " Level " };
+
+/*
+    Display width of the columns after the key columns, from the bar after the keys to the final bar
+*/
+#define GROUP_REPORT_TOTALS_WIDTH 104
+
+int group_spec_parse(const char *text, GroupSpec *spec) {
+    GroupSpec parsed = { .key_count = 0 };
+    const char *cursor = text;
+
+    while(1) {
+        const char *token_end = strchr(cursor, ',');
+        if(token_end == NULL) token_end = cursor + strlen(cursor);
+
+        size_t length = (size_t)(token_end - cursor);
+        size_t field_index = 0;
+        size_t field_count = sizeof(group_field_names) / sizeof(group_field_names[0]);
+        while(field_index < field_count &&
+              (strlen(group_field_names[field_index].name) != length || strncmp(group_field_names[field_index].name, cursor, length) != 0)) {
+            ++field_index;
+        }
+
+        if(field_index == field_count || parsed.key_count == GROUP_BY_MAX_KEYS) return -1;
+
+        /* The same key twice would only make the packed keys wider */
+        for(size_t k = 0; k < parsed.key_count; ++k) {
+            if(parsed.keys[k] == group_field_names[field_index].field) return -1;
+        }
+
+        parsed.keys[parsed.key_count++] = group_field_names[field_index].field;
+
+        if(*token_end == '\0') break;
+        cursor = token_end + 1;
+    }
+
+    *spec = parsed;
+    return 0;
+}
+
+static uint64_t field_value(const BusLineProperties *bus_line, GroupField field) {
+    switch(field) {
+        case GROUP_FIELD_LINE_NUMBER:   return (uint32_t)bus_line->line_number;
+        case GROUP_FIELD_HOUR:          return bus_line->departure_minutes / 60u;
+        case GROUP_FIELD_SUBSIDY_LEVEL: return (uint8_t)bus_line->subsidy_level;
+    }
+    return 0;
+}
+
+uint64_t group_spec_key(const GroupSpec *spec, const BusLineProperties *bus_line) {
+    uint64_t key = 0;
+    for(size_t k = 0; k < spec->key_count; ++k) {
+        key = (key << group_field_names[spec->keys[k]].bits) | field_value(bus_line, spec->keys[k]);
+    }
+    return key;
+}
+
+int64_t group_spec_key_value(const GroupSpec *spec, uint64_t key, size_t index) {
+    for(size_t k = spec->key_count; k-- > index + 1;) key >>= group_field_names[spec->keys[k]].bits;
+
+    uint64_t value = key & ((UINT64_C(1) << group_field_names[spec->keys[index]].bits) - 1);
+    if(spec->keys[index] == GROUP_FIELD_SUBSIDY_LEVEL) return (int8_t)value;
+    return (int64_t)value;
+}
+
+static int allocate_slots(GroupTable *table, size_t capacity) {
+    table->keys = malloc(capacity * sizeof(uint64_t));
+    table->totals = malloc(capacity * sizeof(GroupTotals));
+    if(table->keys == NULL || table->totals == NULL) {
+        free(table->keys);
+        free(table->totals);
+        table->keys = NULL;
+        table->totals = NULL;
+        return -1;
+    }
+
+    for(size_t i = 0; i < capacity; ++i) table->keys[i] = GROUP_KEY_EMPTY;
+    table->capacity = capacity;
+    run_stats_allocation(capacity * (sizeof(uint64_t) + sizeof(GroupTotals)));
+    return 0;
+}
+
+int group_table_init(GroupTable *table, const GroupSpec *spec, size_t capacity_hint) {
+    table->spec = *spec;
+    table->count = 0;
+    table->keys = NULL;
+    table->totals = NULL;
+
+    /* At most half full, so that probe sequences stay short */
+    size_t capacity = GROUP_TABLE_MIN_CAPACITY;
+    while(capacity / 2 < capacity_hint && capacity < SIZE_MAX / 4) capacity *= 2;
+
+    return allocate_slots(table, capacity);
+}
+
+void group_table_free(GroupTable *table) {
+    free(table->keys);
+    free(table->totals);
+    table->keys = NULL;
+    table->totals = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static size_t slot_of(const GroupTable *table, uint64_t key) {
+    size_t mask = table->capacity - 1;
+    size_t slot = (size_t)((key * GROUP_HASH_MULTIPLIER) >> 32) & mask;
+
+    while(table->keys[slot] != key && table->keys[slot] != GROUP_KEY_EMPTY) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static int grow(GroupTable *table) {
+    GroupTable grown = *table;
+    if(allocate_slots(&grown, table->capacity * 2) != 0) return -1;
+
+    for(size_t i = 0; i < table->capacity; ++i) {
+        if(table->keys[i] == GROUP_KEY_EMPTY) continue;
+        size_t slot = slot_of(&grown, table->keys[i]);
+        grown.keys[slot] = table->keys[i];
+        grown.totals[slot] = table->totals[i];
+    }
+
+    free(table->keys);
+    free(table->totals);
+    *table = grown;
+    return 0;
+}
+
+/*
+    Slot of the group with the given key, a new empty group is created if there is none yet
+    Returns NULL if the table could not grow
+*/
+static GroupTotals *find_or_insert(GroupTable *table, uint64_t key) {
+    size_t slot = slot_of(table, key);
+    if(table->keys[slot] == key) return &table->totals[slot];
+
+    if(2 * (table->count + 1) > table->capacity) {
+        if(grow(table) != 0) return NULL;
+        slot = slot_of(table, key);
+    }
+
+    table->keys[slot] = key;
+    table->count++;
+
+    GroupTotals *totals = &table->totals[slot];
+    memset(totals, 0, sizeof(*totals));
+    return totals;
+}
+
+int group_table_add(GroupTable *table, const BusLineProperties *bus_line) {
+    GroupTotals *totals = find_or_insert(table, group_spec_key(&table->spec, bus_line));
+    if(totals == NULL) return -1;
+
+    double profit = bus_line->profitability;
+    if(totals->line_count == 0 || profit < totals->min_profit) totals->min_profit = profit;
+    if(totals->line_count == 0 || profit > totals->max_profit) totals->max_profit = profit;
+
+    totals->line_count++;
+    totals->profitable_lines += (profit >= 0);
+    totals->adults += (uint64_t)bus_line->passengers.adult;
+    totals->students += (uint64_t)bus_line->passengers.student;
+    totals->seniors += (uint64_t)bus_line->passengers.senior;
+    bus_line_compensated_add(&totals->profit, &totals->profit_compensation, profit);
+    if(tariff_table_active()->exact) tariff_exact_add_cents(&totals->profit_cents, tariff_cents(profit));
+    return 0;
+}
+
+int group_table_merge(GroupTable *table, const GroupTable *other) {
+    for(size_t i = 0; i < other->capacity; ++i) {
+        if(other->keys[i] == GROUP_KEY_EMPTY) continue;
+
+        const GroupTotals *source = &other->totals[i];
+        GroupTotals *totals = find_or_insert(table, other->keys[i]);
+        if(totals == NULL) return -1;
+
+        if(totals->line_count == 0 || source->min_profit < totals->min_profit) totals->min_profit = source->min_profit;
+        if(totals->line_count == 0 || source->max_profit > totals->max_profit) totals->max_profit = source->max_profit;
+
+        totals->line_count += source->line_count;
+        totals->profitable_lines += source->profitable_lines;
+        totals->adults += source->adults;
+        totals->students += source->students;
+        totals->seniors += source->seniors;
+        bus_line_compensated_add(&totals->profit, &totals->profit_compensation, source->profit);
+        bus_line_compensated_add(&totals->profit, &totals->profit_compensation, source->profit_compensation);
+        tariff_exact_add_cents(&totals->profit_cents, source->profit_cents);
+    }
+
+    return 0;
+}
+
+const GroupTotals *group_table_find(const GroupTable *table, uint64_t key) {
+    size_t slot = slot_of(table, key);
+    return table->keys[slot] == key ? &table->totals[slot] : NULL;
+}
+
+typedef struct {
+    const BusLineProperties *bus_lines;
+    const size_t *selection;        /* NULL = every row */
+    size_t count;
+    size_t partial_count;
+    GroupTable *partials;
+    int *status;
+} GroupJob;
+
+static void group_task(size_t task_index, void *context) {
+    GroupJob *job = (GroupJob *)context;
+    size_t begin = job->count * task_index / job->partial_count;
+    size_t end = job->count * (task_index + 1) / job->partial_count;
+
+    GroupTable *partial = &job->partials[task_index];
+    for(size_t i = begin; i < end && job->status[task_index] == 0; ++i) {
+        job->status[task_index] = group_table_add(partial, &job->bus_lines[job->selection ? job->selection[i] : i]);
+    }
+}
+
+int group_by_lines(const BusLineProperties *bus_lines, size_t count, const GroupSpec *spec, unsigned thread_count, GroupTable *table) {
+    return group_by_selection(bus_lines, NULL, count, spec, thread_count, table);
+}
+
+int group_by_selection(const BusLineProperties *bus_lines, const size_t *selection, size_t count, const GroupSpec *spec,
+                       unsigned thread_count, GroupTable *table) {
+    if(group_table_init(table, spec, 0) != 0) return -1;
+
+    size_t partial_count = count / GROUP_BY_PARTIAL_ROWS;
+    if(partial_count > GROUP_BY_MAX_PARTIALS) partial_count = GROUP_BY_MAX_PARTIALS;
+
+    if(partial_count < 2) {
+        for(size_t i = 0; i < count; ++i) {
+            if(group_table_add(table, &bus_lines[selection ? selection[i] : i]) != 0) {
+                group_table_free(table);
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    GroupTable partials[GROUP_BY_MAX_PARTIALS];
+    int status[GROUP_BY_MAX_PARTIALS];
+    int result = 0;
+
+    size_t initialized = 0;
+    while(initialized < partial_count && group_table_init(&partials[initialized], spec, 0) == 0) {
+        status[initialized++] = 0;
+    }
+
+    if(initialized == partial_count) {
+        GroupJob job = { .bus_lines = bus_lines, .selection = selection, .count = count, .partial_count = partial_count,
+                         .partials = partials, .status = status };
+        worker_pool_run(thread_count, partial_count, group_task, &job);
+
+        /* Merged in range order, which keeps the sums independent of the thread count */
+        for(size_t p = 0; p < partial_count && result == 0; ++p) {
+            result = status[p] != 0 ? -1 : group_table_merge(table, &partials[p]);
+        }
+    } else {
+        result = -1;
+    }
+
+    for(size_t p = 0; p < initialized; ++p) group_table_free(&partials[p]);
+    if(result != 0) group_table_free(table);
+    return result;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t key_a = *(const uint64_t *)a;
+    uint64_t key_b = *(const uint64_t *)b;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+static void write_rule(ReportWriter *report, const GroupSpec *spec) {
+    size_t width = 1 + GROUP_REPORT_TOTALS_WIDTH;
+    for(size_t k = 0; k < spec->key_count; ++k) width += strlen(group_column_titles[spec->keys[k]]) + 1;
+
+    for(size_t i = 0; i < width; ++i) report_writer_append(report, "-", 1);
+    report_writer_append(report, "\n", 1);
+}
+
+int group_by_write_report(const char *filename, const GroupTable *table) {
+    int exact = tariff_table_active()->exact;
+
+    /* A group or the grand total that is too large for exact mode fails the report before anything is written */
+    if(exact) {
+        int64_t cents = 0;
+        for(size_t i = 0; i < table->capacity; ++i) {
+            if(table->keys[i] != GROUP_KEY_EMPTY) tariff_exact_add_cents(&cents, table->totals[i].profit_cents);
+        }
+        if(cents == TARIFF_EXACT_OVERFLOW) {
+            tariff_exact_overflow_error();
+            return -1;
+        }
+    }
+
+    int to_stdout = (strcmp(filename, "-") == 0);
+    ReportWriter report;
+    if(to_stdout) {
+        report_writer_init(&report, 1);
+    } else if(report_writer_open(&report, filename) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not open the output file '%s'.\n", filename);
+        return -1;
+    }
+
+    const GroupSpec *spec = &table->spec;
+
+    /* The groups are few compared to the rows, so their keys are simply collected and sorted */
+    uint64_t *keys = malloc((table->count + 1) * sizeof(uint64_t));
+    if(keys == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Not enough memory to sort %zu groups.\n", table->count);
+        report_writer_close(&report);
+        return -1;
+    }
+
+    size_t group_count = 0;
+    for(size_t i = 0; i < table->capacity; ++i) {
+        if(table->keys[i] != GROUP_KEY_EMPTY) keys[group_count++] = table->keys[i];
+    }
+    qsort(keys, group_count, sizeof(uint64_t), compare_keys);
+
+    report_writer_puts(&report, "--------------------------------------------------------------------\n");
+    report_writer_puts(&report, "                  BUS LINES' PROFITABILITY BY GROUP                  \n");
+    report_writer_puts(&report, "--------------------------------------------------------------------\n\n");
+
+    write_rule(&report, spec);
+    report_writer_puts(&report, "|");
+    for(size_t k = 0; k < spec->key_count; ++k) {
+        report_writer_puts(&report, group_column_titles[spec->keys[k]]);
+        report_writer_puts(&report, "|");
+    }
+    report_writer_puts(&report, " Trips    | Passengers (A+S+Sr)        | Min P/L (€)  | Max P/L (€)  | Avg P/L (€)  | Total P/L (€)    |\n");
+    write_rule(&report, spec);
+
+    double total_profit = 0.0, total_compensation = 0.0;
+    int64_t total_cents = 0;
+    uint64_t total_lines = 0;
+
+    for(size_t g = 0; g < group_count; ++g) {
+        const GroupTotals *totals = group_table_find(table, keys[g]);
+        double profit = exact ? (double)totals->profit_cents / 100.0 : totals->profit + totals->profit_compensation;
+
+        report_writer_append(&report, "|", 1);
+        for(size_t k = 0; k < spec->key_count; ++k) {
+            int64_t value = group_spec_key_value(spec, keys[g], k);
+            int width = -((int)strlen(group_column_titles[spec->keys[k]]) - 2);
+            report_writer_append(&report, " ", 1);
+            if(spec->keys[k] == GROUP_FIELD_HOUR) {
+                /* "08" rather than "8" - the hour reads like the start of a departure time */
+                char hour[3] = { (char)('0' + value / 10), (char)('0' + value % 10), '\0' };
+                report_writer_string(&report, hour, width);
+            } else {
+                report_writer_int(&report, (int)value, width);
+            }
+            report_writer_append(&report, " |", 2);
+        }
+
+        char trips[24], passengers[72];
+        snprintf(trips, sizeof(trips), "%llu", (unsigned long long)totals->line_count);
+        snprintf(passengers, sizeof(passengers), "%llu+%llu+%llu",
+            (unsigned long long)totals->adults, (unsigned long long)totals->students, (unsigned long long)totals->seniors);
+
+        report_writer_append(&report, " ", 1);
+        report_writer_string(&report, trips, -8);
+        report_writer_append(&report, " | ", 3);
+        report_writer_string(&report, passengers, -26);
+        report_writer_append(&report, " | ", 3);
+        report_writer_fixed(&report, totals->min_profit, 2, -12, 1);
+        report_writer_append(&report, " | ", 3);
+        report_writer_fixed(&report, totals->max_profit, 2, -12, 1);
+        report_writer_append(&report, " | ", 3);
+        report_writer_fixed(&report, profit / (double)totals->line_count, 2, -12, 1);
+        report_writer_append(&report, " | ", 3);
+        report_writer_fixed(&report, profit, 2, -16, 1);
+        report_writer_append(&report, " |\n", 3);
+
+        total_lines += totals->line_count;
+        bus_line_compensated_add(&total_profit, &total_compensation, totals->profit);
+        bus_line_compensated_add(&total_profit, &total_compensation, totals->profit_compensation);
+        tariff_exact_add_cents(&total_cents, totals->profit_cents);
+    }
+
+    write_rule(&report, spec);
+    report_writer_printf(&report, "Groups: %zu\nBus lines: %llu\n", group_count, (unsigned long long)total_lines);
+    double total = exact ? (double)total_cents / 100.0 : total_profit + total_compensation;
+    if(total >= 0) {
+        report_writer_printf(&report, "RESULT: PROFIT of %.2f€\n", total);
+    } else {
+        report_writer_printf(&report, "RESULT: LOSS of %.2f€\n", -total);
+    }
+    report_writer_puts(&report, "--------------------------------------------------------------------\n");
+
+    free(keys);
+    return report_writer_close(&report);
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "rank_tree.h"
+
+#define RANK_NIL SIZE_MAX
+#define RANK_TREE_MIN_CAPACITY 64
+
+void rank_tree_init(RankTree *tree) {
+    tree->nodes = NULL;
+    tree->count = 0;
+    tree->capacity = 0;
+    tree->root = RANK_NIL;
+    tree->random_state = UINT64_C(0x9e3779b97f4a7c15);
+}
+
+void rank_tree_free(RankTree *tree) {
+    free(tree->nodes);
+    rank_tree_init(tree);
+}
+
+/*
+    xorshift64 - the priorities only have to be unpredictable with respect to the insertion order
+*/
+static uint32_t next_priority(RankTree *tree) {
+    uint64_t x = tree->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    tree->random_state = x;
+    return (uint32_t)(x >> 32);
+}
+
+/*
+    Nonzero if node a ranks before node b - more profitable first, equal ones in insertion order
+*/
+static int ranks_before(const RankNode *a, const RankNode *b) {
+    if(a->profitability != b->profitability) return a->profitability > b->profitability;
+    return a->row < b->row;
+}
+
+/*
+    Inserts node into the subtree rooted at root and returns the new root of that subtree - a node that ends up
+    below a parent with a lower priority is rotated up, which keeps the expected depth logarithmic
+*/
+static size_t insert_node(RankNode *nodes, size_t root, size_t node) {
+    if(root == RANK_NIL) return node;
+
+    if(ranks_before(&nodes[node], &nodes[root])) {
+        nodes[root].left = insert_node(nodes, nodes[root].left, node);
+        size_t child = nodes[root].left;
+        if(nodes[child].priority > nodes[root].priority) {
+            nodes[root].left = nodes[child].right;
+            nodes[child].right = root;
+            return child;
+        }
+    } else {
+        nodes[root].right = insert_node(nodes, nodes[root].right, node);
+        size_t child = nodes[root].right;
+        if(nodes[child].priority > nodes[root].priority) {
+            nodes[root].right = nodes[child].left;
+            nodes[child].left = root;
+            return child;
+        }
+    }
+
+    return root;
+}
+
+int rank_tree_insert(RankTree *tree, size_t row, double profitability) {
+    if(tree->count == tree->capacity) {
+        size_t grown_capacity = tree->capacity ? tree->capacity * 2 : RANK_TREE_MIN_CAPACITY;
+        RankNode *grown = realloc(tree->nodes, grown_capacity * sizeof(RankNode));
+        if(grown == NULL) return -1;
+        tree->nodes = grown;
+        tree->capacity = grown_capacity;
+    }
+
+    size_t node = tree->count++;
+    tree->nodes[node] = (RankNode){ .row = row, .profitability = profitability, .priority = next_priority(tree),
+                                    .left = RANK_NIL, .right = RANK_NIL };
+    tree->root = insert_node(tree->nodes, tree->root, node);
+    return 0;
+}
+
+/*
+    In-order walk that stops after k rows - reverse walks right to left for the worst rows
+*/
+static void collect(const RankNode *nodes, size_t node, int reverse, size_t k, size_t *rows, size_t *found) {
+    if(node == RANK_NIL || *found == k) return;
+
+    collect(nodes, reverse ? nodes[node].right : nodes[node].left, reverse, k, rows, found);
+    if(*found == k) return;
+    rows[(*found)++] = nodes[node].row;
+    collect(nodes, reverse ? nodes[node].left : nodes[node].right, reverse, k, rows, found);
+}
+
+size_t rank_tree_first(const RankTree *tree, size_t k, size_t *rows) {
+    size_t found = 0;
+    collect(tree->nodes, tree->root, 0, k, rows, &found);
+    return found;
+}
+
+size_t rank_tree_last(const RankTree *tree, size_t k, size_t *rows) {
+    size_t found = 0;
+    collect(tree->nodes, tree->root, 1, k, rows, &found);
+
+    /* Collected worst first - flip them into ranking order */
+    for(size_t i = 0; i < found / 2; ++i) {
+        size_t swap = rows[i];
+        rows[i] = rows[found - 1 - i];
+        rows[found - 1 - i] = swap;
+    }
+    return found;
+}
@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "report_writer.h"
+#include "run_stats.h"
+
+#define REPORT_MAX_DECIMALS 6
+
+/*
+    The fast fixed-point path is exact as long as value * 10^decimals stays below 2^31 (the rounding error of the
+    multiplication is then below 2^-21) and the scaled value is not within this distance of a rounding tie
+*/
+#define FIXED_FAST_LIMIT 2147483648.0
+#define FIXED_TIE_MARGIN 1e-5
+
+/*
+    Longest possible %.6f output (-DBL_MAX has 309 integer digits) plus the terminator
+*/
+#define REPORT_FIXED_MAX_LENGTH 320
+
+static const double powers_of_ten[REPORT_MAX_DECIMALS + 1] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6};
+
+static void writer_setup(ReportWriter *writer, int fd, int owns_fd) {
+    writer->fd = fd;
+    writer->owns_fd = owns_fd;
+    writer->error = 0;
+    writer->size = 0;
+    writer->bytes_written = 0;
+    writer->buffer = malloc(REPORT_WRITER_BUFFER_BYTES);
+    writer->capacity = REPORT_WRITER_BUFFER_BYTES;
+
+    if(writer->buffer == NULL) {
+        writer->buffer = writer->fallback;
+        writer->capacity = sizeof(writer->fallback);
+    }
+}
+
+void report_writer_init(ReportWriter *writer, int fd) {
+    fflush(stdout);
+    writer_setup(writer, fd, 0);
+}
+
+int report_writer_open(ReportWriter *writer, const char *filename) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) return -1;
+
+    writer_setup(writer, fd, 1);
+    return 0;
+}
+
+int report_writer_flush(ReportWriter *writer) {
+    size_t written = 0;
+
+    while(!writer->error && written < writer->size) {
+        ssize_t result = write(writer->fd, writer->buffer + written, writer->size - written);
+        if(result < 0) {
+            if(errno == EINTR) continue;
+            writer->error = 1;
+            break;
+        }
+        written += (size_t)result;
+    }
+
+    writer->bytes_written += written;
+    writer->size = 0;
+    return writer->error ? -1 : 0;
+}
+
+int report_writer_close(ReportWriter *writer) {
+    int status = report_writer_flush(writer);
+    run_stats_add(STATS_BYTES_WRITTEN, writer->bytes_written);
+
+    if(writer->owns_fd && close(writer->fd) != 0) status = -1;
+    if(writer->buffer != writer->fallback) free(writer->buffer);
+
+    writer->buffer = NULL;
+    writer->capacity = 0;
+    return status;
+}
+
+/*
+    Makes room for at least length bytes - returns 0 if the text is larger than the whole buffer
+*/
+static int writer_reserve(ReportWriter *writer, size_t length) {
+    if(writer->capacity - writer->size >= length) return 1;
+    report_writer_flush(writer);
+    return writer->capacity >= length;
+}
+
+void report_writer_append(ReportWriter *writer, const char *text, size_t length) {
+    if(!writer_reserve(writer, length)) {
+        /* Too large to buffer - write it straight through */
+        writer->size = 0;
+        while(!writer->error && length > 0) {
+            ssize_t result = write(writer->fd, text, length);
+            if(result < 0) {
+                if(errno == EINTR) continue;
+                writer->error = 1;
+                break;
+            }
+            text += result;
+            length -= (size_t)result;
+            writer->bytes_written += (uint64_t)result;
+        }
+        return;
+    }
+
+    memcpy(writer->buffer + writer->size, text, length);
+    writer->size += length;
+}
+
+void report_writer_puts(ReportWriter *writer, const char *text) {
+    report_writer_append(writer, text, strlen(text));
+}
+
+void report_writer_printf(ReportWriter *writer, const char *format, ...) {
+    char line[512];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if(length < 0) return;
+
+    if((size_t)length < sizeof(line)) {
+        report_writer_append(writer, line, (size_t)length);
+        return;
+    }
+
+    char *long_line = malloc((size_t)length + 1);
+    if(long_line == NULL) {
+        writer->error = 1;
+        return;
+    }
+
+    va_start(args, format);
+    vsnprintf(long_line, (size_t)length + 1, format, args);
+    va_end(args);
+
+    report_writer_append(writer, long_line, (size_t)length);
+    free(long_line);
+}
+
+/*
+    Appends text padded with spaces to |width| characters, on the left for a positive width and on the right
+    for a negative one
+*/
+static void append_padded(ReportWriter *writer, const char *text, size_t length, int width) {
+    size_t field = (size_t)(width < 0 ? -width : width);
+    size_t padding = (field > length) ? field - length : 0;
+
+    if(!writer_reserve(writer, length + padding)) {
+        /* Absurd widths - not worth a fast path */
+        for(size_t i = 0; width > 0 && i < padding; ++i) report_writer_append(writer, " ", 1);
+        report_writer_append(writer, text, length);
+        for(size_t i = 0; width < 0 && i < padding; ++i) report_writer_append(writer, " ", 1);
+        return;
+    }
+
+    char *out = writer->buffer + writer->size;
+    if(width > 0) {
+        memset(out, ' ', padding);
+        out += padding;
+    }
+    memcpy(out, text, length);
+    out += length;
+    if(width < 0) {
+        memset(out, ' ', padding);
+        out += padding;
+    }
+
+    writer->size = (size_t)(out - writer->buffer);
+}
+
+/*
+    Digits of an unsigned integer, written backwards from the end of the buffer - returns the first digit
+*/
+static char *format_unsigned(char *end, uint64_t value) {
+    do {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    return end;
+}
+
+void report_writer_int(ReportWriter *writer, int value, int width) {
+    char digits[16];
+    char *end = digits + sizeof(digits);
+    uint64_t magnitude = (value < 0) ? (uint64_t)(-(int64_t)value) : (uint64_t)value;
+
+    char *begin = format_unsigned(end, magnitude);
+    if(value < 0) *--begin = '-';
+
+    append_padded(writer, begin, (size_t)(end - begin), width);
+}
+
+void report_writer_string(ReportWriter *writer, const char *text, int width) {
+    append_padded(writer, text, strlen(text), width);
+}
+
+void report_format_time(char *out, uint16_t minutes) {
+    unsigned hours = minutes / 60u, minute = minutes % 60u;
+    out[0] = (char)('0' + hours / 10u);
+    out[1] = (char)('0' + hours % 10u);
+    out[2] = ':';
+    out[3] = (char)('0' + minute / 10u);
+    out[4] = (char)('0' + minute % 10u);
+    out[5] = '\0';
+}
+
+void report_writer_time(ReportWriter *writer, uint16_t minutes, int width) {
+    char text[REPORT_TIME_BYTES];
+    report_format_time(text, minutes);
+    append_padded(writer, text, REPORT_TIME_BYTES - 1, width);
+}
+
+size_t report_format_fixed(char *out, double value, int decimals) {
+    if(decimals < 0) decimals = 0;
+    if(decimals > REPORT_MAX_DECIMALS) decimals = REPORT_MAX_DECIMALS;
+
+    /*
+        signbit instead of value < 0 - printf shows the sign of negative zero as well
+    */
+    int negative = signbit(value) != 0;
+    double scaled = (negative ? -value : value) * powers_of_ten[decimals];
+
+    /* Also catches NaN and infinity */
+    if(!(scaled < FIXED_FAST_LIMIT)) return 0;
+
+    uint64_t integral = (uint64_t)scaled;
+    double fraction = scaled - (double)integral;
+    double tie_distance = fraction - 0.5;
+
+    /*
+        Too close to halfway between two results to be sure which way the exact binary value rounds -
+        printf gets it right, so let it decide
+    */
+    if(tie_distance < FIXED_TIE_MARGIN && tie_distance > -FIXED_TIE_MARGIN) return 0;
+
+    if(fraction > 0.5) ++integral;
+
+    char digits[32];
+    char *end = digits + sizeof(digits);
+    char *begin = format_unsigned(end, integral);
+
+    /* Leading zeroes so that there's at least one digit before the decimal point */
+    while(end - begin <= decimals) *--begin = '0';
+
+    size_t length = 0;
+    if(negative) out[length++] = '-';
+
+    size_t integer_digits = (size_t)(end - begin) - (size_t)decimals;
+    memcpy(out + length, begin, integer_digits);
+    length += integer_digits;
+
+    if(decimals > 0) {
+        out[length++] = '.';
+        memcpy(out + length, begin + integer_digits, (size_t)decimals);
+        length += (size_t)decimals;
+    }
+
+    out[length] = '\0';
+    return length;
+}
+
+void report_writer_fixed(ReportWriter *writer, double value, int decimals, int width, int plus_sign) {
+    char text[REPORT_FIXED_MAX_LENGTH + 2];
+    size_t length = 0;
+
+    if(plus_sign && value >= 0) text[length++] = '+';
+
+    size_t formatted = report_format_fixed(text + length, value, decimals);
+    if(formatted == 0) {
+        if(decimals < 0) decimals = 0;
+        if(decimals > REPORT_MAX_DECIMALS) decimals = REPORT_MAX_DECIMALS;
+        formatted = (size_t)snprintf(text + length, REPORT_FIXED_MAX_LENGTH, "%.*f", decimals, value);
+    }
+    length += formatted;
+
+    append_padded(writer, text, length, width);
+}
@@ -0,0 +1,379 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "field_parser.h"
+#include "row_filter.h"
+#include "run_stats.h"
+#include "worker_pool.h"
+
+#define ROW_FILTER_BLOCK_WORDS (ROW_FILTER_BLOCK_ROWS / 64)
+#define ROW_FILTER_TASK_BLOCKS 64           /* 64 blocks = 65536 rows per task */
+#define ROW_FILTER_MAX_NESTING 32           /* Parentheses and "not"s inside each other */
+
+typedef struct {
+    const char *cursor;
+    RowFilter program;
+    size_t depth;           /* Operand stack depth after the ops emitted so far */
+    size_t nesting;
+} FilterParser;
+
+static void skip_spaces(FilterParser *parser) {
+    while(isspace((unsigned char)*parser->cursor)) ++parser->cursor;
+}
+
+/*
+    Consumes a keyword (and, or, not) if it comes next as a whole word
+*/
+static int accept_word(FilterParser *parser, const char *word) {
+    size_t length = strlen(word);
+    skip_spaces(parser);
+    if(strncmp(parser->cursor, word, length) != 0) return 0;
+
+    char next = parser->cursor[length];
+    if(isalnum((unsigned char)next) || next == '_') return 0;
+
+    parser->cursor += length;
+    return 1;
+}
+
+static int accept_symbol(FilterParser *parser, const char *symbol) {
+    size_t length = strlen(symbol);
+    skip_spaces(parser);
+    if(strncmp(parser->cursor, symbol, length) != 0) return 0;
+
+    parser->cursor += length;
+    return 1;
+}
+
+static int emit(FilterParser *parser, RowFilterOp op) {
+    if(parser->program.op_count == ROW_FILTER_MAX_OPS) return -1;
+
+    if(op.opcode == ROW_FILTER_OP_COMPARE) {
+        if(parser->depth == ROW_FILTER_MAX_DEPTH) return -1;
+        ++parser->depth;
+    } else if(op.opcode != ROW_FILTER_OP_NOT) {
+        --parser->depth;
+    }
+
+    parser->program.ops[parser->program.op_count++] = op;
+    return 0;
+}
+
+static int parse_or(FilterParser *parser);
+
+/*
+    field op value
+*/
+static int parse_comparison(FilterParser *parser) {
+    RowFilterOp op = { .opcode = ROW_FILTER_OP_COMPARE };
+
+    skip_spaces(parser);
+    const char *name = parser->cursor;
+    while(isalpha((unsigned char)*parser->cursor)) ++parser->cursor;
+    if(sort_field_lookup(name, (size_t)(parser->cursor - name), &op.field) != 0) return -1;
+
+    /* Two character operators first, "<" would otherwise match the start of "<=" */
+    if(accept_symbol(parser, "==") || accept_symbol(parser, "=")) op.comparison = ROW_FILTER_EQUAL;
+    else if(accept_symbol(parser, "!=")) op.comparison = ROW_FILTER_NOT_EQUAL;
+    else if(accept_symbol(parser, "<=")) op.comparison = ROW_FILTER_LESS_EQUAL;
+    else if(accept_symbol(parser, "<")) op.comparison = ROW_FILTER_LESS;
+    else if(accept_symbol(parser, ">=")) op.comparison = ROW_FILTER_GREATER_EQUAL;
+    else if(accept_symbol(parser, ">")) op.comparison = ROW_FILTER_GREATER;
+    else return -1;
+
+    skip_spaces(parser);
+    const char *value = parser->cursor;
+    while(isalnum((unsigned char)*parser->cursor) || (*parser->cursor != '\0' && strchr("+-.:", *parser->cursor) != NULL)) {
+        ++parser->cursor;
+    }
+
+    if(op.field == SORT_FIELD_DEPARTURE_TIME) {
+        uint16_t minutes;
+        if(parse_time_field(value, parser->cursor, &minutes) != FIELD_PARSE_OK) return -1;
+        op.value = minutes;
+    } else {
+        /* NaN would never compare equal to anything, so it's rejected instead of matching nothing */
+        if(parse_decimal_field(value, parser->cursor, &op.value) != FIELD_PARSE_OK || op.value != op.value) return -1;
+    }
+
+    return emit(parser, op);
+}
+
+static int parse_unary(FilterParser *parser) {
+    if(++parser->nesting > ROW_FILTER_MAX_NESTING) return -1;
+
+    int status;
+    if(accept_word(parser, "not") || accept_symbol(parser, "!")) {
+        status = parse_unary(parser);
+        if(status == 0) status = emit(parser, (RowFilterOp){ .opcode = ROW_FILTER_OP_NOT });
+    } else if(accept_symbol(parser, "(")) {
+        status = parse_or(parser);
+        if(status == 0 && !accept_symbol(parser, ")")) status = -1;
+    } else {
+        status = parse_comparison(parser);
+    }
+
+    --parser->nesting;
+    return status;
+}
+
+static int parse_and(FilterParser *parser) {
+    if(parse_unary(parser) != 0) return -1;
+
+    while(accept_word(parser, "and") || accept_symbol(parser, "&&")) {
+        if(parse_unary(parser) != 0 || emit(parser, (RowFilterOp){ .opcode = ROW_FILTER_OP_AND }) != 0) return -1;
+    }
+    return 0;
+}
+
+static int parse_or(FilterParser *parser) {
+    if(parse_and(parser) != 0) return -1;
+
+    while(accept_word(parser, "or") || accept_symbol(parser, "||")) {
+        if(parse_and(parser) != 0 || emit(parser, (RowFilterOp){ .opcode = ROW_FILTER_OP_OR }) != 0) return -1;
+    }
+    return 0;
+}
+
+int row_filter_compile(const char *text, RowFilter *filter) {
+    FilterParser parser = { .cursor = text, .depth = 0, .nesting = 0 };
+    parser.program.op_count = 0;
+
+    if(parse_or(&parser) != 0) return -1;
+
+    skip_spaces(&parser);
+    if(*parser.cursor != '\0') return -1;
+
+    *filter = parser.program;
+    return 0;
+}
+
+static double field_value(const BusLineProperties *bus_line, SortField field) {
+    switch(field) {
+        case SORT_FIELD_LINE_NUMBER: return bus_line->line_number;
+        case SORT_FIELD_DEPARTURE_TIME: return bus_line->departure_minutes;
+        case SORT_FIELD_SUBSIDY_LEVEL: return bus_line->subsidy_level;
+        case SORT_FIELD_ADULTS: return bus_line->passengers.adult;
+        case SORT_FIELD_STUDENTS: return bus_line->passengers.student;
+        case SORT_FIELD_SENIORS: return bus_line->passengers.senior;
+        case SORT_FIELD_PASSENGERS:
+            return (double)bus_line->passengers.adult + bus_line->passengers.student + bus_line->passengers.senior;
+        case SORT_FIELD_ROUTE_LENGTH: return bus_line->route_length;
+        case SORT_FIELD_PROFITABILITY: return bus_line->profitability;
+    }
+    return 0.0;
+}
+
+static int compare_value(double value, RowFilterComparison comparison, double constant) {
+    switch(comparison) {
+        case ROW_FILTER_EQUAL: return value == constant;
+        case ROW_FILTER_NOT_EQUAL: return value != constant;
+        case ROW_FILTER_LESS: return value < constant;
+        case ROW_FILTER_LESS_EQUAL: return value <= constant;
+        case ROW_FILTER_GREATER: return value > constant;
+        case ROW_FILTER_GREATER_EQUAL: return value >= constant;
+    }
+    return 0;
+}
+
+int row_filter_matches(const RowFilter *filter, const BusLineProperties *bus_line) {
+    if(filter->op_count == 0) return 1;
+
+    int stack[ROW_FILTER_MAX_DEPTH];
+    size_t depth = 0;
+
+    for(size_t i = 0; i < filter->op_count; ++i) {
+        const RowFilterOp *op = &filter->ops[i];
+        switch(op->opcode) {
+            case ROW_FILTER_OP_COMPARE:
+                stack[depth++] = compare_value(field_value(bus_line, op->field), op->comparison, op->value);
+                break;
+            case ROW_FILTER_OP_AND:
+                --depth;
+                stack[depth - 1] = stack[depth - 1] && stack[depth];
+                break;
+            case ROW_FILTER_OP_OR:
+                --depth;
+                stack[depth - 1] = stack[depth - 1] || stack[depth];
+                break;
+            case ROW_FILTER_OP_NOT:
+                stack[depth - 1] = !stack[depth - 1];
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+/*
+    Copies one column of the block into values - the switch is outside of the loops, so every loop is a plain
+    strided load the compiler can unroll
+*/
+static void gather_column(const BusLineProperties *bus_lines, size_t count, SortField field, double *values) {
+    switch(field) {
+        case SORT_FIELD_LINE_NUMBER:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].line_number;
+            break;
+        case SORT_FIELD_DEPARTURE_TIME:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].departure_minutes;
+            break;
+        case SORT_FIELD_SUBSIDY_LEVEL:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].subsidy_level;
+            break;
+        case SORT_FIELD_ADULTS:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].passengers.adult;
+            break;
+        case SORT_FIELD_STUDENTS:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].passengers.student;
+            break;
+        case SORT_FIELD_SENIORS:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].passengers.senior;
+            break;
+        case SORT_FIELD_PASSENGERS:
+            for(size_t i = 0; i < count; ++i) {
+                const Passengers *passengers = &bus_lines[i].passengers;
+                values[i] = (double)passengers->adult + passengers->student + passengers->senior;
+            }
+            break;
+        case SORT_FIELD_ROUTE_LENGTH:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].route_length;
+            break;
+        case SORT_FIELD_PROFITABILITY:
+            for(size_t i = 0; i < count; ++i) values[i] = bus_lines[i].profitability;
+            break;
+    }
+}
+
+/*
+    One bitmap word per 64 values - bit b of word w is set if values[w * 64 + b] passes the comparison
+*/
+#define COMPARE_WORDS(test) \
+    for(size_t w = 0; w < word_count; ++w) { \
+        const double *word_values = values + w * 64; \
+        uint64_t bits = 0; \
+        for(unsigned b = 0; b < 64; ++b) bits |= (uint64_t)(word_values[b] test constant) << b; \
+        words[w] = bits; \
+    }
+
+static void compare_column(const double *values, size_t word_count, RowFilterComparison comparison, double constant, uint64_t *words) {
+    switch(comparison) {
+        case ROW_FILTER_EQUAL: COMPARE_WORDS(==) break;
+        case ROW_FILTER_NOT_EQUAL: COMPARE_WORDS(!=) break;
+        case ROW_FILTER_LESS: COMPARE_WORDS(<) break;
+        case ROW_FILTER_LESS_EQUAL: COMPARE_WORDS(<=) break;
+        case ROW_FILTER_GREATER: COMPARE_WORDS(>) break;
+        case ROW_FILTER_GREATER_EQUAL: COMPARE_WORDS(>=) break;
+    }
+}
+
+#undef COMPARE_WORDS
+
+/*
+    Runs the program over up to ROW_FILTER_BLOCK_ROWS rows and writes their bits into result
+    (the bits past count are cleared)
+*/
+static void evaluate_block(const RowFilter *filter, const BusLineProperties *bus_lines, size_t count, uint64_t *result) {
+    double values[ROW_FILTER_BLOCK_ROWS];
+    uint64_t stack[ROW_FILTER_MAX_DEPTH][ROW_FILTER_BLOCK_WORDS];
+    size_t word_count = (count + 63) / 64;
+    size_t depth = 0;
+
+    /* The tail of a short block compares zeros, its bits are masked away below */
+    for(size_t i = count; i < word_count * 64; ++i) values[i] = 0.0;
+
+    if(filter->op_count == 0) {
+        for(size_t w = 0; w < word_count; ++w) stack[0][w] = UINT64_MAX;
+        depth = 1;
+    }
+
+    for(size_t i = 0; i < filter->op_count; ++i) {
+        const RowFilterOp *op = &filter->ops[i];
+        switch(op->opcode) {
+            case ROW_FILTER_OP_COMPARE:
+                gather_column(bus_lines, count, op->field, values);
+                compare_column(values, word_count, op->comparison, op->value, stack[depth++]);
+                break;
+            case ROW_FILTER_OP_AND:
+                --depth;
+                for(size_t w = 0; w < word_count; ++w) stack[depth - 1][w] &= stack[depth][w];
+                break;
+            case ROW_FILTER_OP_OR:
+                --depth;
+                for(size_t w = 0; w < word_count; ++w) stack[depth - 1][w] |= stack[depth][w];
+                break;
+            case ROW_FILTER_OP_NOT:
+                for(size_t w = 0; w < word_count; ++w) stack[depth - 1][w] = ~stack[depth - 1][w];
+                break;
+        }
+    }
+
+    memcpy(result, stack[0], word_count * sizeof(uint64_t));
+    if(count % 64 != 0) result[word_count - 1] &= ((uint64_t)1 << (count % 64)) - 1;
+}
+
+typedef struct {
+    const RowFilter *filter;
+    const BusLineProperties *bus_lines;
+    size_t count;
+    size_t block_count;
+    uint64_t *bitmap;
+} FilterJob;
+
+static void filter_task(size_t task_index, void *context) {
+    FilterJob *job = context;
+    size_t first_block = task_index * ROW_FILTER_TASK_BLOCKS;
+    size_t last_block = first_block + ROW_FILTER_TASK_BLOCKS;
+    if(last_block > job->block_count) last_block = job->block_count;
+
+    /* Blocks are a whole number of bitmap words, so the tasks never share a word */
+    for(size_t block = first_block; block < last_block; ++block) {
+        size_t begin = block * ROW_FILTER_BLOCK_ROWS;
+        size_t end = begin + ROW_FILTER_BLOCK_ROWS;
+        if(end > job->count) end = job->count;
+
+        evaluate_block(job->filter, job->bus_lines + begin, end - begin, job->bitmap + begin / 64);
+    }
+}
+
+int row_filter_select(const RowFilter *filter, const BusLineProperties *bus_lines, size_t count, unsigned thread_count,
+                      Arena *arena, size_t **selection, size_t *selected_count) {
+    *selection = NULL;
+    *selected_count = 0;
+
+    size_t word_count = (count + 63) / 64;
+    uint64_t *bitmap = malloc((word_count + 1) * sizeof(uint64_t));
+    if(bitmap == NULL) return -1;
+    run_stats_allocation((word_count + 1) * sizeof(uint64_t));
+
+    FilterJob job = { .filter = filter, .bus_lines = bus_lines, .count = count, .bitmap = bitmap };
+    job.block_count = (count + ROW_FILTER_BLOCK_ROWS - 1) / ROW_FILTER_BLOCK_ROWS;
+    size_t task_count = (job.block_count + ROW_FILTER_TASK_BLOCKS - 1) / ROW_FILTER_TASK_BLOCKS;
+    worker_pool_run(thread_count, task_count, filter_task, &job);
+
+    size_t matching = 0;
+    for(size_t w = 0; w < word_count; ++w) matching += (size_t)__builtin_popcountll(bitmap[w]);
+
+    /* malloc(0) may return NULL, so there is always room for at least one index */
+    size_t bytes = (matching + 1) * sizeof(size_t);
+    size_t *rows = arena ? arena_alloc(arena, bytes, 0) : malloc(bytes);
+    if(rows == NULL) {
+        free(bitmap);
+        return -1;
+    }
+    if(arena == NULL) run_stats_allocation(bytes);
+
+    size_t selected = 0;
+    for(size_t w = 0; w < word_count; ++w) {
+        uint64_t bits = bitmap[w];
+        while(bits != 0) {
+            rows[selected++] = w * 64 + (size_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+        }
+    }
+
+    free(bitmap);
+    *selection = rows;
+    *selected_count = selected;
+    return 0;
+}
@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "run_stats.h"
+
+static int stats_enabled = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t counters[STATS_COUNTER_COUNT];
+static double phase_seconds[STATS_PHASE_COUNT];
+static double phase_started[STATS_PHASE_COUNT];
+static double run_started;
+
+static const char *phase_names[STATS_PHASE_COUNT] = {
+    "load", "profitability", "filter", "summary", "selection", "group_by", "sort", "display", "write", "batch"
+};
+
+static const char *counter_names[STATS_COUNTER_COUNT] = {
+    "bytes_read", "rows_parsed", "rows_rejected",
+    "line_number", "departure_time", "subsidy_level", "adults", "students", "seniors", "route_length", "missing_fields",
+    "cache_hits", "rows_from_cache", "rows_written", "bytes_written", "allocations", "allocated_bytes"
+};
+
+static double monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+void run_stats_enable(void) {
+    stats_enabled = 1;
+    run_started = monotonic_seconds();
+}
+
+int run_stats_enabled(void) {
+    return stats_enabled;
+}
+
+void run_stats_phase_begin(StatsPhase phase) {
+    if(!stats_enabled) return;
+    phase_started[phase] = monotonic_seconds();
+}
+
+void run_stats_phase_end(StatsPhase phase) {
+    if(!stats_enabled) return;
+    phase_seconds[phase] += monotonic_seconds() - phase_started[phase];
+}
+
+void run_stats_add(StatsCounter counter, uint64_t amount) {
+    if(!stats_enabled) return;
+
+    pthread_mutex_lock(&stats_lock);
+    counters[counter] += amount;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+uint64_t run_stats_counter(StatsCounter counter) {
+    pthread_mutex_lock(&stats_lock);
+    uint64_t value = counters[counter];
+    pthread_mutex_unlock(&stats_lock);
+    return value;
+}
+
+void run_stats_allocation(uint64_t bytes) {
+    if(!stats_enabled) return;
+
+    pthread_mutex_lock(&stats_lock);
+    counters[STATS_ALLOCATIONS]++;
+    counters[STATS_ALLOCATED_BYTES] += bytes;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+int run_stats_write(const char *filename) {
+    int to_stderr = (filename == NULL || filename[0] == '\0');
+    FILE *file = to_stderr ? stderr : fopen(filename, "w");
+    if(file == NULL) {
+        fprintf(stderr, "[!!] FATAL Error: Could not open the statistics file '%s'.\n", filename);
+        return -1;
+    }
+
+    /* ru_maxrss is in kilobytes on Linux */
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+
+    pthread_mutex_lock(&stats_lock);
+
+    fprintf(file, "{\"total_s\": %.6f, \"phases_s\": {", monotonic_seconds() - run_started);
+    for(int phase = 0; phase < STATS_PHASE_COUNT; ++phase) {
+        fprintf(file, "%s\"%s\": %.6f", phase ? ", " : "", phase_names[phase], phase_seconds[phase]);
+    }
+
+    fprintf(file, "}, \"counters\": {");
+    for(int counter = 0; counter < STATS_COUNTER_COUNT; ++counter) {
+        if(counter == STATS_REJECTED_LINE_NUMBER) fprintf(file, ", \"rejected_by_reason\": {");
+
+        int first_in_group = (counter == 0 || counter == STATS_REJECTED_LINE_NUMBER);
+        fprintf(file, "%s\"%s\": %llu", first_in_group ? "" : ", ", counter_names[counter], (unsigned long long)counters[counter]);
+
+        if(counter == STATS_REJECTED_MISSING_FIELDS) fprintf(file, "}");
+    }
+
+    fprintf(file, "}, \"peak_rss_kb\": %ld, \"minor_page_faults\": %ld, \"major_page_faults\": %ld}\n",
+        usage.ru_maxrss, usage.ru_minflt, usage.ru_majflt);
+
+    pthread_mutex_unlock(&stats_lock);
+
+    if(to_stderr) return 0;
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -1,15 +1,94 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 #include <ctype.h>
+#include "compressed_input.h"
+#include "field_parser.h"
 #include "runtime_configuration_handler.h"
 
+/*
+    Upper bound for --threads / threads= (0 = one thread per online CPU)
+*/
+#define MAX_THREAD_COUNT 4096
+
+/*
+    Handles a single key=value pair from the [tariff] section of the configuration file
+*/
+static void tariff_config_handler(Tariff *tariff, const char *key, const char *val) {
+    double *amount = NULL;
+
+    if(strcmp(key, "cost_per_km") == 0) {
+        amount = &tariff->cost_per_km;
+    } else if(strcmp(key, "adult_ticket") == 0) {
+        amount = &tariff->adult_ticket;
+    } else if(strcmp(key, "student_ticket") == 0) {
+        amount = &tariff->student_ticket;
+    } else if(strcmp(key, "senior_ticket") == 0) {
+        amount = &tariff->senior_ticket;
+    } else if(strcmp(key, "level1_subsidy") == 0) {
+        amount = &tariff->level_subsidy[1];
+    } else if(strcmp(key, "level2_subsidy") == 0) {
+        amount = &tariff->level_subsidy[2];
+    } else if(strcmp(key, "level3_subsidy") == 0) {
+        amount = &tariff->level_subsidy[3];
+    } else if(strcmp(key, "senior_ticket_levels") == 0) {
+        /*
+            Comma separated list of the subsidy levels on which seniors pay for their tickets, e.g. 1,2
+        */
+        int levels[SUBSIDY_LEVEL_COUNT + 1] = {0};
+        for(const char *cursor = val; *cursor != '\0'; ++cursor) {
+            if(*cursor == ',') continue;
+            if(*cursor < '1' || *cursor > '0' + SUBSIDY_LEVEL_COUNT) {
+                fprintf(stderr, "[!] Warning : Invalid tariff value '%s' for '%s' - keeping the previous levels.\n", val, key);
+                return;
+            }
+            levels[*cursor - '0'] = 1;
+        }
+        memcpy(tariff->senior_ticket_levels, levels, sizeof(levels));
+        return;
+    } else {
+        fprintf(stderr, "[!] Warning : Unknown tariff setting '%s'.\n", key);
+        return;
+    }
+
+    double parsed;
+    if(parse_decimal_field(val, val + strlen(val), &parsed) != FIELD_PARSE_OK) {
+        fprintf(stderr, "[!] Warning : Invalid tariff value '%s' for '%s' - keeping %.2f.\n", val, key, *amount);
+        return;
+    }
+
+    *amount = parsed;
+}
+
 void runtime_config_load_handler(FileSettings *settings, const char* configuration_file) {
     strcpy(settings->input_file, "../data/bus_lines_data.txt");
     strcpy(settings->output_file, "../data/buslines_analysis_report.txt");
     settings->stdout_output_enabled = 1;
     settings->file_output_enabled = 1;
+    settings->thread_count = 0;
+    tariff_set_defaults(&settings->tariff);
+    sort_spec_set_default(&settings->sort_spec);
+    settings->group_spec.key_count = 0;
+    settings->where_filter.op_count = 0;
+    settings->line_lookup = 0;
+    settings->first_line = 0;
+    settings->last_line = 0;
+    settings->top_k = 0;
+    settings->bottom_k = 0;
+    settings->summary_only = 0;
+    settings->huge_pages = 0;
+    settings->exact = 0;
+    settings->cache_enabled = 1;
+    settings->follow = 0;
+    settings->follow_interval = 5;
+    settings->batch_path[0] = '\0';
+    settings->serve_socket[0] = '\0';
+    settings->stats_enabled = 0;
+    settings->stats_file[0] = '\0';
+    strcpy(settings->gzip_path, COMPRESSED_INPUT_GZIP_PATH);
+    strcpy(settings->zstd_path, COMPRESSED_INPUT_ZSTD_PATH);
 
     FILE *file = fopen(configuration_file, "r");
     // assert(file != NULL && "[!] FATAL Error: Unable to load pre-set configuration from the configuration file.");
@@ -21,16 +100,33 @@ void runtime_config_load_handler(FileSettings *settings, const char* configurati
     char line[256];
     char key[64];
     char val[192];
+    char section[64] = "";
 
     while(fgets(line, sizeof(line), file) != NULL) {
         if (line[0] == '#' || line[0] == '\n') continue;
 
+        /*
+            Section headers such as [tariff] - keys before the first header are the general settings
+        */
+        if (line[0] == '[') {
+            if (sscanf(line, "[%63[^]]]", section) != 1) strcpy(section, "?");
+            if (strcmp(section, "tariff") != 0) {
+                fprintf(stderr, "[!] Warning : Unknown configuration section '%s' - its settings are ignored.\n", section);
+            }
+            continue;
+        }
+
         if (sscanf(line, "%63[^=]=%191s", key, val) == 2) {
             char *key_end = key + strlen(key) - 1;
             while(key_end > key && isspace((unsigned char)*key_end)) {
                 *--key_end = '\0';
             }
 
+            if(section[0] != '\0') {
+                if(strcmp(section, "tariff") == 0) tariff_config_handler(&settings->tariff, key, val);
+                continue;
+            }
+
             /*
                 I hate implementing stacked if and else-if branches and avoid them as much as possible, 
                 but in this case I'm unable to use the 'switch' statement as it requires an argument of integral type ¯\_(ツ)_/¯
@@ -44,6 +140,45 @@ void runtime_config_load_handler(FileSettings *settings, const char* configurati
                 settings->stdout_output_enabled = atoi(val);
             } else if (strcmp(key, "file_output") == 0) {
                 settings->file_output_enabled = atoi(val);
+            } else if (strcmp(key, "threads") == 0) {
+                int32_t threads;
+                if (parse_int_field(val, val + strlen(val), 0, MAX_THREAD_COUNT, &threads) == FIELD_PARSE_OK) {
+                    settings->thread_count = (unsigned)threads;
+                } else {
+                    fprintf(stderr, "[!] Warning : Invalid thread count '%s' (0-%d) - keeping %u.\n", val, MAX_THREAD_COUNT, settings->thread_count);
+                }
+            } else if (strcmp(key, "follow_interval") == 0) {
+                if (atoi(val) > 0) settings->follow_interval = (unsigned)atoi(val);
+            } else if (strcmp(key, "cache") == 0) {
+                settings->cache_enabled = atoi(val);
+            } else if (strcmp(key, "huge_pages") == 0) {
+                settings->huge_pages = atoi(val);
+            } else if (strcmp(key, "summary_only") == 0) {
+                settings->summary_only = atoi(val);
+            } else if (strcmp(key, "exact") == 0) {
+                settings->exact = atoi(val);
+            } else if (strcmp(key, "gzip_path") == 0 || strcmp(key, "zstd_path") == 0) {
+                char *path = (key[0] == 'g') ? settings->gzip_path : settings->zstd_path;
+                if (val[0] == '/' && strlen(val) < sizeof(settings->gzip_path)) {
+                    strcpy(path, val);
+                } else {
+                    fprintf(stderr, "[!] Warning : %s must be an absolute path - keeping '%s'.\n", key, path);
+                }
+            } else if (strcmp(key, "sort_by") == 0) {
+                if (sort_spec_parse(val, &settings->sort_spec) != 0) {
+                    fprintf(stderr, "[!] Warning : Invalid sort order '%s' - keeping the default order.\n", val);
+                }
+            } else if (strcmp(key, "group_by") == 0) {
+                if (group_spec_parse(val, &settings->group_spec) != 0) {
+                    fprintf(stderr, "[!] Warning : Invalid grouping '%s' - reporting the bus lines one by one.\n", val);
+                }
+            } else if (strcmp(key, "where") == 0) {
+                /* The expression may contain spaces, so it's the rest of the line rather than the first word */
+                char *expression = strchr(line, '=') + 1;
+                expression[strcspn(expression, "\r\n")] = '\0';
+                if (row_filter_compile(expression, &settings->where_filter) != 0) {
+                    fprintf(stderr, "[!] Warning : Invalid filter '%s' - reporting every bus line.\n", expression);
+                }
             }
         }
     }
@@ -51,6 +186,36 @@ void runtime_config_load_handler(FileSettings *settings, const char* configurati
     fclose(file);
 }
 
+/*
+    Options that only some modes support - the others would quietly ignore them (and e.g. report every bus line),
+    so such combinations are refused instead, whether the option came from the command line or from the
+    configuration file:
+        --group-by, --line / --lines    the regular analysis
+        --where                         the regular analysis and --summary-only
+        --top / --bottom                the regular analysis, --batch and --follow (--serve has its own queries)
+*/
+static void check_mode_options(const FileSettings *settings) {
+    const char *mode = settings->batch_path[0] != '\0' ? "--batch"
+                     : settings->serve_socket[0] != '\0' ? "--serve"
+                     : settings->follow ? "--follow"
+                     : settings->summary_only ? "--summary-only" : NULL;
+    if (mode == NULL) return;
+
+    int summary_only = strcmp(mode, "--summary-only") == 0;
+    int ranked = strcmp(mode, "--batch") == 0 || strcmp(mode, "--follow") == 0;
+
+    const char *option = NULL;
+    if (settings->group_spec.key_count > 0) option = "--group-by";
+    else if (settings->line_lookup) option = (settings->first_line == settings->last_line) ? "--line" : "--lines";
+    else if (settings->where_filter.op_count > 0 && !summary_only) option = "--where";
+    else if ((settings->top_k > 0 || settings->bottom_k > 0) && !ranked) option = (settings->top_k > 0) ? "--top" : "--bottom";
+
+    if (option != NULL) {
+        fprintf(stderr, "[!!] FATAL Error: %s can't be combined with %s, which doesn't support it.\n", option, mode);
+        exit(1);
+    }
+}
+
 void cli_argument_handler(int argc, char **argv, FileSettings *settings) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--input") == 0) {
@@ -71,16 +236,125 @@ void cli_argument_handler(int argc, char **argv, FileSettings *settings) {
             settings->stdout_output_enabled = 0;
         } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--no-file") == 0) {
             settings->file_output_enabled = 0;
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) {
+            int32_t threads = 0;
+            if (i + 1 < argc && parse_int_field(argv[i + 1], argv[i + 1] + strlen(argv[i + 1]), 0, MAX_THREAD_COUNT, &threads) == FIELD_PARSE_OK) {
+                settings->thread_count = (unsigned)threads;
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a thread count (0-%d) after %s\n", MAX_THREAD_COUNT, argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--sort-by") == 0) {
+            if (i + 1 < argc && sort_spec_parse(argv[i + 1], &settings->sort_spec) == 0) {
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a sort order such as 'subsidy,-profit' after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--group-by") == 0) {
+            if (i + 1 < argc && group_spec_parse(argv[i + 1], &settings->group_spec) == 0) {
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected group keys such as 'line,hour' after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--where") == 0) {
+            if (i + 1 < argc && row_filter_compile(argv[i + 1], &settings->where_filter) == 0) {
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a filter such as 'subsidy = 2 and profit < 0' after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 1 < argc && strlen(argv[i + 1]) < sizeof(settings->batch_path)) {
+                strcpy(settings->batch_path, argv[++i]);
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a directory or a glob pattern after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 < argc && strlen(argv[i + 1]) < sizeof(settings->serve_socket)) {
+                strcpy(settings->serve_socket, argv[++i]);
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a socket path after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            settings->stats_enabled = 1;
+        } else if (strcmp(argv[i], "--stats-file") == 0) {
+            if (i + 1 < argc && strlen(argv[i + 1]) < sizeof(settings->stats_file)) {
+                strcpy(settings->stats_file, argv[++i]);
+                settings->stats_enabled = 1;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Missing filename after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--follow") == 0) {
+            settings->follow = 1;
+        } else if (strcmp(argv[i], "--interval") == 0) {
+            int32_t interval = 0;
+            if (i + 1 < argc && parse_int_field(argv[i + 1], argv[i + 1] + strlen(argv[i + 1]), 1, 86400, &interval) == FIELD_PARSE_OK) {
+                settings->follow_interval = (unsigned)interval;
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a number of seconds (1-86400) after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            settings->cache_enabled = 0;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            settings->huge_pages = 1;
+        } else if (strcmp(argv[i], "--summary-only") == 0) {
+            settings->summary_only = 1;
+        } else if (strcmp(argv[i], "--exact") == 0) {
+            settings->exact = 1;
+        } else if (strcmp(argv[i], "--top") == 0 || strcmp(argv[i], "--bottom") == 0) {
+            int32_t row_limit = 0;
+            if (i + 1 < argc && parse_int_field(argv[i + 1], argv[i + 1] + strlen(argv[i + 1]), 1, INT32_MAX, &row_limit) == FIELD_PARSE_OK) {
+                if (strcmp(argv[i], "--top") == 0) {
+                    settings->top_k = (size_t)row_limit;
+                } else {
+                    settings->bottom_k = (size_t)row_limit;
+                }
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a positive number of bus lines after %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--line") == 0 || strcmp(argv[i], "--lines") == 0) {
+            /* --line N or --lines A-B (line numbers are positive, so the first '-' separates the two) */
+            const char *range = (i + 1 < argc) ? argv[i + 1] : "";
+            const char *separator = strchr(range, '-');
+            const char *range_end = range + strlen(range);
+            int32_t first = 0, last = 0;
+
+            int valid = separator == NULL
+                ? parse_int_field(range, range_end, 1, INT32_MAX, &first) == FIELD_PARSE_OK
+                : parse_int_field(range, separator, 1, INT32_MAX, &first) == FIELD_PARSE_OK &&
+                  parse_int_field(separator + 1, range_end, 1, INT32_MAX, &last) == FIELD_PARSE_OK && first <= last;
+
+            if (valid) {
+                settings->line_lookup = 1;
+                settings->first_line = first;
+                settings->last_line = separator == NULL ? first : last;
+                ++i;
+            } else {
+                fprintf(stderr, "[!!] FATAL Error: Expected a line number such as 214 or a range such as 200-250 after %s\n", argv[i]);
+                exit(1);
+            }
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             runtime_usage_print_handler(argv[0]);
             exit(0);
-        } else if (i == 1 && argv[i][0] != '-') {
+        } else if (i == 1 && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)) {
             /* First argument as input file (just for convenience >:DD) */
             strcpy(settings->input_file, argv[i]);
         } else {
             fprintf(stderr, "[!] Warning : Unknown option '%s'\n", argv[i]);
         }
     }
+
+    check_mode_options(settings);
 }
 
 void runtime_usage_print_handler(const char* executable_name) {
@@ -88,9 +362,43 @@ void runtime_usage_print_handler(const char* executable_name) {
     printf("---------------------------------------\n");
     printf("Usage: %s [options] [input_file]\n\n", executable_name);
     printf("Options:\n");
-    printf("  -i, --input FILE    Specify input file (default: from config)\n");
+    printf("  -i, --input FILE    Specify input file (default: from config), - reads from stdin\n");
     printf("  -o, --output FILE   Specify output file (default: from config)\n");
     printf("  -s, --no-screen     Disable output to screen\n");
     printf("  -f, --no-file       Disable output to file\n");
+    printf("  -t, --threads N     Number of worker threads (default: 0 = one per CPU)\n");
+    printf("  --sort-by KEYS      Comma separated sort keys, '-' for descending (default: subsidy,-profit)\n");
+    printf("                      keys: line, time, subsidy, adult, student, senior, passengers, length, profit\n");
+    printf("  --group-by KEYS     Report totals per group instead of every bus line - trips, passengers, min/max/avg\n");
+    printf("                      and total P/L per group; comma separated keys: line, hour, subsidy (not with --batch,\n");
+    printf("                      --serve, --follow or --summary-only)\n");
+    printf("  --where EXPR        Only analyse the bus lines that match EXPR, e.g. 'subsidy = 2 and (profit < 0 or\n");
+    printf("                      time >= 17:00)' - the sort keys compared with = != < <= > >=, and/or/not, parentheses\n");
+    printf("                      (not with --batch, --serve or --follow)\n");
+    printf("  --line N            Only report the bus lines with line number N, looked up through <input>.blidx\n");
+    printf("  --lines A-B         Same for the line numbers A to B - the index is written next to the input file on\n");
+    printf("                      the first lookup and reused until the input changes (unless --no-cache is given;\n");
+    printf("                      not with --batch, --serve, --follow or --summary-only)\n");
+    printf("  --batch DIR|GLOB    Analyse every file in a directory (or matching a quoted glob pattern) concurrently,\n");
+    printf("                      each into <file>.report.txt, plus a merged report with the combined totals\n");
+    printf("                      written to the output file\n");
+    printf("  --serve SOCKET      Load the input once and answer queries on the Unix socket SOCKET until interrupted:\n");
+    printf("                      summary, top K, bottom K, line N, lines A-B, where EXPR, reload, quit (one per line,\n");
+    printf("                      each answered with the rows and an OK/ERR line) - SIGHUP reloads the input as well\n");
+    printf("  --stats             Print runtime statistics (time per phase, rows, bytes, rejects, peak memory)\n");
+    printf("                      as JSON to stderr at the end of the run\n");
+    printf("  --stats-file FILE   Same as --stats, but the JSON is written to FILE\n");
+    printf("  --follow            Keep watching the input file and report appended rows (top/bottom 10 per level\n");
+    printf("                      unless --top/--bottom are given) until interrupted with Ctrl+C\n");
+    printf("  --interval SECONDS  Time between two reports while following (default: 5)\n");
+    printf("  --no-cache          Always parse the input file, without reading or writing <input>.blcache\n");
+    printf("  --huge-pages        Back the bus lines of large inputs with transparent huge pages (fewer TLB misses)\n");
+    printf("  --summary-only      Stream the input and only report the totals per subsidy level (constant memory)\n");
+    printf("  --exact             Calculate in whole cents with integer arithmetic - every total is exact and equal\n");
+    printf("                      to the sum of the reported rows (the tariffs have to be whole cents)\n");
+    printf("  --top K             Only report the K most profitable bus lines of each subsidy level\n");
+    printf("  --bottom K          Only report the K least profitable bus lines of each subsidy level\n");
+    printf("                      (--top and --bottom can be combined, the totals still cover every bus line;\n");
+    printf("                      not with --serve or --summary-only)\n");
     printf("  -h, --help          Display this help message\n");
 }
\ No newline at end of file
@@ -0,0 +1,528 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bus_line_cache.h"
+#include "field_parser.h"
+#include "row_filter.h"
+#include "serve_mode.h"
+#include "sort_engine.h"
+
+/*
+    How often the accept loop wakes up to look at the signal flags
+*/
+#define SERVE_POLL_MILLISECONDS 500
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t reload_requested = 0;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+static void request_reload(int signal_number) {
+    (void)signal_number;
+    reload_requested = 1;
+}
+
+static void snapshot_destroy(ServeSnapshot *snapshot) {
+    free(snapshot->index);
+    arena_release(&snapshot->arena);
+    free(snapshot);
+}
+
+/*
+    Reads the input and prepares everything the queries need - the rows are never modified after this
+*/
+static ServeSnapshot *snapshot_load(const FileSettings *settings) {
+    ServeSnapshot *snapshot = calloc(1, sizeof(ServeSnapshot));
+    if(snapshot == NULL) return NULL;
+
+    arena_init(&snapshot->arena, 0, settings->huge_pages);
+    bus_line_store_init_arena(&snapshot->store, &snapshot->arena, 0);
+
+    int64_t read_count = bus_line_cache_read(settings->input_file, &snapshot->store, settings->thread_count, settings->cache_enabled);
+    if(read_count <= 0) {
+        snapshot_destroy(snapshot);
+        return NULL;
+    }
+
+    const BusLineProperties *bus_lines = snapshot->store.lines;
+    size_t count = snapshot->store.count;
+
+    calculate_profitability_parallel(snapshot->store.lines, count, settings->thread_count);
+    summarize_profitability(bus_lines, count, settings->thread_count, &snapshot->summary);
+
+    SortSpec spec;
+    sort_spec_set_default(&spec);
+    snapshot->report_order = arena_alloc(&snapshot->arena, (count + 1) * sizeof(size_t), 0);
+    if(snapshot->report_order == NULL) {
+        snapshot_destroy(snapshot);
+        return NULL;
+    }
+    for(size_t i = 0; i < count; ++i) snapshot->report_order[i] = i;
+
+    if(sort_engine_order_arena(bus_lines, snapshot->report_order, count, &spec, &snapshot->arena) != 0 ||
+       bus_line_index_build(bus_lines, count, &snapshot->index) != 0) {
+        snapshot_destroy(snapshot);
+        return NULL;
+    }
+
+    /* Every subsidy level is one contiguous range of the report order */
+    size_t level_count = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(i == 0 || bus_lines[snapshot->report_order[i]].subsidy_level != bus_lines[snapshot->report_order[i - 1]].subsidy_level) ++level_count;
+    }
+
+    snapshot->level_starts = arena_alloc(&snapshot->arena, (level_count + 1) * sizeof(size_t), 0);
+    if(snapshot->level_starts == NULL) {
+        snapshot_destroy(snapshot);
+        return NULL;
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        if(i == 0 || bus_lines[snapshot->report_order[i]].subsidy_level != bus_lines[snapshot->report_order[i - 1]].subsidy_level) {
+            snapshot->level_starts[snapshot->level_count++] = i;
+        }
+    }
+    snapshot->level_starts[level_count] = count;
+
+    snapshot->references = 1;
+    return snapshot;
+}
+
+int serve_state_init(ServeState *state, const FileSettings *settings) {
+    state->settings = settings;
+    state->current = snapshot_load(settings);
+    if(state->current == NULL) return -1;
+
+    pthread_mutex_init(&state->lock, NULL);
+    pthread_mutex_init(&state->reload_lock, NULL);
+    return 0;
+}
+
+void serve_state_free(ServeState *state) {
+    serve_snapshot_release(state, state->current);
+    state->current = NULL;
+
+    pthread_mutex_destroy(&state->lock);
+    pthread_mutex_destroy(&state->reload_lock);
+}
+
+ServeSnapshot *serve_snapshot_acquire(ServeState *state) {
+    pthread_mutex_lock(&state->lock);
+    ServeSnapshot *snapshot = state->current;
+    ++snapshot->references;
+    pthread_mutex_unlock(&state->lock);
+    return snapshot;
+}
+
+void serve_snapshot_release(ServeState *state, ServeSnapshot *snapshot) {
+    pthread_mutex_lock(&state->lock);
+    size_t references = --snapshot->references;
+    pthread_mutex_unlock(&state->lock);
+
+    if(references == 0) snapshot_destroy(snapshot);
+}
+
+int64_t serve_state_reload(ServeState *state) {
+    pthread_mutex_lock(&state->reload_lock);
+
+    /* The slow part runs without the query lock, the swap itself only takes a moment */
+    ServeSnapshot *snapshot = snapshot_load(state->settings);
+    int64_t count = -1;
+
+    if(snapshot != NULL) {
+        count = (int64_t)snapshot->store.count;
+
+        pthread_mutex_lock(&state->lock);
+        ServeSnapshot *previous = state->current;
+        state->current = snapshot;
+        pthread_mutex_unlock(&state->lock);
+
+        /* Drops the reference of being current - queries still running on it keep it alive */
+        serve_snapshot_release(state, previous);
+    }
+
+    pthread_mutex_unlock(&state->reload_lock);
+    return count;
+}
+
+/*
+    line,HH:MM,subsidy,adults,students,seniors,length,profit
+*/
+static void write_row(ReportWriter *response, const BusLineProperties *line) {
+    report_writer_int(response, line->line_number, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_time(response, line->departure_minutes, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_int(response, line->subsidy_level, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_int(response, line->passengers.adult, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_int(response, line->passengers.student, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_int(response, line->passengers.senior, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_fixed(response, line->route_length, 1, 0, 0);
+    report_writer_append(response, ",", 1);
+    report_writer_fixed(response, line->profitability, 2, 0, 0);
+    report_writer_append(response, "\n", 1);
+}
+
+static void write_summary(ReportWriter *response, const BusLineSummary *summary) {
+    report_writer_printf(response, "lines=%zu profitable=%zu unprofitable=%zu total=%.2f\n",
+                         summary->line_count, summary->profitable_lines, summary->unprofitable_lines, summary->total_profit);
+}
+
+/*
+    Parses "N" or "A-B" (positive numbers) - returns 0 on success
+*/
+static int parse_line_range(const char *text, int32_t *first, int32_t *last) {
+    const char *end = text + strlen(text);
+    const char *separator = strchr(text, '-');
+
+    if(separator == NULL) {
+        if(parse_int_field(text, end, 1, INT32_MAX, first) != FIELD_PARSE_OK) return -1;
+        *last = *first;
+        return 0;
+    }
+
+    if(parse_int_field(text, separator, 1, INT32_MAX, first) != FIELD_PARSE_OK ||
+       parse_int_field(separator + 1, end, 1, INT32_MAX, last) != FIELD_PARSE_OK) return -1;
+    return *first <= *last ? 0 : -1;
+}
+
+static void query_extremes(const ServeSnapshot *snapshot, int32_t k, int top, ReportWriter *response) {
+    size_t rows = 0;
+
+    for(size_t level = 0; level < snapshot->level_count; ++level) {
+        size_t begin = snapshot->level_starts[level], end = snapshot->level_starts[level + 1];
+        size_t size = end - begin, limit = (size_t)k < size ? (size_t)k : size;
+        if(top) end = begin + limit;
+        else begin = end - limit;
+
+        for(size_t i = begin; i < end; ++i) write_row(response, &snapshot->store.lines[snapshot->report_order[i]]);
+        rows += end - begin;
+    }
+
+    report_writer_printf(response, "OK %zu\n", rows);
+}
+
+static void query_lines(const ServeSnapshot *snapshot, int32_t first_line, int32_t last_line, ReportWriter *response) {
+    size_t begin = 0, end = 0;
+    bus_line_index_range(snapshot->index, snapshot->store.count, first_line, last_line, &begin, &end);
+
+    for(size_t i = begin; i < end; ++i) write_row(response, &snapshot->store.lines[snapshot->index[i].row]);
+    report_writer_printf(response, "OK %zu\n", end - begin);
+}
+
+static void query_where(const ServeSnapshot *snapshot, const char *expression, unsigned thread_count, ReportWriter *response) {
+    RowFilter filter;
+    if(row_filter_compile(expression, &filter) != 0) {
+        report_writer_puts(response, "ERR invalid filter\n");
+        return;
+    }
+
+    size_t *selection = NULL, selected_count = 0;
+    if(row_filter_select(&filter, snapshot->store.lines, snapshot->store.count, thread_count, NULL, &selection, &selected_count) != 0) {
+        report_writer_puts(response, "ERR out of memory\n");
+        return;
+    }
+
+    BusLineSummary summary;
+    summarize_profitability_selection(snapshot->store.lines, selection, selected_count, thread_count, &summary);
+    if(summary.exact_overflow) {
+        report_writer_puts(response, "ERR total too large for --exact\n");
+        free(selection);
+        return;
+    }
+
+    for(size_t i = 0; i < selected_count; ++i) write_row(response, &snapshot->store.lines[selection[i]]);
+    write_summary(response, &summary);
+    report_writer_printf(response, "OK %zu\n", selected_count);
+
+    free(selection);
+}
+
+/*
+    Splits "command argument" - returns the argument (without leading blanks) if the request starts with the command
+*/
+static const char *match_command(const char *request, const char *command) {
+    size_t length = strlen(command);
+    if(strncmp(request, command, length) != 0) return NULL;
+    if(request[length] != '\0' && request[length] != ' ' && request[length] != '\t') return NULL;
+
+    const char *argument = request + length;
+    while(*argument == ' ' || *argument == '\t') ++argument;
+    return argument;
+}
+
+int serve_execute(ServeState *state, const char *request, ReportWriter *response) {
+    const char *argument;
+    int close_connection = 0;
+
+    if(request[0] == '\0') return 0;
+
+    if((argument = match_command(request, "quit")) != NULL && *argument == '\0') {
+        report_writer_puts(response, "OK\n");
+        close_connection = 1;
+    } else if((argument = match_command(request, "reload")) != NULL && *argument == '\0') {
+        int64_t count = serve_state_reload(state);
+        if(count < 0) report_writer_puts(response, "ERR reload failed, still serving the previous data\n");
+        else report_writer_printf(response, "OK %lld\n", (long long)count);
+    } else {
+        ServeSnapshot *snapshot = serve_snapshot_acquire(state);
+        int32_t first = 0, last = 0;
+
+        if((argument = match_command(request, "summary")) != NULL && *argument == '\0') {
+            if(snapshot->summary.exact_overflow) {
+                report_writer_puts(response, "ERR total too large for --exact\n");
+            } else {
+                write_summary(response, &snapshot->summary);
+                report_writer_puts(response, "OK\n");
+            }
+        } else if((argument = match_command(request, "top")) != NULL || (argument = match_command(request, "bottom")) != NULL) {
+            if(parse_int_field(argument, argument + strlen(argument), 1, INT32_MAX, &first) == FIELD_PARSE_OK) {
+                query_extremes(snapshot, first, request[0] == 't', response);
+            } else {
+                report_writer_puts(response, "ERR expected a positive number of rows\n");
+            }
+        } else if((argument = match_command(request, "line")) != NULL || (argument = match_command(request, "lines")) != NULL) {
+            if(parse_line_range(argument, &first, &last) == 0) query_lines(snapshot, first, last, response);
+            else report_writer_puts(response, "ERR expected a line number or a range such as 200-250\n");
+        } else if((argument = match_command(request, "where")) != NULL) {
+            query_where(snapshot, argument, state->settings->thread_count, response);
+        } else {
+            report_writer_puts(response, "ERR unknown request\n");
+        }
+
+        serve_snapshot_release(state, snapshot);
+    }
+
+    report_writer_flush(response);
+    return close_connection;
+}
+
+/*
+    Connected clients - the server shuts their sockets down when it stops and waits for their threads
+*/
+typedef struct {
+    ServeState *state;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int fds[SERVE_MAX_CLIENTS];
+    size_t count;
+} ClientList;
+
+typedef struct {
+    ClientList *clients;
+    int fd;
+} ClientConnection;
+
+static void client_list_remove(ClientList *clients, int fd) {
+    pthread_mutex_lock(&clients->lock);
+    for(size_t i = 0; i < clients->count; ++i) {
+        if(clients->fds[i] == fd) {
+            clients->fds[i] = clients->fds[--clients->count];
+            break;
+        }
+    }
+    pthread_cond_signal(&clients->finished);
+    pthread_mutex_unlock(&clients->lock);
+}
+
+static void *client_main(void *argument) {
+    ClientConnection connection = *(ClientConnection *)argument;
+    free(argument);
+
+    ReportWriter response;
+    report_writer_init(&response, connection.fd);
+
+    char request[SERVE_MAX_REQUEST_BYTES];
+    size_t used = 0;
+    int done = 0;
+
+    while(!done) {
+        ssize_t received = read(connection.fd, request + used, sizeof(request) - 1 - used);
+        if(received < 0 && errno == EINTR) continue;
+        if(received <= 0) break;
+        used += (size_t)received;
+
+        /* Every complete line is one request, a partial one waits for the rest */
+        char *line = request;
+        char *newline;
+        while(!done && (newline = memchr(line, '\n', used - (size_t)(line - request))) != NULL) {
+            *newline = '\0';
+            if(newline > line && newline[-1] == '\r') newline[-1] = '\0';
+
+            done = serve_execute(connection.clients->state, line, &response) || response.error;
+            line = newline + 1;
+        }
+
+        used -= (size_t)(line - request);
+        memmove(request, line, used);
+
+        if(!done && used == sizeof(request) - 1) {
+            report_writer_puts(&response, "ERR request too long\n");
+            report_writer_flush(&response);
+            done = 1;
+        }
+    }
+
+    report_writer_close(&response);
+    client_list_remove(connection.clients, connection.fd);
+    close(connection.fd);
+    return NULL;
+}
+
+static void accept_client(ClientList *clients, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if(fd < 0) return;
+
+    pthread_mutex_lock(&clients->lock);
+    int full = clients->count == SERVE_MAX_CLIENTS;
+    if(!full) clients->fds[clients->count++] = fd;
+    pthread_mutex_unlock(&clients->lock);
+
+    if(full) {
+        static const char busy[] = "ERR too many clients\n";
+        ssize_t ignored = write(fd, busy, sizeof(busy) - 1);
+        (void)ignored;
+        close(fd);
+        return;
+    }
+
+    ClientConnection *connection = malloc(sizeof(ClientConnection));
+    pthread_attr_t attributes;
+    pthread_t thread;
+    int started = 0;
+
+    if(connection != NULL) {
+        *connection = (ClientConnection){ .clients = clients, .fd = fd };
+        pthread_attr_init(&attributes);
+        pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+        started = pthread_create(&thread, &attributes, client_main, connection) == 0;
+        pthread_attr_destroy(&attributes);
+    }
+
+    if(!started) {
+        free(connection);
+        client_list_remove(clients, fd);
+        close(fd);
+    }
+}
+
+/*
+    Binds the listening socket - a socket file left behind by a server that is no longer running is replaced
+    Returns the descriptor or -1 on error
+*/
+static int listen_on(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "[!!] FATAL Error: Socket path '%s' is too long.\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    if(!bound && errno == EADDRINUSE) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if(probe >= 0) close(probe);
+
+        if(alive) {
+            fprintf(stderr, "[!!] FATAL Error: Another server is already listening on '%s'.\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    }
+
+    if(!bound || listen(fd, SERVE_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: Could not listen on '%s'.\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_mode_run(const FileSettings *settings) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = request_reload;
+    sigaction(SIGHUP, &action, NULL);
+
+    /* A client that hangs up mid-response must not take the whole server down */
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+
+    ServeState state;
+    if(serve_state_init(&state, settings) != 0) {
+        fprintf(stderr, "[!!] FATAL Error: No valid data found in input file '%s'.\n", settings->input_file);
+        return EXIT_FAILURE;
+    }
+
+    int listen_fd = listen_on(settings->serve_socket);
+    if(listen_fd < 0) {
+        serve_state_free(&state);
+        return EXIT_FAILURE;
+    }
+
+    ClientList clients = { .state = &state, .count = 0 };
+    pthread_mutex_init(&clients.lock, NULL);
+    pthread_cond_init(&clients.finished, NULL);
+
+    printf("[*] Serving '%s' (%zu bus lines) on %s\n", settings->input_file, state.current->store.count, settings->serve_socket);
+    fflush(stdout);
+
+    while(!stop_requested) {
+        struct pollfd poll_fd = { .fd = listen_fd, .events = POLLIN };
+        int ready = poll(&poll_fd, 1, SERVE_POLL_MILLISECONDS);
+        if(ready < 0 && errno != EINTR) break;
+
+        if(reload_requested) {
+            reload_requested = 0;
+            int64_t count = serve_state_reload(&state);
+            if(count < 0) fprintf(stderr, "[!] Warning : Reload failed - still serving the previous data.\n");
+            else printf("[+] Reloaded '%s' (%lld bus lines)\n", settings->input_file, (long long)count);
+            fflush(stdout);
+        }
+
+        if(ready > 0 && (poll_fd.revents & POLLIN)) accept_client(&clients, listen_fd);
+    }
+
+    close(listen_fd);
+    unlink(settings->serve_socket);
+
+    /* Wakes up the clients waiting for their next request and waits until their threads are gone */
+    pthread_mutex_lock(&clients.lock);
+    for(size_t i = 0; i < clients.count; ++i) shutdown(clients.fds[i], SHUT_RDWR);
+    while(clients.count > 0) pthread_cond_wait(&clients.finished, &clients.lock);
+    pthread_mutex_unlock(&clients.lock);
+
+    pthread_cond_destroy(&clients.finished);
+    pthread_mutex_destroy(&clients.lock);
+    serve_state_free(&state);
+
+    printf("[+] Stopped serving on %s. Exiting...\n", settings->serve_socket);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+#include "run_stats.h"
+#include "sort_engine.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1u << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+/*
+    Below this many rows an insertion sort beats building the histograms
+*/
+#define SORT_SMALL_COUNT 32
+
+#define KEY_SIGN_BIT (UINT64_C(1) << 63)
+
+typedef struct {
+    const char *name;
+    SortField field;
+} SortFieldName;
+
+static const SortFieldName sort_field_names[] = {
+    {"line", SORT_FIELD_LINE_NUMBER},
+    {"time", SORT_FIELD_DEPARTURE_TIME},
+    {"subsidy", SORT_FIELD_SUBSIDY_LEVEL},
+    {"adult", SORT_FIELD_ADULTS},
+    {"student", SORT_FIELD_STUDENTS},
+    {"senior", SORT_FIELD_SENIORS},
+    {"passengers", SORT_FIELD_PASSENGERS},
+    {"length", SORT_FIELD_ROUTE_LENGTH},
+    {"profit", SORT_FIELD_PROFITABILITY}
+};
+
+void sort_spec_set_default(SortSpec *spec) {
+    spec->key_count = 2;
+    spec->keys[0].field = SORT_FIELD_SUBSIDY_LEVEL;
+    spec->keys[0].descending = 0;
+    spec->keys[1].field = SORT_FIELD_PROFITABILITY;
+    spec->keys[1].descending = 1;
+}
+
+int sort_field_lookup(const char *name, size_t length, SortField *field) {
+    size_t field_count = sizeof(sort_field_names) / sizeof(sort_field_names[0]);
+
+    for(size_t i = 0; i < field_count; ++i) {
+        if(strlen(sort_field_names[i].name) == length && strncmp(sort_field_names[i].name, name, length) == 0) {
+            *field = sort_field_names[i].field;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int sort_spec_parse(const char *text, SortSpec *spec) {
+    SortSpec parsed = { .key_count = 0 };
+    const char *cursor = text;
+
+    while(1) {
+        const char *token_end = strchr(cursor, ',');
+        if(token_end == NULL) token_end = cursor + strlen(cursor);
+
+        int descending = 0;
+        if(cursor < token_end && (*cursor == '-' || *cursor == '+')) {
+            descending = (*cursor == '-');
+            ++cursor;
+        }
+
+        SortField field;
+        if(sort_field_lookup(cursor, (size_t)(token_end - cursor), &field) != 0 || parsed.key_count == SORT_MAX_KEYS) return -1;
+
+        parsed.keys[parsed.key_count].field = field;
+        parsed.keys[parsed.key_count].descending = descending;
+        parsed.key_count++;
+
+        if(*token_end == '\0') break;
+        cursor = token_end + 1;
+    }
+
+    *spec = parsed;
+    return 0;
+}
+
+static int64_t integer_field(const BusLineProperties *line, SortField field) {
+    switch(field) {
+        case SORT_FIELD_LINE_NUMBER:   return line->line_number;
+        case SORT_FIELD_DEPARTURE_TIME: return line->departure_minutes;
+        case SORT_FIELD_SUBSIDY_LEVEL: return line->subsidy_level;
+        case SORT_FIELD_ADULTS:        return line->passengers.adult;
+        case SORT_FIELD_STUDENTS:      return line->passengers.student;
+        case SORT_FIELD_SENIORS:       return line->passengers.senior;
+        case SORT_FIELD_PASSENGERS:
+            return (int64_t)line->passengers.adult + line->passengers.student + line->passengers.senior;
+        default:                       return 0;
+    }
+}
+
+int sort_engine_compare(const BusLineProperties *bus_line_a, const BusLineProperties *bus_line_b, const SortSpec *spec) {
+    for(size_t k = 0; k < spec->key_count; ++k) {
+        SortField field = spec->keys[k].field;
+        int result;
+
+        if(field == SORT_FIELD_ROUTE_LENGTH || field == SORT_FIELD_PROFITABILITY) {
+            double a = (field == SORT_FIELD_ROUTE_LENGTH) ? bus_line_a->route_length : bus_line_a->profitability;
+            double b = (field == SORT_FIELD_ROUTE_LENGTH) ? bus_line_b->route_length : bus_line_b->profitability;
+            result = (a > b) - (a < b);
+        } else {
+            int64_t a = integer_field(bus_line_a, field);
+            int64_t b = integer_field(bus_line_b, field);
+            result = (a > b) - (a < b);
+        }
+
+        if(result != 0) return spec->keys[k].descending ? -result : result;
+    }
+
+    return 0;
+}
+
+/*
+    Order-preserving mappings to unsigned integers - flipping the sign bit moves negative integers below
+    the positive ones, negative doubles additionally get all their bits flipped so that a larger magnitude
+    sorts lower. Adding 0.0 turns -0.0 into 0.0 so that both zeroes get the same key (as in the comparison).
+*/
+static uint64_t integer_key(int64_t value) {
+    return (uint64_t)value ^ KEY_SIGN_BIT;
+}
+
+static uint64_t double_key(double value) {
+    uint64_t bits;
+    value += 0.0;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & KEY_SIGN_BIT) ? ~bits : (bits | KEY_SIGN_BIT);
+}
+
+static uint64_t row_key(const BusLineProperties *line, const SortKey *sort_key) {
+    uint64_t key;
+
+    switch(sort_key->field) {
+        case SORT_FIELD_ROUTE_LENGTH:   key = double_key(line->route_length); break;
+        case SORT_FIELD_PROFITABILITY:  key = double_key(line->profitability); break;
+        default:                        key = integer_key(integer_field(line, sort_key->field)); break;
+    }
+
+    return sort_key->descending ? ~key : key;
+}
+
+/*
+    Stable LSD radix sort of key/index pairs. All 8 histograms are built in a single pass over the keys,
+    a byte whose histogram has only one non-empty bucket is the same for every key and its pass is skipped.
+    The sorted pairs end up back in keys/indices.
+*/
+static void radix_sort_pairs(uint64_t *keys, size_t *indices, uint64_t *key_scratch, size_t *index_scratch, size_t count) {
+    size_t histogram[RADIX_PASSES][RADIX_BUCKETS] = {{0}};
+
+    for(size_t i = 0; i < count; ++i) {
+        uint64_t key = keys[i];
+        for(unsigned pass = 0; pass < RADIX_PASSES; ++pass) {
+            histogram[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    uint64_t *source_keys = keys, *target_keys = key_scratch;
+    size_t *source_indices = indices, *target_indices = index_scratch;
+
+    for(unsigned pass = 0; pass < RADIX_PASSES; ++pass) {
+        unsigned shift = pass * RADIX_BITS;
+        if(histogram[pass][(source_keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count) continue;
+
+        size_t offset = 0;
+        for(unsigned bucket = 0; bucket < RADIX_BUCKETS; ++bucket) {
+            size_t bucket_size = histogram[pass][bucket];
+            histogram[pass][bucket] = offset;
+            offset += bucket_size;
+        }
+
+        for(size_t i = 0; i < count; ++i) {
+            size_t target = histogram[pass][(source_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            target_keys[target] = source_keys[i];
+            target_indices[target] = source_indices[i];
+        }
+
+        uint64_t *swap_keys = source_keys;
+        source_keys = target_keys;
+        target_keys = swap_keys;
+        size_t *swap_indices = source_indices;
+        source_indices = target_indices;
+        target_indices = swap_indices;
+    }
+
+    if(source_keys != keys) {
+        memcpy(keys, source_keys, count * sizeof(uint64_t));
+        memcpy(indices, source_indices, count * sizeof(size_t));
+    }
+}
+
+static void insertion_sort_order(const BusLineProperties *bus_lines, size_t *order, size_t count, const SortSpec *spec) {
+    for(size_t i = 1; i < count; ++i) {
+        size_t current = order[i];
+        size_t j = i;
+        while(j > 0 && sort_engine_compare(&bus_lines[order[j - 1]], &bus_lines[current], spec) > 0) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = current;
+    }
+}
+
+/*
+    Scratch memory comes from the arena if there is one (it is rewound by the caller), otherwise from malloc
+*/
+static void *scratch_alloc(Arena *scratch, size_t bytes) {
+    if(scratch != NULL) return arena_alloc(scratch, bytes, ARENA_SIMD_ALIGNMENT);
+
+    void *memory = malloc(bytes);
+    if(memory != NULL) run_stats_allocation(bytes);
+    return memory;
+}
+
+static void scratch_free(Arena *scratch, void *memory) {
+    if(scratch == NULL) free(memory);
+}
+
+static int order_rows(const BusLineProperties *bus_lines, size_t *order, size_t count, const SortSpec *spec, Arena *scratch) {
+    if(count < 2 || spec->key_count == 0) return 0;
+
+    if(count < SORT_SMALL_COUNT) {
+        insertion_sort_order(bus_lines, order, count, spec);
+        return 0;
+    }
+
+    uint64_t *keys = scratch_alloc(scratch, 2 * count * sizeof(uint64_t));
+    size_t *indices = scratch_alloc(scratch, 2 * count * sizeof(size_t));
+    if(keys == NULL || indices == NULL) {
+        scratch_free(scratch, keys);
+        scratch_free(scratch, indices);
+        return -1;
+    }
+
+    memcpy(indices, order, count * sizeof(size_t));
+
+    /*
+        LSD over the keys as well - sorting stably by the least significant key first leaves
+        the rows ordered by all of them once the most significant key has been sorted
+    */
+    for(size_t k = spec->key_count; k-- > 0;) {
+        const SortKey *sort_key = &spec->keys[k];
+        for(size_t i = 0; i < count; ++i) keys[i] = row_key(&bus_lines[indices[i]], sort_key);
+        radix_sort_pairs(keys, indices, keys + count, indices + count, count);
+    }
+
+    memcpy(order, indices, count * sizeof(size_t));
+
+    scratch_free(scratch, keys);
+    scratch_free(scratch, indices);
+    return 0;
+}
+
+int sort_engine_order(const BusLineProperties *bus_lines, size_t *order, size_t count, const SortSpec *spec) {
+    return order_rows(bus_lines, order, count, spec, NULL);
+}
+
+int sort_engine_order_arena(const BusLineProperties *bus_lines, size_t *order, size_t count, const SortSpec *spec, Arena *scratch) {
+    if(scratch == NULL) return order_rows(bus_lines, order, count, spec, NULL);
+
+    ArenaMark mark = arena_mark(scratch);
+    int status = order_rows(bus_lines, order, count, spec, scratch);
+    arena_rewind(scratch, mark);
+    return status;
+}
+
+static void apply_order(BusLineProperties *bus_lines, size_t *order, size_t count) {
+    /*
+        order[i] is the row that belongs to position i - follow each cycle of the permutation so that
+        every row is moved exactly once. Positions that are done get marked with order[i] = i.
+    */
+    for(size_t start = 0; start < count; ++start) {
+        if(order[start] == start) continue;
+
+        BusLineProperties first = bus_lines[start];
+        size_t position = start;
+
+        while(order[position] != start) {
+            size_t source = order[position];
+            bus_lines[position] = bus_lines[source];
+            order[position] = position;
+            position = source;
+        }
+
+        bus_lines[position] = first;
+        order[position] = position;
+    }
+}
+
+int sort_engine_sort(BusLineProperties *bus_lines, size_t count, const SortSpec *spec) {
+    return sort_engine_sort_arena(bus_lines, count, spec, NULL);
+}
+
+int sort_engine_sort_arena(BusLineProperties *bus_lines, size_t count, const SortSpec *spec, Arena *scratch) {
+    if(count < 2) return 0;
+
+    ArenaMark mark = { NULL, NULL, 0 };
+    if(scratch != NULL) mark = arena_mark(scratch);
+
+    int status = -1;
+    size_t *order = scratch_alloc(scratch, count * sizeof(size_t));
+
+    if(order != NULL) {
+        for(size_t i = 0; i < count; ++i) order[i] = i;
+
+        status = order_rows(bus_lines, order, count, spec, scratch);
+        if(status == 0) apply_order(bus_lines, order, count);
+        scratch_free(scratch, order);
+    }
+
+    if(scratch != NULL) arena_rewind(scratch, mark);
+    return status;
+}
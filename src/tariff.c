@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "tariff.h"
+
+static TariffTable active_table = {
+    .per_km = { -COST_PER_KM, LEVEL1_SUBSIDY - COST_PER_KM, LEVEL2_SUBSIDY - COST_PER_KM, LEVEL3_SUBSIDY - COST_PER_KM },
+    .adult_ticket = { ADULT_TICKET, ADULT_TICKET, ADULT_TICKET, ADULT_TICKET },
+    .student_ticket = { STUDENT_TICKET, STUDENT_TICKET, STUDENT_TICKET, STUDENT_TICKET },
+    .senior_ticket = { 0.0, SENIOR_TICKET, 0.0, 0.0 }
+};
+
+void tariff_set_defaults(Tariff *tariff) {
+    tariff->cost_per_km = COST_PER_KM;
+    tariff->adult_ticket = ADULT_TICKET;
+    tariff->student_ticket = STUDENT_TICKET;
+    tariff->senior_ticket = SENIOR_TICKET;
+
+    tariff->level_subsidy[0] = 0.0;
+    tariff->level_subsidy[1] = LEVEL1_SUBSIDY;
+    tariff->level_subsidy[2] = LEVEL2_SUBSIDY;
+    tariff->level_subsidy[3] = LEVEL3_SUBSIDY;
+
+    /*
+        Only seniors on subsidy level 1 lines pay for their tickets
+    */
+    tariff->senior_ticket_levels[0] = 0;
+    tariff->senior_ticket_levels[1] = 1;
+    tariff->senior_ticket_levels[2] = 0;
+    tariff->senior_ticket_levels[3] = 0;
+}
+
+void tariff_table_build(const Tariff *tariff, TariffTable *table) {
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        double subsidy = (level == 0) ? 0.0 : tariff->level_subsidy[level];
+        int seniors_pay = (level == 0) ? 0 : tariff->senior_ticket_levels[level];
+
+        table->per_km[level] = subsidy - tariff->cost_per_km;
+        table->adult_ticket[level] = tariff->adult_ticket;
+        table->student_ticket[level] = tariff->student_ticket;
+        table->senior_ticket[level] = seniors_pay ? tariff->senior_ticket : 0.0;
+    }
+
+    table->exact = 0;
+}
+
+/*
+    Converts an amount in euros to whole cents times scale - returns -1 if it isn't a whole number of cents
+    (up to the rounding of the configured value) or the result isn't below limit in magnitude
+*/
+static int exact_coefficient(double euros, int32_t scale, double limit, int32_t *coefficient) {
+    double cents = euros * 100.0;
+    if(!(cents > -limit / scale && cents < limit / scale)) return -1;
+
+    int64_t whole = (int64_t)(cents + (cents < 0 ? -0.5 : 0.5));
+    double error = cents - (double)whole;
+    if(error > 1e-6 || error < -1e-6) return -1;
+
+    *coefficient = (int32_t)(whole * scale);
+    return 0;
+}
+
+int tariff_table_enable_exact(TariffTable *table) {
+    TariffTable exact = *table;
+
+    for(int level = 0; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        if(exact_coefficient(table->per_km[level], 1, TARIFF_EXACT_MAX_PER_KM_UNITS, &exact.exact_per_km[level]) != 0 ||
+           exact_coefficient(table->adult_ticket[level], TARIFF_EXACT_UNITS_PER_CENT, TARIFF_EXACT_MAX_TICKET_UNITS, &exact.exact_adult_ticket[level]) != 0 ||
+           exact_coefficient(table->student_ticket[level], TARIFF_EXACT_UNITS_PER_CENT, TARIFF_EXACT_MAX_TICKET_UNITS, &exact.exact_student_ticket[level]) != 0 ||
+           exact_coefficient(table->senior_ticket[level], TARIFF_EXACT_UNITS_PER_CENT, TARIFF_EXACT_MAX_TICKET_UNITS, &exact.exact_senior_ticket[level]) != 0) {
+            return -1;
+        }
+    }
+
+    exact.exact = 1;
+    *table = exact;
+    return 0;
+}
+
+void tariff_table_set_active(const TariffTable *table) {
+    active_table = *table;
+}
+
+const TariffTable *tariff_table_active(void) {
+    return &active_table;
+}
+
+void tariff_exact_overflow_error(void) {
+    fprintf(stderr, "[!!] FATAL Error: A total reached %.2f€ - too large to be added up to the cent with --exact.\n",
+            (double)TARIFF_EXACT_MAX_CENTS / 100.0);
+}
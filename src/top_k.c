@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "run_stats.h"
+#include "tariff.h"
+#include "top_k.h"
+
+/*
+    Heaps are indexed by tariff_level_index, which keeps out-of-range levels together in slot 0
+*/
+#define TOP_K_LEVEL_SLOTS (SUBSIDY_LEVEL_COUNT + 1)
+
+typedef struct {
+    size_t *rows;
+    size_t size;
+    size_t capacity;
+    int keep_highest;   /* 1 = top heap (the root is the worst of the kept rows), 0 = bottom heap */
+} RowHeap;
+
+/*
+    Rank of row a compared to row b in the default report order (most profitable first, equal ones by position)
+    Returns nonzero if a comes before b
+*/
+static int ranks_before(const BusLineProperties *bus_lines, size_t a, size_t b) {
+    if(bus_lines[a].profitability != bus_lines[b].profitability) return bus_lines[a].profitability > bus_lines[b].profitability;
+    return a < b;
+}
+
+/*
+    Nonzero if row a should be closer to the root than row b - the root is the row that gets evicted first
+*/
+static int heap_above(const BusLineProperties *bus_lines, const RowHeap *heap, size_t a, size_t b) {
+    return heap->keep_highest ? ranks_before(bus_lines, b, a) : ranks_before(bus_lines, a, b);
+}
+
+static void heap_sift_down(const BusLineProperties *bus_lines, RowHeap *heap, size_t position) {
+    size_t row = heap->rows[position];
+
+    while(1) {
+        size_t child = 2 * position + 1;
+        if(child >= heap->size) break;
+        if(child + 1 < heap->size && heap_above(bus_lines, heap, heap->rows[child + 1], heap->rows[child])) ++child;
+        if(!heap_above(bus_lines, heap, heap->rows[child], row)) break;
+
+        heap->rows[position] = heap->rows[child];
+        position = child;
+    }
+
+    heap->rows[position] = row;
+}
+
+static void heap_offer(const BusLineProperties *bus_lines, RowHeap *heap, size_t row) {
+    if(heap->capacity == 0) return;
+
+    if(heap->size < heap->capacity) {
+        size_t position = heap->size++;
+        while(position > 0) {
+            size_t parent = (position - 1) / 2;
+            if(!heap_above(bus_lines, heap, row, heap->rows[parent])) break;
+            heap->rows[position] = heap->rows[parent];
+            position = parent;
+        }
+        heap->rows[position] = row;
+        return;
+    }
+
+    /* Full - the new row only gets in if it beats the root, which is then evicted */
+    if(heap_above(bus_lines, heap, heap->rows[0], row)) {
+        heap->rows[0] = row;
+        heap_sift_down(bus_lines, heap, 0);
+    }
+}
+
+static int compare_row_indices(const void *a, const void *b) {
+    size_t row_a = *(const size_t *)a;
+    size_t row_b = *(const size_t *)b;
+    return (row_a > row_b) - (row_a < row_b);
+}
+
+int top_k_select(const BusLineProperties *bus_lines, size_t count, size_t top_k, size_t bottom_k,
+                 size_t **selection, size_t *selected_count) {
+    return top_k_select_from(bus_lines, NULL, count, top_k, bottom_k, NULL, selection, selected_count);
+}
+
+int top_k_select_from(const BusLineProperties *bus_lines, const size_t *candidates, size_t count,
+                      size_t top_k, size_t bottom_k, Arena *arena, size_t **selection, size_t *selected_count) {
+    *selection = NULL;
+    *selected_count = 0;
+
+    /* A level can't have more rows than the whole input */
+    if(top_k > count) top_k = count;
+    if(bottom_k > count) bottom_k = count;
+
+    size_t per_level = top_k + bottom_k;
+    if(per_level == 0 || count == 0) return 0;
+    if(per_level > SIZE_MAX / sizeof(size_t) / TOP_K_LEVEL_SLOTS) return -1;
+
+    /* The heaps are compacted in place into the selection, so they share one allocation */
+    size_t bytes = per_level * TOP_K_LEVEL_SLOTS * sizeof(size_t);
+    size_t *heap_rows = arena ? arena_alloc(arena, bytes, 0) : malloc(bytes);
+    if(heap_rows == NULL) return -1;
+
+    if(arena == NULL) run_stats_allocation(bytes);
+
+    RowHeap top[TOP_K_LEVEL_SLOTS], bottom[TOP_K_LEVEL_SLOTS];
+    for(size_t level = 0; level < TOP_K_LEVEL_SLOTS; ++level) {
+        top[level] = (RowHeap){ .rows = heap_rows + level * per_level, .capacity = top_k, .keep_highest = 1 };
+        bottom[level] = (RowHeap){ .rows = heap_rows + level * per_level + top_k, .capacity = bottom_k, .keep_highest = 0 };
+    }
+
+    /* Candidates are in ascending row order, so ties are still broken by row position */
+    for(size_t i = 0; i < count; ++i) {
+        size_t row = candidates ? candidates[i] : i;
+        int level = tariff_level_index(bus_lines[row].subsidy_level);
+        heap_offer(bus_lines, &top[level], row);
+        heap_offer(bus_lines, &bottom[level], row);
+    }
+
+    /*
+        Gather everything that was kept to the front of the heap buffer (the write position never overtakes
+        the read position), sort by position and drop the duplicates of rows that made it into both heaps
+    */
+    size_t gathered = 0;
+    for(size_t level = 0; level < TOP_K_LEVEL_SLOTS; ++level) {
+        for(size_t j = 0; j < top[level].size; ++j) heap_rows[gathered++] = top[level].rows[j];
+        for(size_t j = 0; j < bottom[level].size; ++j) heap_rows[gathered++] = bottom[level].rows[j];
+    }
+
+    qsort(heap_rows, gathered, sizeof(size_t), compare_row_indices);
+
+    size_t unique = 0;
+    for(size_t j = 0; j < gathered; ++j) {
+        if(unique == 0 || heap_rows[unique - 1] != heap_rows[j]) heap_rows[unique++] = heap_rows[j];
+    }
+
+    *selection = heap_rows;
+    *selected_count = unique;
+    return 0;
+}
+
+int top_k_select_rows(const BusLineProperties *bus_lines, size_t count, size_t top_k, size_t bottom_k, Arena *arena,
+                      BusLineProperties **selected_lines, size_t *selected_count) {
+    size_t *selection = NULL;
+    *selected_lines = NULL;
+    *selected_count = 0;
+
+    if(top_k_select(bus_lines, count, top_k, bottom_k, &selection, selected_count) != 0) return -1;
+
+    /* malloc(0) may return NULL, so there is always room for at least one row */
+    size_t bytes = (*selected_count + 1) * sizeof(BusLineProperties);
+    *selected_lines = arena ? arena_alloc(arena, bytes, ARENA_SIMD_ALIGNMENT) : malloc(bytes);
+    if(*selected_lines == NULL) {
+        free(selection);
+        *selected_count = 0;
+        return -1;
+    }
+
+    if(arena == NULL) run_stats_allocation(bytes);
+
+    for(size_t i = 0; i < *selected_count; ++i) (*selected_lines)[i] = bus_lines[selection[i]];
+    free(selection);
+    return 0;
+}
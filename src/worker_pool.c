@@ -0,0 +1,62 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "worker_pool.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next_task;
+    size_t task_count;
+    WorkerTask task;
+    void *context;
+} WorkerPool;
+
+static void *worker_main(void *argument) {
+    WorkerPool *pool = argument;
+
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        size_t task_index = pool->next_task;
+        if(task_index < pool->task_count) ++pool->next_task;
+        pthread_mutex_unlock(&pool->lock);
+
+        if(task_index >= pool->task_count) break;
+        pool->task(task_index, pool->context);
+    }
+
+    return NULL;
+}
+
+unsigned worker_pool_default_threads(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return (online > 0) ? (unsigned)online : 1;
+}
+
+void worker_pool_run(unsigned thread_count, size_t task_count, WorkerTask task, void *context) {
+    if(task_count == 0) return;
+    if(thread_count == 0) thread_count = worker_pool_default_threads();
+    if(thread_count > task_count) thread_count = (unsigned)task_count;
+
+    WorkerPool pool = { .next_task = 0, .task_count = task_count, .task = task, .context = context };
+    pthread_mutex_init(&pool.lock, NULL);
+
+    pthread_t *threads = (thread_count > 1) ? malloc((thread_count - 1) * sizeof(pthread_t)) : NULL;
+    unsigned started = 0;
+
+    if(threads != NULL) {
+        while(started < thread_count - 1 && pthread_create(&threads[started], NULL, worker_main, &pool) == 0) ++started;
+    }
+
+    /*
+        The calling thread works too instead of just waiting
+    */
+    worker_main(&pool);
+
+    for(unsigned i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+}
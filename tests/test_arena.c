@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../incl/arena.h"
+#include "../incl/bus_line_store.h"
+#include "../incl/sort_engine.h"
+#include "test_utils.h"
+
+void test_arena_alignment(TestResults *results);
+void test_arena_grow(TestResults *results);
+void test_arena_mark_rewind(TestResults *results);
+void test_arena_backed_store(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Arena Allocator ---\n\n");
+
+    test_arena_alignment(&results);
+    test_arena_grow(&results);
+    test_arena_mark_rewind(&results);
+    test_arena_backed_store(&results);
+
+    print_test_summary(&results);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+void test_arena_alignment(TestResults *results) {
+    printf("Testing arena alignment...\n");
+
+    Arena arena;
+    arena_init(&arena, 64 * 1024, 0);
+
+    char *first = arena_alloc(&arena, 3, 1);
+    void *simd = arena_alloc(&arena, 100, ARENA_SIMD_ALIGNMENT);
+    void *fallback = arena_alloc(&arena, 8, 0);
+    ASSERT_TRUE("Allocations succeed", first != NULL && simd != NULL && fallback != NULL);
+    ASSERT_TRUE("SIMD allocation is cache line aligned", ((uintptr_t)simd % ARENA_SIMD_ALIGNMENT) == 0);
+    ASSERT_TRUE("Default alignment fits any basic type", ((uintptr_t)fallback % 16) == 0);
+    ASSERT_TRUE("Small allocations share one block", arena.blocks != NULL && arena.reserved_bytes == 64 * 1024);
+
+    memset(simd, 0xAB, 100);
+    ASSERT_TRUE("Allocations don't overlap", first + 3 <= (char *)simd);
+
+    arena_release(&arena);
+    ASSERT_TRUE("Release gives everything back", arena.blocks == NULL && arena.reserved_bytes == 0);
+}
+
+/*
+    The last allocation of a block grows in place, a large one moves and gives its old block back
+*/
+void test_arena_grow(TestResults *results) {
+    printf("Testing arena growth...\n");
+
+    Arena arena;
+    arena_init(&arena, 64 * 1024, 0);
+
+    char *small = arena_alloc(&arena, 100, 0);
+    memset(small, 7, 100);
+    char *grown = arena_grow(&arena, small, 100, 1000, 0);
+    ASSERT_TRUE("Last allocation grows in place", grown == small);
+
+    arena_alloc(&arena, 16, 0);
+    grown = arena_grow(&arena, small, 1000, 2000, 0);
+    ASSERT_TRUE("Allocation followed by another one moves", grown != NULL && grown != small && grown[99] == 7);
+
+    char *large = arena_alloc(&arena, 1 << 20, ARENA_SIMD_ALIGNMENT);
+    large[0] = 1;
+    large[(1 << 20) - 1] = 2;
+    uint64_t reserved = arena.reserved_bytes;
+    ASSERT_TRUE("Large allocation gets a block of its own", large != NULL && reserved >= 64 * 1024 + (1 << 20));
+
+    char *moved = arena_grow(&arena, large, 1 << 20, 8 << 20, ARENA_SIMD_ALIGNMENT);
+    ASSERT_TRUE("Large allocation keeps its contents", moved != NULL && moved[0] == 1 && moved[(1 << 20) - 1] == 2);
+    ASSERT_TRUE("Old block of a moved allocation is unmapped", arena.reserved_bytes < reserved + (8 << 20));
+
+    arena_release(&arena);
+}
+
+void test_arena_mark_rewind(TestResults *results) {
+    printf("Testing arena mark and rewind...\n");
+
+    Arena arena;
+    arena_init(&arena, 64 * 1024, 0);
+
+    arena_alloc(&arena, 128, 0);
+    ArenaMark mark = arena_mark(&arena);
+    uint64_t reserved = arena.reserved_bytes;
+
+    void *scratch = arena_alloc(&arena, 256, 0);
+    arena_alloc(&arena, 1 << 20, 0);
+    arena_alloc(&arena, 40 * 1024, 0);
+    ASSERT_TRUE("Scratch needs more blocks", arena.reserved_bytes > reserved);
+
+    arena_rewind(&arena, mark);
+    ASSERT_TRUE("Rewind unmaps the blocks mapped since the mark", arena.reserved_bytes == reserved);
+    ASSERT_TRUE("Rewind reuses the memory after the mark", arena_alloc(&arena, 256, 0) == scratch);
+
+    arena_release(&arena);
+}
+
+/*
+    An arena-backed store grows to many rows and sorts with arena scratch exactly like with malloc'ed scratch
+*/
+void test_arena_backed_store(TestResults *results) {
+    printf("Testing an arena-backed bus line store...\n");
+
+    Arena arena;
+    arena_init(&arena, 0, 1);
+
+    BusLineStore store;
+    ASSERT_INT_EQUAL("Store init", 0, bus_line_store_init_arena(&store, &arena, 0));
+
+    const size_t count = 200000;
+    int appended = 1;
+    for (size_t i = 0; appended && i < count; i++) {
+        BusLineProperties *line = bus_line_store_next_slot(&store);
+        if (line == NULL) {
+            appended = 0;
+            break;
+        }
+        memset(line, 0, sizeof(*line));
+        line->line_number = (int)((i * 7919) % count);
+        line->subsidy_level = (int)(i % 3) + 1;
+        line->profitability = (double)((i * 104729) % 1000);
+        bus_line_store_commit(&store);
+    }
+    ASSERT_TRUE("All rows appended", appended && store.count == count);
+    ASSERT_TRUE("Rows are SIMD aligned", ((uintptr_t)store.lines % ARENA_SIMD_ALIGNMENT) == 0);
+
+    int ordered = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (store.lines[i].line_number != (int)((i * 7919) % count)) ordered = 0;
+    }
+    ASSERT_TRUE("Rows survive the growth", ordered);
+
+    SortSpec spec;
+    sort_spec_set_default(&spec);
+    BusLineProperties *expected = malloc(count * sizeof(BusLineProperties));
+    memcpy(expected, store.lines, count * sizeof(BusLineProperties));
+    sort_engine_sort(expected, count, &spec);
+
+    uint64_t reserved = arena.reserved_bytes;
+    ASSERT_INT_EQUAL("Sort with arena scratch", 0, sort_engine_sort_arena(store.lines, store.count, &spec, &arena));
+    ASSERT_TRUE("Same order as malloc scratch", memcmp(expected, store.lines, count * sizeof(BusLineProperties)) == 0);
+    ASSERT_TRUE("Sort scratch is given back", arena.reserved_bytes == reserved);
+
+    free(expected);
+    bus_line_store_free(&store);
+    arena_release(&arena);
+}
@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../incl/batch_mode.h"
+#include "../incl/bus_line_handler.h"
+#include "../incl/file_handler.h"
+#include "../incl/runtime_configuration_handler.h"
+#include "test_utils.h"
+
+#define TEST_BATCH_DIR "test_batch_dir"
+#define TEST_BATCH_REPORT "test_batch_report.txt"
+
+void test_batch_collect(TestResults *results);
+void test_batch_process(TestResults *results);
+
+static const char *batch_inputs[] = { TEST_BATCH_DIR "/depot_b.txt", TEST_BATCH_DIR "/depot_a.txt", TEST_BATCH_DIR "/depot_c.txt" };
+static const char *batch_extras[] = { TEST_BATCH_DIR "/depot_a.txt.blcache", TEST_BATCH_DIR "/depot_a.txt.report.txt",
+                                      TEST_BATCH_DIR "/.hidden.txt" };
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Batch Mode ---\n\n");
+
+    test_batch_collect(&results);
+    test_batch_process(&results);
+
+    print_test_summary(&results);
+
+    for (size_t i = 0; i < 3; i++) {
+        char report[256];
+        snprintf(report, sizeof(report), "%s%s", batch_inputs[i], BATCH_REPORT_SUFFIX);
+        unlink(batch_inputs[i]);
+        unlink(report);
+        unlink(batch_extras[i]);
+    }
+    rmdir(TEST_BATCH_DIR);
+    unlink(TEST_BATCH_REPORT);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+static void write_text_file(const char *filename, const char *text) {
+    FILE *file = fopen(filename, "w");
+    if (file) {
+        fputs(text, file);
+        fclose(file);
+    }
+}
+
+/*
+    depot_a and depot_b are valid, depot_c has nothing but invalid lines
+*/
+static void setup_batch_dir(void) {
+    mkdir(TEST_BATCH_DIR, 0755);
+    write_text_file(batch_inputs[0], "1,08:00,1,25,10,5,15.5\n2,09:15,2,18,8,4,12.0\n");
+    write_text_file(batch_inputs[1], "3,10:30,3,15,7,6,10.5\n4,12:00,1,3,2,1,50.0\n5,13:00,2,40,0,0,20.0\n");
+    write_text_file(batch_inputs[2], "not,a,bus,line\n");
+    for (size_t i = 0; i < 3; i++) write_text_file(batch_extras[i], "6,14:00,1,1,1,1,1.0\n");
+}
+
+void test_batch_collect(TestResults *results) {
+    printf("Testing collecting the files of a batch...\n");
+
+    setup_batch_dir();
+
+    BatchFileList list;
+    batch_file_list_init(&list);
+
+    ASSERT_INT_EQUAL("Directory: caches, reports and hidden files are skipped", 3, (int)batch_collect_files(TEST_BATCH_DIR, NULL, &list));
+    if (list.count == 3) {
+        ASSERT_STRING_EQUAL("Sorted by name (1)", TEST_BATCH_DIR "/depot_a.txt", list.files[0].input_file);
+        ASSERT_STRING_EQUAL("Sorted by name (2)", TEST_BATCH_DIR "/depot_b.txt", list.files[1].input_file);
+        ASSERT_STRING_EQUAL("Sorted by name (3)", TEST_BATCH_DIR "/depot_c.txt", list.files[2].input_file);
+        ASSERT_STRING_EQUAL("Report next to the input", TEST_BATCH_DIR "/depot_a.txt.report.txt", list.files[0].report_file);
+    }
+    batch_file_list_free(&list);
+
+    ASSERT_INT_EQUAL("Glob pattern", 2, (int)batch_collect_files(TEST_BATCH_DIR "/depot_[ab]*", NULL, &list));
+    batch_file_list_free(&list);
+
+    ASSERT_INT_EQUAL("Excluded output file", 2, (int)batch_collect_files(TEST_BATCH_DIR, batch_inputs[2], &list));
+    batch_file_list_free(&list);
+
+    ASSERT_INT_EQUAL("Pattern without matches", 0, (int)batch_collect_files(TEST_BATCH_DIR "/*.csv", NULL, &list));
+    batch_file_list_free(&list);
+}
+
+void test_batch_process(TestResults *results) {
+    printf("Testing processing a batch with a failing file...\n");
+
+    FileSettings settings;
+    runtime_config_load_handler(&settings, "nonexistent_config.txt");
+    settings.cache_enabled = 0;
+    settings.thread_count = 3;
+
+    BatchFileList list;
+    batch_file_list_init(&list);
+    batch_collect_files(TEST_BATCH_DIR, NULL, &list);
+
+    size_t failed = batch_process_files(&settings, &list);
+    ASSERT_INT_EQUAL("Only the invalid file failed", 1, (int)failed);
+
+    if (list.count == 3) {
+        ASSERT_INT_EQUAL("depot_a analysed", 0, list.files[0].status);
+        ASSERT_INT_EQUAL("depot_b analysed", 0, list.files[1].status);
+        ASSERT_INT_EQUAL("depot_c failed", -1, list.files[2].status);
+        ASSERT_TRUE("depot_a report written", access(list.files[0].report_file, F_OK) == 0);
+        ASSERT_TRUE("No report for the failed file", access(list.files[2].report_file, F_OK) != 0);
+
+        /* The combined totals have to match all the valid lines analysed as one input */
+        BusLineProperties lines[5];
+        BusLineStore store;
+        bus_line_store_init(&store, 0);
+        read_handler(batch_inputs[1], &store, READ_ALL_BUS_LINES);
+        read_handler(batch_inputs[0], &store, READ_ALL_BUS_LINES);
+        memcpy(lines, store.lines, 5 * sizeof(BusLineProperties));
+        bus_line_store_free(&store);
+        calculate_profitability(lines, 5);
+
+        BusLineSummary expected, a, b;
+        summarize_profitability(lines, 5, 1, &expected);
+        bus_line_aggregator_total(&list.files[0].totals, &a);
+        bus_line_aggregator_total(&list.files[1].totals, &b);
+        ASSERT_INT_EQUAL("Line counts add up", (int)expected.line_count, (int)(a.line_count + b.line_count));
+        ASSERT_DOUBLE_EQUAL("Profits add up", expected.total_profit, a.total_profit + b.total_profit, 0.001);
+    }
+
+    ASSERT_INT_EQUAL("Merged report written", 0, batch_write_report(TEST_BATCH_REPORT, &list));
+
+    char report[4096] = "";
+    FILE *file = fopen(TEST_BATCH_REPORT, "r");
+    if (file) {
+        size_t size = fread(report, 1, sizeof(report) - 1, file);
+        report[size] = '\0';
+        fclose(file);
+    }
+    ASSERT_TRUE("Failed file listed", strstr(report, "depot_c.txt: FAILED (no valid bus lines)") != NULL);
+    ASSERT_TRUE("File counts listed", strstr(report, "Files analysed: 2, failed: 1") != NULL);
+    ASSERT_TRUE("Combined total", strstr(report, "Total bus lines analyzed: 5") != NULL);
+
+    batch_file_list_free(&list);
+}
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../incl/bus_line_cache.h"
+#include "../incl/file_handler.h"
+#include "test_utils.h"
+
+#define TEST_CACHE_INPUT_FILE "test_cache_input.txt"
+#define TEST_CACHE_FILE TEST_CACHE_INPUT_FILE BUS_LINE_CACHE_SUFFIX
+
+void test_cache_round_trip(TestResults *results);
+void test_cache_invalidation(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Bus Line Cache ---\n\n");
+
+    test_cache_round_trip(&results);
+    test_cache_invalidation(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_CACHE_INPUT_FILE);
+    unlink(TEST_CACHE_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+static void create_cache_input_file(int rows) {
+    FILE *file = fopen(TEST_CACHE_INPUT_FILE, "w");
+    if (file) {
+        fprintf(file, "# Cache Test Bus Line Data\n");
+        for (int i = 1; i <= rows; i++) {
+            fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.%02d\n", i, i % 24, i % 60, (i % 3) + 1, i % 50, i % 20, i % 7, i % 90 + 1, i % 100);
+        }
+        fprintf(file, "%d,23:59,1,1,2,3,4.5\n", rows + 1);     /* Latest possible departure time */
+        fclose(file);
+    }
+}
+
+void test_cache_round_trip(TestResults *results) {
+    printf("Testing cache save and load...\n");
+
+    create_cache_input_file(10000);
+    unlink(TEST_CACHE_FILE);
+
+    BusLineCacheSource source;
+    ASSERT_INT_EQUAL("Source identified", 0, bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &source));
+
+    BusLineStore parsed, cached;
+    bus_line_store_init(&parsed, 0);
+    bus_line_store_init(&cached, 0);
+
+    ASSERT_INT_EQUAL("No cache yet", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &source, &cached));
+    ASSERT_INT_EQUAL("Cache needs a hashed source", -1, bus_line_cache_save(TEST_CACHE_INPUT_FILE, &source, NULL, 0));
+    ASSERT_INT_EQUAL("Source hashed", 0, bus_line_cache_hash(TEST_CACHE_INPUT_FILE, &source));
+
+    int64_t count = read_handler(TEST_CACHE_INPUT_FILE, &parsed, READ_ALL_BUS_LINES);
+    ASSERT_INT_EQUAL("Source parsed", 10001, (int)count);
+    ASSERT_INT_EQUAL("Cache saved", 0, bus_line_cache_save(TEST_CACHE_INPUT_FILE, &source, parsed.lines, parsed.count));
+    ASSERT_INT_EQUAL("Cache loaded", 10001, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &source, &cached));
+
+    int same = (parsed.count == cached.count);
+    for (size_t i = 0; same && i < parsed.count; i++) {
+        const BusLineProperties *x = &parsed.lines[i], *y = &cached.lines[i];
+        same = x->line_number == y->line_number && x->departure_minutes == y->departure_minutes &&
+               x->subsidy_level == y->subsidy_level && x->passengers.adult == y->passengers.adult &&
+               x->passengers.student == y->passengers.student && x->passengers.senior == y->passengers.senior &&
+               x->route_length == y->route_length;
+    }
+    ASSERT_TRUE("Cached rows are identical to the parsed ones", same);
+    ASSERT_INT_EQUAL("Latest departure time survives", 23 * 60 + 59, cached.lines[10000].departure_minutes);
+
+    bus_line_store_free(&parsed);
+    bus_line_store_free(&cached);
+}
+
+/*
+    Moves the modification time of the cache to the given number of seconds after the last change of the source
+*/
+static void set_cache_time(const BusLineCacheSource *source, int seconds) {
+    struct timespec times[2] = { { .tv_sec = (time_t)(source->ctime_sec + seconds), .tv_nsec = (long)source->ctime_nsec },
+                                 { .tv_sec = (time_t)(source->ctime_sec + seconds), .tv_nsec = (long)source->ctime_nsec } };
+    utimensat(AT_FDCWD, TEST_CACHE_FILE, times, 0);
+}
+
+void test_cache_invalidation(TestResults *results) {
+    printf("Testing cache invalidation...\n");
+
+    BusLineCacheSource source, changed;
+    bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &source);
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+
+    /* Unchanged since the cache was written - the attributes are enough, the source isn't read */
+    set_cache_time(&source, 2);
+    changed = source;
+    ASSERT_INT_EQUAL("Unchanged source loaded", 10001, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+    ASSERT_INT_EQUAL("Unchanged source not hashed", 0, (int)changed.hashed);
+
+    /* Written within the same second as the last change - the source could have changed again unnoticed */
+    set_cache_time(&source, 0);
+    changed = source;
+    ASSERT_INT_EQUAL("Racy cache loaded", 10001, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+    ASSERT_INT_EQUAL("Racy cache checked against the contents", 1, (int)changed.hashed);
+
+    /* Attributes that differ from the file on disk - it changed after being identified */
+    changed = source;
+    changed.size += 1;
+    ASSERT_INT_EQUAL("Stale size rejected", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+    changed = source;
+    changed.mtime_nsec += 1;
+    ASSERT_INT_EQUAL("Stale modification time rejected", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+
+    /* Touched without changing the contents - used after hashing, and the next run takes the fast path again */
+    struct timespec touched[2] = { { .tv_sec = (time_t)source.mtime_sec + 5, .tv_nsec = 0 }, { .tv_sec = (time_t)source.mtime_sec + 5, .tv_nsec = 0 } };
+    utimensat(AT_FDCWD, TEST_CACHE_INPUT_FILE, touched, 0);
+    bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &changed);
+    ASSERT_INT_EQUAL("Touched source loaded", 10001, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+    ASSERT_INT_EQUAL("Touched source hashed", 1, (int)changed.hashed);
+
+    set_cache_time(&changed, 2);
+    bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &changed);
+    ASSERT_INT_EQUAL("Refreshed cache loaded", 10001, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+    ASSERT_INT_EQUAL("Refreshed cache takes the fast path", 0, (int)changed.hashed);
+
+    /* Rewriting the source with different contents of the same size changes the hash */
+    bus_line_cache_hash(TEST_CACHE_INPUT_FILE, &changed);
+    source = changed;
+    create_cache_input_file(10000);
+    FILE *file = fopen(TEST_CACHE_INPUT_FILE, "r+");
+    if (file) {
+        fseek(file, 0, SEEK_SET);
+        fputc('#', file);
+        fputc('!', file);
+        fclose(file);
+    }
+    bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &changed);
+    bus_line_cache_hash(TEST_CACHE_INPUT_FILE, &changed);
+    ASSERT_TRUE("Edited source gets a new hash", changed.size == source.size && changed.hash != source.hash);
+    ASSERT_INT_EQUAL("Edited source rejected", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+    store.count = 0;
+
+    /*
+        An edit in the middle that keeps the size and the modification time (cp -p, rsync -t) - the
+        cache written for the file before the edit must not be used for it
+    */
+    BusLineStore parsed;
+    bus_line_store_init(&parsed, 0);
+    bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &source);
+    bus_line_cache_hash(TEST_CACHE_INPUT_FILE, &source);
+    read_handler(TEST_CACHE_INPUT_FILE, &parsed, READ_ALL_BUS_LINES);
+    bus_line_cache_save(TEST_CACHE_INPUT_FILE, &source, parsed.lines, parsed.count);
+    bus_line_store_free(&parsed);
+
+    struct stat before;
+    stat(TEST_CACHE_INPUT_FILE, &before);
+    file = fopen(TEST_CACHE_INPUT_FILE, "r+");
+    if (file) {
+        fseek(file, (long)before.st_size / 2, SEEK_SET);
+        int c;
+        while ((c = fgetc(file)) != EOF && (c < '0' || c > '8')) {}
+        fseek(file, -1, SEEK_CUR);
+        fputc(c + 1, file);
+        fclose(file);
+    }
+    struct timespec times[2] = { before.st_atim, before.st_mtim };
+    utimensat(AT_FDCWD, TEST_CACHE_INPUT_FILE, times, 0);
+
+    bus_line_cache_identify(TEST_CACHE_INPUT_FILE, &changed);
+    ASSERT_TRUE("Same size and time", changed.size == source.size && changed.mtime_sec == source.mtime_sec && changed.mtime_nsec == source.mtime_nsec);
+    ASSERT_INT_EQUAL("Edit in the middle rejected", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &changed, &store));
+
+    /* A corrupt header is ignored */
+    file = fopen(TEST_CACHE_FILE, "r+");
+    if (file) {
+        fputc('X', file);
+        fclose(file);
+    }
+    ASSERT_INT_EQUAL("Corrupt cache rejected", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &source, &store));
+
+    /* A truncated cache is ignored as well */
+    truncate(TEST_CACHE_FILE, 100);
+    ASSERT_INT_EQUAL("Truncated cache rejected", -1, (int)bus_line_cache_load(TEST_CACHE_INPUT_FILE, &source, &store));
+    ASSERT_INT_EQUAL("Nothing loaded from bad caches", 0, (int)store.count);
+
+    bus_line_store_free(&store);
+}
@@ -1,13 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include "../incl/bus_line_aggregator.h"
 #include "../incl/bus_line_handler.h"
+#include "../incl/tariff.h"
 #include "test_utils.h"
 
 
 void test_calculate_profitability(TestResults *results);
 void test_sort_lines(TestResults *results);
 void test_edge_cases(TestResults *results);
+void test_custom_tariff(TestResults *results);
+void test_parallel_profitability(TestResults *results);
+void test_exact_profitability(TestResults *results);
+void test_exact_overflow(TestResults *results);
 
 int main() {
     TestResults results;
@@ -18,6 +24,10 @@ int main() {
     test_calculate_profitability(&results);
     test_sort_lines(&results);
     test_edge_cases(&results);
+    test_custom_tariff(&results);
+    test_parallel_profitability(&results);
+    test_exact_profitability(&results);
+    test_exact_overflow(&results);
     
     print_test_summary(&results);
     
@@ -36,7 +46,7 @@ void test_calculate_profitability(TestResults *results) {
     */
     BusLineProperties line1 = {
         .line_number = 1,
-        .departure_time = "08:00",
+        .departure_minutes = 8 * 60,
         .subsidy_level = 1,
         .passengers = {.adult = 25, .student = 10, .senior = 5},
         .route_length = 15.5
@@ -59,7 +69,7 @@ void test_calculate_profitability(TestResults *results) {
     */
     BusLineProperties line2 = {
         .line_number = 331,
-        .departure_time = "01:00",
+        .departure_minutes = 1 * 60,
         .subsidy_level = 3,
         .passengers = {.adult = 1, .student = 0, .senior = 0},
         .route_length = 120.0
@@ -82,7 +92,7 @@ void test_calculate_profitability(TestResults *results) {
     */
     BusLineProperties line3 = {
         .line_number = 999,
-        .departure_time = "23:59",
+        .departure_minutes = 23 * 60 + 59,
         .subsidy_level = 2,
         .passengers = {.adult = 0, .student = 0, .senior = 0},
         .route_length = 50.0
@@ -110,7 +120,7 @@ void test_sort_lines(TestResults *results) {
     BusLineProperties bus_lines[5] = {
         {
             .line_number = 1,
-            .departure_time = "08:00",
+            .departure_minutes = 8 * 60,
             .subsidy_level = 2,
             .passengers = {.adult = 20, .student = 10, .senior = 5},
             .route_length = 15.0,
@@ -118,7 +128,7 @@ void test_sort_lines(TestResults *results) {
         },
         {
             .line_number = 2,
-            .departure_time = "09:00",
+            .departure_minutes = 9 * 60,
             .subsidy_level = 1,
             .passengers = {.adult = 25, .student = 15, .senior = 10},
             .route_length = 20.0,
@@ -126,7 +136,7 @@ void test_sort_lines(TestResults *results) {
         },
         {
             .line_number = 3,
-            .departure_time = "10:00",
+            .departure_minutes = 10 * 60,
             .subsidy_level = 3,
             .passengers = {.adult = 15, .student = 5, .senior = 3},
             .route_length = 10.0,
@@ -134,7 +144,7 @@ void test_sort_lines(TestResults *results) {
         },
         {
             .line_number = 4,
-            .departure_time = "11:00",
+            .departure_minutes = 11 * 60,
             .subsidy_level = 2,
             .passengers = {.adult = 10, .student = 5, .senior = 2},
             .route_length = 25.0,
@@ -142,7 +152,7 @@ void test_sort_lines(TestResults *results) {
         },
         {
             .line_number = 5,
-            .departure_time = "12:00",
+            .departure_minutes = 12 * 60,
             .subsidy_level = 1,
             .passengers = {.adult = 5, .student = 2, .senior = 1},
             .route_length = 30.0,
@@ -185,7 +195,7 @@ void test_edge_cases(TestResults *results) {
     */
     BusLineProperties single_line = {
         .line_number = 1,
-        .departure_time = "08:00",
+        .departure_minutes = 8 * 60,
         .subsidy_level = 1,
         .passengers = {.adult = 10, .student = 5, .senior = 2},
         .route_length = 10.0
@@ -211,3 +221,278 @@ void test_edge_cases(TestResults *results) {
     */
     ASSERT_TRUE("Empty array sorting completed without crashes", true);
 }
+
+
+/*
+    The profitability calculation has to follow the active tariff table instead of compiled-in constants
+*/
+void test_custom_tariff(TestResults *results) {
+    printf("Testing profitability with a custom tariff...\n");
+
+    Tariff tariff;
+    tariff_set_defaults(&tariff);
+    tariff.cost_per_km = 3.0;
+    tariff.level_subsidy[2] = 2.0;
+    tariff.senior_ticket_levels[2] = 1;
+
+    TariffTable table;
+    tariff_table_build(&tariff, &table);
+    tariff_table_set_active(&table);
+
+    BusLineProperties line = {
+        .line_number = 7,
+        .departure_minutes = 16 * 60 + 30,
+        .subsidy_level = 2,
+        .passengers = {.adult = 4, .student = 6, .senior = 3},
+        .route_length = 22.5
+    };
+
+    calculate_profitability(&line, 1);
+
+    /*
+        Expected result of the profitability calcuation:
+        Cost = 22.5 * 3.0 = 67.5
+        Revenue = (4 * 12.0) + (6 * 8.0) + (3 * 5.0) = 48 + 48 + 15 = 111
+        Subsidy = 22.5 * 2.0 = 45.0
+        Profit = 111 + 45 - 67.5 = 88.5
+    */
+    ASSERT_DOUBLE_EQUAL("Custom tariff with paying seniors on level 2", 88.5, line.profitability, 0.01);
+
+    /*
+        Back to the defaults for anything that runs after this test
+    */
+    tariff_set_defaults(&tariff);
+    tariff_table_build(&tariff, &table);
+    tariff_table_set_active(&table);
+
+    calculate_profitability(&line, 1);
+    ASSERT_DOUBLE_EQUAL("Default tariff restored", 111.0 - 15.0 + 22.5 * 1.0 - 22.5 * 2.5, line.profitability, 0.01);
+}
+
+
+/*
+    Parallel profitability and the summary totals must not depend on the number of threads
+*/
+void test_parallel_profitability(TestResults *results) {
+    printf("Testing parallel profitability and summary...\n");
+
+    const size_t count = 200003;
+    BusLineProperties *lines = calloc(count, sizeof(BusLineProperties));
+    BusLineProperties *expected = calloc(count, sizeof(BusLineProperties));
+    if(lines == NULL || expected == NULL) {
+        ASSERT_TRUE("Allocating the test bus lines", 0);
+        free(lines);
+        free(expected);
+        return;
+    }
+
+    unsigned seed = 12345;
+    for(size_t i = 0; i < count; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        lines[i].line_number = (int)(i % 999) + 1;
+        lines[i].subsidy_level = (int)(seed >> 16) % 3 + 1;
+        lines[i].passengers.adult = (int)(seed >> 8) % 40;
+        lines[i].passengers.student = (int)(seed >> 4) % 30;
+        lines[i].passengers.senior = (int)(seed >> 12) % 20;
+        lines[i].route_length = 0.1 * (double)((seed >> 10) % 600 + 1);
+    }
+    for(size_t i = 0; i < count; ++i) expected[i] = lines[i];
+
+    calculate_profitability(expected, count);
+    calculate_profitability_parallel(lines, count, 4);
+
+    size_t mismatches = 0;
+    for(size_t i = 0; i < count; ++i) mismatches += (lines[i].profitability != expected[i].profitability);
+    ASSERT_INT_EQUAL("Parallel profitability matches sequential", 0, (int)mismatches);
+
+    BusLineSummary reference;
+    summarize_profitability(lines, count, 1, &reference);
+
+    double naive_total = 0.0;
+    size_t naive_profitable = 0;
+    for(size_t i = 0; i < count; ++i) {
+        naive_total += lines[i].profitability;
+        naive_profitable += (lines[i].profitability >= 0);
+    }
+
+    ASSERT_INT_EQUAL("Summary line count", (int)count, (int)reference.line_count);
+    ASSERT_INT_EQUAL("Summary profitable lines", (int)naive_profitable, (int)reference.profitable_lines);
+    ASSERT_INT_EQUAL("Summary unprofitable lines", (int)(count - naive_profitable), (int)reference.unprofitable_lines);
+    ASSERT_DOUBLE_EQUAL("Summary total close to the naive sum", naive_total, reference.total_profit, 0.01);
+
+    const unsigned thread_counts[] = {2, 3, 8, 0};
+    int identical = 1;
+    for(size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t) {
+        BusLineSummary summary;
+        summarize_profitability(lines, count, thread_counts[t], &summary);
+        if(summary.total_profit != reference.total_profit ||
+           summary.profitable_lines != reference.profitable_lines) identical = 0;
+    }
+    ASSERT_TRUE("Summary is bit-identical for any thread count", identical);
+
+    BusLineSummary empty;
+    summarize_profitability(lines, 0, 4, &empty);
+    ASSERT_TRUE("Empty summary", empty.line_count == 0 && empty.total_profit == 0.0 && empty.profitable_lines == 0);
+
+    /*
+        The streaming aggregator gets to the same totals one row at a time
+    */
+    BusLineAggregator aggregator;
+    bus_line_aggregator_init(&aggregator);
+    for(size_t i = 0; i < count; ++i) bus_line_aggregator_add(&aggregator, &lines[i]);
+
+    BusLineSummary streamed;
+    bus_line_aggregator_total(&aggregator, &streamed);
+    ASSERT_INT_EQUAL("Streamed line count", (int)count, (int)streamed.line_count);
+    ASSERT_INT_EQUAL("Streamed profitable lines", (int)reference.profitable_lines, (int)streamed.profitable_lines);
+    ASSERT_DOUBLE_EQUAL("Streamed total matches the pairwise total", reference.total_profit, streamed.total_profit, 1e-6);
+
+    size_t level_lines = 0;
+    for(int level = 1; level <= SUBSIDY_LEVEL_COUNT; ++level) {
+        BusLineSummary level_summary;
+        bus_line_aggregator_level(&aggregator, level, &level_summary);
+        level_lines += level_summary.line_count;
+    }
+    ASSERT_INT_EQUAL("Per level counts add up", (int)count, (int)level_lines);
+
+    free(lines);
+    free(expected);
+}
+
+/*
+    Exact mode - results in whole cents rounded half away from zero, totals that don't depend on the order
+*/
+void test_exact_profitability(TestResults *results) {
+    printf("Testing exact mode...\n");
+
+    Tariff tariff;
+    TariffTable table;
+    tariff_set_defaults(&tariff);
+    tariff.cost_per_km = 2.505;
+    tariff_table_build(&tariff, &table);
+    ASSERT_INT_EQUAL("Tariff with a fraction of a cent rejected", -1, tariff_table_enable_exact(&table));
+    ASSERT_INT_EQUAL("Rejected table stays in floating-point mode", 0, table.exact);
+
+    /* Tickets and per-km amounts are capped so that no bus line can overflow the int64 milli-cents */
+    tariff.cost_per_km = 2.55;
+    tariff.adult_ticket = 1342.18;
+    tariff_table_build(&tariff, &table);
+    ASSERT_INT_EQUAL("Ticket above the exact mode cap rejected", -1, tariff_table_enable_exact(&table));
+
+    tariff.adult_ticket = 12.0;
+    tariff.cost_per_km = 1342178.0;
+    tariff_table_build(&tariff, &table);
+    ASSERT_INT_EQUAL("Cost per km above the exact mode cap rejected", -1, tariff_table_enable_exact(&table));
+
+    tariff.cost_per_km = 2.55;
+    tariff_table_build(&tariff, &table);
+    ASSERT_INT_EQUAL("Exact mode enabled", 0, tariff_table_enable_exact(&table));
+    tariff_table_set_active(&table);
+
+    /*
+        0.3 * (0.50 - 2.55) = -0.615 -> -0.62
+        25 * 12.0 + 10 * 8.0 + 5 * 5.0 + 15.5 * (0.50 - 2.55) = 373.225 -> 373.23
+    */
+    BusLineProperties lines[2] = {
+        { .line_number = 1, .subsidy_level = 1, .route_length = 0.3 },
+        { .line_number = 2, .subsidy_level = 1, .passengers = {.adult = 25, .student = 10, .senior = 5}, .route_length = 15.5 }
+    };
+    calculate_profitability(lines, 2);
+    ASSERT_TRUE("Half a cent rounds away from zero", lines[0].profitability == -62 / 100.0);
+    ASSERT_TRUE("Known line in whole cents", lines[1].profitability == 37323 / 100.0);
+
+    tariff_set_defaults(&tariff);
+    tariff_table_build(&tariff, &table);
+    tariff_table_enable_exact(&table);
+    tariff_table_set_active(&table);
+
+    /* 0.7km of a level 3 line: 0.7 * -1.0 = -0.70 - a sum of those in double drifts, in cents it doesn't */
+    const size_t count = 100001;
+    BusLineProperties *many = calloc(count, sizeof(BusLineProperties));
+    size_t *reversed = malloc(count * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        many[i].subsidy_level = 3;
+        many[i].passengers.student = (int)(i % 3);
+        many[i].route_length = 0.7 + (double)(i % 5);
+        reversed[i] = count - 1 - i;
+    }
+    calculate_profitability_parallel(many, count, 4);
+
+    int64_t expected_cents = 0;
+    for (size_t i = 0; i < count; i++) expected_cents += (int64_t)(i % 3) * 800 - (int64_t)(70 + 100 * (i % 5));
+
+    BusLineSummary forward, backward, streamed;
+    summarize_profitability(many, count, 3, &forward);
+    summarize_profitability_selection(many, reversed, count, 1, &backward);
+
+    BusLineAggregator aggregator;
+    bus_line_aggregator_init(&aggregator);
+    for (size_t i = 0; i < count; i++) bus_line_aggregator_add(&aggregator, &many[i]);
+    bus_line_aggregator_total(&aggregator, &streamed);
+
+    ASSERT_TRUE("Exact total", forward.total_profit == (double)expected_cents / 100.0);
+    ASSERT_TRUE("Same total in reverse order", backward.total_profit == forward.total_profit);
+    ASSERT_TRUE("Same total when streamed", streamed.total_profit == forward.total_profit);
+
+    free(many);
+    free(reversed);
+
+    tariff_table_build(&tariff, &table);
+    tariff_table_set_active(&table);
+}
+
+/*
+    Exact mode at its limits - the largest bus line is still exact, a total beyond 2^50 cents is flagged
+*/
+void test_exact_overflow(TestResults *results) {
+    printf("Testing exact mode limits...\n");
+
+    Tariff tariff;
+    TariffTable table;
+    tariff_set_defaults(&tariff);
+    tariff.adult_ticket = tariff.student_ticket = tariff.senior_ticket = 1342.17;
+    tariff_table_build(&tariff, &table);
+    ASSERT_INT_EQUAL("Tickets at the cap accepted", 0, tariff_table_enable_exact(&table));
+    tariff_table_set_active(&table);
+
+    /* 3 * 2147483647 * 1342.17 + 100000 * (0.50 - 2.50) = 8646864179481.97€ (seniors pay on level 1) */
+    const int64_t row_cents = 864686417948197;
+    enum { LINE_COUNT = 2 };
+    BusLineProperties lines[LINE_COUNT];
+    for (int i = 0; i < LINE_COUNT; i++) {
+        lines[i] = (BusLineProperties){ .line_number = i + 1, .subsidy_level = 1, .route_length = 100000.0,
+                                        .passengers = {.adult = 2147483647, .student = 2147483647, .senior = 2147483647} };
+    }
+    calculate_profitability(lines, LINE_COUNT);
+    ASSERT_TRUE("Largest bus line in whole cents", lines[0].profitability == (double)row_cents / 100.0);
+    ASSERT_TRUE("Largest bus line converts back to its cents", tariff_cents(lines[0].profitability) == row_cents);
+
+    /* One of them stays below 2^50 cents, two don't */
+    BusLineSummary summary;
+    summarize_profitability(lines, 1, 1, &summary);
+    ASSERT_TRUE("Total below the limit is exact", !summary.exact_overflow && summary.total_profit == (double)row_cents / 100.0);
+    summarize_profitability(lines, LINE_COUNT, 1, &summary);
+    ASSERT_INT_EQUAL("Total beyond the limit flagged", 1, summary.exact_overflow);
+
+    BusLineAggregator aggregator;
+    bus_line_aggregator_init(&aggregator);
+    for (int i = 0; i < LINE_COUNT; i++) bus_line_aggregator_add(&aggregator, &lines[i]);
+    bus_line_aggregator_total(&aggregator, &summary);
+    ASSERT_INT_EQUAL("Streamed total beyond the limit flagged", 1, summary.exact_overflow);
+
+    /* The largest total still converts to euros and back, one cent more is flagged */
+    int64_t cents = 0;
+    tariff_exact_add_cents(&cents, TARIFF_EXACT_MAX_CENTS - 1);
+    ASSERT_TRUE("Total at the cap accepted", cents == TARIFF_EXACT_MAX_CENTS - 1);
+    ASSERT_TRUE("Total at the cap converts back to its cents", tariff_cents((double)cents / 100.0) == TARIFF_EXACT_MAX_CENTS - 1);
+    tariff_exact_add_cents(&cents, 1);
+    ASSERT_TRUE("Total one cent beyond the cap flagged", cents == TARIFF_EXACT_OVERFLOW);
+
+    /* The marker sticks, even if negative bus lines would bring the sum back into range */
+    tariff_exact_add_cents(&cents, -row_cents);
+    ASSERT_TRUE("Overflow marker sticks", cents == TARIFF_EXACT_OVERFLOW);
+
+    tariff_set_defaults(&tariff);
+    tariff_table_build(&tariff, &table);
+    tariff_table_set_active(&table);
+}
@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../incl/bus_line_cache.h"
+#include "../incl/bus_line_index.h"
+#include "test_utils.h"
+
+#define TEST_INDEX_INPUT_FILE "test_index_input.txt"
+#define TEST_INDEX_CACHE_FILE TEST_INDEX_INPUT_FILE BUS_LINE_CACHE_SUFFIX
+#define TEST_INDEX_FILE TEST_INDEX_INPUT_FILE BUS_LINE_INDEX_SUFFIX
+
+void test_index_build_and_range(TestResults *results);
+void test_index_lookup(TestResults *results);
+void test_index_invalidation(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Bus Line Index ---\n\n");
+
+    test_index_build_and_range(&results);
+    test_index_lookup(&results);
+    test_index_invalidation(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_INDEX_INPUT_FILE);
+    unlink(TEST_INDEX_CACHE_FILE);
+    unlink(TEST_INDEX_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/*
+    Line numbers cycle through 1-500 in a scrambled order, so every line has several departures
+*/
+static void create_index_input_file(int rows) {
+    FILE *file = fopen(TEST_INDEX_INPUT_FILE, "w");
+    if (file) {
+        fprintf(file, "# Index Test Bus Line Data\n");
+        for (int i = 0; i < rows; i++) {
+            fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.5\n", (i * 7919) % 500 + 1, (i * 13) % 24, (i * 17) % 60, (i % 3) + 1,
+                    i % 50, i % 20, i % 7, i % 90 + 1);
+        }
+        fclose(file);
+    }
+}
+
+static int same_row(const BusLineProperties *x, const BusLineProperties *y) {
+    return x->line_number == y->line_number && x->departure_minutes == y->departure_minutes &&
+           x->subsidy_level == y->subsidy_level && x->passengers.adult == y->passengers.adult &&
+           x->passengers.student == y->passengers.student && x->passengers.senior == y->passengers.senior &&
+           x->route_length == y->route_length;
+}
+
+/*
+    Rows of lines first..last in (line, time, row) order - the reference for the index
+*/
+static size_t expected_rows(const BusLineProperties *bus_lines, size_t count, int first, int last, size_t *rows) {
+    size_t found = 0;
+    for (int line = first; line <= last; line++) {
+        for (int minutes = 0; minutes < 24 * 60; minutes++) {
+            for (size_t i = 0; i < count; i++) {
+                if (bus_lines[i].line_number == line && bus_lines[i].departure_minutes == minutes) rows[found++] = i;
+            }
+        }
+    }
+    return found;
+}
+
+void test_index_build_and_range(TestResults *results) {
+    printf("Testing index build and range search...\n");
+
+    const size_t count = 3000;
+    BusLineProperties *bus_lines = calloc(count, sizeof(BusLineProperties));
+    for (size_t i = 0; i < count; i++) {
+        bus_lines[i].line_number = (int)((i * 7919) % 200) + 1;
+        bus_lines[i].departure_minutes = (uint16_t)((i * 31) % 1440);
+    }
+
+    BusLineIndexEntry *entries = NULL;
+    ASSERT_INT_EQUAL("Index built", 0, bus_line_index_build(bus_lines, count, &entries));
+
+    int sorted = 1;
+    for (size_t i = 1; i < count; i++) {
+        const BusLineIndexEntry *a = &entries[i - 1], *b = &entries[i];
+        sorted &= a->line_number < b->line_number || (a->line_number == b->line_number &&
+                  (a->departure_minutes < b->departure_minutes || (a->departure_minutes == b->departure_minutes && a->row < b->row)));
+    }
+    ASSERT_TRUE("Entries sorted by line, time and row", sorted);
+
+    size_t begin = 0, end = 0;
+    bus_line_index_range(entries, count, 17, 17, &begin, &end);
+    int point = end - begin == 15;
+    for (size_t i = begin; i < end; i++) point &= entries[i].line_number == 17 && bus_lines[entries[i].row].line_number == 17;
+    ASSERT_TRUE("Point lookup finds every row of the line", point);
+
+    bus_line_index_range(entries, count, 190, 250, &begin, &end);
+    ASSERT_TRUE("Range past the last line", end == count && end - begin == 11 * 15);
+    bus_line_index_range(entries, count, 300, 400, &begin, &end);
+    ASSERT_TRUE("Range without lines", begin == end);
+    bus_line_index_range(entries, count, 5, 4, &begin, &end);
+    ASSERT_TRUE("Empty range", begin == end);
+
+    free(entries);
+    free(bus_lines);
+}
+
+/*
+    The first lookup reads the text file and writes the cache and the index, the second one only uses those two
+*/
+void test_index_lookup(TestResults *results) {
+    printf("Testing index lookups...\n");
+
+    create_index_input_file(20000);
+    unlink(TEST_INDEX_CACHE_FILE);
+    unlink(TEST_INDEX_FILE);
+
+    BusLineStore all_lines, first, second;
+    bus_line_store_init(&all_lines, 0);
+    bus_line_store_init(&first, 0);
+    bus_line_store_init(&second, 0);
+    bus_line_cache_read(TEST_INDEX_INPUT_FILE, &all_lines, 1, 0);
+
+    size_t *rows = malloc(all_lines.count * sizeof(size_t));
+    size_t expected = expected_rows(all_lines.lines, all_lines.count, 42, 44, rows);
+
+    ASSERT_INT_EQUAL("First lookup", (int)expected, (int)bus_line_index_read(TEST_INDEX_INPUT_FILE, 42, 44, &first, 1, 1));
+    ASSERT_TRUE("Index written", access(TEST_INDEX_FILE, F_OK) == 0 && access(TEST_INDEX_CACHE_FILE, F_OK) == 0);
+
+    /* Written well after the source - the lookup only compares the file attributes, nothing is hashed */
+    BusLineCacheSource source;
+    bus_line_cache_identify(TEST_INDEX_INPUT_FILE, &source);
+    struct timespec later[2] = { { .tv_sec = (time_t)source.ctime_sec + 2, .tv_nsec = 0 }, { .tv_sec = (time_t)source.ctime_sec + 2, .tv_nsec = 0 } };
+    utimensat(AT_FDCWD, TEST_INDEX_FILE, later, 0);
+    utimensat(AT_FDCWD, TEST_INDEX_CACHE_FILE, later, 0);
+    ASSERT_INT_EQUAL("Lookup through the index", (int)expected, (int)bus_line_index_lookup(TEST_INDEX_INPUT_FILE, &source, 42, 44, &second));
+    ASSERT_INT_EQUAL("Source not hashed for the lookup", 0, (int)source.hashed);
+
+    int same = first.count == expected && second.count == expected;
+    for (size_t i = 0; same && i < expected; i++) {
+        same = same_row(&first.lines[i], &all_lines.lines[rows[i]]) && same_row(&second.lines[i], &all_lines.lines[rows[i]]);
+    }
+    ASSERT_TRUE("Same rows in line and time order with and without the index", same);
+
+    BusLineStore none;
+    bus_line_store_init(&none, 0);
+    ASSERT_INT_EQUAL("Unknown line number", 0, (int)bus_line_index_read(TEST_INDEX_INPUT_FILE, 501, 600, &none, 1, 1));
+
+    free(rows);
+    bus_line_store_free(&none);
+    bus_line_store_free(&all_lines);
+    bus_line_store_free(&first);
+    bus_line_store_free(&second);
+}
+
+void test_index_invalidation(TestResults *results) {
+    printf("Testing index invalidation...\n");
+
+    BusLineCacheSource source, changed;
+    bus_line_cache_identify(TEST_INDEX_INPUT_FILE, &source);
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+
+    changed = source;
+    changed.size += 1;
+    ASSERT_INT_EQUAL("Stale index rejected", -1, (int)bus_line_index_lookup(TEST_INDEX_INPUT_FILE, &changed, 1, 10, &store));
+
+    /* The index alone is not enough, the rows come from the cache */
+    unlink(TEST_INDEX_CACHE_FILE);
+    ASSERT_INT_EQUAL("Index without a cache rejected", -1, (int)bus_line_index_lookup(TEST_INDEX_INPUT_FILE, &source, 1, 10, &store));
+
+    truncate(TEST_INDEX_FILE, 100);
+    ASSERT_INT_EQUAL("Truncated index rejected", -1, (int)bus_line_index_lookup(TEST_INDEX_INPUT_FILE, &source, 1, 10, &store));
+    ASSERT_INT_EQUAL("Nothing loaded from bad indexes", 0, (int)store.count);
+
+    /* Both get rebuilt by the next lookup */
+    int64_t rebuilt = bus_line_index_read(TEST_INDEX_INPUT_FILE, 1, 10, &store, 1, 1);
+    ASSERT_TRUE("Lookup rebuilds the index", rebuilt > 0);
+    ASSERT_TRUE("Rebuilt index is usable", bus_line_index_lookup(TEST_INDEX_INPUT_FILE, &source, 1, 10, &store) == rebuilt);
+
+    bus_line_store_free(&store);
+}
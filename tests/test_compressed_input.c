@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../incl/compressed_input.h"
+#include "../incl/file_handler.h"
+#include "test_utils.h"
+
+#define TEST_COMPRESSED_PLAIN_FILE "test_compressed_input.txt"
+#define TEST_COMPRESSED_GZIP_FILE "test_compressed_input.txt.gz"
+#define TEST_COMPRESSED_ZSTD_FILE "test_compressed_input.txt.zst"
+#define TEST_COMPRESSED_TRUNCATED_FILE "test_compressed_truncated.gz"
+#define TEST_COMPRESSED_ROWS 5000
+
+void test_detect_format(TestResults *results);
+void test_read_gzip(TestResults *results);
+void test_read_zstd(TestResults *results);
+void test_read_truncated(TestResults *results);
+void test_missing_tool(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Compressed Input ---\n\n");
+
+    FILE *file = fopen(TEST_COMPRESSED_PLAIN_FILE, "w");
+    if (file) {
+        for (int i = 0; i < TEST_COMPRESSED_ROWS; i++) {
+            fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.5\n", i % 97 + 1, (i / 60) % 24, i % 60, i % 3 + 1, i % 40, i % 11, i % 7, i % 30 + 1);
+        }
+        fclose(file);
+    }
+
+    test_detect_format(&results);
+    test_read_gzip(&results);
+    test_read_zstd(&results);
+    test_read_truncated(&results);
+    test_missing_tool(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_COMPRESSED_PLAIN_FILE);
+    unlink(TEST_COMPRESSED_GZIP_FILE);
+    unlink(TEST_COMPRESSED_ZSTD_FILE);
+    unlink(TEST_COMPRESSED_TRUNCATED_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+static int same_rows(const BusLineStore *x, const BusLineStore *y) {
+    if (x->count != y->count) return 0;
+    for (size_t i = 0; i < x->count; i++) {
+        const BusLineProperties *a = &x->lines[i], *b = &y->lines[i];
+        if (a->line_number != b->line_number || a->departure_minutes != b->departure_minutes ||
+            a->subsidy_level != b->subsidy_level || a->passengers.adult != b->passengers.adult ||
+            a->passengers.student != b->passengers.student || a->passengers.senior != b->passengers.senior ||
+            a->route_length != b->route_length) return 0;
+    }
+    return 1;
+}
+
+/*
+    Reads the compressed file and compares it to the plain one, with and without a line limit
+*/
+static void check_compressed_rows(TestResults *results, const char *compressed_file) {
+    BusLineStore plain, compressed;
+    bus_line_store_init(&plain, 0);
+    bus_line_store_init(&compressed, 0);
+
+    read_handler(TEST_COMPRESSED_PLAIN_FILE, &plain, READ_ALL_BUS_LINES);
+    ASSERT_INT_EQUAL("Every compressed row read", TEST_COMPRESSED_ROWS, (int)read_handler(compressed_file, &compressed, READ_ALL_BUS_LINES));
+    ASSERT_TRUE("Compressed rows are identical to the plain ones", same_rows(&plain, &compressed));
+    bus_line_store_free(&compressed);
+
+    /* Stopping early closes the pipe while the decompressor still has data to write */
+    bus_line_store_init(&compressed, 0);
+    ASSERT_INT_EQUAL("Line limit respected", 10, (int)read_handler(compressed_file, &compressed, 10));
+    ASSERT_TRUE("Limited rows are the first ones", compressed.count == 10 && compressed.lines[9].line_number == plain.lines[9].line_number &&
+                compressed.lines[9].departure_minutes == plain.lines[9].departure_minutes);
+
+    bus_line_store_free(&plain);
+    bus_line_store_free(&compressed);
+}
+
+/*
+    The decompressors are only started by absolute path - point the library at wherever this system keeps them
+*/
+static int use_installed_tool(CompressionFormat format) {
+    char command[64], path[COMPRESSED_INPUT_PATH_BYTES];
+    snprintf(command, sizeof(command), "command -v %s", compressed_input_tool(format));
+
+    FILE *output = popen(command, "r");
+    if (output == NULL) return -1;
+    int found = fgets(path, sizeof(path), output) != NULL;
+    pclose(output);
+    if (!found) return -1;
+
+    path[strcspn(path, "\n")] = '\0';
+    return compressed_input_set_tool_path(format, path);
+}
+
+void test_detect_format(TestResults *results) {
+    printf("Testing format detection...\n");
+
+    const unsigned char gzip_header[] = { 0x1f, 0x8b, 0x08, 0x00 };
+    const unsigned char zstd_header[] = { 0x28, 0xb5, 0x2f, 0xfd };
+    const unsigned char text_header[] = { '1', ',', '0', '8' };
+
+    ASSERT_INT_EQUAL("Gzip magic", COMPRESSION_GZIP, compressed_input_detect(gzip_header, sizeof(gzip_header)));
+    ASSERT_INT_EQUAL("Zstd magic", COMPRESSION_ZSTD, compressed_input_detect(zstd_header, sizeof(zstd_header)));
+    ASSERT_INT_EQUAL("Plain text", COMPRESSION_NONE, compressed_input_detect(text_header, sizeof(text_header)));
+    ASSERT_INT_EQUAL("Partial zstd magic", COMPRESSION_NONE, compressed_input_detect(zstd_header, 2));
+    ASSERT_INT_EQUAL("Empty file", COMPRESSION_NONE, compressed_input_detect(gzip_header, 0));
+
+    int fd = open(TEST_COMPRESSED_PLAIN_FILE, O_RDONLY);
+    ASSERT_INT_EQUAL("Plain file detected", COMPRESSION_NONE, compressed_input_detect_fd(fd));
+    ASSERT_INT_EQUAL("File offset unchanged", 0, (int)lseek(fd, 0, SEEK_CUR));
+    close(fd);
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) == 0) {
+        write(pipe_fds[1], gzip_header, sizeof(gzip_header));
+        ASSERT_INT_EQUAL("Pipes are never sniffed", COMPRESSION_NONE, compressed_input_detect_fd(pipe_fds[0]));
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+}
+
+void test_read_gzip(TestResults *results) {
+    printf("Testing gzip input...\n");
+
+    if (system("gzip -c " TEST_COMPRESSED_PLAIN_FILE " > " TEST_COMPRESSED_GZIP_FILE " 2>/dev/null") != 0 ||
+        use_installed_tool(COMPRESSION_GZIP) != 0) {
+        printf("gzip not available, skipping\n");
+        return;
+    }
+    check_compressed_rows(results, TEST_COMPRESSED_GZIP_FILE);
+}
+
+void test_read_zstd(TestResults *results) {
+    printf("Testing zstd input...\n");
+
+    if (system("zstd -q -c " TEST_COMPRESSED_PLAIN_FILE " > " TEST_COMPRESSED_ZSTD_FILE " 2>/dev/null") != 0 ||
+        use_installed_tool(COMPRESSION_ZSTD) != 0) {
+        printf("zstd not available, skipping\n");
+        return;
+    }
+    check_compressed_rows(results, TEST_COMPRESSED_ZSTD_FILE);
+}
+
+void test_read_truncated(TestResults *results) {
+    printf("Testing truncated archives...\n");
+
+    if (system("gzip -c " TEST_COMPRESSED_PLAIN_FILE " | head -c 2000 > " TEST_COMPRESSED_TRUNCATED_FILE " 2>/dev/null") != 0 ||
+        use_installed_tool(COMPRESSION_GZIP) != 0) {
+        printf("gzip not available, skipping\n");
+        return;
+    }
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    ASSERT_INT_EQUAL("Truncated archive rejected", -1, (int)read_handler(TEST_COMPRESSED_TRUNCATED_FILE, &store, READ_ALL_BUS_LINES));
+    bus_line_store_free(&store);
+}
+
+void test_missing_tool(TestResults *results) {
+    printf("Testing a missing decompressor...\n");
+
+    ASSERT_INT_EQUAL("Relative tool path refused", -1, compressed_input_set_tool_path(COMPRESSION_GZIP, "gzip"));
+    ASSERT_TRUE("Default path is absolute", compressed_input_tool_path(COMPRESSION_ZSTD)[0] == '/');
+
+    if (access(TEST_COMPRESSED_GZIP_FILE, R_OK) != 0) {
+        printf("gzip not available, skipping\n");
+        return;
+    }
+
+    compressed_input_set_tool_path(COMPRESSION_GZIP, "/nonexistent/gzip");
+
+    int fd = open(TEST_COMPRESSED_GZIP_FILE, O_RDONLY);
+    CompressedInput input;
+    ASSERT_INT_EQUAL("Missing decompressor reported as not installed", -2, compressed_input_open(fd, COMPRESSION_GZIP, &input));
+    close(fd);
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    ASSERT_INT_EQUAL("Input rejected without the decompressor", -1, (int)read_handler(TEST_COMPRESSED_GZIP_FILE, &store, READ_ALL_BUS_LINES));
+    bus_line_store_free(&store);
+
+    use_installed_tool(COMPRESSION_GZIP);
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../incl/csv_scanner.h"
+#include "test_utils.h"
+
+void test_block_kernels(TestResults *results);
+void test_row_boundaries(TestResults *results);
+void test_long_rows(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing CSV Scanner ---\n\n");
+
+    test_block_kernels(&results);
+    test_row_boundaries(&results);
+    test_long_rows(&results);
+
+    print_test_summary(&results);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/*
+    Fills a buffer with random bytes that are heavy on the characters the scanner is looking for
+*/
+static void fill_random_csv(char *buffer, size_t size, unsigned seed) {
+    static const char alphabet[] = ",,,\n\n\r##0123456789.: x";
+    srand(seed);
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = alphabet[rand() % (int)(sizeof(alphabet) - 1)];
+    }
+}
+
+static int masks_equal(const CsvBlockMasks *a, const CsvBlockMasks *b) {
+    return a->comma == b->comma && a->newline == b->newline &&
+           a->carriage_return == b->carriage_return && a->comment == b->comment;
+}
+
+/*
+    Every vectorized kernel that the CPU supports has to produce exactly the same bitmasks as the scalar kernel
+*/
+void test_block_kernels(TestResults *results) {
+    printf("Testing block scanning kernels...\n");
+
+    const char *kernels[] = {"sse2", "avx2"};
+    char block[CSV_BLOCK_SIZE];
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (csv_scanner_select_kernel(kernels[k]) != 0) {
+            printf("  (kernel %s is not supported on this CPU, skipping)\n", kernels[k]);
+            continue;
+        }
+
+        int mismatches = 0;
+        for (unsigned seed = 0; seed < 2000; seed++) {
+            fill_random_csv(block, sizeof(block), seed);
+
+            CsvBlockMasks expected, actual;
+            csv_scan_block_scalar(block, &expected);
+            csv_scan_block(block, &actual);
+            if (!masks_equal(&expected, &actual)) mismatches++;
+        }
+
+        char message[64];
+        snprintf(message, sizeof(message), "Kernel %s matches the scalar kernel", kernels[k]);
+        ASSERT_INT_EQUAL(message, 0, mismatches);
+    }
+
+    ASSERT_INT_EQUAL("Scalar kernel can always be selected", 0, csv_scanner_select_kernel("scalar"));
+    ASSERT_INT_EQUAL("Unknown kernel is rejected", -1, csv_scanner_select_kernel("quantum"));
+}
+
+/*
+    Scans data with the currently selected kernel and compares every row and comma position against a naive
+    byte-by-byte split of the same data. Returns the number of mismatching rows.
+*/
+static int compare_with_naive_split(const char *data, size_t size) {
+    CsvScanner scanner;
+    CsvRow row;
+    size_t pos = 0;
+    int mismatches = 0;
+
+    csv_scanner_start(&scanner, data, size);
+
+    while (pos < size) {
+        const char *newline = memchr(data + pos, '\n', size - pos);
+        size_t end = newline ? (size_t)(newline - data) : size;
+
+        if (!csv_scanner_next_row(&scanner, &row)) return mismatches + 1;
+
+        size_t commas = 0;
+        int row_ok = row.begin == data + pos && row.end == data + end;
+        for (size_t i = pos; i < end; i++) {
+            if (data[i] != ',') continue;
+            if (commas < CSV_MAX_ROW_COMMAS && row.commas[commas] != i - pos) row_ok = 0;
+            commas++;
+        }
+
+        row_ok = row_ok && row.comma_count == commas;
+        row_ok = row_ok && row.has_carriage_return == (end > pos && data[end - 1] == '\r');
+        row_ok = row_ok && row.is_comment == (data[pos] == '#');
+        if (!row_ok) mismatches++;
+
+        pos = newline ? end + 1 : size;
+    }
+
+    if (csv_scanner_next_row(&scanner, &row)) mismatches++;
+
+    return mismatches;
+}
+
+/*
+    Row and field boundaries must come out exactly the same as with a naive scalar split, for all kernels
+    and for buffer sizes that do and do not line up with the block size
+*/
+void test_row_boundaries(TestResults *results) {
+    printf("Testing row and field boundaries...\n");
+
+    const char *kernels[] = {"scalar", "sse2", "avx2"};
+    char buffer[1031];
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (csv_scanner_select_kernel(kernels[k]) != 0) continue;
+
+        int mismatches = 0;
+        for (unsigned seed = 0; seed < 300; seed++) {
+            size_t size = 1 + (size_t)seed * 7 % sizeof(buffer);
+            fill_random_csv(buffer, size, seed + 17);
+            mismatches += compare_with_naive_split(buffer, size);
+        }
+
+        char message[64];
+        snprintf(message, sizeof(message), "Rows found by %s match a naive split", kernels[k]);
+        ASSERT_INT_EQUAL(message, 0, mismatches);
+    }
+
+    /*
+        A CR that ends one block followed by a LF that starts the next one is still a CRLF line ending
+    */
+    char crlf[CSV_BLOCK_SIZE + 8];
+    memset(crlf, 'x', sizeof(crlf));
+    crlf[CSV_BLOCK_SIZE - 1] = '\r';
+    crlf[CSV_BLOCK_SIZE] = '\n';
+
+    CsvScanner scanner;
+    CsvRow row;
+    csv_scanner_init();
+    csv_scanner_start(&scanner, crlf, sizeof(crlf));
+    csv_scanner_next_row(&scanner, &row);
+    ASSERT_TRUE("CRLF split across two blocks is detected", row.has_carriage_return);
+    ASSERT_INT_EQUAL("Row ends right before the LF", CSV_BLOCK_SIZE, (int)(row.end - row.begin));
+
+    ASSERT_INT_EQUAL("Empty input has no rows", 0, (csv_scanner_start(&scanner, crlf, 0), csv_scanner_next_row(&scanner, &row)));
+}
+
+/*
+    Rows with more commas than CSV_MAX_ROW_COMMAS still report the correct number of separators
+*/
+void test_long_rows(TestResults *results) {
+    printf("Testing rows with many fields...\n");
+
+    char line[256];
+    size_t len = 0;
+    for (int i = 0; i < 40; i++) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%d,", i);
+    }
+
+    CsvScanner scanner;
+    CsvRow row;
+    csv_scanner_start(&scanner, line, len);
+
+    ASSERT_TRUE("Long row is found", csv_scanner_next_row(&scanner, &row));
+    ASSERT_INT_EQUAL("All 40 commas are counted", 40, (int)row.comma_count);
+    ASSERT_INT_EQUAL("Fifth comma position", 9, (int)row.commas[4]);
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../incl/field_parser.h"
+#include "test_utils.h"
+
+void test_parse_int_field(TestResults *results);
+void test_parse_decimal_field(TestResults *results);
+void test_parse_time_field(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Field Parser ---\n\n");
+
+    test_parse_int_field(&results);
+    test_parse_decimal_field(&results);
+    test_parse_time_field(&results);
+
+    print_test_summary(&results);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+static FieldParseStatus parse_int(const char *text, int32_t min_value, int32_t max_value, int32_t *value) {
+    return parse_int_field(text, text + strlen(text), min_value, max_value, value);
+}
+
+static FieldParseStatus parse_decimal(const char *text, double *value) {
+    return parse_decimal_field(text, text + strlen(text), value);
+}
+
+static FieldParseStatus parse_time(const char *text, uint16_t *minutes) {
+    return parse_time_field(text, text + strlen(text), minutes);
+}
+
+/*
+    Integer fields - regular values, signs, range limits, overflow and garbage
+*/
+void test_parse_int_field(TestResults *results) {
+    printf("Testing integer field parsing...\n");
+
+    int32_t value = 0;
+
+    ASSERT_INT_EQUAL("Plain integer parses", FIELD_PARSE_OK, parse_int("214", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Plain integer value", 214, value);
+    ASSERT_INT_EQUAL("Explicit plus sign", FIELD_PARSE_OK, parse_int("+7", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Explicit plus sign value", 7, value);
+    ASSERT_INT_EQUAL("Negative number in range", FIELD_PARSE_OK, parse_int("-12", INT32_MIN, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Negative number value", -12, value);
+    ASSERT_INT_EQUAL("Largest 32-bit value", FIELD_PARSE_OK, parse_int("2147483647", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Largest 32-bit value parsed", INT32_MAX, value);
+    ASSERT_INT_EQUAL("Smallest 32-bit value", FIELD_PARSE_OK, parse_int("-2147483648", INT32_MIN, 0, &value));
+    ASSERT_TRUE("Smallest 32-bit value parsed", value == INT32_MIN);
+
+    ASSERT_INT_EQUAL("Overflow is a range error", FIELD_PARSE_RANGE, parse_int("2147483648", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Huge number is a range error", FIELD_PARSE_RANGE, parse_int("99999999999999999999999", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Negative passengers are a range error", FIELD_PARSE_RANGE, parse_int("-5", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Subsidy level 5 is a range error", FIELD_PARSE_RANGE, parse_int("5", 1, 3, &value));
+    ASSERT_INT_EQUAL("Empty field", FIELD_PARSE_EMPTY, parse_int("", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Lone sign", FIELD_PARSE_SYNTAX, parse_int("-", INT32_MIN, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Text is a syntax error", FIELD_PARSE_SYNTAX, parse_int("invalid", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Trailing garbage is a syntax error", FIELD_PARSE_SYNTAX, parse_int("12abc", 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Decimal point is a syntax error", FIELD_PARSE_SYNTAX, parse_int("1.5", 0, INT32_MAX, &value));
+
+    /*
+        Only the [begin, end) range is looked at - the characters after it do not matter
+    */
+    const char *row = "42,08:00";
+    ASSERT_INT_EQUAL("Range inside a row", FIELD_PARSE_OK, parse_int_field(row, row + 2, 0, INT32_MAX, &value));
+    ASSERT_INT_EQUAL("Range inside a row value", 42, value);
+}
+
+/*
+    Decimal fields - the fast path has to give exactly the same double as strtod
+*/
+void test_parse_decimal_field(TestResults *results) {
+    printf("Testing decimal field parsing...\n");
+
+    double value = 0.0;
+
+    ASSERT_INT_EQUAL("Route length parses", FIELD_PARSE_OK, parse_decimal("15.5", &value));
+    ASSERT_TRUE("Route length value is exact", value == 15.5);
+    ASSERT_INT_EQUAL("Integer route length", FIELD_PARSE_OK, parse_decimal("12", &value));
+    ASSERT_TRUE("Integer route length value", value == 12.0);
+    ASSERT_INT_EQUAL("Leading dot", FIELD_PARSE_OK, parse_decimal(".25", &value));
+    ASSERT_TRUE("Leading dot value", value == 0.25);
+    ASSERT_INT_EQUAL("Trailing dot", FIELD_PARSE_OK, parse_decimal("3.", &value));
+    ASSERT_TRUE("Trailing dot value", value == 3.0);
+    ASSERT_INT_EQUAL("Negative decimal", FIELD_PARSE_OK, parse_decimal("-10.5", &value));
+    ASSERT_TRUE("Negative decimal value", value == -10.5);
+    ASSERT_INT_EQUAL("Exponent goes through the slow path", FIELD_PARSE_OK, parse_decimal("1.5e2", &value));
+    ASSERT_TRUE("Exponent value", value == 150.0);
+
+    ASSERT_INT_EQUAL("Empty decimal", FIELD_PARSE_EMPTY, parse_decimal("", &value));
+    ASSERT_INT_EQUAL("Lone dot", FIELD_PARSE_SYNTAX, parse_decimal(".", &value));
+    ASSERT_INT_EQUAL("Trailing garbage", FIELD_PARSE_SYNTAX, parse_decimal("15.5km", &value));
+    ASSERT_INT_EQUAL("Two dots", FIELD_PARSE_SYNTAX, parse_decimal("1.2.3", &value));
+    ASSERT_INT_EQUAL("Dangling exponent", FIELD_PARSE_SYNTAX, parse_decimal("1e", &value));
+    ASSERT_INT_EQUAL("NaN is not accepted", FIELD_PARSE_SYNTAX, parse_decimal("nan", &value));
+    ASSERT_INT_EQUAL("Infinity is not accepted", FIELD_PARSE_SYNTAX, parse_decimal("inf", &value));
+    ASSERT_INT_EQUAL("Overflowing exponent", FIELD_PARSE_RANGE, parse_decimal("1e999", &value));
+
+    /*
+        Random fixed-precision decimals and long mantissas must match strtod bit for bit
+    */
+    int mismatches = 0;
+    char text[64];
+    srand(1234);
+    for (int i = 0; i < 100000; i++) {
+        int decimals = rand() % 8;
+        long long whole = rand() % 100000;
+        long long fraction = rand() % 10000000;
+        if (i % 10 == 0) {
+            snprintf(text, sizeof(text), "%lld%07lld%07lld.%lld", whole, fraction, (long long)rand(), fraction);
+        } else {
+            snprintf(text, sizeof(text), "%lld.%0*lld", whole, decimals + 1, fraction % 100000000LL);
+        }
+
+        double expected = strtod(text, NULL);
+        if (parse_decimal(text, &value) != FIELD_PARSE_OK || value != expected) mismatches++;
+    }
+    ASSERT_INT_EQUAL("Random decimals match strtod exactly", 0, mismatches);
+}
+
+/*
+    Departure times - only HH:MM from 00:00 to 23:59 is accepted
+*/
+void test_parse_time_field(TestResults *results) {
+    printf("Testing departure time parsing...\n");
+
+    uint16_t minutes = 0;
+    ASSERT_INT_EQUAL("Regular time", FIELD_PARSE_OK, parse_time("08:15", &minutes));
+    ASSERT_INT_EQUAL("Regular time value", 8 * 60 + 15, minutes);
+    ASSERT_INT_EQUAL("Midnight", FIELD_PARSE_OK, parse_time("00:00", &minutes));
+    ASSERT_INT_EQUAL("Midnight value", 0, minutes);
+    ASSERT_INT_EQUAL("Last minute of the day", FIELD_PARSE_OK, parse_time("23:59", &minutes));
+    ASSERT_INT_EQUAL("Last minute value", MINUTES_PER_DAY - 1, minutes);
+
+    minutes = 77;
+    ASSERT_INT_EQUAL("Empty time", FIELD_PARSE_EMPTY, parse_time("", &minutes));
+    ASSERT_INT_EQUAL("Hour 24", FIELD_PARSE_RANGE, parse_time("24:00", &minutes));
+    ASSERT_INT_EQUAL("Minute 60", FIELD_PARSE_RANGE, parse_time("12:60", &minutes));
+    ASSERT_INT_EQUAL("Single digit hour", FIELD_PARSE_SYNTAX, parse_time("8:00", &minutes));
+    ASSERT_INT_EQUAL("Seconds", FIELD_PARSE_SYNTAX, parse_time("08:00:00", &minutes));
+    ASSERT_INT_EQUAL("No colon", FIELD_PARSE_SYNTAX, parse_time("08.00", &minutes));
+    ASSERT_INT_EQUAL("Signed minutes", FIELD_PARSE_SYNTAX, parse_time("08:-1", &minutes));
+    ASSERT_INT_EQUAL("Nothing written on failure", 77, minutes);
+}
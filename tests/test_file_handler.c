@@ -1,16 +1,29 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "../incl/file_handler.h"
+#include "../incl/tariff.h"
 #include "test_utils.h"
 
 void test_read_handler(TestResults *results);
+void test_read_handler_large_input(TestResults *results);
+void test_read_handler_line_endings(TestResults *results);
+void test_read_handler_pipe(TestResults *results);
+void test_read_handler_parallel(TestResults *results);
+void test_read_handler_stream(TestResults *results);
 void test_write_handler(TestResults *results);
 void test_invalid_inputs(TestResults *results);
 
 #define TEST_INPUT_FILE "test_input.txt"
 #define TEST_OUTPUT_FILE "test_output.txt"
+#define TEST_FIFO_FILE "test_input.fifo"
+#define TEST_WARNINGS_FILE "test_warnings.txt"
+#define TEST_WARNINGS_PARALLEL_FILE "test_warnings_parallel.txt"
 
 int main() {
     TestResults results;
@@ -19,6 +32,11 @@ int main() {
     printf("\n--- Testing File Handler ---\n\n");
     
     test_read_handler(&results);
+    test_read_handler_large_input(&results);
+    test_read_handler_line_endings(&results);
+    test_read_handler_pipe(&results);
+    test_read_handler_parallel(&results);
+    test_read_handler_stream(&results);
     test_write_handler(&results);
     test_invalid_inputs(&results);
     
@@ -29,6 +47,9 @@ int main() {
     */
     unlink(TEST_INPUT_FILE);
     unlink(TEST_OUTPUT_FILE);
+    unlink(TEST_FIFO_FILE);
+    unlink(TEST_WARNINGS_FILE);
+    unlink(TEST_WARNINGS_PARALLEL_FILE);
     
     return results.tests_failed > 0 ? 1 : 0;
 }
@@ -60,8 +81,10 @@ void test_read_handler(TestResults *results) {
     /*
         Verify that valid bus lines are read 
     */
-    BusLineProperties bus_lines[MAX_BUS_LINES];
-    int count = read_handler(TEST_INPUT_FILE, bus_lines, MAX_BUS_LINES);
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int count = (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+    BusLineProperties *bus_lines = store.lines;
     
     /*
         Check if the count matches the expected number of lines that the function was supposed to parse from the
@@ -73,7 +96,7 @@ void test_read_handler(TestResults *results) {
         Verify the data integrity (by integrity I do not mean a hash or a checksum lol, just the contents of the data) of the first bus line
     */
     ASSERT_INT_EQUAL("Line 1 number", 1, bus_lines[0].line_number);
-    ASSERT_STRING_EQUAL("Line 1 departure time", "08:00", bus_lines[0].departure_time);
+    ASSERT_INT_EQUAL("Line 1 departure time", 8 * 60, bus_lines[0].departure_minutes);
     ASSERT_INT_EQUAL("Line 1 subsidy level", 1, bus_lines[0].subsidy_level);
     ASSERT_INT_EQUAL("Line 1 adult passengers", 25, bus_lines[0].passengers.adult);
     ASSERT_INT_EQUAL("Line 1 student passengers", 10, bus_lines[0].passengers.student);
@@ -84,7 +107,7 @@ void test_read_handler(TestResults *results) {
         Perform the same verification for the fourth line as for the first (after the comment and empty line)
     */
     ASSERT_INT_EQUAL("Line 4 number", 4, bus_lines[3].line_number);
-    ASSERT_STRING_EQUAL("Line 4 departure time", "12:00", bus_lines[3].departure_time);
+    ASSERT_INT_EQUAL("Line 4 departure time", 12 * 60, bus_lines[3].departure_minutes);
     ASSERT_INT_EQUAL("Line 4 subsidy level", 1, bus_lines[3].subsidy_level);
     ASSERT_INT_EQUAL("Line 4 adult passengers", 20, bus_lines[3].passengers.adult);
     ASSERT_INT_EQUAL("Line 4 student passengers", 12, bus_lines[3].passengers.student);
@@ -94,9 +117,285 @@ void test_read_handler(TestResults *results) {
     /*
         Test an edge case - the limit of maximum bus lines allowed for analysis at a time
     */
-    BusLineProperties limited_lines[2];
-    int limited_count = read_handler(TEST_INPUT_FILE, limited_lines, 2);
+    BusLineStore limited_store;
+    bus_line_store_init(&limited_store, 0);
+    int limited_count = (int)read_handler(TEST_INPUT_FILE, &limited_store, 2);
     ASSERT_INT_EQUAL("Respect max_bus_lines limit", 2, limited_count);
+    ASSERT_INT_EQUAL("Store holds only the limited number of lines", 2, (int)limited_store.count);
+
+    bus_line_store_free(&limited_store);
+    bus_line_store_free(&store);
+}
+
+/*
+    Inputs bigger than the old fixed buffer of 100 bus lines must be read completely - the row store
+    grows on demand instead of silently dropping everything past the first 100 lines
+*/
+void test_read_handler_large_input(TestResults *results) {
+    printf("Testing read_handler with a large input...\n");
+
+    FILE *file = fopen(TEST_INPUT_FILE, "w");
+    if (file) {
+        fprintf(file, "# Large Test Bus Line Data\n");
+        for (int i = 1; i <= 5000; i++) {
+            fprintf(file, "%d,08:00,%d,20,10,5,12.5\n", i, (i % 3) + 1);
+        }
+        fclose(file);
+    }
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int count = (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+
+    ASSERT_INT_EQUAL("All 5000 bus lines read", 5000, count);
+    ASSERT_INT_EQUAL("Store count matches", 5000, (int)store.count);
+    ASSERT_TRUE("Store capacity covers all lines", store.capacity >= store.count);
+    ASSERT_INT_EQUAL("Last line number correct", 5000, store.lines[4999].line_number);
+
+    /*
+        Appending to a non-empty store keeps the rows that were already there
+    */
+    count = (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+    ASSERT_INT_EQUAL("Second read appends 5000 more lines", 5000, count);
+    ASSERT_INT_EQUAL("Store holds both reads", 10000, (int)store.count);
+    ASSERT_INT_EQUAL("First line survives growth", 1, store.lines[0].line_number);
+
+    bus_line_store_free(&store);
+}
+
+/*
+    CRLF line endings, blank CRLF lines, whitespace around fields and a last line without a trailing newline
+    must all be handled the same way by the memory mapped input path
+*/
+void test_read_handler_line_endings(TestResults *results) {
+    printf("Testing read_handler with CRLF line endings...\n");
+
+    FILE *file = fopen(TEST_INPUT_FILE, "wb");
+    if (file) {
+        fputs("# Windows line endings\r\n", file);
+        fputs("1,08:00,1,25,10,5,15.5\r\n", file);
+        fputs("\r\n", file);
+        fputs(" 2 , 09:15 ,2,18,8,4, 12.0 \r\n", file);
+        fputs("#3,10:30,3,15,7,6,10.5\r\n", file);
+        fputs("4,12:00,1,20,12,3,18.0", file);  /* No newline at the very end of the file */
+        fclose(file);
+    }
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int count = (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+
+    ASSERT_INT_EQUAL("CRLF lines read", 3, count);
+    if (count == 3) {
+        ASSERT_DOUBLE_EQUAL("CR is not part of the route length", 15.5, store.lines[0].route_length, 0.0001);
+        ASSERT_INT_EQUAL("Departure time is trimmed", 9 * 60 + 15, store.lines[1].departure_minutes);
+        ASSERT_INT_EQUAL("Line number is trimmed", 2, store.lines[1].line_number);
+        ASSERT_INT_EQUAL("Unterminated last line is read", 4, store.lines[2].line_number);
+        ASSERT_DOUBLE_EQUAL("Unterminated last route length", 18.0, store.lines[2].route_length, 0.0001);
+    }
+
+    bus_line_store_free(&store);
+}
+
+/*
+    Pipes cannot be memory mapped - the read handler has to fall back to buffered reads for them
+*/
+void test_read_handler_pipe(TestResults *results) {
+    printf("Testing read_handler with a pipe as input...\n");
+
+    unlink(TEST_FIFO_FILE);
+    if (mkfifo(TEST_FIFO_FILE, 0600) != 0) {
+        ASSERT_TRUE("Created a FIFO for the pipe test", 0);
+        return;
+    }
+
+    pid_t writer = fork();
+    if (writer == 0) {
+        FILE *fifo = fopen(TEST_FIFO_FILE, "w");
+        if (fifo) {
+            fputs("# Piped Bus Line Data\n", fifo);
+            fputs("1,08:00,1,25,10,5,15.5\r\n", fifo);
+            fputs("\n", fifo);
+            fputs("2,09:15,2,18,8,4,12.0\n", fifo);
+            fclose(fifo);
+        }
+        _exit(0);
+    }
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int count = (int)read_handler(TEST_FIFO_FILE, &store, READ_ALL_BUS_LINES);
+    waitpid(writer, NULL, 0);
+
+    ASSERT_INT_EQUAL("Lines read from a pipe", 2, count);
+    if (count == 2) {
+        ASSERT_DOUBLE_EQUAL("CR stripped on buffered path", 15.5, store.lines[0].route_length, 0.0001);
+        ASSERT_INT_EQUAL("Second piped line number", 2, store.lines[1].line_number);
+    }
+
+    bus_line_store_free(&store);
+}
+
+/*
+    Runs a read handler with stderr redirected into a file so that the warnings can be compared afterwards
+*/
+static void append_to_store(BusLineProperties *bus_line, void *context) {
+    BusLineStore *store = context;
+    BusLineProperties *slot = bus_line_store_next_slot(store);
+    if (slot) {
+        *slot = *bus_line;
+        bus_line_store_commit(store);
+    }
+}
+
+/*
+    thread_count == 0 reads through the streaming path (into the store, via a visitor)
+*/
+static int64_t read_capturing_warnings(const char *warnings_file, unsigned thread_count, BusLineStore *store) {
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    FILE *warnings = fopen(warnings_file, "w");
+    if (warnings) dup2(fileno(warnings), STDERR_FILENO);
+
+    int64_t count = (thread_count == 0) ? read_handler_stream(TEST_INPUT_FILE, append_to_store, store)
+                  : (thread_count == 1) ? read_handler(TEST_INPUT_FILE, store, READ_ALL_BUS_LINES)
+                                        : read_handler_parallel(TEST_INPUT_FILE, store, thread_count);
+
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    if (warnings) fclose(warnings);
+
+    return count;
+}
+
+static int same_bus_lines(const BusLineStore *a, const BusLineStore *b) {
+    if (a->count != b->count) return 0;
+    for (size_t i = 0; i < a->count; i++) {
+        const BusLineProperties *x = &a->lines[i], *y = &b->lines[i];
+        if (x->line_number != y->line_number || x->departure_minutes != y->departure_minutes ||
+            x->subsidy_level != y->subsidy_level || x->passengers.adult != y->passengers.adult ||
+            x->passengers.student != y->passengers.student || x->passengers.senior != y->passengers.senior ||
+            x->route_length != y->route_length) return 0;
+    }
+    return 1;
+}
+
+static int files_equal(const char *path_a, const char *path_b) {
+    FILE *a = fopen(path_a, "r"), *b = fopen(path_b, "r");
+    int equal = (a != NULL && b != NULL);
+    while (equal) {
+        int ca = fgetc(a), cb = fgetc(b);
+        if (ca != cb) equal = 0;
+        if (ca == EOF || cb == EOF) break;
+    }
+    if (a) fclose(a);
+    if (b) fclose(b);
+    return equal;
+}
+
+/*
+    Parsing a big file on several threads has to give exactly the same rows (in the same order)
+    and the same warnings (with the same line numbers) as parsing it sequentially
+*/
+void test_read_handler_parallel(TestResults *results) {
+    printf("Testing parallel read_handler...\n");
+
+    FILE *file = fopen(TEST_INPUT_FILE, "w");
+    if (file) {
+        fprintf(file, "# Parallel Test Bus Line Data\n");
+        for (int i = 1; i <= 200000; i++) {
+            if (i % 25013 == 0) {
+                fprintf(file, "%d,08:00,7,20,10,5,12.5\n", i);      /* Invalid subsidy level */
+            } else if (i % 33331 == 0) {
+                fprintf(file, "%d,25:00,1,20,10,5,12.5\n", i);     /* Invalid departure time */
+            } else if (i % 40009 == 0) {
+                fprintf(file, "\n# comment in the middle\n");
+            } else {
+                fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.%d\n", i, i % 24, i % 60, (i % 3) + 1, i % 50, i % 20, i % 7, i % 90 + 1, i % 10);
+            }
+        }
+        fclose(file);
+    }
+
+    BusLineStore sequential, parallel;
+    bus_line_store_init(&sequential, 0);
+    bus_line_store_init(&parallel, 0);
+
+    int64_t sequential_count = read_capturing_warnings(TEST_WARNINGS_FILE, 1, &sequential);
+    int64_t parallel_count = read_capturing_warnings(TEST_WARNINGS_PARALLEL_FILE, 4, &parallel);
+
+    ASSERT_TRUE("Sequential read found the valid lines", sequential_count == 200000 - 7 - 4 - 6);
+    ASSERT_TRUE("Parallel read found the same number of lines", parallel_count == sequential_count);
+    ASSERT_TRUE("Parallel read keeps the original row order", same_bus_lines(&sequential, &parallel));
+    ASSERT_TRUE("Parallel warnings have the same line numbers", files_equal(TEST_WARNINGS_FILE, TEST_WARNINGS_PARALLEL_FILE));
+
+    bus_line_store_free(&sequential);
+    bus_line_store_free(&parallel);
+}
+
+/*
+    The streaming path reads in fixed-size blocks, so lines get split between two reads - it still has to find
+    exactly the same rows and print the same warnings as the regular path
+*/
+void test_read_handler_stream(TestResults *results) {
+    printf("Testing streaming read_handler...\n");
+
+    FILE *file = fopen(TEST_INPUT_FILE, "w");
+    if (file) {
+        fprintf(file, "# Streaming Test Bus Line Data\n");
+        for (int i = 1; i <= 120000; i++) {
+            if (i % 30011 == 0) {
+                fprintf(file, "%d,08:00,1,-20,10,5,12.5\n", i);     /* Invalid number of adults */
+            } else if (i % 7 == 0) {
+                fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.5\r\n", i, i % 24, i % 60, (i % 3) + 1, i % 50, i % 20, i % 7, i % 90 + 1);
+            } else {
+                fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.%d\n", i, i % 24, i % 60, (i % 3) + 1, i % 50, i % 20, i % 7, i % 90 + 1, i % 10);
+            }
+        }
+        fprintf(file, "120001,23:59,2,1,2,3,4.5");       /* No trailing newline */
+        fclose(file);
+    }
+
+    BusLineStore regular, streamed;
+    bus_line_store_init(&regular, 0);
+    bus_line_store_init(&streamed, 0);
+
+    int64_t regular_count = read_capturing_warnings(TEST_WARNINGS_FILE, 1, &regular);
+    int64_t streamed_count = read_capturing_warnings(TEST_WARNINGS_PARALLEL_FILE, 0, &streamed);
+
+    ASSERT_TRUE("Regular read found the valid lines", regular_count == 120001 - 3);
+    ASSERT_TRUE("Streaming read found the same number of lines", streamed_count == regular_count);
+    ASSERT_TRUE("Streaming read gives the same rows", same_bus_lines(&regular, &streamed));
+    ASSERT_TRUE("Streaming warnings have the same line numbers", files_equal(TEST_WARNINGS_FILE, TEST_WARNINGS_PARALLEL_FILE));
+
+    bus_line_store_free(&regular);
+    bus_line_store_free(&streamed);
+
+    /*
+        The summary report of the streaming mode
+    */
+    BusLineAggregator aggregator;
+    bus_line_aggregator_init(&aggregator);
+    BusLineProperties line = { .subsidy_level = 2, .profitability = -12.5 };
+    bus_line_aggregator_add(&aggregator, &line);
+    line.subsidy_level = 3;
+    line.profitability = 40.0;
+    bus_line_aggregator_add(&aggregator, &line);
+
+    ASSERT_INT_EQUAL("Summary written", 0, write_summary_handler(TEST_OUTPUT_FILE, &aggregator));
+
+    char buffer[4096] = {0};
+    file = fopen(TEST_OUTPUT_FILE, "r");
+    if (file) {
+        size_t bytes_read = fread(buffer, 1, sizeof(buffer) - 1, file);
+        buffer[bytes_read] = '\0';
+        fclose(file);
+    }
+
+    ASSERT_TRUE("Per level totals", strstr(buffer, "SUBSIDY LEVEL 2: 1 lines (0 profitable, 1 unprofitable), P/L -12.50") != NULL);
+    ASSERT_TRUE("Empty level listed", strstr(buffer, "SUBSIDY LEVEL 1: 0 lines") != NULL);
+    ASSERT_TRUE("Overall result", strstr(buffer, "RESULT: PROFIT of 27.50") != NULL);
 }
 
 /*
@@ -111,7 +410,7 @@ void test_write_handler(TestResults *results) {
     BusLineProperties bus_lines[3] = {
         {
             .line_number = 1,
-            .departure_time = "08:00",
+            .departure_minutes = 8 * 60,
             .subsidy_level = 1,
             .passengers = {.adult = 25, .student = 10, .senior = 5},
             .route_length = 15.5,
@@ -119,7 +418,7 @@ void test_write_handler(TestResults *results) {
         },
         {
             .line_number = 2,
-            .departure_time = "09:15",
+            .departure_minutes = 9 * 60 + 15,
             .subsidy_level = 2,
             .passengers = {.adult = 18, .student = 8, .senior = 4},
             .route_length = 12.0,
@@ -127,7 +426,7 @@ void test_write_handler(TestResults *results) {
         },
         {
             .line_number = 3,
-            .departure_time = "10:30",
+            .departure_minutes = 10 * 60 + 30,
             .subsidy_level = 3,
             .passengers = {.adult = 15, .student = 7, .senior = 6},
             .route_length = 10.5,
@@ -139,7 +438,7 @@ void test_write_handler(TestResults *results) {
     /*
         Write the results of the analysis to the output file created
     */
-    int write_result = write_handler(TEST_OUTPUT_FILE, bus_lines, 3);
+    int write_result = write_handler(TEST_OUTPUT_FILE, bus_lines, 3, NULL);
     ASSERT_INT_EQUAL("Write handler returns success", 0, write_result);
     
 
@@ -183,7 +482,7 @@ void test_write_handler(TestResults *results) {
     /*
         Test writing to an empty array - this should succeed nevertheless
     */
-    write_result = write_handler(TEST_OUTPUT_FILE, bus_lines, 0);
+    write_result = write_handler(TEST_OUTPUT_FILE, bus_lines, 0, NULL);
     ASSERT_INT_EQUAL("Write handler with empty array returns success", 0, write_result);
 }
 
@@ -198,8 +497,9 @@ void test_invalid_inputs(TestResults *results) {
         non-existent input file should return an error as the program cannot retrieve a valid
         pointer to a file that does not exist in the first place
     */
-    BusLineProperties bus_lines[MAX_BUS_LINES];
-    int count = read_handler("nonexistent_file.txt", bus_lines, MAX_BUS_LINES);
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int count = (int)read_handler("nonexistent_file.txt", &store, READ_ALL_BUS_LINES);
     ASSERT_INT_EQUAL("Reading non-existent file returns error", -1, count);
     
     // Test invalid input in bus line data
@@ -217,12 +517,49 @@ void test_invalid_inputs(TestResults *results) {
         */
         fprintf(file, "invalid,08:00,1,25,10,5,15.5\n");  /* Invalid line number */
         fprintf(file, "1,08:00,5,25,10,5,15.5\n");        /* Invalid subsidy level */
+        fprintf(file, "5,24:00,1,25,10,5,15.5\n");        /* Invalid departure times - out of range or not HH:MM */
+        fprintf(file, "6,08:60,1,25,10,5,15.5\n");
+        fprintf(file, "7,8:00,1,25,10,5,15.5\n");
+        fprintf(file, "8,08:00:00,1,25,10,5,15.5\n");
+        fprintf(file, "9,0800,1,25,10,5,15.5\n");
         fprintf(file, "2,08:00,1,-5,10,5,15.5\n");        /* Invalid passenger count */
         fprintf(file, "3,08:00,1,25,10,5,-10.5\n");       /* Invalid route length */
+        fprintf(file, "3,08:00,1,25,10,5,1e300\n");       /* Longer than MAX_ROUTE_LENGTH_KM */
         fprintf(file, "4,08:00,1,25\n");                  /* Incomplete data - no passenger count for students, seniors/elderly and the route length is also not defined*/
         fclose(file);
         
-        count = read_handler(TEST_INPUT_FILE, bus_lines, MAX_BUS_LINES);
+        count = (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES);
         ASSERT_INT_EQUAL("All invalid lines rejected", 0, count);
+        ASSERT_INT_EQUAL("No rejected line left in the store", 0, (int)store.count);
     }
+
+    /* Exact mode takes route lengths in whole metres only, anything finer is rejected instead of rounded */
+    file = fopen(TEST_INPUT_FILE, "w");
+    if (file) {
+        fprintf(file, "1,08:00,1,25,10,5,12.345\n");
+        fprintf(file, "2,08:00,1,25,10,5,12.3456\n");
+        fprintf(file, "3,08:00,1,25,10,5,100000\n");
+        fprintf(file, "4,08:00,1,25,10,5,100000.001\n");
+        fclose(file);
+
+        Tariff tariff;
+        TariffTable table;
+        tariff_set_defaults(&tariff);
+        tariff_table_build(&tariff, &table);
+        tariff_table_enable_exact(&table);
+        tariff_table_set_active(&table);
+
+        count = (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+        ASSERT_INT_EQUAL("Sub-metre and too long route lengths rejected in exact mode", 2, count);
+        ASSERT_TRUE("Whole metres and the longest route kept", store.count == 2 && store.lines[0].line_number == 1 && store.lines[1].line_number == 3);
+
+        tariff_table_build(&tariff, &table);
+        tariff_table_set_active(&table);
+        bus_line_store_free(&store);
+        bus_line_store_init(&store, 0);
+        ASSERT_INT_EQUAL("Sub-metre route length accepted otherwise", 3, (int)read_handler(TEST_INPUT_FILE, &store, READ_ALL_BUS_LINES));
+        ASSERT_INT_EQUAL("Route longer than the cap rejected otherwise too", 3, (int)store.lines[2].line_number);
+    }
+
+    bus_line_store_free(&store);
 }
@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../incl/follow_mode.h"
+#include "../incl/rank_tree.h"
+#include "../incl/sort_engine.h"
+#include "../incl/top_k.h"
+#include "test_utils.h"
+
+#define TEST_FOLLOW_FILE "test_follow.txt"
+
+void test_rank_tree(TestResults *results);
+void test_follow_appends(TestResults *results);
+void test_follow_truncation(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Follow Mode ---\n\n");
+
+    test_rank_tree(&results);
+    test_follow_appends(&results);
+    test_follow_truncation(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_FOLLOW_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/*
+    The tree has to give the same ranking as the stable sort (most profitable first, ties in insertion order)
+*/
+void test_rank_tree(TestResults *results) {
+    printf("Testing the ranking tree...\n");
+
+    const size_t count = 20000;
+    double *profits = malloc(count * sizeof(double));
+    size_t *expected = malloc(count * sizeof(size_t));
+    size_t *ranked = malloc(count * sizeof(size_t));
+
+    RankTree tree;
+    rank_tree_init(&tree);
+
+    srand(77);
+    for (size_t i = 0; i < count; i++) {
+        profits[i] = (rand() % 500 - 250) / 2.0;
+        rank_tree_insert(&tree, i, profits[i]);
+    }
+
+    /* Reference: insertion sort of the row indices, stable */
+    for (size_t i = 0; i < count; i++) {
+        size_t j = i;
+        while (j > 0 && profits[expected[j - 1]] < profits[i]) {
+            expected[j] = expected[j - 1];
+            j--;
+        }
+        expected[j] = i;
+    }
+
+    ASSERT_INT_EQUAL("All rows ranked", (int)count, (int)rank_tree_first(&tree, count, ranked));
+    ASSERT_TRUE("Full ranking matches the stable sort", memcmp(ranked, expected, count * sizeof(size_t)) == 0);
+
+    ASSERT_INT_EQUAL("Top 5 rows", 5, (int)rank_tree_first(&tree, 5, ranked));
+    ASSERT_TRUE("Top rows match", memcmp(ranked, expected, 5 * sizeof(size_t)) == 0);
+
+    ASSERT_INT_EQUAL("Bottom 7 rows", 7, (int)rank_tree_last(&tree, 7, ranked));
+    ASSERT_TRUE("Bottom rows match (in ranking order)", memcmp(ranked, expected + count - 7, 7 * sizeof(size_t)) == 0);
+
+    rank_tree_free(&tree);
+    free(profits);
+    free(expected);
+    free(ranked);
+}
+
+static void append_rows(int first, int last, const char *tail) {
+    FILE *file = fopen(TEST_FOLLOW_FILE, "a");
+    if (file) {
+        for (int i = first; i <= last; i++) {
+            fprintf(file, "%d,%02d:%02d,%d,%d,%d,%d,%d.%d\n", i, i % 24, i % 60, (i % 3) + 1, i % 50, i % 20, i % 7, i % 90 + 1, i % 10);
+        }
+        if (tail) fputs(tail, file);
+        fclose(file);
+    }
+}
+
+void test_follow_appends(TestResults *results) {
+    printf("Testing incremental updates of a followed file...\n");
+
+    unlink(TEST_FOLLOW_FILE);
+    append_rows(1, 3000, NULL);
+
+    FollowState state;
+    follow_state_init(&state, TEST_FOLLOW_FILE);
+
+    ASSERT_INT_EQUAL("Initial rows", 3000, (int)follow_state_update(&state));
+    ASSERT_INT_EQUAL("Nothing new", 0, (int)follow_state_update(&state));
+
+    /* The last line is still being written - it only counts once it's complete */
+    append_rows(3001, 3500, "3501,10:00,2,40,2");
+    ASSERT_INT_EQUAL("Only complete lines are parsed", 500, (int)follow_state_update(&state));
+    append_rows(1, 0, "0,20,0.1\n");
+    ASSERT_INT_EQUAL("Partial line completed", 1, (int)follow_state_update(&state));
+    ASSERT_INT_EQUAL("Rows stored", 3501, (int)state.rows.count);
+    ASSERT_INT_EQUAL("Completed line parsed correctly", 20, state.rows.lines[3500].passengers.student);
+
+    /*
+        The report rows have to match what --top/--bottom selects from a full sort of the same rows
+    */
+    BusLineProperties *report_rows = NULL;
+    size_t report_count = 0;
+    ASSERT_INT_EQUAL("Report rows collected", 0, follow_state_report_rows(&state, 4, 3, &report_rows, &report_count));
+
+    size_t *selection = NULL;
+    size_t selected_count = 0;
+    top_k_select(state.rows.lines, state.rows.count, 4, 3, &selection, &selected_count);
+    BusLineProperties *expected = malloc(selected_count * sizeof(BusLineProperties));
+    for (size_t i = 0; i < selected_count; i++) expected[i] = state.rows.lines[selection[i]];
+    sort_lines(expected, selected_count);
+
+    int same = (report_count == selected_count);
+    for (size_t i = 0; same && i < report_count; i++) {
+        same = report_rows[i].line_number == expected[i].line_number && report_rows[i].profitability == expected[i].profitability;
+    }
+    ASSERT_TRUE("Report rows match the batch top/bottom selection", same);
+
+    BusLineSummary summary;
+    bus_line_aggregator_total(&state.totals, &summary);
+    ASSERT_INT_EQUAL("Running totals cover every row", 3501, (int)summary.line_count);
+
+    free(expected);
+    free(selection);
+    free(report_rows);
+    follow_state_free(&state);
+}
+
+void test_follow_truncation(TestResults *results) {
+    printf("Testing a followed file that gets truncated...\n");
+
+    unlink(TEST_FOLLOW_FILE);
+    append_rows(1, 100, NULL);
+
+    FollowState state;
+    follow_state_init(&state, TEST_FOLLOW_FILE);
+    ASSERT_INT_EQUAL("Initial rows", 100, (int)follow_state_update(&state));
+
+    truncate(TEST_FOLLOW_FILE, 0);
+    append_rows(1, 10, NULL);
+    ASSERT_INT_EQUAL("Truncated file read again", 10, (int)follow_state_update(&state));
+    ASSERT_INT_EQUAL("Old rows dropped", 10, (int)state.rows.count);
+
+    follow_state_free(&state);
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../incl/bus_line_handler.h"
+#include "../incl/group_by.h"
+#include "test_utils.h"
+
+void test_group_spec(TestResults *results);
+void test_group_table(TestResults *results);
+void test_group_by_parallel(TestResults *results);
+void test_group_report(TestResults *results);
+
+#define TEST_GROUP_REPORT_FILE "test_group_report.txt"
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Group-By Aggregation ---\n\n");
+
+    test_group_spec(&results);
+    test_group_table(&results);
+    test_group_by_parallel(&results);
+    test_group_report(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_GROUP_REPORT_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/* Many distinct lines, no route lengths */
+static const RandomLineRanges group_ranges = {
+    .line_numbers = 500, .departures = 1440, .adults = 60, .students = 30, .seniors = 20,
+    .profit_steps = 100000, .profit_shift = 40000, .profit_divisor = 100.0
+};
+
+void test_group_spec(TestResults *results) {
+    printf("Testing group key parsing...\n");
+
+    GroupSpec spec = { .key_count = 0 };
+    ASSERT_INT_EQUAL("Single key", 0, group_spec_parse("line", &spec));
+    ASSERT_INT_EQUAL("Single key count", 1, (int)spec.key_count);
+    ASSERT_INT_EQUAL("Composite key", 0, group_spec_parse("subsidy,hour,line", &spec));
+    ASSERT_INT_EQUAL("Composite key count", 3, (int)spec.key_count);
+    ASSERT_TRUE("Composite key order", spec.keys[0] == GROUP_FIELD_SUBSIDY_LEVEL && spec.keys[1] == GROUP_FIELD_HOUR &&
+                                       spec.keys[2] == GROUP_FIELD_LINE_NUMBER);
+
+    ASSERT_INT_EQUAL("Unknown key", -1, group_spec_parse("line,profit", &spec));
+    ASSERT_INT_EQUAL("Repeated key", -1, group_spec_parse("hour,hour", &spec));
+    ASSERT_INT_EQUAL("Empty key", -1, group_spec_parse("line,", &spec));
+    ASSERT_INT_EQUAL("Spec untouched on error", 3, (int)spec.key_count);
+
+    /* Packed keys sort like the columns one after the other */
+    BusLineProperties a = { .line_number = 7, .departure_minutes = 23 * 60, .subsidy_level = 1 };
+    BusLineProperties b = { .line_number = 7, .departure_minutes = 6 * 60, .subsidy_level = 2 };
+    group_spec_parse("subsidy,hour,line", &spec);
+    uint64_t key_a = group_spec_key(&spec, &a), key_b = group_spec_key(&spec, &b);
+    ASSERT_TRUE("Most significant key first", key_a < key_b);
+    ASSERT_INT_EQUAL("Unpacked subsidy level", 2, (int)group_spec_key_value(&spec, key_b, 0));
+    ASSERT_INT_EQUAL("Unpacked hour", 6, (int)group_spec_key_value(&spec, key_b, 1));
+    ASSERT_INT_EQUAL("Unpacked line number", 7, (int)group_spec_key_value(&spec, key_b, 2));
+}
+
+/*
+    The hash table has to match a plain per-line count, including while it grows
+*/
+void test_group_table(TestResults *results) {
+    printf("Testing the group table...\n");
+
+    const size_t count = 20000;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    fill_random_lines(bus_lines, count, 9, &group_ranges);
+
+    GroupSpec spec;
+    group_spec_parse("line", &spec);
+    GroupTable table;
+    ASSERT_INT_EQUAL("Table initialized", 0, group_table_init(&table, &spec, 0));
+
+    int added = 1;
+    for (size_t i = 0; i < count; i++) added &= group_table_add(&table, &bus_lines[i]) == 0;
+    ASSERT_TRUE("Every line added", added);
+
+    size_t trips[501] = {0};
+    double min_profit[501], max_profit[501];
+    for (size_t i = 0; i < count; i++) {
+        int line = bus_lines[i].line_number;
+        double profit = bus_lines[i].profitability;
+        if (trips[line] == 0 || profit < min_profit[line]) min_profit[line] = profit;
+        if (trips[line] == 0 || profit > max_profit[line]) max_profit[line] = profit;
+        trips[line]++;
+    }
+
+    size_t groups = 0;
+    int matches = 1;
+    for (int line = 1; line <= 500; line++) {
+        BusLineProperties probe = { .line_number = line };
+        const GroupTotals *totals = group_table_find(&table, group_spec_key(&spec, &probe));
+        if (trips[line] == 0) {
+            matches &= totals == NULL;
+            continue;
+        }
+        groups++;
+        matches &= totals != NULL && totals->line_count == trips[line] &&
+                   totals->min_profit == min_profit[line] && totals->max_profit == max_profit[line];
+    }
+    ASSERT_TRUE("Counts, minimums and maximums per line", matches);
+    ASSERT_INT_EQUAL("Number of groups", (int)groups, (int)table.count);
+
+    group_table_free(&table);
+    free(bus_lines);
+}
+
+/*
+    Partial tables merged after a parallel run give exactly the same totals for any thread count
+*/
+void test_group_by_parallel(TestResults *results) {
+    printf("Testing parallel grouping...\n");
+
+    const size_t count = 1200000;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    fill_random_lines(bus_lines, count, 17, &group_ranges);
+
+    GroupSpec spec;
+    group_spec_parse("line,hour", &spec);
+
+    GroupTable single, parallel;
+    ASSERT_INT_EQUAL("Single-threaded grouping", 0, group_by_lines(bus_lines, count, &spec, 1, &single));
+    ASSERT_INT_EQUAL("Parallel grouping", 0, group_by_lines(bus_lines, count, &spec, 4, &parallel));
+    ASSERT_INT_EQUAL("Same number of groups", (int)single.count, (int)parallel.count);
+
+    int identical = 1;
+    uint64_t lines = 0, adults = 0, expected_adults = 0;
+    for (size_t i = 0; i < single.capacity; i++) {
+        if (single.keys[i] == GROUP_KEY_EMPTY) continue;
+        const GroupTotals *a = &single.totals[i];
+        const GroupTotals *b = group_table_find(&parallel, single.keys[i]);
+        identical &= b != NULL && memcmp(a, b, sizeof(*a)) == 0;
+        lines += a->line_count;
+        adults += a->adults;
+    }
+    for (size_t i = 0; i < count; i++) expected_adults += (uint64_t)bus_lines[i].passengers.adult;
+
+    ASSERT_TRUE("Totals are bit-identical for any thread count", identical);
+    ASSERT_TRUE("Every bus line counted once", lines == count);
+    ASSERT_TRUE("Passenger totals", adults == expected_adults);
+
+    group_table_free(&single);
+    group_table_free(&parallel);
+    free(bus_lines);
+}
+
+void test_group_report(TestResults *results) {
+    printf("Testing the group report...\n");
+
+    BusLineProperties bus_lines[4] = {
+        { .line_number = 2, .departure_minutes = 8 * 60 + 5, .subsidy_level = 1, .passengers = { .adult = 1, .student = 2, .senior = 3 }, .profitability = 10.0 },
+        { .line_number = 1, .departure_minutes = 9 * 60, .subsidy_level = 1, .passengers = { .adult = 1, .student = 1, .senior = 1 }, .profitability = -4.5 },
+        { .line_number = 2, .departure_minutes = 8 * 60 + 50, .subsidy_level = 2, .passengers = { .adult = 0, .student = 0, .senior = 1 }, .profitability = 2.0 },
+        { .line_number = 2, .departure_minutes = 17 * 60, .subsidy_level = 3, .passengers = { .adult = 4, .student = 0, .senior = 0 }, .profitability = 1.0 }
+    };
+
+    GroupSpec spec;
+    group_spec_parse("line,hour", &spec);
+    GroupTable table;
+    ASSERT_INT_EQUAL("Lines grouped", 0, group_by_lines(bus_lines, 4, &spec, 1, &table));
+    ASSERT_INT_EQUAL("Report written", 0, group_by_write_report(TEST_GROUP_REPORT_FILE, &table));
+    group_table_free(&table);
+
+    char report[8192] = "";
+    FILE *file = fopen(TEST_GROUP_REPORT_FILE, "r");
+    if (file) {
+        size_t size = fread(report, 1, sizeof(report) - 1, file);
+        report[size] = '\0';
+        fclose(file);
+    }
+
+    char *first = strstr(report, "| 1      | 09   | 1        | 1+1+1");
+    char *merged = strstr(report, "| 2      | 08   | 2        | 1+2+4");
+    char *last = strstr(report, "| 2      | 17   | 1        | 4+0+0");
+    ASSERT_TRUE("Groups in key order", first != NULL && merged != NULL && last != NULL && first < merged && merged < last);
+    ASSERT_TRUE("Min, max, average and total of a group", merged != NULL &&
+                strstr(merged, "| +2.00        | +10.00       | +6.00        | +12.00           |") != NULL);
+    ASSERT_TRUE("Group count", strstr(report, "Groups: 3\n") != NULL);
+    ASSERT_TRUE("Total result", strstr(report, "RESULT: PROFIT of 8.50€") != NULL);
+}
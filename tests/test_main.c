@@ -72,8 +72,10 @@ void test_integration(TestResults *results) {
     FileSettings settings;
     runtime_config_load_handler(&settings, TEST_CONFIG_FILE);
     
-    BusLineProperties bus_lines[MAX_BUS_LINES];
-    int line_count = read_handler(settings.input_file, bus_lines, MAX_BUS_LINES);
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int line_count = (int)read_handler(settings.input_file, &store, READ_ALL_BUS_LINES);
+    BusLineProperties *bus_lines = store.lines;
     
     /*
         Verify that the program reads the right number of bus lines' data and proceed to calculating
@@ -97,7 +99,7 @@ void test_integration(TestResults *results) {
     
     ASSERT_INT_EQUAL("First subsidy level is 1", 1, bus_lines[0].subsidy_level);
     
-    int write_result = write_handler(settings.output_file, bus_lines, line_count);
+    int write_result = write_handler(settings.output_file, bus_lines, line_count, NULL);
     ASSERT_INT_EQUAL("Write handler returns success", 0, write_result);
     
     FILE *output_file = fopen(settings.output_file, "r");
@@ -105,6 +107,8 @@ void test_integration(TestResults *results) {
     if (output_file) {
         fclose(output_file);
     }
+
+    bus_line_store_free(&store);
 }
 
 /*
@@ -120,21 +124,21 @@ void test_profit_loss_calculation(TestResults *results) {
     BusLineProperties profitable_lines[3] = {
         {
             .line_number = 1,
-            .departure_time = "08:00",
+            .departure_minutes = 8 * 60,
             .subsidy_level = 1,
             .passengers = {.adult = 25, .student = 10, .senior = 5},
             .route_length = 15.5
         },
         {
             .line_number = 2,
-            .departure_time = "09:15",
+            .departure_minutes = 9 * 60 + 15,
             .subsidy_level = 2,
             .passengers = {.adult = 18, .student = 8, .senior = 4},
             .route_length = 12.0
         },
         {
             .line_number = 3,
-            .departure_time = "10:30",
+            .departure_minutes = 10 * 60 + 30,
             .subsidy_level = 3,
             .passengers = {.adult = 15, .student = 7, .senior = 6},
             .route_length = 10.5
@@ -167,21 +171,21 @@ void test_profit_loss_calculation(TestResults *results) {
     BusLineProperties unprofitable_lines[3] = {
         {
             .line_number = 111,
-            .departure_time = "05:00",
+            .departure_minutes = 5 * 60,
             .subsidy_level = 1,
             .passengers = {.adult = 2, .student = 1, .senior = 0},
             .route_length = 70.0
         },
         {
             .line_number = 221,
-            .departure_time = "03:30",
+            .departure_minutes = 3 * 60 + 30,
             .subsidy_level = 2,
             .passengers = {.adult = 1, .student = 1, .senior = 0},
             .route_length = 95.0
         },
         {
             .line_number = 331,
-            .departure_time = "01:00",
+            .departure_minutes = 1 * 60,
             .subsidy_level = 3,
             .passengers = {.adult = 1, .student = 0, .senior = 0},
             .route_length = 120.0
@@ -214,28 +218,28 @@ void test_profit_loss_calculation(TestResults *results) {
     BusLineProperties mixed_lines[4] = {
         {
             .line_number = 101,
-            .departure_time = "07:30",
+            .departure_minutes = 7 * 60 + 30,
             .subsidy_level = 1,
             .passengers = {.adult = 15, .student = 8, .senior = 4},
             .route_length = 12.0
         },
         {
             .line_number = 301,
-            .departure_time = "14:15",
+            .departure_minutes = 14 * 60 + 15,
             .subsidy_level = 1,
             .passengers = {.adult = 3, .student = 2, .senior = 1},
             .route_length = 50.0
         },
         {
             .line_number = 102,
-            .departure_time = "08:15",
+            .departure_minutes = 8 * 60 + 15,
             .subsidy_level = 2,
             .passengers = {.adult = 12, .student = 6, .senior = 3},
             .route_length = 10.0
         },
         {
             .line_number = 501,
-            .departure_time = "06:00",
+            .departure_minutes = 6 * 60,
             .subsidy_level = 3,
             .passengers = {.adult = 3, .student = 1, .senior = 1},
             .route_length = 60.0
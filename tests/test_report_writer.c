@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "../incl/report_writer.h"
+#include "test_utils.h"
+
+#define TEST_REPORT_FILE "test_report.txt"
+
+void test_fixed_formatting(TestResults *results);
+void test_writer_output(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Report Writer ---\n\n");
+
+    test_fixed_formatting(&results);
+    test_writer_output(&results);
+
+    print_test_summary(&results);
+
+    remove(TEST_REPORT_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/*
+    The fast formatter either agrees with printf byte for byte or declines (returns 0)
+*/
+static int fixed_matches_printf(double value, int decimals) {
+    char fast[64], expected[64];
+    size_t length = report_format_fixed(fast, value, decimals);
+    if (length == 0) return 1;
+
+    snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+    return strcmp(fast, expected) == 0 && length == strlen(expected);
+}
+
+void test_fixed_formatting(TestResults *results) {
+    printf("Testing fixed-point formatting...\n");
+
+    const double special[] = {0.0, -0.0, 0.004, -0.004, 0.005, 0.015, 0.125, 2.675, 1.005, -1.005, 99.995,
+                              123456.785, 0.5, -0.5, 1e9, 21474836.47, 1e300, -1e300};
+    int all_match = 1;
+    for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+        for (int decimals = 0; decimals <= 6; decimals++) all_match &= fixed_matches_printf(special[i], decimals);
+    }
+    ASSERT_TRUE("Special values match printf", all_match);
+
+    srand(1234);
+    int random_match = 1, fast_hits = 0;
+    for (int i = 0; i < 200000; i++) {
+        double value = ((double)rand() / RAND_MAX - 0.5) * (i % 2 ? 2000.0 : 2e7);
+        if (i % 3 == 0) value = (rand() % 2000000 - 1000000) / 100.0 + (rand() % 3) * 0.005;    /* Ties galore */
+        int decimals = (i % 4 == 0) ? 1 : 2;
+
+        char fast[64];
+        fast_hits += report_format_fixed(fast, value, decimals) != 0;
+        random_match &= fixed_matches_printf(value, decimals);
+    }
+    ASSERT_TRUE("Random values match printf", random_match);
+    ASSERT_TRUE("Most values take the fast path", fast_hits > 150000);
+
+    char text[64];
+    ASSERT_INT_EQUAL("Negative zero keeps its sign", 5, (int)report_format_fixed(text, -0.0, 2));
+    ASSERT_STRING_EQUAL("Negative zero text", "-0.00", text);
+    ASSERT_INT_EQUAL("Infinity is left to printf", 0, (int)report_format_fixed(text, 1.0 / 0.0, 2));
+}
+
+void test_writer_output(TestResults *results) {
+    printf("Testing buffered report output...\n");
+
+    ReportWriter writer;
+    ASSERT_INT_EQUAL("Report file opened", 0, report_writer_open(&writer, TEST_REPORT_FILE));
+
+    char expected[8192];
+    size_t expected_length = 0;
+
+    for (int i = 0; i < 20; i++) {
+        int value = (i % 2 ? -1 : 1) * i * 1237;
+        double amount = i * 12.345 - 100.0;
+
+        report_writer_append(&writer, "| ", 2);
+        report_writer_int(&writer, value, -4);
+        report_writer_append(&writer, " | ", 3);
+        report_writer_int(&writer, value, 3);
+        report_writer_append(&writer, " | ", 3);
+        report_writer_string(&writer, "08:00", -6);
+        report_writer_append(&writer, " | ", 3);
+        report_writer_time(&writer, (uint16_t)(i * 71), -6);
+        report_writer_append(&writer, " | ", 3);
+        report_writer_fixed(&writer, amount, 1, -9, 0);
+        report_writer_append(&writer, " | ", 3);
+        report_writer_fixed(&writer, amount, 2, -12, 1);
+        report_writer_printf(&writer, " |%s\n", "");
+
+        char indicator[32], time[32];
+        snprintf(indicator, sizeof(indicator), amount >= 0 ? "+%.2f" : "%.2f", amount);
+        snprintf(time, sizeof(time), "%02d:%02d", i * 71 / 60, i * 71 % 60);
+        expected_length += (size_t)snprintf(expected + expected_length, sizeof(expected) - expected_length,
+            "| %-4d | %3d | %-6s | %-6s | %-9.1f | %-12s |\n", value, value, "08:00", time, amount, indicator);
+    }
+
+    report_writer_int(&writer, INT_MIN, 0);
+    report_writer_int(&writer, INT_MAX, 12);
+    expected_length += (size_t)snprintf(expected + expected_length, sizeof(expected) - expected_length, "%d%12d", INT_MIN, INT_MAX);
+
+    ASSERT_INT_EQUAL("Report closed", 0, report_writer_close(&writer));
+
+    char written[8192] = {0};
+    size_t written_length = 0;
+    FILE *file = fopen(TEST_REPORT_FILE, "r");
+    if (file) {
+        written_length = fread(written, 1, sizeof(written) - 1, file);
+        fclose(file);
+    }
+
+    ASSERT_INT_EQUAL("Same number of bytes as printf", (int)expected_length, (int)written_length);
+    ASSERT_TRUE("Same bytes as printf", memcmp(expected, written, expected_length) == 0);
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../incl/arena.h"
+#include "../incl/bus_line_handler.h"
+#include "../incl/row_filter.h"
+#include "../incl/sort_engine.h"
+#include "../incl/top_k.h"
+#include "test_utils.h"
+
+void test_row_filter_compile(TestResults *results);
+void test_row_filter_matches(TestResults *results);
+void test_row_filter_select(TestResults *results);
+void test_selection_consumers(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Row Filter ---\n\n");
+
+    test_row_filter_compile(&results);
+    test_row_filter_matches(&results);
+    test_row_filter_select(&results);
+    test_selection_consumers(&results);
+
+    print_test_summary(&results);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/* Small line numbers and mostly positive profits, so every filter matches some rows */
+static const RandomLineRanges filter_ranges = {
+    .line_numbers = 100, .departures = 1440, .adults = 40, .students = 20, .seniors = 20,
+    .route_steps = 500, .route_divisor = 10.0,
+    .profit_steps = 20000, .profit_shift = 5000, .profit_divisor = 100.0
+};
+
+void test_row_filter_compile(TestResults *results) {
+    printf("Testing filter compilation...\n");
+
+    RowFilter filter;
+    ASSERT_INT_EQUAL("Single comparison", 0, row_filter_compile("profit < 0", &filter));
+    ASSERT_INT_EQUAL("Single comparison op count", 1, (int)filter.op_count);
+    ASSERT_TRUE("Comparison operands", filter.ops[0].field == SORT_FIELD_PROFITABILITY &&
+                                       filter.ops[0].comparison == ROW_FILTER_LESS && filter.ops[0].value == 0.0);
+
+    ASSERT_INT_EQUAL("Time value", 0, row_filter_compile("time>=17:30", &filter));
+    ASSERT_TRUE("Time compared in minutes", filter.ops[0].value == 17 * 60 + 30);
+
+    /* "and" binds tighter than "or": a or (b and c) */
+    ASSERT_INT_EQUAL("Precedence", 0, row_filter_compile("line = 1 or subsidy = 2 and adult > 3", &filter));
+    ASSERT_TRUE("And before or", filter.op_count == 5 && filter.ops[3].opcode == ROW_FILTER_OP_AND &&
+                                 filter.ops[4].opcode == ROW_FILTER_OP_OR);
+
+    ASSERT_INT_EQUAL("Symbols and parentheses", 0, row_filter_compile("!(line == 1 || length <= 2.5) && senior != -1", &filter));
+    ASSERT_INT_EQUAL("Symbols op count", 6, (int)filter.op_count);
+
+    size_t op_count = filter.op_count;
+    ASSERT_INT_EQUAL("Empty expression", -1, row_filter_compile("", &filter));
+    ASSERT_INT_EQUAL("Unknown column", -1, row_filter_compile("speed > 3", &filter));
+    ASSERT_INT_EQUAL("Missing value", -1, row_filter_compile("profit <", &filter));
+    ASSERT_INT_EQUAL("Invalid time", -1, row_filter_compile("time < 25:00", &filter));
+    ASSERT_INT_EQUAL("Unbalanced parentheses", -1, row_filter_compile("(line = 1", &filter));
+    ASSERT_INT_EQUAL("Trailing garbage", -1, row_filter_compile("line = 1 line = 2", &filter));
+    ASSERT_INT_EQUAL("Keyword needs a word boundary", -1, row_filter_compile("line = 1 andline = 2", &filter));
+    ASSERT_INT_EQUAL("Filter untouched on error", (int)op_count, (int)filter.op_count);
+
+    /* Deeply nested operands need more stack than the program may use */
+    char deep[512] = "";
+    for (int i = 0; i < ROW_FILTER_MAX_DEPTH; i++) strcat(deep, "line = 1 or (");
+    strcat(deep, "line = 1");
+    for (int i = 0; i < ROW_FILTER_MAX_DEPTH; i++) strcat(deep, ")");
+    ASSERT_INT_EQUAL("Operand stack limit", -1, row_filter_compile(deep, &filter));
+}
+
+void test_row_filter_matches(TestResults *results) {
+    printf("Testing single row evaluation...\n");
+
+    BusLineProperties line = { .line_number = 7, .departure_minutes = 18 * 60, .subsidy_level = 2,
+                               .passengers = { .adult = 10, .student = 5, .senior = 5 }, .route_length = 12.5, .profitability = -3.25 };
+    RowFilter filter;
+
+    row_filter_compile("subsidy = 2 and profit < 0", &filter);
+    ASSERT_INT_EQUAL("Both sides true", 1, row_filter_matches(&filter, &line));
+    row_filter_compile("passengers >= 21 or time > 17:59", &filter);
+    ASSERT_INT_EQUAL("Computed passenger total and time", 1, row_filter_matches(&filter, &line));
+    row_filter_compile("not (length > 12 and line != 7)", &filter);
+    ASSERT_INT_EQUAL("Negated group", 1, row_filter_matches(&filter, &line));
+    row_filter_compile("profit >= -3.24", &filter);
+    ASSERT_INT_EQUAL("Decimal boundary", 0, row_filter_matches(&filter, &line));
+
+    filter.op_count = 0;
+    ASSERT_INT_EQUAL("Empty filter matches everything", 1, row_filter_matches(&filter, &line));
+}
+
+/*
+    The block-wise bitmap evaluation has to agree with the row-by-row one, for block and word tails too
+*/
+void test_row_filter_select(TestResults *results) {
+    printf("Testing selection vectors...\n");
+
+    const size_t count = 300000 + 1023;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    fill_random_lines(bus_lines, count, 5, &filter_ranges);
+
+    RowFilter filter;
+    row_filter_compile("(subsidy = 1 or passengers > 50) and not (time < 06:00 or time >= 22:00) and profit > 10", &filter);
+
+    size_t *single = NULL, *parallel = NULL;
+    size_t single_count = 0, parallel_count = 0;
+    ASSERT_INT_EQUAL("Single-threaded selection", 0, row_filter_select(&filter, bus_lines, count, 1, NULL, &single, &single_count));
+    ASSERT_INT_EQUAL("Parallel selection", 0, row_filter_select(&filter, bus_lines, count, 4, NULL, &parallel, &parallel_count));
+
+    size_t expected = 0;
+    int matches = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (!row_filter_matches(&filter, &bus_lines[i])) continue;
+        matches &= expected < single_count && single[expected] == i;
+        expected++;
+    }
+    ASSERT_TRUE("Same rows as row-by-row evaluation", matches && expected == single_count);
+    ASSERT_TRUE("Same selection for any thread count", single_count == parallel_count &&
+                memcmp(single, parallel, single_count * sizeof(size_t)) == 0);
+    free(single);
+    free(parallel);
+
+    Arena arena;
+    arena_init(&arena, 0, 0);
+    size_t *from_arena = NULL, arena_count = 0;
+    filter.op_count = 0;
+    ASSERT_INT_EQUAL("Selection from an arena", 0, row_filter_select(&filter, bus_lines, 100, 2, &arena, &from_arena, &arena_count));
+    ASSERT_TRUE("Empty filter selects every row", arena_count == 100 && from_arena[0] == 0 && from_arena[99] == 99);
+    arena_release(&arena);
+
+    free(bus_lines);
+}
+
+/*
+    Summary, top-k and sorting over a selection give the same results as over a compacted copy of the rows
+*/
+void test_selection_consumers(TestResults *results) {
+    printf("Testing the consumers of a selection...\n");
+
+    const size_t count = 100000;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    fill_random_lines(bus_lines, count, 11, &filter_ranges);
+
+    RowFilter filter;
+    row_filter_compile("line <= 60", &filter);
+    size_t *selection = NULL, selected_count = 0;
+    row_filter_select(&filter, bus_lines, count, 0, NULL, &selection, &selected_count);
+
+    BusLineProperties *copy = malloc(selected_count * sizeof(BusLineProperties));
+    for (size_t i = 0; i < selected_count; i++) copy[i] = bus_lines[selection[i]];
+
+    BusLineSummary from_selection, from_copy;
+    summarize_profitability_selection(bus_lines, selection, selected_count, 4, &from_selection);
+    summarize_profitability(copy, selected_count, 1, &from_copy);
+    ASSERT_TRUE("Summary is bit-identical to a compacted copy", memcmp(&from_selection, &from_copy, sizeof(BusLineSummary)) == 0);
+
+    Arena arena;
+    arena_init(&arena, 0, 0);
+    size_t *top = NULL, *top_copy = NULL, top_count = 0, top_copy_count = 0;
+    top_k_select_from(bus_lines, selection, selected_count, 5, 5, &arena, &top, &top_count);
+    top_k_select(copy, selected_count, 5, 5, &top_copy, &top_copy_count);
+    int same_top = top_count == top_copy_count;
+    for (size_t i = 0; same_top && i < top_count; i++) same_top = top[i] == selection[top_copy[i]];
+    ASSERT_TRUE("Top-k among the candidates", same_top);
+
+    SortSpec spec;
+    sort_spec_parse("line,-profit", &spec);
+    ASSERT_INT_EQUAL("Sort the selection", 0, sort_engine_order(bus_lines, selection, selected_count, &spec));
+    sort_engine_sort(copy, selected_count, &spec);
+    int same_order = 1;
+    for (size_t i = 0; i < selected_count; i++) same_order &= memcmp(&bus_lines[selection[i]], &copy[i], sizeof(BusLineProperties)) == 0;
+    ASSERT_TRUE("Sorted selection matches the sorted copy", same_order);
+
+    arena_release(&arena);
+    free(top_copy);
+    free(copy);
+    free(selection);
+    free(bus_lines);
+}
@@ -0,0 +1,130 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../incl/file_handler.h"
+#include "../incl/run_stats.h"
+#include "test_utils.h"
+
+#define TEST_STATS_INPUT_FILE "test_stats_input.txt"
+#define TEST_STATS_REPORT_FILE "test_stats_report.txt"
+#define TEST_STATS_JSON_FILE "test_stats.json"
+
+void test_stats_disabled(TestResults *results);
+void test_stats_counters(TestResults *results);
+void test_stats_json(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Runtime Statistics ---\n\n");
+
+    /* The statistics can only be switched on, so the disabled case has to run first */
+    test_stats_disabled(&results);
+    test_stats_counters(&results);
+    test_stats_json(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_STATS_INPUT_FILE);
+    unlink(TEST_STATS_REPORT_FILE);
+    unlink(TEST_STATS_JSON_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/*
+    3 valid lines, one with an invalid subsidy level, one with an invalid line number and adult count,
+    and one with missing fields
+*/
+static const char stats_input[] =
+    "# Statistics test\n"
+    "1,08:00,1,25,10,5,15.5\n"
+    "2,09:15,7,18,8,4,12.0\n"
+    "x,10:30,3,-5,7,6,10.5\n"
+    "4,12:00,1,3,2,1,50.0\n"
+    "6,24:00,2,3,2,1,8.0\n"
+    "5,13:00,2\n"
+    "6,14:00,3,10,10,10,20.0\n";
+
+static void create_stats_input_file(void) {
+    FILE *file = fopen(TEST_STATS_INPUT_FILE, "w");
+    if (file) {
+        fputs(stats_input, file);
+        fclose(file);
+    }
+}
+
+void test_stats_disabled(TestResults *results) {
+    printf("Testing that nothing is counted by default...\n");
+
+    create_stats_input_file();
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    read_handler(TEST_STATS_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+    bus_line_store_free(&store);
+
+    ASSERT_TRUE("Disabled by default", !run_stats_enabled());
+    ASSERT_INT_EQUAL("No bytes counted", 0, (int)run_stats_counter(STATS_BYTES_READ));
+    ASSERT_INT_EQUAL("No rows counted", 0, (int)run_stats_counter(STATS_ROWS_PARSED));
+    ASSERT_INT_EQUAL("No allocations counted", 0, (int)run_stats_counter(STATS_ALLOCATIONS));
+}
+
+void test_stats_counters(TestResults *results) {
+    printf("Testing the counters...\n");
+
+    run_stats_enable();
+
+    BusLineStore store;
+    bus_line_store_init(&store, 0);
+    int64_t count = read_handler(TEST_STATS_INPUT_FILE, &store, READ_ALL_BUS_LINES);
+
+    ASSERT_INT_EQUAL("Valid rows read", 3, (int)count);
+    ASSERT_INT_EQUAL("Bytes read", (int)strlen(stats_input), (int)run_stats_counter(STATS_BYTES_READ));
+    ASSERT_INT_EQUAL("Rows parsed", 3, (int)run_stats_counter(STATS_ROWS_PARSED));
+    ASSERT_INT_EQUAL("Rows rejected", 4, (int)run_stats_counter(STATS_ROWS_REJECTED));
+    ASSERT_INT_EQUAL("Rejected for the line number", 1, (int)run_stats_counter(STATS_REJECTED_LINE_NUMBER));
+    ASSERT_INT_EQUAL("Rejected for the departure time", 1, (int)run_stats_counter(STATS_REJECTED_DEPARTURE_TIME));
+    ASSERT_INT_EQUAL("Rejected for the subsidy level", 1, (int)run_stats_counter(STATS_REJECTED_SUBSIDY_LEVEL));
+    ASSERT_INT_EQUAL("Rejected for the adults", 1, (int)run_stats_counter(STATS_REJECTED_ADULTS));
+    ASSERT_INT_EQUAL("Rejected for missing fields", 1, (int)run_stats_counter(STATS_REJECTED_MISSING_FIELDS));
+    ASSERT_TRUE("Row store allocation counted", run_stats_counter(STATS_ALLOCATIONS) >= 1);
+
+    calculate_profitability(store.lines, store.count);
+    ASSERT_INT_EQUAL("Report written", 0, write_handler(TEST_STATS_REPORT_FILE, store.lines, store.count, NULL));
+
+    struct stat report_stat;
+    stat(TEST_STATS_REPORT_FILE, &report_stat);
+    ASSERT_INT_EQUAL("Rows written", 3, (int)run_stats_counter(STATS_ROWS_WRITTEN));
+    ASSERT_INT_EQUAL("Bytes written", (int)report_stat.st_size, (int)run_stats_counter(STATS_BYTES_WRITTEN));
+
+    bus_line_store_free(&store);
+}
+
+void test_stats_json(TestResults *results) {
+    printf("Testing the JSON output...\n");
+
+    run_stats_phase_begin(STATS_PHASE_SORT);
+    run_stats_phase_end(STATS_PHASE_SORT);
+
+    ASSERT_INT_EQUAL("Statistics written", 0, run_stats_write(TEST_STATS_JSON_FILE));
+
+    char json[4096] = "";
+    FILE *file = fopen(TEST_STATS_JSON_FILE, "r");
+    if (file) {
+        size_t size = fread(json, 1, sizeof(json) - 1, file);
+        json[size] = '\0';
+        fclose(file);
+    }
+
+    ASSERT_TRUE("Single JSON object", json[0] == '{' && strstr(json, "}\n") != NULL);
+    ASSERT_TRUE("Phase times", strstr(json, "\"phases_s\": {\"load\": ") != NULL && strstr(json, "\"sort\": ") != NULL);
+    ASSERT_TRUE("Rows parsed", strstr(json, "\"rows_parsed\": 3") != NULL);
+    ASSERT_TRUE("Rejections by reason", strstr(json, "\"rejected_by_reason\": {\"line_number\": 1, \"departure_time\": 1, \"subsidy_level\": 1, \"adults\": 1") != NULL);
+    ASSERT_TRUE("Peak RSS", strstr(json, "\"peak_rss_kb\": ") != NULL);
+}
@@ -7,6 +7,7 @@
 
 void test_config_load(TestResults *results);
 void test_cli_arguments(TestResults *results);
+void test_tariff_section(TestResults *results);
 
 #define TEST_CONFIG_FILE "test_config.txt"
 
@@ -18,6 +19,7 @@ int main() {
     
     test_config_load(&results);
     test_cli_arguments(&results);
+    test_tariff_section(&results);
     
     print_test_summary(&results);
     
@@ -101,6 +103,22 @@ void test_config_load(TestResults *results) {
         */
         ASSERT_TRUE("Handler handles empty input file value", strlen(invalid_settings.input_file) > 0);
     }
+
+    /*
+        Thread counts get the same check as --threads - an invalid one keeps the previous value
+    */
+    file = fopen(TEST_CONFIG_FILE, "w");
+    if (file) {
+        fprintf(file, "threads=6\n");
+        fprintf(file, "threads=-1\n");
+        fprintf(file, "threads=abc\n");
+        fprintf(file, "threads=99999\n");
+        fclose(file);
+
+        FileSettings thread_settings;
+        runtime_config_load_handler(&thread_settings, TEST_CONFIG_FILE);
+        ASSERT_INT_EQUAL("Invalid thread counts keep the valid one", 6, (int)thread_settings.thread_count);
+    }
 }
 
 /*
@@ -183,4 +201,78 @@ void test_cli_arguments(TestResults *results) {
     char *argv7[] = {"program", "--unknown"};
     cli_argument_handler(2, argv7, &settings);
     ASSERT_TRUE("Unknown option handled gracefully", 1); // Just check we didn't crash
+
+    /*
+        Test 8: the number of parser threads can be set from the command line
+    */
+    settings.thread_count = 0;
+    char *argv8[] = {"program", "--threads", "8"};
+    cli_argument_handler(3, argv8, &settings);
+    ASSERT_INT_EQUAL("Thread count from CLI argument", 8, (int)settings.thread_count);
+
+    /*
+        Test 9: the report order can be set from the command line
+    */
+    char *argv9[] = {"program", "--sort-by", "-passengers,line"};
+    cli_argument_handler(3, argv9, &settings);
+    ASSERT_INT_EQUAL("Sort keys from CLI argument", 2, (int)settings.sort_spec.key_count);
+    ASSERT_TRUE("Descending passengers first", settings.sort_spec.keys[0].field == SORT_FIELD_PASSENGERS && settings.sort_spec.keys[0].descending);
+
+    /*
+        Test 10: top/bottom limits
+    */
+    char *argv10[] = {"program", "--top", "50", "--bottom", "20"};
+    cli_argument_handler(5, argv10, &settings);
+    ASSERT_INT_EQUAL("Top limit from CLI argument", 50, (int)settings.top_k);
+    ASSERT_INT_EQUAL("Bottom limit from CLI argument", 20, (int)settings.bottom_k);
+
+    /*
+        Test 11: streaming summary from stdin
+    */
+    char *argv11[] = {"program", "-", "--summary-only"};
+    cli_argument_handler(3, argv11, &settings);
+    ASSERT_STRING_EQUAL("Stdin as the input file", "-", settings.input_file);
+    ASSERT_INT_EQUAL("Summary-only mode enabled", 1, settings.summary_only);
+}
+
+/*
+    Tests for the [tariff] section of the configuration file - the tariffs have to be adjustable without a rebuild
+*/
+void test_tariff_section(TestResults *results) {
+    printf("Testing tariff configuration...\n");
+
+    FILE *file = fopen(TEST_CONFIG_FILE, "w");
+    if (file) {
+        fprintf(file, "input_file=test_input.txt\n");
+        fprintf(file, "[tariff]\n");
+        fprintf(file, "cost_per_km=3.25\n");
+        fprintf(file, "adult_ticket=13.5\n");
+        fprintf(file, "level2_subsidy=1.20\n");
+        fprintf(file, "senior_ticket_levels=1,2\n");
+        fprintf(file, "student_ticket=free\n");   /* Invalid - the default has to be kept */
+        fclose(file);
+    }
+
+    FileSettings settings;
+    runtime_config_load_handler(&settings, TEST_CONFIG_FILE);
+
+    ASSERT_STRING_EQUAL("General settings before the section still load", "test_input.txt", settings.input_file);
+    ASSERT_DOUBLE_EQUAL("Cost per km from the tariff section", 3.25, settings.tariff.cost_per_km, 0.0001);
+    ASSERT_DOUBLE_EQUAL("Adult ticket from the tariff section", 13.5, settings.tariff.adult_ticket, 0.0001);
+    ASSERT_DOUBLE_EQUAL("Level 2 subsidy from the tariff section", 1.20, settings.tariff.level_subsidy[2], 0.0001);
+    ASSERT_DOUBLE_EQUAL("Level 1 subsidy keeps its default", LEVEL1_SUBSIDY, settings.tariff.level_subsidy[1], 0.0001);
+    ASSERT_DOUBLE_EQUAL("Invalid student ticket keeps its default", STUDENT_TICKET, settings.tariff.student_ticket, 0.0001);
+    ASSERT_INT_EQUAL("Seniors pay on level 1", 1, settings.tariff.senior_ticket_levels[1]);
+    ASSERT_INT_EQUAL("Seniors pay on level 2", 1, settings.tariff.senior_ticket_levels[2]);
+    ASSERT_INT_EQUAL("Seniors ride free on level 3", 0, settings.tariff.senior_ticket_levels[3]);
+
+    /*
+        The coefficient table folds the subsidy and the cost into a single net rate per km
+    */
+    TariffTable table;
+    tariff_table_build(&settings.tariff, &table);
+    ASSERT_DOUBLE_EQUAL("Net rate per km on level 2", 1.20 - 3.25, table.per_km[2], 0.0001);
+    ASSERT_DOUBLE_EQUAL("Senior ticket on level 2", SENIOR_TICKET, table.senior_ticket[2], 0.0001);
+    ASSERT_DOUBLE_EQUAL("No senior ticket on level 3", 0.0, table.senior_ticket[3], 0.0001);
+    ASSERT_DOUBLE_EQUAL("Out-of-range levels get no subsidy", -3.25, table.per_km[0], 0.0001);
 }
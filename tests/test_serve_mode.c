@@ -0,0 +1,185 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../incl/serve_mode.h"
+#include "test_utils.h"
+
+#define TEST_SERVE_INPUT_FILE "test_serve_input.txt"
+#define TEST_SERVE_RESPONSE_FILE "test_serve_response.txt"
+
+void test_serve_queries(TestResults *results);
+void test_serve_errors(TestResults *results);
+void test_serve_reload(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Serve Mode ---\n\n");
+
+    test_serve_queries(&results);
+    test_serve_errors(&results);
+    test_serve_reload(&results);
+
+    print_test_summary(&results);
+
+    unlink(TEST_SERVE_INPUT_FILE);
+    unlink(TEST_SERVE_RESPONSE_FILE);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+static void write_serve_input(const char *text) {
+    FILE *file = fopen(TEST_SERVE_INPUT_FILE, "w");
+    if (file) {
+        fputs(text, file);
+        fclose(file);
+    }
+}
+
+static const char serve_input[] =
+    "1,08:00,1,25,10,5,15.5\n"
+    "2,09:15,2,18,8,4,12.0\n"
+    "3,10:30,3,15,7,6,10.5\n"
+    "4,12:00,1,3,2,1,50.0\n"
+    "2,07:00,2,40,0,0,20.0\n";
+
+static void init_serve_settings(FileSettings *settings) {
+    runtime_config_load_handler(settings, "nonexistent_config.txt");
+    strcpy(settings->input_file, TEST_SERVE_INPUT_FILE);
+    settings->cache_enabled = 0;
+    settings->thread_count = 2;
+}
+
+/*
+    Runs one request and returns the whole response in response (NUL terminated)
+*/
+static int execute(ServeState *state, const char *request, char *response, size_t response_size) {
+    int fd = open(TEST_SERVE_RESPONSE_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ReportWriter writer;
+    report_writer_init(&writer, fd);
+
+    int quit = serve_execute(state, request, &writer);
+    report_writer_close(&writer);
+
+    lseek(fd, 0, SEEK_SET);
+    ssize_t size = read(fd, response, response_size - 1);
+    response[size > 0 ? size : 0] = '\0';
+    close(fd);
+    return quit;
+}
+
+static size_t count_lines(const char *text) {
+    size_t lines = 0;
+    for (; *text; text++) lines += *text == '\n';
+    return lines;
+}
+
+void test_serve_queries(TestResults *results) {
+    printf("Testing queries...\n");
+
+    write_serve_input(serve_input);
+
+    FileSettings settings;
+    init_serve_settings(&settings);
+
+    ServeState state;
+    ASSERT_INT_EQUAL("Snapshot loaded", 0, serve_state_init(&state, &settings));
+
+    char response[4096];
+    execute(&state, "summary", response, sizeof(response));
+    ASSERT_TRUE("Summary counts every bus line", strncmp(response, "lines=5 ", 8) == 0);
+    ASSERT_TRUE("Summary ends with OK", strstr(response, "\nOK\n") != NULL);
+
+    execute(&state, "top 1", response, sizeof(response));
+    ASSERT_INT_EQUAL("Top 1 of every subsidy level", 4, (int)count_lines(response));
+    ASSERT_TRUE("Top rows start with subsidy level 1", strncmp(response, "1,08:00,1,", 10) == 0 && strstr(response, "OK 3\n") != NULL);
+
+    execute(&state, "bottom 5", response, sizeof(response));
+    ASSERT_TRUE("Bottom K larger than a level", strstr(response, "OK 5\n") != NULL);
+
+    execute(&state, "line 2", response, sizeof(response));
+    ASSERT_TRUE("Line lookup by departure time", strncmp(response, "2,07:00,2,40,0,0,20.0,", 22) == 0 && strstr(response, "\n2,09:15,") != NULL &&
+                strstr(response, "OK 2\n") != NULL);
+
+    execute(&state, "lines 3-10", response, sizeof(response));
+    ASSERT_TRUE("Line range", strncmp(response, "3,10:30,", 8) == 0 && strstr(response, "OK 2\n") != NULL);
+
+    execute(&state, "where subsidy = 1 and time < 10:00", response, sizeof(response));
+    ASSERT_TRUE("Filter rows and summary", strncmp(response, "1,08:00,", 8) == 0 && strstr(response, "\nlines=1 ") != NULL &&
+                strstr(response, "OK 1\n") != NULL);
+
+    ASSERT_INT_EQUAL("Empty request ignored", 0, execute(&state, "", response, sizeof(response)));
+    ASSERT_STRING_EQUAL("Nothing written for an empty request", "", response);
+
+    ASSERT_INT_EQUAL("Quit closes the connection", 1, execute(&state, "quit", response, sizeof(response)));
+
+    serve_state_free(&state);
+}
+
+void test_serve_errors(TestResults *results) {
+    printf("Testing invalid requests...\n");
+
+    FileSettings settings;
+    init_serve_settings(&settings);
+
+    ServeState state;
+    serve_state_init(&state, &settings);
+
+    char response[4096];
+    const char *invalid[] = { "hello", "top", "top -3", "top 2x", "lines 9-3", "line abc", "where profit <", "summaryx" };
+    int rejected = 1;
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        int quit = execute(&state, invalid[i], response, sizeof(response));
+        rejected &= quit == 0 && strncmp(response, "ERR ", 4) == 0 && count_lines(response) == 1;
+    }
+    ASSERT_TRUE("Invalid requests answered with a single ERR line", rejected);
+
+    serve_state_free(&state);
+
+    strcpy(settings.input_file, "nonexistent_serve_input.txt");
+    ASSERT_INT_EQUAL("Missing input rejected", -1, serve_state_init(&state, &settings));
+}
+
+/*
+    A query holding the old snapshot keeps it intact while a reload swaps in the new one
+*/
+void test_serve_reload(TestResults *results) {
+    printf("Testing reloads...\n");
+
+    write_serve_input(serve_input);
+
+    FileSettings settings;
+    init_serve_settings(&settings);
+
+    ServeState state;
+    serve_state_init(&state, &settings);
+
+    ServeSnapshot *old_snapshot = serve_snapshot_acquire(&state);
+
+    char appended[sizeof(serve_input) + 64];
+    snprintf(appended, sizeof(appended), "%s9,23:00,3,1,1,1,5.0\n", serve_input);
+    write_serve_input(appended);
+
+    ASSERT_INT_EQUAL("Reload reads the new input", 6, (int)serve_state_reload(&state));
+    ASSERT_TRUE("New snapshot is current", state.current != old_snapshot && state.current->store.count == 6);
+    ASSERT_INT_EQUAL("Old snapshot still usable", 5, (int)old_snapshot->store.count);
+    ASSERT_INT_EQUAL("Old snapshot only held by the query", 1, (int)old_snapshot->references);
+    serve_snapshot_release(&state, old_snapshot);
+
+    char response[4096];
+    execute(&state, "line 9", response, sizeof(response));
+    ASSERT_TRUE("Queries see the new rows", strncmp(response, "9,23:00,", 8) == 0);
+
+    /* A failed reload keeps serving the data that was there */
+    unlink(TEST_SERVE_INPUT_FILE);
+    execute(&state, "reload", response, sizeof(response));
+    ASSERT_TRUE("Failed reload reported", strncmp(response, "ERR ", 4) == 0);
+    ASSERT_INT_EQUAL("Previous snapshot kept", 6, (int)state.current->store.count);
+
+    serve_state_free(&state);
+}
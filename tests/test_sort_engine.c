@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../incl/bus_line_handler.h"
+#include "../incl/sort_engine.h"
+#include "test_utils.h"
+
+void test_sort_spec_parse(TestResults *results);
+void test_default_order(TestResults *results);
+void test_custom_orders(TestResults *results);
+void test_sort_order_subset(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Sort Engine ---\n\n");
+
+    test_sort_spec_parse(&results);
+    test_default_order(&results);
+    test_custom_orders(&results);
+    test_sort_order_subset(&results);
+
+    print_test_summary(&results);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/* The line number is the original position, used for checking stability; lots of ties and negative values */
+static const RandomLineRanges sort_ranges = {
+    .departures = 1440, .adults = 60, .students = 30, .seniors = 20,
+    .route_steps = 100000, .route_divisor = 100.0, .route_offset = 0.01,
+    .profit_steps = 2000, .profit_shift = 1000, .profit_divisor = 4.0
+};
+
+/*
+    Checks that the rows are in order according to the spec and that rows with equal keys kept their input order
+*/
+static int is_sorted_and_stable(const BusLineProperties *bus_lines, size_t count, const SortSpec *spec) {
+    for (size_t i = 1; i < count; i++) {
+        int result = sort_engine_compare(&bus_lines[i - 1], &bus_lines[i], spec);
+        if (result > 0) return 0;
+        if (result == 0 && bus_lines[i - 1].line_number > bus_lines[i].line_number) return 0;
+    }
+    return 1;
+}
+
+void test_sort_spec_parse(TestResults *results) {
+    printf("Testing sort spec parsing...\n");
+
+    SortSpec spec;
+    sort_spec_set_default(&spec);
+    ASSERT_INT_EQUAL("Default spec has two keys", 2, (int)spec.key_count);
+
+    ASSERT_INT_EQUAL("Valid spec accepted", 0, sort_spec_parse("-passengers,+time,line", &spec));
+    ASSERT_INT_EQUAL("Parsed key count", 3, (int)spec.key_count);
+    ASSERT_TRUE("First key is descending passengers", spec.keys[0].field == SORT_FIELD_PASSENGERS && spec.keys[0].descending);
+    ASSERT_TRUE("Second key is ascending time", spec.keys[1].field == SORT_FIELD_DEPARTURE_TIME && !spec.keys[1].descending);
+    ASSERT_TRUE("Third key is ascending line", spec.keys[2].field == SORT_FIELD_LINE_NUMBER && !spec.keys[2].descending);
+
+    ASSERT_INT_EQUAL("Unknown key rejected", -1, sort_spec_parse("subsidy,price", &spec));
+    ASSERT_INT_EQUAL("Key prefix rejected", -1, sort_spec_parse("prof", &spec));
+    ASSERT_INT_EQUAL("Empty key rejected", -1, sort_spec_parse("subsidy,,profit", &spec));
+    ASSERT_INT_EQUAL("Empty spec rejected", -1, sort_spec_parse("", &spec));
+    ASSERT_INT_EQUAL("Rejected spec leaves the old one", 3, (int)spec.key_count);
+}
+
+void test_default_order(TestResults *results) {
+    printf("Testing the default sort order...\n");
+
+    const size_t count = 50000;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    fill_random_lines(bus_lines, count, 99, &sort_ranges);
+
+    bus_lines[10].profitability = -0.0;
+    bus_lines[11].profitability = 0.0;
+    bus_lines[11].subsidy_level = bus_lines[10].subsidy_level;
+
+    SortSpec spec;
+    sort_spec_set_default(&spec);
+    sort_lines(bus_lines, count);
+    ASSERT_TRUE("Sorted by subsidy level and descending profitability", is_sorted_and_stable(bus_lines, count, &spec));
+
+    size_t zero_10 = count, zero_11 = count;
+    for (size_t i = 0; i < count; i++) {
+        if (bus_lines[i].line_number == 10) zero_10 = i;
+        if (bus_lines[i].line_number == 11) zero_11 = i;
+    }
+    ASSERT_TRUE("-0.0 and 0.0 compare equal and keep their order", zero_10 + 1 == zero_11);
+
+    /* A handful of rows goes through the insertion sort instead of the radix sort */
+    BusLineProperties small[9];
+    fill_random_lines(small, 9, 5, &sort_ranges);
+    sort_lines(small, 9);
+    ASSERT_TRUE("Small input sorted", is_sorted_and_stable(small, 9, &spec));
+
+    free(bus_lines);
+}
+
+void test_custom_orders(TestResults *results) {
+    printf("Testing custom sort orders...\n");
+
+    const size_t count = 20000;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    const char *specs[] = {"time,-subsidy", "-passengers", "length", "senior,student,-adult", "-time"};
+
+    for (size_t s = 0; s < sizeof(specs) / sizeof(specs[0]); s++) {
+        SortSpec spec;
+        fill_random_lines(bus_lines, count, 3 + (unsigned)s, &sort_ranges);
+
+        /* The first and the last minute of the day */
+        bus_lines[1].departure_minutes = 0;
+        bus_lines[2].departure_minutes = 23 * 60 + 59;
+
+        ASSERT_INT_EQUAL(specs[s], 0, sort_spec_parse(specs[s], &spec));
+        ASSERT_INT_EQUAL("Sort succeeded", 0, sort_engine_sort(bus_lines, count, &spec));
+        ASSERT_TRUE("Rows are in order and ties are stable", is_sorted_and_stable(bus_lines, count, &spec));
+    }
+
+    free(bus_lines);
+}
+
+/*
+    Sorting only the indices of some of the rows leaves the rows themselves untouched
+*/
+void test_sort_order_subset(TestResults *results) {
+    printf("Testing sorting of row indices...\n");
+
+    BusLineProperties bus_lines[200];
+    fill_random_lines(bus_lines, 200, 11, &sort_ranges);
+
+    size_t order[100];
+    for (size_t i = 0; i < 100; i++) order[i] = 2 * i + 1;
+
+    SortSpec spec;
+    sort_spec_parse("-profit", &spec);
+    ASSERT_INT_EQUAL("Index sort succeeded", 0, sort_engine_order(bus_lines, order, 100, &spec));
+
+    int in_order = 1, odd_only = 1;
+    for (size_t i = 0; i < 100; i++) {
+        if (order[i] % 2 == 0) odd_only = 0;
+        if (i > 0 && sort_engine_compare(&bus_lines[order[i - 1]], &bus_lines[order[i]], &spec) > 0) in_order = 0;
+    }
+    ASSERT_TRUE("Indices are in order", in_order);
+    ASSERT_TRUE("Only the given rows are included", odd_only);
+    ASSERT_INT_EQUAL("Rows themselves untouched", 5, bus_lines[5].line_number);
+}
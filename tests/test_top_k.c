@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../incl/bus_line_handler.h"
+#include "../incl/sort_engine.h"
+#include "../incl/top_k.h"
+#include "test_utils.h"
+
+void test_top_k_matches_full_sort(TestResults *results);
+void test_top_k_small_levels(TestResults *results);
+
+int main() {
+    TestResults results;
+    init_test_results(&results);
+
+    printf("\n--- Testing Top-K Selection ---\n\n");
+
+    test_top_k_matches_full_sort(&results);
+    test_top_k_small_levels(&results);
+
+    print_test_summary(&results);
+
+    return results.tests_failed > 0 ? 1 : 0;
+}
+
+/* The line number is the original position, for mapping the sorted rows back; plenty of ties */
+static const RandomLineRanges top_k_ranges = {
+    .profit_steps = 400, .profit_shift = 200, .profit_divisor = 2.0
+};
+
+/*
+    The selection has to be exactly the first K and the last K rows of each level after a full sort
+*/
+static int selection_matches_full_sort(const BusLineProperties *bus_lines, size_t count, size_t top_k, size_t bottom_k) {
+    BusLineProperties *sorted = malloc(count * sizeof(BusLineProperties));
+    char *expected = calloc(count, 1);
+    memcpy(sorted, bus_lines, count * sizeof(BusLineProperties));
+    sort_lines(sorted, count);
+
+    for (size_t begin = 0; begin < count;) {
+        size_t end = begin;
+        while (end < count && sorted[end].subsidy_level == sorted[begin].subsidy_level) end++;
+        for (size_t i = begin; i < end; i++) {
+            if (i - begin < top_k || end - i <= bottom_k) expected[sorted[i].line_number] = 1;
+        }
+        begin = end;
+    }
+
+    size_t *selection = NULL;
+    size_t selected_count = 0;
+    int matches = top_k_select(bus_lines, count, top_k, bottom_k, &selection, &selected_count) == 0;
+
+    size_t expected_count = 0;
+    for (size_t i = 0; i < count; i++) expected_count += expected[i];
+    matches = matches && selected_count == expected_count;
+
+    for (size_t i = 0; matches && i < selected_count; i++) {
+        if (!expected[selection[i]] || (i > 0 && selection[i - 1] >= selection[i])) matches = 0;
+    }
+
+    free(selection);
+    free(expected);
+    free(sorted);
+    return matches;
+}
+
+void test_top_k_matches_full_sort(TestResults *results) {
+    printf("Testing top/bottom selection against a full sort...\n");
+
+    const size_t count = 30000;
+    BusLineProperties *bus_lines = malloc(count * sizeof(BusLineProperties));
+    fill_random_lines(bus_lines, count, 21, &top_k_ranges);
+
+    ASSERT_TRUE("Top 50 and bottom 50", selection_matches_full_sort(bus_lines, count, 50, 50));
+    ASSERT_TRUE("Top 1 only", selection_matches_full_sort(bus_lines, count, 1, 0));
+    ASSERT_TRUE("Bottom 7 only", selection_matches_full_sort(bus_lines, count, 0, 7));
+    ASSERT_TRUE("Top 500 with many ties", selection_matches_full_sort(bus_lines, count, 500, 3));
+
+    size_t *selection = NULL;
+    size_t selected_count = 1;
+    ASSERT_INT_EQUAL("Nothing requested", 0, top_k_select(bus_lines, count, 0, 0, &selection, &selected_count));
+    ASSERT_TRUE("Nothing selected", selected_count == 0 && selection == NULL);
+
+    free(bus_lines);
+}
+
+/*
+    Levels with fewer rows than top + bottom select every row exactly once
+*/
+void test_top_k_small_levels(TestResults *results) {
+    printf("Testing top/bottom selection on small levels...\n");
+
+    BusLineProperties bus_lines[40];
+    fill_random_lines(bus_lines, 40, 4, &top_k_ranges);
+    bus_lines[0].subsidy_level = 2;
+    for (size_t i = 1; i < 40; i++) bus_lines[i].subsidy_level = (i < 4) ? 3 : 1;
+
+    ASSERT_TRUE("Overlapping top and bottom", selection_matches_full_sort(bus_lines, 40, 5, 5));
+    ASSERT_TRUE("K larger than the input", selection_matches_full_sort(bus_lines, 40, 1000, 1000));
+
+    size_t *selection = NULL;
+    size_t selected_count = 0;
+    top_k_select(bus_lines, 40, 1000, 1000, &selection, &selected_count);
+    ASSERT_INT_EQUAL("Every row selected once", 40, (int)selected_count);
+    free(selection);
+}
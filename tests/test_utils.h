@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <math.h>
+#include "../incl/bus_line_handler.h"
 
 
 typedef struct {
@@ -91,4 +92,38 @@ FILE* create_temp_file(const char* content) {
     return tmp;
 }
 
+/*
+    Value ranges for fill_random_lines. A field with a range of 0 stays 0 and takes no draw from
+    rand(), so the rows for a seed only depend on the fields a test asks for
+*/
+typedef struct {
+    int line_numbers;       /* 1..line_numbers, or the row's position when 0 */
+    int departures;         /* rand() % departures minutes, or 08:00 when 0 */
+    int adults;
+    int students;
+    int seniors;
+    int route_steps;        /* route_length = rand() % route_steps / route_divisor + route_offset */
+    double route_divisor;
+    double route_offset;
+    int profit_steps;       /* profitability = (rand() % profit_steps - profit_shift) / profit_divisor */
+    int profit_shift;
+    double profit_divisor;
+} RandomLineRanges;
+
+void fill_random_lines(BusLineProperties *bus_lines, size_t count, unsigned seed, const RandomLineRanges *ranges) {
+    srand(seed);
+    for (size_t i = 0; i < count; i++) {
+        BusLineProperties *line = &bus_lines[i];
+        memset(line, 0, sizeof(*line));
+        line->line_number = ranges->line_numbers ? rand() % ranges->line_numbers + 1 : (int)i;
+        line->departure_minutes = ranges->departures ? (uint16_t)(rand() % ranges->departures) : 8 * 60;
+        line->subsidy_level = rand() % 3 + 1;
+        if (ranges->adults) line->passengers.adult = rand() % ranges->adults;
+        if (ranges->students) line->passengers.student = rand() % ranges->students;
+        if (ranges->seniors) line->passengers.senior = rand() % ranges->seniors;
+        if (ranges->route_steps) line->route_length = (rand() % ranges->route_steps) / ranges->route_divisor + ranges->route_offset;
+        if (ranges->profit_steps) line->profitability = (rand() % ranges->profit_steps - ranges->profit_shift) / ranges->profit_divisor;
+    }
+}
+
 #endif // TEST_UTILS_H